@@ -20,6 +20,8 @@
 
 #include <v8.h>
 
+#include <algorithm>
+
 namespace workerd::api {
 
 namespace {
@@ -120,6 +122,49 @@ ActorObserver& currentActorMetrics() {
   return IoContext::current().getActorOrThrow().getMetrics();
 }
 
+void addListReadUnits(size_t cachedReadBytes, size_t uncachedReadBytes, bool completelyCached) {
+  auto& actorMetrics = currentActorMetrics();
+  if (cachedReadBytes || uncachedReadBytes) {
+    size_t totalReadBytes = cachedReadBytes + uncachedReadBytes;
+    uint32_t totalUnits = billingUnits(totalReadBytes);
+
+    // If we went to disk, we want to ensure we bill at least 1 uncached unit.
+    // Otherwise, we disable this behavior, to ensure a fully cached list will have
+    // uncachedUnits == 0.
+    auto billAtLeastOne = completelyCached ? BillAtLeastOne::NO : BillAtLeastOne::YES;
+    uint32_t uncachedUnits = billingUnits(uncachedReadBytes, billAtLeastOne);
+    uint32_t cachedUnits = totalUnits - uncachedUnits;
+
+    actorMetrics.addUncachedStorageReadUnits(uncachedUnits);
+    actorMetrics.addCachedStorageReadUnits(cachedUnits);
+  } else {
+    // We bill 1 uncached read unit if there was no results from the list.
+    actorMetrics.addUncachedStorageReadUnits(1);
+  }
+}
+
+void addGetMultipleReadUnits(
+    uint32_t cachedUnits, uint32_t uncachedUnits, size_t numInputKeys, size_t numResults) {
+  auto& actorMetrics = currentActorMetrics();
+  actorMetrics.addCachedStorageReadUnits(cachedUnits);
+
+  size_t leftoverKeys = 0;
+  if (numInputKeys >= numResults) {
+    leftoverKeys = numInputKeys - numResults;
+  } else {
+    KJ_LOG(ERROR, "More returned pairs than provided input keys in getMultipleResultsToMap",
+        numInputKeys, numResults);
+  }
+
+  // leftover keys weren't in the result set, but potentially still
+  // had to be queried for existence.
+  //
+  // TODO(someday): This isn't quite accurate -- we do cache negative entries.
+  // Billing will still be correct today, but if we do ever start billing
+  // only for uncached reads, we'll need to address this.
+  actorMetrics.addUncachedStorageReadUnits(leftoverKeys + uncachedUnits);
+}
+
 jsg::JsRef<jsg::JsValue> listResultsToMap(
     jsg::Lock& js, ActorCacheOps::GetResultList value, bool completelyCached) {
   return js.withinHandleScope([&] {
@@ -132,24 +177,7 @@ jsg::JsRef<jsg::JsValue> listResultsToMap(
       bytesRef += entry.key.size() + entry.value.size();
       map.set(js, entry.key, deserializeV8Value(js, entry.key, entry.value));
     }
-    auto& actorMetrics = currentActorMetrics();
-    if (cachedReadBytes || uncachedReadBytes) {
-      size_t totalReadBytes = cachedReadBytes + uncachedReadBytes;
-      uint32_t totalUnits = billingUnits(totalReadBytes);
-
-      // If we went to disk, we want to ensure we bill at least 1 uncached unit.
-      // Otherwise, we disable this behavior, to ensure a fully cached list will have
-      // uncachedUnits == 0.
-      auto billAtLeastOne = completelyCached ? BillAtLeastOne::NO : BillAtLeastOne::YES;
-      uint32_t uncachedUnits = billingUnits(uncachedReadBytes, billAtLeastOne);
-      uint32_t cachedUnits = totalUnits - uncachedUnits;
-
-      actorMetrics.addUncachedStorageReadUnits(uncachedUnits);
-      actorMetrics.addCachedStorageReadUnits(cachedUnits);
-    } else {
-      // We bill 1 uncached read unit if there was no results from the list.
-      actorMetrics.addUncachedStorageReadUnits(1);
-    }
+    addListReadUnits(cachedReadBytes, uncachedReadBytes, completelyCached);
 
     return jsg::JsValue(map).addRef(js);
   });
@@ -168,30 +196,100 @@ getMultipleResultsToMap(size_t numInputKeys) {
         unitsRef += billingUnits(entry.key.size() + entry.value.size());
         map.set(js, entry.key, deserializeV8Value(js, entry.key, entry.value));
       }
-      auto& actorMetrics = currentActorMetrics();
-      actorMetrics.addCachedStorageReadUnits(cachedUnits);
-
-      size_t leftoverKeys = 0;
-      if (numInputKeys >= value.size()) {
-        leftoverKeys = numInputKeys - value.size();
-      } else {
-        KJ_LOG(ERROR, "More returned pairs than provided input keys in getMultipleResultsToMap",
-            numInputKeys, value.size());
-      }
-
-      // leftover keys weren't in the result set, but potentially still
-      // had to be queried for existence.
-      //
-      // TODO(someday): This isn't quite accurate -- we do cache negative entries.
-      // Billing will still be correct today, but if we do ever start billing
-      // only for uncached reads, we'll need to address this.
-      actorMetrics.addUncachedStorageReadUnits(leftoverKeys + uncachedUnits);
+      addGetMultipleReadUnits(cachedUnits, uncachedUnits, numInputKeys, value.size());
 
       return jsg::JsValue(map).addRef(js);
     });
   };
 }
 
+// The try*InPlace() functions below implement get() and list() on top of the in-place read
+// methods of ActorCacheOps, deserializing each value directly from the storage-owned bytes rather
+// than from a copy held by a GetResultList. Each returns kj::none if `cache` doesn't support
+// in-place reads, in which case the caller should fall back to the regular path.
+//
+// In-place results are always available synchronously. For consistency with the regular path,
+// they are billed exactly as a synchronously-returned result would be.
+
+kj::Maybe<jsg::JsRef<jsg::JsValue>> tryGetOneInPlace(jsg::Lock& js,
+    ActorCacheOps& cache,
+    const kj::String& key,
+    ActorCacheOps::ReadOptions options) {
+  kj::Maybe<jsg::JsRef<jsg::JsValue>> result;
+  uint32_t units = 1;
+  auto maybeCount = cache.getInPlace(kj::arrayPtr(&key, 1), options,
+      [&](ActorCacheOps::KeyPtr, ActorCacheOps::ValuePtr value) {
+    units = billingUnits(value.size());
+    result = deserializeV8Value(js, key, value).addRef(js);
+  });
+  if (maybeCount == kj::none) {
+    return kj::none;
+  }
+
+  currentActorMetrics().addCachedStorageReadUnits(units);
+  return kj::mv(result).orDefault([&]() { return js.undefined().addRef(js); });
+}
+
+kj::Maybe<jsg::JsRef<jsg::JsValue>> tryGetMultipleInPlace(jsg::Lock& js,
+    ActorCacheOps& cache,
+    kj::ArrayPtr<const kj::String> keys,
+    ActorCacheOps::ReadOptions options) {
+  return js.withinHandleScope([&]() -> kj::Maybe<jsg::JsRef<jsg::JsValue>> {
+    struct Result {
+      ActorCacheOps::KeyPtr key;
+      jsg::JsValue value;
+    };
+    kj::Vector<Result> results(keys.size());
+    uint32_t uncachedUnits = 0;
+    auto maybeCount = cache.getInPlace(
+        keys, options, [&](ActorCacheOps::KeyPtr key, ActorCacheOps::ValuePtr value) {
+      uncachedUnits += billingUnits(key.size() + value.size());
+      results.add(Result{key, deserializeV8Value(js, key, value)});
+    });
+    if (maybeCount == kj::none) {
+      return kj::none;
+    }
+
+    // getInPlace() doesn't deliver results in any particular order, but the map must be ordered
+    // by key, same as a GetResultList.
+    std::sort(results.begin(), results.end(), [](auto& a, auto& b) { return a.key < b.key; });
+
+    auto map = js.map();
+    for (auto& result: results) {
+      map.set(js, result.key, result.value);
+    }
+    addGetMultipleReadUnits(0, uncachedUnits, keys.size(), results.size());
+
+    return jsg::JsValue(map).addRef(js);
+  });
+}
+
+kj::Maybe<jsg::JsRef<jsg::JsValue>> tryListInPlace(jsg::Lock& js,
+    ActorCacheOps& cache,
+    bool reverse,
+    ActorCacheOps::KeyPtr start,
+    kj::Maybe<ActorCacheOps::KeyPtr> end,
+    kj::Maybe<uint> limit,
+    ActorCacheOps::ReadOptions options) {
+  return js.withinHandleScope([&]() -> kj::Maybe<jsg::JsRef<jsg::JsValue>> {
+    auto map = js.map();
+    size_t uncachedReadBytes = 0;
+    auto callback = [&](ActorCacheOps::KeyPtr key, ActorCacheOps::ValuePtr value) {
+      uncachedReadBytes += key.size() + value.size();
+      map.set(js, key, deserializeV8Value(js, key, value));
+    };
+    auto maybeCount = reverse ? cache.listReverseInPlace(start, end, limit, options, callback)
+                              : cache.listInPlace(start, end, limit, options, callback);
+    if (maybeCount == kj::none) {
+      return kj::none;
+    }
+
+    addListReadUnits(0, uncachedReadBytes, true);
+
+    return jsg::JsValue(map).addRef(js);
+  });
+}
+
 kj::Promise<void> updateStorageWriteUnit(
     IoContext& context, ActorObserver& metrics, uint32_t units) {
   // The ActorObserver& reference here is guaranteed to outlive this task, so
@@ -267,7 +365,12 @@ jsg::Promise<jsg::JsRef<jsg::JsValue>> DurableObjectStorageOperations::get(jsg::
 
 jsg::Promise<jsg::JsRef<jsg::JsValue>> DurableObjectStorageOperations::getOne(
     jsg::Lock& js, kj::String key, const GetOptions& options) {
-  auto result = getCache(OP_GET).get(kj::str(key), options);
+  auto& cache = getCache(OP_GET);
+  KJ_IF_SOME(value, tryGetOneInPlace(js, cache, key, options)) {
+    return js.resolvedPromise(kj::mv(value));
+  }
+
+  auto result = cache.get(kj::str(key), options);
   return transformCacheResultWithCacheStatus(js, kj::mv(result), options,
       [key = kj::mv(key)](jsg::Lock& js, kj::Maybe<ActorCacheOps::Value> value, bool cached) {
     uint32_t units = 1;
@@ -301,93 +404,88 @@ jsg::Promise<kj::Maybe<double>> DurableObjectStorageOperations::getAlarm(
   });
 }
 
-jsg::Promise<jsg::JsRef<jsg::JsValue>> DurableObjectStorageOperations::list(
-    jsg::Lock& js, jsg::Optional<ListOptions> maybeOptions) {
+namespace {
+
+struct KeyRange {
   kj::String start;
   kj::Maybe<kj::String> end;
-  bool reverse = false;
-  kj::Maybe<uint> limit;
+};
 
-  auto makeEmptyResult = [&]() { return js.resolvedPromise(jsg::JsValue(js.map()).addRef(js)); };
+// Computes the key range [start, end) selected by the `start`, `startAfter`, `end`, and `prefix`
+// fields of `o`, moving the strings out of it. Returns kj::none if the range is empty.
+template <typename Options>
+kj::Maybe<KeyRange> takeKeyRange(kj::StringPtr op, Options& o) {
+  kj::String start;
+  kj::Maybe<kj::String> end;
 
-  KJ_IF_SOME(o, maybeOptions) {
-    KJ_IF_SOME(s, o.start) {
-      if (o.startAfter != kj::none) {
-        KJ_FAIL_REQUIRE(
-            "jsg.TypeError: list() cannot be called with both start and startAfter values.");
-      }
-      start = kj::mv(s);
-    }
-    KJ_IF_SOME(sks, o.startAfter) {
-      // Convert an exclusive startAfter into an inclusive start key here so that the implementation
-      // doesn't need to handle both. This can be done simply by adding two NULL bytes. One to the end of
-      // the startAfter and another to set the start key after startAfter.
-      auto startAfterKey = kj::heapArray<char>(sks.size() + 2);
-
-      // Copy over the original string.
-      memcpy(startAfterKey.begin(), sks.begin(), sks.size());
-      // Add one additional null byte to set the new start as the key immediately
-      // after startAfter. This looks a little sketchy to be doing with strings rather
-      // than arrays, but kj::String explicitly allows for NULL bytes inside of strings.
-      startAfterKey[startAfterKey.size() - 2] = '\0';
-      // kj::String automatically reads the last NULL as string termination, so we need to add it twice
-      // to make it stick in the final string.
-      startAfterKey[startAfterKey.size() - 1] = '\0';
-      start = kj::String(kj::mv(startAfterKey));
-    }
-    KJ_IF_SOME(e, o.end) {
-      end = kj::mv(e);
-    }
-    KJ_IF_SOME(r, o.reverse) {
-      reverse = r;
+  KJ_IF_SOME(s, o.start) {
+    if (o.startAfter != kj::none) {
+      JSG_FAIL_REQUIRE(TypeError, op, " cannot be called with both start and startAfter values.");
     }
-    KJ_IF_SOME(l, o.limit) {
-      JSG_REQUIRE(l > 0, TypeError, "List limit must be positive.");
-      limit = l;
-    }
-    KJ_IF_SOME(prefix, o.prefix) {
-      // Let's clamp `start` and `end` to include only keys with the given prefix.
-      if (prefix.size() > 0) {
-        if (start < prefix) {
-          // `start` is before `prefix`, so listing should actually start at `prefix`.
-          start = kj::str(prefix);
-        } else if (start.startsWith(prefix)) {
-          // `start` is within the prefix, so need not be modified.
-        } else {
-          // `start` comes after the last value with the prefix, so there's no overlap.
-          return makeEmptyResult();
-        }
+    start = kj::mv(s);
+  }
+  KJ_IF_SOME(sks, o.startAfter) {
+    // Convert an exclusive startAfter into an inclusive start key here so that the implementation
+    // doesn't need to handle both. This can be done simply by adding two NULL bytes. One to the end of
+    // the startAfter and another to set the start key after startAfter.
+    auto startAfterKey = kj::heapArray<char>(sks.size() + 2);
+
+    // Copy over the original string.
+    memcpy(startAfterKey.begin(), sks.begin(), sks.size());
+    // Add one additional null byte to set the new start as the key immediately
+    // after startAfter. This looks a little sketchy to be doing with strings rather
+    // than arrays, but kj::String explicitly allows for NULL bytes inside of strings.
+    startAfterKey[startAfterKey.size() - 2] = '\0';
+    // kj::String automatically reads the last NULL as string termination, so we need to add it twice
+    // to make it stick in the final string.
+    startAfterKey[startAfterKey.size() - 1] = '\0';
+    start = kj::String(kj::mv(startAfterKey));
+  }
+  KJ_IF_SOME(e, o.end) {
+    end = kj::mv(e);
+  }
+  KJ_IF_SOME(prefix, o.prefix) {
+    // Let's clamp `start` and `end` to include only keys with the given prefix.
+    if (prefix.size() > 0) {
+      if (start < prefix) {
+        // `start` is before `prefix`, so listing should actually start at `prefix`.
+        start = kj::str(prefix);
+      } else if (start.startsWith(prefix)) {
+        // `start` is within the prefix, so need not be modified.
+      } else {
+        // `start` comes after the last value with the prefix, so there's no overlap.
+        return kj::none;
+      }
 
-        // Calculate the first key that sorts after all keys with the given prefix.
-        kj::Vector<char> keyAfterPrefix(prefix.size());
-        keyAfterPrefix.addAll(prefix);
-        while (!keyAfterPrefix.empty() && (byte)keyAfterPrefix.back() == 0xff) {
-          keyAfterPrefix.removeLast();
-        }
-        if (keyAfterPrefix.empty()) {
-          // The prefix is a string of some number of 0xff bytes, so includes the entire key space
-          // up through the last possible key. Hence, there is no end. (But if an end was specified
-          // earlier, that's still valid.)
-        } else {
-          keyAfterPrefix.back()++;
-          keyAfterPrefix.add('\0');
-          auto keyAfterPrefixStr = kj::String(keyAfterPrefix.releaseAsArray());
-
-          KJ_IF_SOME(e, end) {
-            if (e <= prefix) {
-              // No keys could possibly match both the end and the prefix.
-              return makeEmptyResult();
-            } else if (e.startsWith(prefix)) {
-              // `end` is within the prefix, so need not be modified.
-            } else {
-              // `end` comes after all keys with the prefix, so we should stop at the end of the
-              // prefix.
-              end = kj::mv(keyAfterPrefixStr);
-            }
+      // Calculate the first key that sorts after all keys with the given prefix.
+      kj::Vector<char> keyAfterPrefix(prefix.size());
+      keyAfterPrefix.addAll(prefix);
+      while (!keyAfterPrefix.empty() && (byte)keyAfterPrefix.back() == 0xff) {
+        keyAfterPrefix.removeLast();
+      }
+      if (keyAfterPrefix.empty()) {
+        // The prefix is a string of some number of 0xff bytes, so includes the entire key space
+        // up through the last possible key. Hence, there is no end. (But if an end was specified
+        // earlier, that's still valid.)
+      } else {
+        keyAfterPrefix.back()++;
+        keyAfterPrefix.add('\0');
+        auto keyAfterPrefixStr = kj::String(keyAfterPrefix.releaseAsArray());
+
+        KJ_IF_SOME(e, end) {
+          if (e <= prefix) {
+            // No keys could possibly match both the end and the prefix.
+            return kj::none;
+          } else if (e.startsWith(prefix)) {
+            // `end` is within the prefix, so need not be modified.
           } else {
-            // We didn't have any end set, so use the end of the prefix range.
+            // `end` comes after all keys with the prefix, so we should stop at the end of the
+            // prefix.
             end = kj::mv(keyAfterPrefixStr);
           }
+        } else {
+          // We didn't have any end set, so use the end of the prefix range.
+          end = kj::mv(keyAfterPrefixStr);
         }
       }
     }
@@ -396,16 +494,42 @@ jsg::Promise<jsg::JsRef<jsg::JsValue>> DurableObjectStorageOperations::list(
   KJ_IF_SOME(e, end) {
     if (e <= start) {
       // Key range is empty.
-      return makeEmptyResult();
+      return kj::none;
+    }
+  }
+
+  return KeyRange{.start = kj::mv(start), .end = kj::mv(end)};
+}
+
+}  // namespace
+
+jsg::Promise<jsg::JsRef<jsg::JsValue>> DurableObjectStorageOperations::list(
+    jsg::Lock& js, jsg::Optional<ListOptions> maybeOptions) {
+  bool reverse = false;
+  kj::Maybe<uint> limit;
+
+  KJ_IF_SOME(o, maybeOptions) {
+    KJ_IF_SOME(r, o.reverse) {
+      reverse = r;
+    }
+    KJ_IF_SOME(l, o.limit) {
+      JSG_REQUIRE(l > 0, TypeError, "List limit must be positive.");
+      limit = l;
     }
   }
 
   auto options = configureOptions(kj::mv(maybeOptions).orDefault(ListOptions{}));
+  auto [start, end] = KJ_UNWRAP_OR(takeKeyRange(OP_LIST, options),
+      return js.resolvedPromise(jsg::JsValue(js.map()).addRef(js)));
   ActorCacheOps::ReadOptions readOptions = options;
 
-  auto result = reverse
-      ? getCache(OP_LIST).listReverse(kj::mv(start), kj::mv(end), limit, readOptions)
-      : getCache(OP_LIST).list(kj::mv(start), kj::mv(end), limit, readOptions);
+  auto& cache = getCache(OP_LIST);
+  KJ_IF_SOME(map, tryListInPlace(js, cache, reverse, start, end, limit, readOptions)) {
+    return js.resolvedPromise(kj::mv(map));
+  }
+
+  auto result = reverse ? cache.listReverse(kj::mv(start), kj::mv(end), limit, readOptions)
+                        : cache.list(kj::mv(start), kj::mv(end), limit, readOptions);
   return transformCacheResultWithCacheStatus(js, kj::mv(result), options, &listResultsToMap);
 }
 
@@ -552,8 +676,13 @@ jsg::Promise<jsg::JsRef<jsg::JsValue>> DurableObjectStorageOperations::getMultip
     jsg::Lock& js, kj::Array<kj::String> keys, const GetOptions& options) {
   auto numKeys = keys.size();
 
+  auto& cache = getCache(OP_GET);
+  KJ_IF_SOME(map, tryGetMultipleInPlace(js, cache, keys, options)) {
+    return js.resolvedPromise(kj::mv(map));
+  }
+
   return transformCacheResult(
-      js, getCache(OP_GET).get(kj::mv(keys), options), options, getMultipleResultsToMap(numKeys));
+      js, cache.get(kj::mv(keys), options), options, getMultipleResultsToMap(numKeys));
 }
 
 jsg::Promise<void> DurableObjectStorageOperations::putMultiple(
@@ -594,6 +723,35 @@ jsg::Promise<int> DurableObjectStorageOperations::deleteMultiple(
   });
 }
 
+jsg::Promise<int> DurableObjectStorageOperations::deleteRange(
+    jsg::Lock& js, jsg::Optional<RangeOptions> maybeOptions) {
+  auto options = configureOptions(kj::mv(maybeOptions).orDefault(RangeOptions{}));
+  auto [start, end] =
+      KJ_UNWRAP_OR(takeKeyRange(OP_DELETE_RANGE, options), return js.resolvedPromise(0));
+
+  return transformCacheResult(js,
+      getCache(OP_DELETE_RANGE).deleteRange(kj::mv(start), kj::mv(end), options), options,
+      [](jsg::Lock&, uint count) -> int {
+    currentActorMetrics().addStorageDeletes(kj::max(count, 1u));
+    return count;
+  });
+}
+
+jsg::Promise<int> DurableObjectStorageOperations::countRange(
+    jsg::Lock& js, jsg::Optional<RangeOptions> maybeOptions) {
+  auto options = configureOptions(kj::mv(maybeOptions).orDefault(RangeOptions{}));
+  auto [start, end] =
+      KJ_UNWRAP_OR(takeKeyRange(OP_COUNT_RANGE, options), return js.resolvedPromise(0));
+
+  return transformCacheResult(js,
+      getCache(OP_COUNT_RANGE).countRange(kj::mv(start), kj::mv(end), options), options,
+      [](jsg::Lock&, ActorCacheOps::RangeCount result) -> int {
+    // Only keys are read, so bill as a list() whose values were all empty.
+    addListReadUnits(0, result.keyBytes, false);
+    return result.count;
+  });
+}
+
 ActorCacheOps& DurableObjectStorage::getCache(OpName op) {
   return *cache;
 }
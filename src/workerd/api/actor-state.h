@@ -105,6 +105,35 @@ class DurableObjectStorageOperations {
       kj::OneOf<kj::String, kj::Array<kj::String>> keys,
       jsg::Optional<PutOptions> options);
 
+  // Selects a key range the same way ListOptions does, for operations that act on every key in
+  // the range rather than returning them.
+  struct RangeOptions {
+    jsg::Optional<kj::String> start;
+    jsg::Optional<kj::String> startAfter;
+    jsg::Optional<kj::String> end;
+    jsg::Optional<kj::String> prefix;
+
+    jsg::Optional<bool> allowConcurrency;
+    jsg::Optional<bool> allowUnconfirmed;
+    jsg::Optional<bool> noCache;
+
+    inline operator ActorCacheOps::ReadOptions() const {
+      return {.noCache = noCache.orDefault(false)};
+    }
+    inline operator ActorCacheOps::WriteOptions() const {
+      return {
+        .allowUnconfirmed = allowUnconfirmed.orDefault(false), .noCache = noCache.orDefault(false)};
+    }
+
+    JSG_STRUCT(start, startAfter, end, prefix, allowConcurrency, allowUnconfirmed, noCache);
+    JSG_STRUCT_TS_OVERRIDE(DurableObjectRangeOptions);  // Rename from DurableObjectStorageOperationsRangeOptions
+  };
+
+  // Delete or count every key in a range without reading any values. deleteRange() resolves to
+  // the number of keys deleted.
+  jsg::Promise<int> deleteRange(jsg::Lock& js, jsg::Optional<RangeOptions> options);
+  jsg::Promise<int> countRange(jsg::Lock& js, jsg::Optional<RangeOptions> options);
+
   struct SetAlarmOptions {
     jsg::Optional<bool> allowConcurrency;
     jsg::Optional<bool> allowUnconfirmed;
@@ -133,11 +162,13 @@ class DurableObjectStorageOperations {
   static constexpr OpName OP_PUT_ALARM = "setAlarm()"_kj;
   static constexpr OpName OP_DELETE = "delete()"_kj;
   static constexpr OpName OP_DELETE_ALARM = "deleteAlarm()"_kj;
+  static constexpr OpName OP_DELETE_RANGE = "deleteRange()"_kj;
+  static constexpr OpName OP_COUNT_RANGE = "countRange()"_kj;
   static constexpr OpName OP_RENAME = "rename()"_kj;
   static constexpr OpName OP_ROLLBACK = "rollback()"_kj;
 
   static bool readOnlyOp(OpName op) {
-    return op == OP_GET || op == OP_LIST || op == OP_ROLLBACK;
+    return op == OP_GET || op == OP_LIST || op == OP_COUNT_RANGE || op == OP_ROLLBACK;
   }
 
   virtual ActorCacheOps& getCache(OpName op) = 0;
@@ -276,6 +307,8 @@ class DurableObjectStorage: public jsg::Object, public DurableObjectStorageOpera
     JSG_METHOD(onNextSessionRestoreBookmark);
 
     if (flags.getWorkerdExperimental()) {
+      JSG_METHOD(deleteRange);
+      JSG_METHOD(countRange);
       JSG_METHOD(waitForBookmark);
       JSG_READONLY_INSTANCE_PROPERTY(primary, getPrimary);
     }
@@ -335,7 +368,7 @@ class DurableObjectTransaction final: public jsg::Object, public DurableObjectSt
   // Just throws an exception saying this isn't supported.
   void deleteAll();
 
-  JSG_RESOURCE_TYPE(DurableObjectTransaction) {
+  JSG_RESOURCE_TYPE(DurableObjectTransaction, CompatibilityFlags::Reader flags) {
     JSG_METHOD(get);
     JSG_METHOD(list);
     JSG_METHOD(put);
@@ -346,6 +379,11 @@ class DurableObjectTransaction final: public jsg::Object, public DurableObjectSt
     JSG_METHOD(setAlarm);
     JSG_METHOD(deleteAlarm);
 
+    if (flags.getWorkerdExperimental()) {
+      JSG_METHOD(deleteRange);
+      JSG_METHOD(countRange);
+    }
+
     JSG_TS_OVERRIDE({
       get<T = unknown>(key: string, options?: DurableObjectGetOptions): Promise<T | undefined>;
       get<T = unknown>(keys: string[], options?: DurableObjectGetOptions): Promise<Map<string, T>>;
@@ -608,6 +646,7 @@ class DurableObjectState: public jsg::Object {
       api::DurableObjectStorageOperations::GetOptions,                                             \
       api::DurableObjectStorageOperations::GetAlarmOptions,                                        \
       api::DurableObjectStorageOperations::PutOptions,                                             \
+      api::DurableObjectStorageOperations::RangeOptions,                                           \
       api::DurableObjectStorageOperations::SetAlarmOptions, api::WebSocketRequestResponsePair
 
 }  // namespace workerd::api
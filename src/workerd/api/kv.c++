@@ -9,9 +9,11 @@
 
 #include <workerd/io/features.h>
 #include <workerd/io/io-context.h>
+#include <workerd/io/kv-client.h>
 #include <workerd/io/limit-enforcer.h>
 #include <workerd/util/http-util.h>
 #include <workerd/util/mimetype.h>
+#include <workerd/util/stream-utils.h>
 
 #include <kj/compat/http.h>
 #include <kj/encoding.h>
@@ -20,6 +22,7 @@ namespace workerd::api {
 
 // As documented in Cloudflare's Worker KV limits.
 static constexpr size_t kMaxKeyLength = 512;
+static constexpr size_t kMaxBulkKeys = 100;
 
 static void checkForErrorStatus(kj::StringPtr method, const kj::HttpClient::Response& response) {
   if (response.statusCode < 200 || response.statusCode >= 300) {
@@ -64,52 +67,75 @@ static void parseListMetadata(
   });
 }
 
+// Converts a value from a KvClient to what get() returns for the response type `typeName`.
+static KvNamespace::GetResult toGetResult(
+    jsg::Lock& js, IoContext& context, kj::StringPtr typeName, kj::Array<byte> value) {
+  if (typeName == "stream") {
+    auto stream = newMemoryInputStream(value).attach(kj::mv(value));
+    return jsg::alloc<ReadableStream>(
+        context, newSystemStream(kj::mv(stream), StreamEncoding::IDENTITY, context));
+  } else if (typeName == "text") {
+    return kj::str(value.asChars());
+  } else if (typeName == "arrayBuffer") {
+    return kj::mv(value);
+  } else if (typeName == "json") {
+    return jsg::JsRef(js, jsg::JsValue::fromJson(js, value.asChars()));
+  } else {
+    JSG_FAIL_REQUIRE(TypeError,
+        "Unknown response type. Possible types are \"text\", \"arrayBuffer\", "
+        "\"json\", and \"stream\".");
+  }
+}
+
 constexpr auto FLPROD_405_HEADER = "CF-KV-FLPROD-405"_kj;
 
-kj::Own<kj::HttpClient> KvNamespace::getHttpClient(IoContext& context,
-    kj::HttpHeaders& headers,
-    kj::OneOf<LimitEnforcer::KvOpType, kj::LiteralStringConst> opTypeOrUnknown,
-    kj::StringPtr urlStr,
-    kj::Maybe<kj::OneOf<ListOptions, kj::OneOf<kj::String, GetOptions>, PutOptions>> options) {
-  const auto operationName = [&] {
-    KJ_SWITCH_ONEOF(opTypeOrUnknown) {
-      KJ_CASE_ONEOF(name, kj::LiteralStringConst) {
-        return name;
-      }
-      KJ_CASE_ONEOF(opType, LimitEnforcer::KvOpType) {
-        // Check if we've hit KV usage limits. (This will throw if we have.)
-        context.getLimitEnforcer().newKvRequest(opType);
-
-        switch (opType) {
-          case LimitEnforcer::KvOpType::GET:
-            return "kv_get"_kjc;
-          case LimitEnforcer::KvOpType::GET_WITH:
-            return "kv_getWithMetadata"_kjc;
-          case LimitEnforcer::KvOpType::PUT:
-            return "kv_put"_kjc;
-          case LimitEnforcer::KvOpType::LIST:
-            return "kv_list"_kjc;
-          case LimitEnforcer::KvOpType::DELETE:
-            return "kv_delete"_kjc;
-        }
+// Returns the name of a KV operation, for spans. If `opTypeOrUnknown` is a KvOpType, first checks
+// its limiter, which throws if the limit was hit.
+static kj::LiteralStringConst startKvOperation(IoContext& context,
+    kj::OneOf<LimitEnforcer::KvOpType, kj::LiteralStringConst> opTypeOrUnknown) {
+  KJ_SWITCH_ONEOF(opTypeOrUnknown) {
+    KJ_CASE_ONEOF(name, kj::LiteralStringConst) {
+      return name;
+    }
+    KJ_CASE_ONEOF(opType, LimitEnforcer::KvOpType) {
+      // Check if we've hit KV usage limits. (This will throw if we have.)
+      context.getLimitEnforcer().newKvRequest(opType);
+
+      switch (opType) {
+        case LimitEnforcer::KvOpType::GET:
+          return "kv_get"_kjc;
+        case LimitEnforcer::KvOpType::GET_WITH:
+          return "kv_getWithMetadata"_kjc;
+        case LimitEnforcer::KvOpType::PUT:
+          return "kv_put"_kjc;
+        case LimitEnforcer::KvOpType::LIST:
+          return "kv_list"_kjc;
+        case LimitEnforcer::KvOpType::DELETE:
+          return "kv_delete"_kjc;
       }
     }
+  }
 
-    KJ_UNREACHABLE;
-  }();
+  KJ_UNREACHABLE;
+}
 
+// Returns the user span tags describing a KV operation and its options.
+static kj::Vector<Span::Tag> getKvSpanTags(kj::LiteralStringConst operationName,
+    kj::Maybe<kj::OneOf<KvNamespace::ListOptions,
+        kj::OneOf<kj::String, KvNamespace::GetOptions>,
+        KvNamespace::PutOptions>> options) {
   kj::Vector<Span::Tag> tags;
   tags.add("db.system"_kjc, kj::str("cloudflare-kv"_kjc));
   tags.add("cloudflare.kv.operation.name"_kjc, kj::str(operationName.slice(3)));
 
   KJ_IF_SOME(_options, options) {
     KJ_SWITCH_ONEOF(_options) {
-      KJ_CASE_ONEOF(o2, kj::OneOf<kj::String, GetOptions>) {
+      KJ_CASE_ONEOF(o2, kj::OneOf<kj::String, KvNamespace::GetOptions>) {
         KJ_SWITCH_ONEOF(o2) {
           KJ_CASE_ONEOF(type, kj::String) {
             tags.add("cloudflare.kv.query.parameter.type"_kjc, kj::mv(type));
           }
-          KJ_CASE_ONEOF(o, GetOptions) {
+          KJ_CASE_ONEOF(o, KvNamespace::GetOptions) {
             KJ_IF_SOME(type, o.type) {
               tags.add("cloudflare.kv.query.parameter.type"_kjc, kj::mv(type));
             }
@@ -119,7 +145,7 @@ kj::Own<kj::HttpClient> KvNamespace::getHttpClient(IoContext& context,
           }
         }
       }
-      KJ_CASE_ONEOF(o, ListOptions) {
+      KJ_CASE_ONEOF(o, KvNamespace::ListOptions) {
         KJ_IF_SOME(l, o.limit) {
           tags.add("cloudflare.kv.query.parameter.limit"_kjc, (int64_t)l);
         }
@@ -134,7 +160,7 @@ kj::Own<kj::HttpClient> KvNamespace::getHttpClient(IoContext& context,
           }
         }
       }
-      KJ_CASE_ONEOF(o, PutOptions) {
+      KJ_CASE_ONEOF(o, KvNamespace::PutOptions) {
         KJ_IF_SOME(expiration, o.expiration) {
           tags.add("cloudflare.kv.query.parameter.expiration"_kjc, (int64_t)expiration);
         }
@@ -144,6 +170,17 @@ kj::Own<kj::HttpClient> KvNamespace::getHttpClient(IoContext& context,
       }
     }
   }
+
+  return tags;
+}
+
+kj::Own<kj::HttpClient> KvNamespace::getHttpClient(IoContext& context,
+    kj::HttpHeaders& headers,
+    kj::OneOf<LimitEnforcer::KvOpType, kj::LiteralStringConst> opTypeOrUnknown,
+    kj::StringPtr urlStr,
+    kj::Maybe<kj::OneOf<ListOptions, kj::OneOf<kj::String, GetOptions>, PutOptions>> options) {
+  auto operationName = startKvOperation(context, opTypeOrUnknown);
+  auto tags = getKvSpanTags(operationName, kj::mv(options));
   auto client = context.getHttpClientWithSpans(
       subrequestChannel, true, kj::none, operationName, kj::mv(tags));
 
@@ -155,6 +192,22 @@ kj::Own<kj::HttpClient> KvNamespace::getHttpClient(IoContext& context,
   return client;
 }
 
+kj::Own<KvClient> KvNamespace::startKvRequest(IoContext& context,
+    KvClient& client,
+    LimitEnforcer::KvOpType opType,
+    kj::Maybe<kj::OneOf<ListOptions, kj::OneOf<kj::String, GetOptions>, PutOptions>> options) {
+  // Account for the operation as getHttpClient() would, where it's an in-house subrequest.
+  context.getLimitEnforcer().newSubrequest(true);
+  auto operationName = startKvOperation(context, opType);
+  TraceContext tracing(
+      context.makeTraceSpan(operationName), context.makeUserTraceSpan(operationName));
+  for (auto& tag: getKvSpanTags(operationName, kj::mv(options))) {
+    tracing.userSpan.setTag(kj::mv(tag.key), kj::mv(tag.value));
+  }
+
+  return kj::Own<KvClient>(&client, kj::NullDisposer::instance).attach(kj::mv(tracing));
+}
+
 jsg::Promise<KvNamespace::GetResult> KvNamespace::get(
     jsg::Lock& js, kj::String name, jsg::Optional<kj::OneOf<kj::String, GetOptions>> options) {
   return js.evalNow([&] {
@@ -165,6 +218,121 @@ jsg::Promise<KvNamespace::GetResult> KvNamespace::get(
   });
 }
 
+jsg::Promise<KvNamespace::GetResult> KvNamespace::getOneOrMany(jsg::Lock& js,
+    kj::OneOf<kj::String, kj::Array<kj::String>> name,
+    jsg::Optional<kj::OneOf<kj::String, GetOptions>> options) {
+  KJ_SWITCH_ONEOF(name) {
+    KJ_CASE_ONEOF(key, kj::String) {
+      return get(js, kj::mv(key), kj::mv(options));
+    }
+    KJ_CASE_ONEOF(keys, kj::Array<kj::String>) {
+      return js.evalNow([&] { return getBulk(js, kj::mv(keys), kj::mv(options)); });
+    }
+  }
+  KJ_UNREACHABLE;
+}
+
+jsg::Promise<KvNamespace::GetResult> KvNamespace::getBulk(jsg::Lock& js,
+    kj::Array<kj::String> names,
+    jsg::Optional<kj::OneOf<kj::String, GetOptions>> options) {
+  JSG_REQUIRE(names.size() > 0, TypeError, "KV GET_BULK requires at least one key.");
+  JSG_REQUIRE(names.size() <= kMaxBulkKeys, RangeError, "KV GET_BULK failed: at most ",
+      kMaxBulkKeys, " keys can be requested at once.");
+  for (auto& name: names) {
+    validateKeyName("GET_BULK", name);
+  }
+
+  auto type = kj::str("text");
+  KJ_IF_SOME(oneOfOptions, options) {
+    KJ_SWITCH_ONEOF(oneOfOptions) {
+      KJ_CASE_ONEOF(t, kj::String) {
+        type = kj::str(t);
+      }
+      KJ_CASE_ONEOF(options, GetOptions) {
+        KJ_IF_SOME(t, options.type) {
+          type = kj::str(t);
+        }
+      }
+    }
+  }
+  JSG_REQUIRE(type == "text" || type == "json", TypeError,
+      "Unknown response type. Possible types for multiple keys are \"text\" and \"json\".");
+
+  auto& context = IoContext::current();
+
+  KJ_IF_SOME(client, context.getKvClient(subrequestChannel)) {
+    auto kv = startKvRequest(context, client, LimitEnforcer::KvOpType::GET, kj::mv(options));
+    auto promise = kv->getBulk(names).attach(kj::mv(kv));
+    return context.awaitIo(js, kj::mv(promise),
+        [names = kj::mv(names), type = kj::mv(type)](
+            jsg::Lock& js, kj::Array<kj::Maybe<KvClient::Value>> values) {
+      auto result = js.map();
+      for (auto i: kj::indices(names)) {
+        KJ_IF_SOME(value, values[i]) {
+          if (type == "json") {
+            result.set(js, names[i], jsg::JsValue::fromJson(js, value.value.asChars()));
+          } else {
+            result.set(js, names[i], js.str(value.value.asChars()));
+          }
+        } else {
+          result.set(js, names[i], js.null());
+        }
+      }
+      return KvNamespace::GetResult(jsg::JsRef<jsg::JsValue>(js, jsg::JsValue(result)));
+    });
+  }
+
+  auto keys = KJ_MAP(name, names) -> jsg::JsValue { return js.str(name); };
+  auto requestObj = js.obj();
+  requestObj.set(js, "keys"_kjc, js.arr(keys.asPtr()));
+  requestObj.set(js, "type"_kjc, js.str(type));
+  requestObj.set(js, "withMetadata"_kjc, js.boolean(false));
+  auto json = jsg::JsValue(requestObj).toJson(js);
+
+  auto urlStr = kj::str("https://fake-host/bulk/get");
+
+  auto headers = kj::HttpHeaders(context.getHeaderTable());
+  auto client =
+      getHttpClient(context, headers, LimitEnforcer::KvOpType::GET, urlStr, kj::mv(options));
+  headers.set(kj::HttpHeaderId::CONTENT_TYPE, MimeType::JSON.toString());
+
+  auto request = client->request(kj::HttpMethod::POST, urlStr, headers, uint64_t(json.size()));
+  auto writePromise = request.body->write(json.asBytes()).attach(kj::mv(json));
+  auto promise = writePromise.attach(kj::mv(request.body))
+                     .then([response = kj::mv(request.response)]() mutable {
+    return kj::mv(response);
+  });
+
+  return context.awaitIo(js, kj::mv(promise),
+      [&context, client = kj::mv(client), names = kj::mv(names), type = kj::mv(type)](
+          jsg::Lock& js, kj::HttpClient::Response&& response) mutable
+      -> jsg::Promise<KvNamespace::GetResult> {
+    checkForErrorStatus("GET_BULK", response);
+
+    auto stream = newSystemStream(response.body.attach(kj::mv(client)),
+        getContentEncoding(
+            context, *response.headers, Response::BodyEncoding::AUTO, FeatureFlags::get(js)));
+
+    return context.awaitIo(js,
+        stream->readAllText(context.getLimitEnforcer().getBufferingLimit()).attach(kj::mv(stream)),
+        [names = kj::mv(names), type = kj::mv(type)](jsg::Lock& js, kj::String text) {
+      auto values = KJ_REQUIRE_NONNULL(jsg::JsValue::fromJson(js, text).tryCast<jsg::JsObject>());
+      auto result = js.map();
+      for (auto& name: names) {
+        auto value = values.get(js, name);
+        if (value.isUndefined()) {
+          result.set(js, name, js.null());
+        } else if (type == "json" && value.isString()) {
+          result.set(js, name, jsg::JsValue::fromJson(js, value));
+        } else {
+          result.set(js, name, value);
+        }
+      }
+      return KvNamespace::GetResult(jsg::JsRef<jsg::JsValue>(js, jsg::JsValue(result)));
+    });
+  });
+}
+
 jsg::Promise<KvNamespace::GetWithMetadataResult> KvNamespace::getWithMetadata(
     jsg::Lock& js, kj::String name, jsg::Optional<kj::OneOf<kj::String, GetOptions>> options) {
   return getWithMetadataImpl(js, kj::mv(name), kj::mv(options), LimitEnforcer::KvOpType::GET_WITH);
@@ -201,6 +369,36 @@ jsg::Promise<KvNamespace::GetWithMetadataResult> KvNamespace::getWithMetadataImp
     }
   }
 
+  KJ_IF_SOME(client, context.getKvClient(subrequestChannel)) {
+    auto kv = startKvRequest(context, client, op, kj::mv(options));
+    auto promise = kv->get(url.path[0]).attach(kj::mv(kv));
+    return context.awaitIo(js, kj::mv(promise),
+        [type = kj::mv(type), &context](jsg::Lock& js, kj::Maybe<KvClient::Value> maybeValue)
+            -> KvNamespace::GetWithMetadataResult {
+      auto value = KJ_UNWRAP_OR(kj::mv(maybeValue), {
+        return KvNamespace::GetWithMetadataResult{
+          .value = kj::none,
+          .metadata = kj::none,
+          .cacheStatus = kj::none,
+        };
+      });
+
+      auto typeName =
+          type.map([](const kj::String& s) -> kj::StringPtr { return s; }).orDefault("text");
+      auto result = toGetResult(js, context, typeName, kj::mv(value.value));
+
+      kj::Maybe<jsg::JsRef<jsg::JsValue>> meta;
+      KJ_IF_SOME(metaStr, value.metadata) {
+        meta = jsg::JsRef(js, jsg::JsValue::fromJson(js, metaStr));
+      }
+      return KvNamespace::GetWithMetadataResult{
+        .value = kj::mv(result),
+        .metadata = kj::mv(meta),
+        .cacheStatus = kj::none,
+      };
+    });
+  }
+
   auto urlStr = url.toString(kj::Url::Context::HTTP_PROXY_REQUEST);
 
   auto headers = kj::HttpHeaders(context.getHeaderTable());
@@ -292,27 +490,69 @@ jsg::Promise<jsg::JsRef<jsg::JsValue>> KvNamespace::list(
   return js.evalNow([&] {
     auto& context = IoContext::current();
 
-    kj::Url url;
-    url.scheme = kj::str("https");
-    url.host = kj::str("fake-host");
+    kj::Maybe<uint> limit;
+    kj::Maybe<kj::String> prefix;
+    kj::Maybe<kj::String> cursor;
     KJ_IF_SOME(o, options) {
-      KJ_IF_SOME(limit, o.limit) {
-        if (limit > 0) {
-          url.query.add(kj::Url::QueryParam{kj::str("key_count_limit"), kj::str(limit)});
-        }
+      KJ_IF_SOME(l, o.limit) {
+        if (l > 0) limit = l;
       }
       KJ_IF_SOME(maybePrefix, o.prefix) {
-        KJ_IF_SOME(prefix, maybePrefix) {
-          url.query.add(kj::Url::QueryParam{kj::str("prefix"), kj::str(prefix)});
+        KJ_IF_SOME(p, maybePrefix) {
+          prefix = kj::str(p);
         }
       }
       KJ_IF_SOME(maybeCursor, o.cursor) {
-        KJ_IF_SOME(cursor, maybeCursor) {
-          url.query.add(kj::Url::QueryParam{kj::str("cursor"), kj::str(cursor)});
+        KJ_IF_SOME(c, maybeCursor) {
+          cursor = kj::str(c);
         }
       }
     }
 
+    KJ_IF_SOME(client, context.getKvClient(subrequestChannel)) {
+      auto kv = startKvRequest(context, client, LimitEnforcer::KvOpType::LIST, kj::mv(options));
+      auto promise =
+          kv->list(prefix.map([](kj::String& p) -> kj::StringPtr { return p; }).orDefault(""),
+                cursor.map([](kj::String& c) -> kj::StringPtr { return c; }), limit)
+              .attach(kj::mv(kv));
+      return context.awaitIo(
+          js, kj::mv(promise), [](jsg::Lock& js, KvClient::ListResult listed) {
+        auto keys = KJ_MAP(key, listed.keys) -> jsg::JsValue {
+          auto obj = js.obj();
+          obj.set(js, "name"_kjc, js.str(key.name));
+          KJ_IF_SOME(expiration, key.expiration) {
+            obj.set(js, "expiration"_kjc, js.num(static_cast<double>(expiration)));
+          }
+          KJ_IF_SOME(metadata, key.metadata) {
+            obj.set(js, "metadata"_kjc, jsg::JsValue::fromJson(js, metadata));
+          }
+          return obj;
+        };
+
+        auto result = js.obj();
+        result.set(js, "keys"_kjc, js.arr(keys.asPtr()));
+        result.set(js, "list_complete"_kjc, js.boolean(listed.cursor == kj::none));
+        KJ_IF_SOME(c, listed.cursor) {
+          result.set(js, "cursor"_kjc, js.str(c));
+        }
+        result.set(js, "cacheStatus"_kjc, js.null());
+        return jsg::JsRef<jsg::JsValue>(js, jsg::JsValue(result));
+      });
+    }
+
+    kj::Url url;
+    url.scheme = kj::str("https");
+    url.host = kj::str("fake-host");
+    KJ_IF_SOME(l, limit) {
+      url.query.add(kj::Url::QueryParam{kj::str("key_count_limit"), kj::str(l)});
+    }
+    KJ_IF_SOME(p, prefix) {
+      url.query.add(kj::Url::QueryParam{kj::str("prefix"), kj::mv(p)});
+    }
+    KJ_IF_SOME(c, cursor) {
+      url.query.add(kj::Url::QueryParam{kj::str("cursor"), kj::mv(c)});
+    }
+
     auto urlStr = url.toString(kj::Url::Context::HTTP_PROXY_REQUEST);
 
     auto headers = kj::HttpHeaders(context.getHeaderTable());
@@ -371,17 +611,22 @@ jsg::Promise<void> KvNamespace::put(jsg::Lock& js,
 
     // If any optional parameters were specified by the client, append them to
     // the URL's query parameters.
+    KvClient::PutOptions kvOptions;
+    kj::Maybe<kj::String> metadataJson;
     KJ_IF_SOME(o, options) {
       KJ_IF_SOME(expiration, o.expiration) {
         url.query.add(kj::Url::QueryParam{kj::str("expiration"), kj::str(expiration)});
+        kvOptions.expiration = expiration;
       }
       KJ_IF_SOME(expirationTtl, o.expirationTtl) {
         url.query.add(kj::Url::QueryParam{kj::str("expiration_ttl"), kj::str(expirationTtl)});
+        kvOptions.expirationTtl = expirationTtl;
       }
       KJ_IF_SOME(maybeMetadata, o.metadata) {
         KJ_IF_SOME(metadata, maybeMetadata) {
           kj::String json = metadata.getHandle(js).toJson(js);
-          headers.set(context.getHeaderIds().cfKvMetadata, kj::mv(json));
+          headers.set(context.getHeaderIds().cfKvMetadata, kj::str(json));
+          metadataJson = kj::mv(json);
         }
       }
     }
@@ -418,6 +663,42 @@ jsg::Promise<void> KvNamespace::put(jsg::Lock& js,
       }
     }
 
+    KJ_IF_SOME(client, context.getKvClient(subrequestChannel)) {
+      auto kv = startKvRequest(context, client, LimitEnforcer::KvOpType::PUT, kj::mv(options));
+
+      // The value is passed whole, so a stream is read to its end first.
+      kj::Promise<kj::Array<const byte>> value = nullptr;
+      KJ_SWITCH_ONEOF(supportedBody) {
+        KJ_CASE_ONEOF(text, kj::String) {
+          value = text.asBytes().attach(kj::mv(text));
+        }
+        KJ_CASE_ONEOF(data, kj::Array<byte>) {
+          value = kj::Array<const byte>(kj::mv(data));
+        }
+        KJ_CASE_ONEOF(stream, jsg::Ref<ReadableStream>) {
+          value = context.awaitJs(js,
+              stream->getController()
+                  .readAllBytes(js, context.getLimitEnforcer().getBufferingLimit())
+                  .then(js, [](jsg::Lock&, jsg::BufferSource bytes) -> kj::Array<const byte> {
+            return kj::heapArray(bytes.asArrayPtr());
+          }));
+        }
+      }
+
+      auto promise = value.then([&context, kv = kj::mv(kv), name = kj::mv(url.path[0]), kvOptions,
+                                    metadataJson = kj::mv(metadataJson)](
+                                    kj::Array<const byte> value) mutable {
+        return context.waitForOutputLocks().then(
+            [kv = kj::mv(kv), name = kj::mv(name), value = kj::mv(value), kvOptions,
+                metadataJson = kj::mv(metadataJson)]() mutable {
+          kvOptions.metadata =
+              metadataJson.map([](kj::String& json) -> kj::StringPtr { return json; });
+          return kv->put(name, value, kvOptions).attach(kj::mv(kv));
+        });
+      });
+      return context.awaitIo(js, kj::mv(promise));
+    }
+
     auto urlStr = url.toString(kj::Url::Context::HTTP_PROXY_REQUEST);
 
     auto client =
@@ -473,6 +754,15 @@ jsg::Promise<void> KvNamespace::delete_(jsg::Lock& js, kj::String name) {
 
     auto& context = IoContext::current();
 
+    KJ_IF_SOME(client, context.getKvClient(subrequestChannel)) {
+      auto kv = startKvRequest(context, client, LimitEnforcer::KvOpType::DELETE, kj::none);
+      auto promise = context.waitForOutputLocks().then(
+          [kv = kj::mv(kv), name = kj::mv(name)]() mutable {
+        return kv->delete_(name).attach(kj::mv(kv));
+      });
+      return context.awaitIo(js, kj::mv(promise));
+    }
+
     auto urlStr = kj::str("https://fake-host/", kj::encodeUriComponent(name), "?urlencoded=true");
 
     kj::HttpHeaders headers(context.getHeaderTable());
@@ -14,9 +14,40 @@ class HttpHeaders;
 }  // namespace kj
 namespace workerd {
 class IoContext;
-}
+class KvClient;
+}  // namespace workerd
 namespace workerd::api {
 
+// Members of KVNamespace's TypeScript override: get() with a single key, and all other methods.
+// The overrides with and without the experimental flag share them, and only differ in whether
+// get() also accepts an array of keys.
+// clang-format off
+#define EW_KV_NAMESPACE_TS_GET_ONE \
+  get(key: Key, options?: Partial<KVNamespaceGetOptions<undefined>>): Promise<string | null>; \
+  get(key: Key, type: "text"): Promise<string | null>; \
+  get<ExpectedValue = unknown>(key: Key, type: "json"): Promise<ExpectedValue | null>; \
+  get(key: Key, type: "arrayBuffer"): Promise<ArrayBuffer | null>; \
+  get(key: Key, type: "stream"): Promise<ReadableStream | null>; \
+  get(key: Key, options?: KVNamespaceGetOptions<"text">): Promise<string | null>; \
+  get<ExpectedValue = unknown>(key: Key, options?: KVNamespaceGetOptions<"json">): Promise<ExpectedValue | null>; \
+  get(key: Key, options?: KVNamespaceGetOptions<"arrayBuffer">): Promise<ArrayBuffer | null>; \
+  get(key: Key, options?: KVNamespaceGetOptions<"stream">): Promise<ReadableStream | null>;
+
+#define EW_KV_NAMESPACE_TS_OTHER_METHODS \
+  list<Metadata = unknown>(options?: KVNamespaceListOptions): Promise<KVNamespaceListResult<Metadata, Key>>; \
+  put(key: Key, value: string | ArrayBuffer | ArrayBufferView | ReadableStream, options?: KVNamespacePutOptions): Promise<void>; \
+  getWithMetadata<Metadata = unknown>(key: Key, options?: Partial<KVNamespaceGetOptions<undefined>>): Promise<KVNamespaceGetWithMetadataResult<string, Metadata>>; \
+  getWithMetadata<Metadata = unknown>(key: Key, type: "text"): Promise<KVNamespaceGetWithMetadataResult<string, Metadata>>; \
+  getWithMetadata<ExpectedValue = unknown, Metadata = unknown>(key: Key, type: "json"): Promise<KVNamespaceGetWithMetadataResult<ExpectedValue, Metadata>>; \
+  getWithMetadata<Metadata = unknown>(key: Key, type: "arrayBuffer"): Promise<KVNamespaceGetWithMetadataResult<ArrayBuffer, Metadata>>; \
+  getWithMetadata<Metadata = unknown>(key: Key, type: "stream"): Promise<KVNamespaceGetWithMetadataResult<ReadableStream, Metadata>>; \
+  getWithMetadata<Metadata = unknown>(key: Key, options: KVNamespaceGetOptions<"text">): Promise<KVNamespaceGetWithMetadataResult<string, Metadata>>; \
+  getWithMetadata<ExpectedValue = unknown, Metadata = unknown>(key: Key, options: KVNamespaceGetOptions<"json">): Promise<KVNamespaceGetWithMetadataResult<ExpectedValue, Metadata>>; \
+  getWithMetadata<Metadata = unknown>(key: Key, options: KVNamespaceGetOptions<"arrayBuffer">): Promise<KVNamespaceGetWithMetadataResult<ArrayBuffer, Metadata>>; \
+  getWithMetadata<Metadata = unknown>(key: Key, options: KVNamespaceGetOptions<"stream">): Promise<KVNamespaceGetWithMetadataResult<ReadableStream, Metadata>>; \
+  delete(key: Key): Promise<void>;
+// clang-format on
+
 // A capability to a KV namespace.
 class KvNamespace: public jsg::Object {
  public:
@@ -53,6 +84,13 @@ class KvNamespace: public jsg::Object {
   jsg::Promise<GetResult> get(
       jsg::Lock& js, kj::String name, jsg::Optional<kj::OneOf<kj::String, GetOptions>> options);
 
+  // Replaces get() when the experimental flag is set. `name` may then be an array of keys, which
+  // are all fetched in a single request and returned as a Map from key to value. Without the
+  // flag, get() coerces arrays to a single key like any other value, as it always has.
+  jsg::Promise<GetResult> getOneOrMany(jsg::Lock& js,
+      kj::OneOf<kj::String, kj::Array<kj::String>> name,
+      jsg::Optional<kj::OneOf<kj::String, GetOptions>> options);
+
   struct GetWithMetadataResult {
     GetResult value;
     kj::Maybe<jsg::JsRef<jsg::JsValue>> metadata;
@@ -111,8 +149,12 @@ class KvNamespace: public jsg::Object {
 
   jsg::Promise<void> delete_(jsg::Lock& js, kj::String name);
 
-  JSG_RESOURCE_TYPE(KvNamespace) {
-    JSG_METHOD(get);
+  JSG_RESOURCE_TYPE(KvNamespace, CompatibilityFlags::Reader flags) {
+    if (flags.getWorkerdExperimental()) {
+      JSG_METHOD_NAMED(get, getOneOrMany);
+    } else {
+      JSG_METHOD(get);
+    }
     JSG_METHOD(list);
     JSG_METHOD(put);
     JSG_METHOD(getWithMetadata);
@@ -132,34 +174,22 @@ class KvNamespace: public jsg::Object {
     );
     // `Metadata` before `Key` type parameter for backwards-compatibility with `workers-types@3`.
     // `Key` is also an optional type parameter, which must come after required parameters.
-
-    JSG_TS_OVERRIDE(KVNamespace<Key extends string = string> {
-      get(key: Key, options?: Partial<KVNamespaceGetOptions<undefined>>): Promise<string | null>;
-      get(key: Key, type: "text"): Promise<string | null>;
-      get<ExpectedValue = unknown>(key: Key, type: "json"): Promise<ExpectedValue | null>;
-      get(key: Key, type: "arrayBuffer"): Promise<ArrayBuffer | null>;
-      get(key: Key, type: "stream"): Promise<ReadableStream | null>;
-      get(key: Key, options?: KVNamespaceGetOptions<"text">): Promise<string | null>;
-      get<ExpectedValue = unknown>(key: Key, options?: KVNamespaceGetOptions<"json">): Promise<ExpectedValue | null>;
-      get(key: Key, options?: KVNamespaceGetOptions<"arrayBuffer">): Promise<ArrayBuffer | null>;
-      get(key: Key, options?: KVNamespaceGetOptions<"stream">): Promise<ReadableStream | null>;
-
-      list<Metadata = unknown>(options?: KVNamespaceListOptions): Promise<KVNamespaceListResult<Metadata, Key>>;
-
-      put(key: Key, value: string | ArrayBuffer | ArrayBufferView | ReadableStream, options?: KVNamespacePutOptions): Promise<void>;
-
-      getWithMetadata<Metadata = unknown>(key: Key, options?: Partial<KVNamespaceGetOptions<undefined>>): Promise<KVNamespaceGetWithMetadataResult<string, Metadata>>;
-      getWithMetadata<Metadata = unknown>(key: Key, type: "text"): Promise<KVNamespaceGetWithMetadataResult<string, Metadata>>;
-      getWithMetadata<ExpectedValue = unknown, Metadata = unknown>(key: Key, type: "json"): Promise<KVNamespaceGetWithMetadataResult<ExpectedValue, Metadata>>;
-      getWithMetadata<Metadata = unknown>(key: Key, type: "arrayBuffer"): Promise<KVNamespaceGetWithMetadataResult<ArrayBuffer, Metadata>>;
-      getWithMetadata<Metadata = unknown>(key: Key, type: "stream"): Promise<KVNamespaceGetWithMetadataResult<ReadableStream, Metadata>>;
-      getWithMetadata<Metadata = unknown>(key: Key, options: KVNamespaceGetOptions<"text">): Promise<KVNamespaceGetWithMetadataResult<string, Metadata>>;
-      getWithMetadata<ExpectedValue = unknown, Metadata = unknown>(key: Key, options: KVNamespaceGetOptions<"json">): Promise<KVNamespaceGetWithMetadataResult<ExpectedValue, Metadata>>;
-      getWithMetadata<Metadata = unknown>(key: Key, options: KVNamespaceGetOptions<"arrayBuffer">): Promise<KVNamespaceGetWithMetadataResult<ArrayBuffer, Metadata>>;
-      getWithMetadata<Metadata = unknown>(key: Key, options: KVNamespaceGetOptions<"stream">): Promise<KVNamespaceGetWithMetadataResult<ReadableStream, Metadata>>;
-
-      delete(key: Key): Promise<void>;
-    });
+    if (flags.getWorkerdExperimental()) {
+      JSG_TS_OVERRIDE(KVNamespace<Key extends string = string> {
+        EW_KV_NAMESPACE_TS_GET_ONE
+        get(key: Key[], type: "text"): Promise<Map<string, string | null>>;
+        get<ExpectedValue = unknown>(key: Key[], type: "json"): Promise<Map<string, ExpectedValue | null>>;
+        get(key: Key[], options?: Partial<KVNamespaceGetOptions<undefined>>): Promise<Map<string, string | null>>;
+        get(key: Key[], options?: KVNamespaceGetOptions<"text">): Promise<Map<string, string | null>>;
+        get<ExpectedValue = unknown>(key: Key[], options?: KVNamespaceGetOptions<"json">): Promise<Map<string, ExpectedValue | null>>;
+        EW_KV_NAMESPACE_TS_OTHER_METHODS
+      });
+    } else {
+      JSG_TS_OVERRIDE(KVNamespace<Key extends string = string> {
+        EW_KV_NAMESPACE_TS_GET_ONE
+        EW_KV_NAMESPACE_TS_OTHER_METHODS
+      });
+    }
   }
 
   void visitForMemoryInfo(jsg::MemoryTracker& tracker) const {
@@ -178,9 +208,21 @@ class KvNamespace: public jsg::Object {
       kj::StringPtr urlStr,
       kj::Maybe<kj::OneOf<ListOptions, kj::OneOf<kj::String, GetOptions>, PutOptions>> options);
 
+  // The counterpart of getHttpClient() for a namespace implemented in this process, whose
+  // KvClient IoContext::getKvClient() returned: checks the limiter for `opType`, and returns
+  // `client` holding the operation's spans until it's dropped.
+  kj::Own<KvClient> startKvRequest(IoContext& context,
+      KvClient& client,
+      LimitEnforcer::KvOpType opType,
+      kj::Maybe<kj::OneOf<ListOptions, kj::OneOf<kj::String, GetOptions>, PutOptions>> options);
+
  private:
   kj::Array<AdditionalHeader> additionalHeaders;
   uint subrequestChannel;
+
+  jsg::Promise<GetResult> getBulk(jsg::Lock& js,
+      kj::Array<kj::String> names,
+      jsg::Optional<kj::OneOf<kj::String, GetOptions>> options);
 };
 
 #define EW_KV_ISOLATE_TYPES                                                                        \
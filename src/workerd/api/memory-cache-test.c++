@@ -0,0 +1,235 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "memory-cache.h"
+
+#include <workerd/io/trace.h>
+
+#include <kj/test.h>
+#include <kj/thread.h>
+
+namespace workerd::api {
+namespace {
+
+using Use = SharedMemoryCache::Use;
+using EvictionPolicy = SharedMemoryCache::EvictionPolicy;
+
+struct CacheFixture {
+  kj::EventLoop loop;
+  kj::WaitScope ws{loop};
+  kj::Own<const SharedMemoryCache> cache;
+  Use use;
+  SpanBuilder span{nullptr};
+
+  explicit CacheFixture(SharedMemoryCache::Limits limits,
+      const kj::MonotonicClock& clock = kj::systemPreciseMonotonicClock())
+      : cache(SharedMemoryCache::create(kj::none, "test"_kj, kj::none, clock)),
+        use(kj::atomicAddRef(*cache), limits) {}
+
+  // Reads `key` the way `read(key, fallback)` does, storing a value of `size` bytes if it is
+  // missing. Returns whether the read was a hit.
+  bool read(kj::StringPtr key, size_t size = 1) {
+    KJ_SWITCH_ONEOF(use.getWithFallback(kj::str(key), span)) {
+      KJ_CASE_ONEOF(value, kj::Own<CacheValue>) {
+        return true;
+      }
+      KJ_CASE_ONEOF(promise, kj::Promise<Use::GetWithFallbackOutcome>) {
+        auto outcome = promise.wait(ws);
+        outcome.get<Use::FallbackDoneCallback>()(Use::FallbackResult{
+          .value = kj::atomicRefcounted<CacheValue>(kj::heapArray<kj::byte>(size)),
+          .expiration = kj::none,
+        });
+        return false;
+      }
+    }
+    KJ_UNREACHABLE;
+  }
+
+  bool contains(kj::StringPtr key) {
+    return use.getWithoutFallback(kj::str(key), span) != kj::none;
+  }
+
+  uint countContained(kj::StringPtr prefix, uint count) {
+    uint result = 0;
+    for (auto i: kj::zeroTo(count)) {
+      if (contains(kj::str(prefix, i))) ++result;
+    }
+    return result;
+  }
+};
+
+// Reads 50 keys eight times each, and then 200 other keys once each, in a cache that only has
+// room for 100 keys.
+void readHotKeysThenScan(CacheFixture& f) {
+  for (auto round KJ_UNUSED: kj::zeroTo(8)) {
+    for (auto i: kj::zeroTo(50)) {
+      f.read(kj::str("hot", i));
+    }
+  }
+  for (auto i: kj::zeroTo(200)) {
+    f.read(kj::str("scan", i));
+  }
+}
+
+KJ_TEST("memory cache counts hits, misses and evictions") {
+  CacheFixture f({.maxKeys = 2, .maxValueSize = 100, .maxTotalValueSize = 1000});
+
+  KJ_EXPECT(!f.read("a"));
+  KJ_EXPECT(f.read("a"));
+  KJ_EXPECT(!f.read("b"));
+  KJ_EXPECT(!f.read("c"));
+  KJ_EXPECT(!f.contains("a"));
+
+  auto stats = f.cache->getStats();
+  KJ_EXPECT(stats.hits == 1);
+  KJ_EXPECT(stats.misses == 4);
+  KJ_EXPECT(stats.evictions == 1);
+  KJ_EXPECT(stats.rejections == 0);
+}
+
+KJ_TEST("LRU memory cache evicts among a sample of old entries when it is large") {
+  CacheFixture f({.maxKeys = 1000, .maxValueSize = 100, .maxTotalValueSize = 1 << 20});
+  for (auto i: kj::zeroTo(1000)) {
+    f.read(kj::str("key", i));
+  }
+  // Read a quarter of them again, so that the rest are older.
+  for (auto i: kj::zeroTo(250)) {
+    KJ_EXPECT(f.read(kj::str("key", i)));
+  }
+  for (auto i: kj::zeroTo(100)) {
+    f.read(kj::str("new", i));
+  }
+
+  // Each eviction picks the oldest of a sample of the entries, which is practically never one that
+  // has been read again.
+  KJ_EXPECT(f.countContained("key", 250) == 250);
+  KJ_EXPECT(f.countContained("new", 100) == 100);
+  KJ_EXPECT(f.cache->getStats().evictions == 100);
+}
+
+KJ_TEST("memory cache hits on several threads share the cache with a writer") {
+  SharedMemoryCache::Limits limits{
+    .maxKeys = 2000, .maxValueSize = 100, .maxTotalValueSize = 1 << 20};
+  CacheFixture f(limits);
+  for (auto i: kj::zeroTo(10)) {
+    f.read(kj::str("key", i));
+  }
+
+  constexpr uint THREAD_COUNT = 4;
+  constexpr uint READS_PER_THREAD = 10000;
+  {
+    // Each Use is assigned its own reader shard.
+    kj::Vector<kj::Own<kj::Thread>> threads;
+    for (auto t KJ_UNUSED: kj::zeroTo(THREAD_COUNT)) {
+      threads.add(kj::heap<kj::Thread>([&]() {
+        Use use(kj::atomicAddRef(*f.cache), limits);
+        SpanBuilder span(nullptr);
+        for (auto i: kj::zeroTo(READS_PER_THREAD)) {
+          KJ_ASSERT(use.getWithoutFallback(kj::str("key", i % 10), span) != kj::none);
+        }
+      }));
+    }
+    // Meanwhile, store other keys, which excludes the readers while modifying the cache.
+    for (auto i: kj::zeroTo(1000)) {
+      f.read(kj::str("other", i));
+    }
+  }
+
+  auto stats = f.cache->getStats();
+  KJ_EXPECT(stats.hits == THREAD_COUNT * READS_PER_THREAD);
+  KJ_EXPECT(stats.misses == 1010);
+  KJ_EXPECT(stats.evictions == 0);
+}
+
+KJ_TEST("LRU memory cache loses frequently read keys to a scan") {
+  CacheFixture f({.maxKeys = 100, .maxValueSize = 100, .maxTotalValueSize = 1 << 20});
+  readHotKeysThenScan(f);
+
+  KJ_EXPECT(f.countContained("hot", 50) < 10);
+  KJ_EXPECT(f.cache->getStats().rejections == 0);
+}
+
+KJ_TEST("TinyLFU memory cache keeps frequently read keys through a scan") {
+  CacheFixture f({
+    .maxKeys = 100,
+    .maxValueSize = 100,
+    .maxTotalValueSize = 1 << 20,
+    .evictionPolicy = EvictionPolicy::TINY_LFU,
+  });
+  readHotKeysThenScan(f);
+
+  KJ_EXPECT(f.countContained("hot", 50) >= 45);
+  auto stats = f.cache->getStats();
+  KJ_EXPECT(stats.rejections >= 100);
+  KJ_EXPECT(stats.hits >= 50 * 7);
+}
+
+KJ_TEST("TinyLFU memory cache doesn't let a large value displace popular small ones") {
+  for (auto policy: {EvictionPolicy::LRU, EvictionPolicy::TINY_LFU}) {
+    CacheFixture f({
+      .maxKeys = 100,
+      .maxValueSize = 1000,
+      .maxTotalValueSize = 1000,
+      .evictionPolicy = policy,
+    });
+
+    for (auto round KJ_UNUSED: kj::zeroTo(4)) {
+      for (auto i: kj::zeroTo(20)) {
+        f.read(kj::str("small", i), 10);
+      }
+    }
+    // Making room for this needs ten small values to go.
+    f.read("large", 900);
+
+    if (policy == EvictionPolicy::LRU) {
+      KJ_EXPECT(f.contains("large"));
+      KJ_EXPECT(f.countContained("small", 20) == 10);
+    } else {
+      // The small value that was in the admission window along with the large one competes for
+      // room first, and loses a tie against the small values that are already admitted.
+      KJ_EXPECT(!f.contains("large"));
+      KJ_EXPECT(f.countContained("small", 20) == 19);
+      KJ_EXPECT(f.cache->getStats().rejections == 2);
+    }
+  }
+}
+
+class FakeClock final: public kj::MonotonicClock {
+ public:
+  kj::TimePoint now() const override {
+    return time;
+  }
+
+  kj::TimePoint time = kj::origin<kj::TimePoint>();
+};
+
+KJ_TEST("TinyLFU memory cache logs its stats periodically") {
+  kj::_::Debug::setLogLevel(kj::LogSeverity::INFO);
+  KJ_DEFER(kj::_::Debug::setLogLevel(kj::LogSeverity::WARNING));
+
+  FakeClock clock;
+  CacheFixture f(
+      {
+        .maxKeys = 100,
+        .maxValueSize = 100,
+        .maxTotalValueSize = 1 << 20,
+        .evictionPolicy = EvictionPolicy::TINY_LFU,
+      },
+      clock);
+
+  // The first store only schedules the first log.
+  f.read("a");
+  f.read("a");
+  clock.time += SharedMemoryCache::STATS_LOG_INTERVAL - 1 * kj::SECONDS;
+  f.read("b");
+
+  clock.time += 1 * kj::SECONDS;
+  {
+    KJ_EXPECT_LOG(INFO, "memory cache stats; id = test; stats.hits = 1; stats.misses = 3");
+    f.read("c");
+  }
+}
+
+}  // namespace
+}  // namespace workerd::api
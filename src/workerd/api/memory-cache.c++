@@ -7,6 +7,9 @@
 #include <workerd/jsg/ser.h>
 #include <workerd/util/weak-refs.h>
 
+#include <algorithm>
+#include <functional>
+
 namespace workerd::api {
 
 static constexpr size_t MAX_KEY_SIZE = 2 * 1024;
@@ -36,6 +39,15 @@ static bool hasExpired(const kj::Maybe<double>& expiration, bool allowOutsideIoC
   return false;
 }
 
+// Returns the time to mark cache entries as used with. This deliberately does
+// not use the cache's own clock, which may be an event loop timer that only
+// advances between turns: entries read one after the other need distinct times
+// for LRU eviction to tell them apart.
+static uint64_t lastUsedNow() {
+  return (kj::systemPreciseMonotonicClock().now() - kj::origin<kj::TimePoint>()) /
+      kj::NANOSECONDS;
+}
+
 SharedMemoryCache::SharedMemoryCache(kj::Maybe<const MemoryCacheProvider&> provider,
     kj::StringPtr id,
     kj::Maybe<AdditionalResizeMemoryLimitHandler&> additionalResizeMemoryLimitHandler,
@@ -53,22 +65,147 @@ SharedMemoryCache::~SharedMemoryCache() noexcept(false) {
 }
 
 void SharedMemoryCache::suggest(const Limits& limits) const {
-  auto data = this->data.lockExclusive();
+  auto data = lockExclusive();
   bool isKnownLimit = data->suggestedLimits.find(limits) != data->suggestedLimits.end();
   data->suggestedLimits.insert(limits);
   if (!isKnownLimit) {
+    data.excludeReaders();
     resize(*data);
   }
 }
 
 void SharedMemoryCache::unsuggest(const Limits& limits) const {
-  auto data = this->data.lockExclusive();
+  auto data = lockExclusive();
   auto loc = data->suggestedLimits.find(limits);
   KJ_ASSERT(loc != data->suggestedLimits.end());
   data->suggestedLimits.erase(loc);
+  data.excludeReaders();
   resize(*data);
 }
 
+uint SharedMemoryCache::assignReaderShard() const {
+  return nextReaderShard.fetch_add(1, std::memory_order_relaxed) % READER_SHARD_COUNT;
+}
+
+SharedMemoryCache::SharedLock SharedMemoryCache::lockShared(uint readerShard) const {
+  // Writers hold every reader shard exclusively while modifying `data`, so holding any one of
+  // them shared is enough to read it.
+  return SharedLock(readerShards[readerShard].lock.lockShared(), data.getWithoutLock());
+}
+
+SharedMemoryCache::ExclusiveLock SharedMemoryCache::lockExclusive() const {
+  return ExclusiveLock(data.lockExclusive(), *this);
+}
+
+void SharedMemoryCache::ExclusiveLock::excludeReaders() {
+  // `data` is always locked first and then the shards in order, so that writers can't deadlock
+  // each other. Readers only ever hold one shard and never wait for anything else while holding it.
+  for (auto i: kj::zeroTo(READER_SHARD_COUNT)) {
+    if (shards[i] == kj::none) {
+      shards[i] = cache.readerShards[i].lock.lockExclusive();
+    }
+  }
+}
+
+SharedMemoryCache::Stats SharedMemoryCache::getStats() const {
+  auto data = lockExclusive();
+  return getStatsWhileLocked(*data);
+}
+
+SharedMemoryCache::Stats SharedMemoryCache::getStatsWhileLocked(
+    const ThreadUnsafeData& data) const {
+  Stats stats{
+    .hits = data.hits,
+    .misses = data.misses,
+    .evictions = data.evictions,
+    .rejections = data.rejections,
+  };
+  for (auto& shard: readerShards) {
+    stats.hits += shard.hits.load(std::memory_order_relaxed);
+    stats.misses += shard.misses.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+void SharedMemoryCache::maybeLogStatsWhileLocked(ThreadUnsafeData& data) const {
+  if (data.effectiveLimits.evictionPolicy != EvictionPolicy::TINY_LFU) return;
+
+  auto now = timer.now();
+  KJ_IF_SOME(nextStatsLog, data.nextStatsLog) {
+    if (now < nextStatsLog) return;
+    auto stats = getStatsWhileLocked(data);
+    KJ_LOG(INFO, "memory cache stats", id, stats.hits, stats.misses, stats.evictions,
+        stats.rejections);
+  }
+  data.nextStatsLog = now + STATS_LOG_INTERVAL;
+}
+
+void SharedMemoryCache::FrequencySketch::resize(uint32_t maxKeys) {
+  size_t newWidth = 0;
+  if (maxKeys > 0) {
+    newWidth = 16;
+    while (newWidth < maxKeys) newWidth <<= 1;
+  }
+  if (newWidth == width) return;
+
+  width = newWidth;
+  counters = kj::heapArray<std::atomic<uint8_t>>(width * ROWS);
+  for (auto& counter: counters) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+  additions.store(0, std::memory_order_relaxed);
+  // Like Caffeine, forget half of everything after ten reads per counter.
+  sampleSize = 10 * width;
+}
+
+size_t SharedMemoryCache::FrequencySketch::indexOf(uint hashCode, uint row) const {
+  // Spread the key's hash code differently for each row, using splitmix64's finalizer.
+  uint64_t h = hashCode + (row + 1) * 0x9e3779b97f4a7c15ull;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+  h ^= h >> 31;
+  return row * width + (h & (width - 1));
+}
+
+void SharedMemoryCache::FrequencySketch::increment(kj::StringPtr key) const {
+  if (width == 0) return;
+
+  uint hashCode = kj::hashCode(key);
+  bool incremented = false;
+  for (auto row: kj::zeroTo(ROWS)) {
+    auto& counter = counters[indexOf(hashCode, row)];
+    uint8_t count = counter.load(std::memory_order_relaxed);
+    if (count < MAX_COUNT) {
+      counter.store(count + 1, std::memory_order_relaxed);
+      incremented = true;
+    }
+  }
+  // Exactly one increment brings the number of additions up to the sample size, and that one
+  // ages the sketch. Most reads are cache hits, which never reach putWhileLocked(), so aging
+  // there would leave the sketch saturated whenever the hit rate is high.
+  if (incremented && additions.fetch_add(1, std::memory_order_relaxed) + 1 == sampleSize) {
+    age();
+  }
+}
+
+uint SharedMemoryCache::FrequencySketch::estimate(kj::StringPtr key) const {
+  if (width == 0) return 0;
+
+  uint hashCode = kj::hashCode(key);
+  uint result = MAX_COUNT;
+  for (auto row: kj::zeroTo(ROWS)) {
+    result = kj::min(result, counters[indexOf(hashCode, row)].load(std::memory_order_relaxed));
+  }
+  return result;
+}
+
+void SharedMemoryCache::FrequencySketch::age() const {
+  for (auto& counter: counters) {
+    counter.store(counter.load(std::memory_order_relaxed) >> 1, std::memory_order_relaxed);
+  }
+  additions.fetch_sub(sampleSize / 2, std::memory_order_relaxed);
+}
+
 void SharedMemoryCache::resize(ThreadUnsafeData& data) const {
   data.effectiveLimits = Limits::min();
   for (const auto& limits: data.suggestedLimits) {
@@ -83,18 +220,31 @@ void SharedMemoryCache::resize(ThreadUnsafeData& data) const {
   // Fast path for clearing the cache.
   if (data.effectiveLimits.maxKeys == 0) {
     data.totalValueSize = 0;
+    data.windowCount = 0;
+    data.windowValueSize = 0;
     data.cache.clear();
+    data.sketch.resize(0);
     return;
   }
 
+  if (data.effectiveLimits.evictionPolicy == EvictionPolicy::TINY_LFU) {
+    data.sketch.resize(data.effectiveLimits.maxKeys);
+  } else {
+    // Without TINY_LFU, there is no admission window.
+    data.sketch.resize(0);
+    while (data.windowCount > 0) {
+      promoteWhileLocked(data, *data.cache.ordered<3>().begin());
+    }
+  }
+
   // First, remove any values that might be too large.
   while (data.cache.size() != 0) {
-    MemoryCacheEntry& largestEntry = *data.cache.ordered<2>().begin();
+    MemoryCacheEntry& largestEntry = *data.cache.ordered<1>().begin();
     if (largestEntry.size() <= data.effectiveLimits.maxValueSize) {
       break;
     }
-    data.totalValueSize -= largestEntry.size();
-    data.cache.erase(largestEntry);
+    data.evictions++;
+    eraseWhileLocked(data, largestEntry);
   }
 
   // Now just keep keep evicting until we are within limits.
@@ -104,35 +254,33 @@ void SharedMemoryCache::resize(ThreadUnsafeData& data) const {
   }
 }
 
-kj::Maybe<kj::Own<CacheValue>> SharedMemoryCache::getWhileLocked(
-    ThreadUnsafeData& data, const kj::String& key) const {
+kj::Maybe<kj::Own<CacheValue>> SharedMemoryCache::findUnexpired(
+    const ThreadUnsafeData& data, const kj::String& key) const {
   KJ_IF_SOME(existingCacheEntry, data.cache.find(key)) {
     if (hasExpired(existingCacheEntry.expiration)) {
-      // The cache entry has an associated expiration time and that time has
-      // passed (according to the calling IoContext's timer).
-      data.totalValueSize -= existingCacheEntry.size();
-      data.cache.erase(existingCacheEntry);
       return kj::none;
     }
-
-    // Obtain a reference to the cache value before we kj::mv the cache entry.
-    auto cacheValue = kj::atomicAddRef(*existingCacheEntry.value);
-
-    // Update the liveliness.
-    MemoryCacheEntry entry = data.cache.release(existingCacheEntry);
-    entry.liveliness = data.stepLiveliness();
-    data.cache.insert(kj::mv(entry));
-
-    return kj::mv(cacheValue);
+    existingCacheEntry.touch(lastUsedNow());
+    return kj::atomicAddRef(*existingCacheEntry.value);
   } else {
     return kj::none;
   }
 }
 
+kj::Maybe<kj::Own<CacheValue>> SharedMemoryCache::getShared(
+    const ThreadUnsafeData& data, const kj::String& key) const {
+  // Misses count towards a key's frequency too, so that TINY_LFU can tell whether the value that
+  // a fallback is about to produce is worth keeping.
+  data.sketch.increment(key);
+  return findUnexpired(data, key);
+}
+
 void SharedMemoryCache::putWhileLocked(ThreadUnsafeData& data,
     const kj::String& key,
     kj::Own<CacheValue>&& value,
     kj::Maybe<double> expiration) const {
+  maybeLogStatsWhileLocked(data);
+
   size_t valueSize = value->bytes.size();
   if (valueSize > data.effectiveLimits.maxValueSize) {
     // Silently drop the value. For consistency, also drop the previous value,
@@ -154,16 +302,24 @@ void SharedMemoryCache::putWhileLocked(ThreadUnsafeData& data,
     KJ_ASSERT(data.totalValueSize >= oldValueSize);
     MemoryCacheEntry updatedEntry = data.cache.release(entry);
     data.totalValueSize -= oldValueSize;
+    if (updatedEntry.inWindow) {
+      data.windowValueSize -= oldValueSize;
+    }
     while (data.totalValueSize + valueSize > data.effectiveLimits.maxTotalValueSize) {
       // We have already released the existing entry for our key, so there is no
       // risk of evicting it.
       evictNextWhileLocked(data);
     }
-    updatedEntry.liveliness = data.stepLiveliness();
+    updatedEntry.lastUsed.store(lastUsedNow(), std::memory_order_relaxed);
     updatedEntry.value = kj::mv(value);
     updatedEntry.expiration = expiration;
+    if (updatedEntry.inWindow) {
+      data.windowValueSize += valueSize;
+    }
     data.cache.insert(kj::mv(updatedEntry));
     data.totalValueSize += valueSize;
+  } else if (data.effectiveLimits.evictionPolicy == EvictionPolicy::TINY_LFU) {
+    insertIntoWindowWhileLocked(data, key, kj::mv(value), expiration);
   } else {
     // Ensure that adding a new key won't push us over the limit.
     if (data.cache.size() >= data.effectiveLimits.maxKeys) {
@@ -173,13 +329,7 @@ void SharedMemoryCache::putWhileLocked(ThreadUnsafeData& data,
     while (data.totalValueSize + valueSize > data.effectiveLimits.maxTotalValueSize) {
       evictNextWhileLocked(data);
     }
-    MemoryCacheEntry newEntry = {
-      kj::str(key),
-      data.stepLiveliness(),
-      kj::mv(value),
-      expiration,
-    };
-    data.cache.insert(kj::mv(newEntry));
+    data.cache.insert(MemoryCacheEntry(kj::str(key), lastUsedNow(), kj::mv(value), expiration));
     data.totalValueSize += valueSize;
   }
 }
@@ -188,21 +338,178 @@ void SharedMemoryCache::evictNextWhileLocked(
     ThreadUnsafeData& data, bool allowOutsideIoContext) const {
   // The caller is responsible for ensuring that the cache is not empty already.
   KJ_REQUIRE(data.cache.size() > 0);
+  data.evictions++;
 
   // If there is an entry that has expired already, evict that one.
-  MemoryCacheEntry& maybeExpired = *data.cache.ordered<3>().begin();
-  KJ_ASSERT(data.totalValueSize >= maybeExpired.size());
+  if (evictExpiredWhileLocked(data, allowOutsideIoContext)) {
+    return;
+  }
+
+  // Otherwise, evict the least recently used entry outside of TINY_LFU's
+  // admission window, or an approximation of it for larger caches. Only if
+  // there is no such entry, evict the oldest entry in the window.
+  KJ_IF_SOME(entry,
+      sampleLeastRecentlyUsed(data, [](const MemoryCacheEntry& e) { return !e.inWindow; })) {
+    eraseWhileLocked(data, entry);
+  } else {
+    eraseWhileLocked(data, *data.cache.ordered<3>().begin());
+  }
+}
+
+bool SharedMemoryCache::evictExpiredWhileLocked(
+    ThreadUnsafeData& data, bool allowOutsideIoContext) const {
+  if (data.cache.size() == 0) return false;
+
+  MemoryCacheEntry& maybeExpired = *data.cache.ordered<2>().begin();
   if (hasExpired(maybeExpired.expiration, allowOutsideIoContext)) {
-    data.totalValueSize -= maybeExpired.size();
-    data.cache.erase(maybeExpired);
+    eraseWhileLocked(data, maybeExpired);
+    return true;
+  }
+  return false;
+}
+
+kj::Maybe<MemoryCacheEntry&> SharedMemoryCache::sampleLeastRecentlyUsed(
+    ThreadUnsafeData& data, kj::FunctionParam<bool(const MemoryCacheEntry&)> eligible) const {
+  MemoryCacheEntry* candidate = nullptr;
+  auto consider = [&](MemoryCacheEntry& entry) {
+    if (eligible(entry) &&
+        (candidate == nullptr ||
+            entry.lastUsed.load(std::memory_order_relaxed) <
+                candidate->lastUsed.load(std::memory_order_relaxed))) {
+      candidate = &entry;
+    }
+  };
+
+  if (data.cache.size() > EVICTION_SAMPLE_SIZE) {
+    for (uint i = 0; i < EVICTION_SAMPLE_SIZE; i++) {
+      consider(data.cache.begin()[data.nextEvictionSample()]);
+    }
+  }
+  if (candidate == nullptr) {
+    for (auto& entry: data.cache) {
+      consider(entry);
+    }
+  }
+
+  if (candidate == nullptr) return kj::none;
+  return *candidate;
+}
+
+void SharedMemoryCache::insertIntoWindowWhileLocked(ThreadUnsafeData& data,
+    const kj::String& key,
+    kj::Own<CacheValue>&& value,
+    kj::Maybe<double> expiration) const {
+  // New entries always enter the window, even if that puts the cache over its limits for now.
+  size_t valueSize = value->bytes.size();
+  MemoryCacheEntry newEntry(kj::str(key), lastUsedNow(), kj::mv(value), expiration);
+  newEntry.inWindow = true;
+  newEntry.windowSeq = data.nextWindowSeq++;
+  data.cache.insert(kj::mv(newEntry));
+  data.totalValueSize += valueSize;
+  data.windowCount++;
+  data.windowValueSize += valueSize;
+
+  auto& limits = data.effectiveLimits;
+  auto isOverLimits = [&]() {
+    return data.cache.size() > limits.maxKeys || data.totalValueSize > limits.maxTotalValueSize;
+  };
+
+  // Entries leaving the window move on to the rest of the cache if there is room for them, and
+  // otherwise have to compete with the entries they would displace. A value larger than the
+  // window's share of bytes has to compete right away.
+  size_t maxWindowCount = kj::max(limits.maxKeys / 100, 1u);
+  size_t maxWindowValueSize = limits.maxTotalValueSize / 100;
+  for (;;) {
+    // Expired entries make room for free.
+    while (isOverLimits() && evictExpiredWhileLocked(data, false)) {
+      data.evictions++;
+    }
+    if (data.windowCount == 0 ||
+        (data.windowCount <= maxWindowCount && data.windowValueSize <= maxWindowValueSize)) {
+      break;
+    }
+
+    MemoryCacheEntry& oldest = *data.cache.ordered<3>().begin();
+    if (isOverLimits()) {
+      admitOrRejectWhileLocked(data, oldest);
+    } else {
+      promoteWhileLocked(data, oldest);
+    }
+  }
+
+  // If the rest of the cache ran out of entries to displace, the window itself may still be over
+  // the limits.
+  while (isOverLimits()) {
+    evictNextWhileLocked(data);
+  }
+}
+
+void SharedMemoryCache::admitOrRejectWhileLocked(
+    ThreadUnsafeData& data, MemoryCacheEntry& candidate) const {
+  auto& limits = data.effectiveLimits;
+  uint candidateFrequency = data.sketch.estimate(candidate.key);
+
+  // Find the entries outside the window that would have to go to make room for the candidate,
+  // least recently used first. The candidate is only admitted if it has been read more often
+  // than all of them together, so we can stop looking as soon as that is no longer the case.
+  kj::Vector<MemoryCacheEntry*> victims;
+  kj::HashSet<const MemoryCacheEntry*> isVictim;
+  uint victimFrequency = 0;
+  size_t freedValueSize = 0;
+  while (victimFrequency < candidateFrequency &&
+      (data.cache.size() - victims.size() > limits.maxKeys ||
+          data.totalValueSize - freedValueSize > limits.maxTotalValueSize)) {
+    KJ_IF_SOME(victim, sampleLeastRecentlyUsed(data, [&](const MemoryCacheEntry& e) {
+      return !e.inWindow && !isVictim.contains(&e);
+    })) {
+      victims.add(&victim);
+      isVictim.insert(&victim);
+      victimFrequency += data.sketch.estimate(victim.key);
+      freedValueSize += victim.size();
+    } else {
+      break;
+    }
+  }
+
+  if (victimFrequency >= candidateFrequency) {
+    data.rejections++;
+    data.evictions++;
+    eraseWhileLocked(data, candidate);
     return;
   }
 
-  // Otherwise, if no entry has expired, evict the least recently used entry.
-  MemoryCacheEntry& leastRecentlyUsed = *data.cache.ordered<1>().begin();
-  KJ_ASSERT(data.totalValueSize >= leastRecentlyUsed.size());
-  data.totalValueSize -= leastRecentlyUsed.size();
-  data.cache.erase(leastRecentlyUsed);
+  // kj::Table fills the hole left by an erased row with its last row. Erasing the victims from
+  // the back of the table first makes sure that none of the rows we still have to erase move.
+  auto candidateKey = kj::str(candidate.key);
+  std::sort(victims.begin(), victims.end(), std::greater<MemoryCacheEntry*>());
+  for (auto victim: victims) {
+    data.evictions++;
+    eraseWhileLocked(data, *victim);
+  }
+  promoteWhileLocked(data, KJ_ASSERT_NONNULL(data.cache.find(candidateKey)));
+}
+
+void SharedMemoryCache::promoteWhileLocked(ThreadUnsafeData& data, MemoryCacheEntry& entry) const {
+  // The window index sorts entries by whether they are in the window, so this needs a
+  // re-insertion.
+  KJ_ASSERT(entry.inWindow);
+  data.windowCount--;
+  data.windowValueSize -= entry.size();
+  MemoryCacheEntry promoted = data.cache.release(entry);
+  promoted.inWindow = false;
+  promoted.windowSeq = 0;
+  data.cache.insert(kj::mv(promoted));
+}
+
+void SharedMemoryCache::eraseWhileLocked(ThreadUnsafeData& data, MemoryCacheEntry& entry) const {
+  size_t valueSize = entry.size();
+  KJ_ASSERT(valueSize <= data.totalValueSize);
+  data.totalValueSize -= valueSize;
+  if (entry.inWindow) {
+    data.windowCount--;
+    data.windowValueSize -= valueSize;
+  }
+  data.cache.erase(entry);
 }
 
 void SharedMemoryCache::removeIfExistsWhileLocked(
@@ -211,10 +518,7 @@ void SharedMemoryCache::removeIfExistsWhileLocked(
     // This DOES NOT count as an eviction because it might happen while
     // replacing the existing cache entry with a new one, when the new one is
     // being evicted immediately. It is up to the caller to count that.
-    size_t valueSize = entry.size();
-    KJ_ASSERT(valueSize <= data.totalValueSize);
-    data.totalValueSize -= valueSize;
-    data.cache.erase(entry);
+    eraseWhileLocked(data, entry);
   }
 }
 
@@ -228,11 +532,15 @@ kj::Own<const SharedMemoryCache> SharedMemoryCache::create(
 
 SharedMemoryCache::Use::Use(kj::Own<const SharedMemoryCache> cache, const Limits& limits)
     : cache(kj::mv(cache)),
-      limits(limits) {
+      limits(limits),
+      readerShard(this->cache->assignReaderShard()) {
   this->cache->suggest(limits);
 }
 
-SharedMemoryCache::Use::Use(Use&& other): cache(kj::mv(other.cache)), limits(other.limits) {
+SharedMemoryCache::Use::Use(Use&& other)
+    : cache(kj::mv(other.cache)),
+      limits(other.limits),
+      readerShard(other.readerShard) {
   this->cache->suggest(limits);
 }
 
@@ -242,25 +550,57 @@ SharedMemoryCache::Use::~Use() noexcept(false) {
   }
 }
 
-kj::Maybe<kj::Own<CacheValue>> SharedMemoryCache::Use::getWithoutFallback(
+kj::Maybe<kj::Own<CacheValue>> SharedMemoryCache::Use::lookupShared(
     const kj::String& key, SpanBuilder& span) const {
-  kj::Locked<ThreadUnsafeData> data = [&] {
+  SharedLock data = [&] {
     auto memoryCacheLockRecord =
         ScopedDurationTagger(span, memoryCachekLockWaitTimeTag, cache->timer);
-    return cache->data.lockExclusive();
+    return cache->lockShared(readerShard);
   }();
-  return cache->getWhileLocked(*data, key);
+  return cache->getShared(*data, key);
+}
+
+kj::Maybe<kj::Own<CacheValue>> SharedMemoryCache::Use::getWithoutFallback(
+    const kj::String& key, SpanBuilder& span) const {
+  auto result = lookupShared(key, span);
+  auto& shard = cache->readerShards[readerShard];
+  if (result == kj::none) {
+    shard.misses.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    shard.hits.fetch_add(1, std::memory_order_relaxed);
+  }
+  span.setTag(memoryCacheHitTag, result != kj::none);
+  return result;
 }
 
 kj::OneOf<kj::Own<CacheValue>, kj::Promise<SharedMemoryCache::Use::GetWithFallbackOutcome>>
 SharedMemoryCache::Use::getWithFallback(const kj::String& key, SpanBuilder& span) const {
-  kj::Locked<ThreadUnsafeData> data = [&] {
+  // Cache hits, which are expected to be the common case, only need a shared lock.
+  KJ_IF_SOME(existingValue, lookupShared(key, span)) {
+    cache->readerShards[readerShard].hits.fetch_add(1, std::memory_order_relaxed);
+    span.setTag(memoryCacheHitTag, true);
+    return kj::mv(existingValue);
+  }
+
+  // Otherwise, lock the cache exclusively to set up a fallback. Another thread may have stored
+  // the value in the meantime, so look for it again. Neither that nor queueing the fallback
+  // modifies the cache entries, so readers don't need to be excluded. The wait for the shared
+  // lock has already been recorded under memoryCachekLockWaitTimeTag, so this wait gets a tag of
+  // its own.
+  ExclusiveLock data = [&] {
     auto memoryCacheLockRecord =
-        ScopedDurationTagger(span, memoryCachekLockWaitTimeTag, cache->timer);
-    return cache->data.lockExclusive();
+        ScopedDurationTagger(span, memoryCacheExclusiveLockWaitTimeTag, cache->timer);
+    return cache->lockExclusive();
   }();
-  KJ_IF_SOME(existingValue, cache->getWhileLocked(*data, key)) {
-    return kj::mv(existingValue);
+  auto existingValue = cache->findUnexpired(*data, key);
+  if (existingValue == kj::none) {
+    data->misses++;
+  } else {
+    data->hits++;
+  }
+  span.setTag(memoryCacheHitTag, existingValue != kj::none);
+  KJ_IF_SOME(value, existingValue) {
+    return kj::mv(value);
   } else KJ_IF_SOME(existingInProgress, data->inProgress.find(key)) {
     // We return a Promise, but we keep the fulfiller. We might fulfill it
     // from a different thread, so we need a cross-thread fulfiller here.
@@ -303,7 +643,8 @@ SharedMemoryCache::Use::FallbackDoneCallback SharedMemoryCache::Use::prepareFall
       // The fallback succeeded. Store the value in the cache and propagate it to
       // all waiting requests, even if it has expired already.
       status.hasSettled = true;
-      auto data = cache->data.lockExclusive();
+      auto data = cache->lockExclusive();
+      data.excludeReaders();
       cache->putWhileLocked(
           *data, kj::str(inProgress.key), kj::atomicAddRef(*result.value), result.expiration);
       for (auto& waiter: inProgress.waiting) {
@@ -326,7 +667,7 @@ void SharedMemoryCache::Use::handleFallbackFailure(InProgress& inProgress) const
   // If there is another queued fallback, retrieve it and remove it from the
   // queue. Otherwise, just delete the queue entirely.
   {
-    auto data = cache->data.lockExclusive();
+    auto data = cache->lockExclusive();
     auto next = inProgress.waiting.begin();
     if (next != inProgress.waiting.end()) {
       nextFulfiller = kj::mv(next->fulfiller);
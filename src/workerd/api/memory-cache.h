@@ -9,6 +9,7 @@
 #include <kj/table.h>
 #include <kj/timer.h>
 
+#include <atomic>
 #include <set>
 
 namespace workerd {
@@ -44,21 +45,53 @@ struct CacheValue: kj::AtomicRefcounted {
 };
 
 struct MemoryCacheEntry {
+  MemoryCacheEntry(kj::String key,
+      uint64_t lastUsed,
+      kj::Own<CacheValue> value,
+      kj::Maybe<double> expiration)
+      : key(kj::mv(key)),
+        lastUsed(lastUsed),
+        value(kj::mv(value)),
+        expiration(expiration) {}
+
+  // kj::Table moves rows around, which std::atomic does not support by
+  // itself. Rows are only moved while the cache is locked exclusively, so
+  // nobody can be updating `lastUsed` meanwhile.
+  MemoryCacheEntry(MemoryCacheEntry&& other)
+      : key(kj::mv(other.key)),
+        lastUsed(other.lastUsed.load(std::memory_order_relaxed)),
+        value(kj::mv(other.value)),
+        expiration(other.expiration),
+        inWindow(other.inWindow),
+        windowSeq(other.windowSeq) {}
+  MemoryCacheEntry& operator=(MemoryCacheEntry&& other) {
+    key = kj::mv(other.key);
+    lastUsed.store(other.lastUsed.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    value = kj::mv(other.value);
+    expiration = other.expiration;
+    inWindow = other.inWindow;
+    windowSeq = other.windowSeq;
+    return *this;
+  }
+
   // The key that this entry is associated with.
   kj::String key;
 
-  // Whenever an entry is created, updated, or retrieved, its liveliness is
-  // set to the value of a monotonically increasing counter.
-  uint64_t liveliness;
-  // TODO(cleanup): The liveliness index accomplishes the same thing as
-  //   kj::InsertionOrderIndex.
-  //
-  // TODO(perf): Updating a cache entry's liveliness requires a re-insertion,
-  //   which means that cache reads require an exclusive lock. This may be
-  //   suboptimal for a read-heavy workload. WorkerSet avoids this by atomically
-  //   updating a `lastUsed` timestamp. The tradeoff is that LRU-eviction
-  //   becomes O(n) instead of O(1), since we can no longer use kj::Table's
-  //   index to find the LRU entry.
+  // Whenever an entry is created, updated, or retrieved, this is set to the
+  // current time on the system's monotonic clock, in nanoseconds. Cache hits
+  // only hold a shared lock, so rather than re-inserting the entry into an
+  // index, they update this in place. The price is that finding an entry to
+  // evict means sampling entries rather than looking at the front of an index;
+  // see SharedMemoryCache::evictNextWhileLocked().
+  mutable std::atomic<uint64_t> lastUsed;
+
+  // Marks the entry as used at `now`. Safe to call with only a shared lock.
+  inline void touch(uint64_t now) const {
+    // Another thread may have stamped a later time already; keep that one.
+    if (lastUsed.load(std::memory_order_relaxed) < now) {
+      lastUsed.store(now, std::memory_order_relaxed);
+    }
+  }
 
   // The stored JavaScript value, serialized by V8. It is atomicRefcounted to
   // allow threads to deserialize the value without having to lock the cache,
@@ -75,6 +108,11 @@ struct MemoryCacheEntry {
   // stored as a double so that it is compatible with api::dateNow() and
   // EdgeWorkerPlatform::CurrentClockTimeMillis().
   kj::Maybe<double> expiration;
+
+  // Whether this entry is in the admission window of a TINY_LFU cache, and if
+  // so, a sequence number that orders it by when it entered the window.
+  bool inWindow = false;
+  uint64_t windowSeq = 0;
 };
 
 struct CacheValueProduceResult {
@@ -98,6 +136,21 @@ class SharedMemoryCache: public kj::AtomicRefcounted {
  public:
   struct ThreadUnsafeData;
 
+  // How to choose which entries to evict when the cache is full.
+  enum class EvictionPolicy : uint8_t {
+    // Evict the least recently used entry. For caches with many entries, this
+    // is approximated, see evictNextWhileLocked().
+    LRU,
+
+    // W-TinyLFU: new entries enter a small LRU admission window, holding 1% of
+    // the cache's keys and bytes. Entries leaving the window are only admitted
+    // to the rest of the cache if they have been read more often recently than
+    // the entries they would displace, all of them together, so that a scan of
+    // keys that are read once does not flush out frequently read ones, and a
+    // single large value can't displace many popular small ones.
+    TINY_LFU,
+  };
+
   struct Limits {
     // The maximum number of keys that may exist within the cache at the same
     // time. The cache size grows at least linearly in the number of entries.
@@ -111,6 +164,8 @@ class SharedMemoryCache: public kj::AtomicRefcounted {
     // for keys and the overhead of the data structures themselves.
     uint64_t maxTotalValueSize;
 
+    EvictionPolicy evictionPolicy = EvictionPolicy::LRU;
+
     bool operator<(const Limits& b) const {
       if (maxTotalValueSize != b.maxTotalValueSize) {
         return maxTotalValueSize < b.maxTotalValueSize;
@@ -118,7 +173,10 @@ class SharedMemoryCache: public kj::AtomicRefcounted {
       if (maxKeys != b.maxKeys) {
         return maxKeys < b.maxKeys;
       }
-      return maxTotalValueSize < b.maxTotalValueSize;
+      if (maxValueSize != b.maxValueSize) {
+        return maxValueSize < b.maxValueSize;
+      }
+      return evictionPolicy < b.evictionPolicy;
     }
 
     Limits normalize() const KJ_WARN_UNUSED_RESULT {
@@ -133,6 +191,7 @@ class SharedMemoryCache: public kj::AtomicRefcounted {
         .maxKeys = maxKeys,
         .maxValueSize = static_cast<uint32_t>(kj::min(maxValueSize, maxTotalValueSize)),
         .maxTotalValueSize = maxTotalValueSize,
+        .evictionPolicy = evictionPolicy,
       };
     }
 
@@ -140,15 +199,41 @@ class SharedMemoryCache: public kj::AtomicRefcounted {
       return {0, 0, 0};
     }
 
+    // TINY_LFU wins over LRU, so that bindings that don't ask for it don't
+    // take it away from bindings that do.
     static Limits max(const Limits& a, const Limits& b) {
       return Limits{
         std::max(a.maxKeys, b.maxKeys),
         std::max(a.maxValueSize, b.maxValueSize),
         std::max(a.maxTotalValueSize, b.maxTotalValueSize),
+        std::max(a.evictionPolicy, b.evictionPolicy),
       };
     }
   };
 
+  // Counters describing how well the cache is doing since it was created.
+  struct Stats {
+    // Reads that found a value, and reads that did not.
+    uint64_t hits;
+    uint64_t misses;
+
+    // Entries removed to make room for others, including expired entries and
+    // entries that TINY_LFU did not admit, and entries removed because the
+    // limits were lowered.
+    uint64_t evictions;
+
+    // Entries that TINY_LFU evicted when they left its admission window,
+    // because they were read less often than the entries they would have
+    // displaced.
+    uint64_t rejections;
+  };
+
+  Stats getStats() const;
+
+  // Caches that use TINY_LFU log their Stats at INFO level at most this often, when values are
+  // stored, so that the policy's effect on the hit rate can be seen.
+  static constexpr kj::Duration STATS_LOG_INTERVAL = 1 * kj::MINUTES;
+
   KJ_DISALLOW_COPY_AND_MOVE(SharedMemoryCache);
 
   using AdditionalResizeMemoryLimitHandler = kj::Function<void(ThreadUnsafeData&)>;
@@ -202,6 +287,9 @@ class SharedMemoryCache: public kj::AtomicRefcounted {
         const kj::String& key, SpanBuilder& span) const;
 
    private:
+    // Looks up a value under a shared lock, without counting a hit or a miss.
+    kj::Maybe<kj::Own<CacheValue>> lookupShared(const kj::String& key, SpanBuilder& span) const;
+
     // Creates a new FallbackDoneCallback associated with the given
     // InProgress struct. This is called whenever getWithFallback() wants to
     // invoke a fallback but it does not call the fallback directly. The caller
@@ -219,7 +307,14 @@ class SharedMemoryCache: public kj::AtomicRefcounted {
 
     kj::Own<const SharedMemoryCache> cache;
     static constexpr auto memoryCachekLockWaitTimeTag = "memory_cache_lock_wait_time_ns"_kjc;
+    static constexpr auto memoryCacheExclusiveLockWaitTimeTag =
+        "memory_cache_exclusive_lock_wait_time_ns"_kjc;
+    static constexpr auto memoryCacheHitTag = "memory_cache_hit"_kjc;
     Limits limits;
+
+    // Index of the reader lock that cache hits through this Use take, see
+    // SharedMemoryCache::readerShards.
+    uint readerShard;
   };
 
  private:
@@ -271,11 +366,22 @@ class SharedMemoryCache: public kj::AtomicRefcounted {
   // does not change the cache contents).
   void resize(ThreadUnsafeData& data) const;
 
-  // Returns a cached value while the cache's data is already locked by the
-  // calling thread. If such a cache entry exists, it will be marked as the
-  // most recently used entry.
-  kj::Maybe<kj::Own<CacheValue>> getWhileLocked(
-      ThreadUnsafeData& data, const kj::String& key) const;
+  // Returns a cached value while the cache's data is locked, exclusively or through a reader
+  // shard. If such a cache entry exists, it will be marked as the most recently used entry. An
+  // expired entry is treated as missing and left for the next writer to remove.
+  kj::Maybe<kj::Own<CacheValue>> findUnexpired(
+      const ThreadUnsafeData& data, const kj::String& key) const;
+
+  // Like findUnexpired(), but also records the read in the frequency sketch.
+  kj::Maybe<kj::Own<CacheValue>> getShared(
+      const ThreadUnsafeData& data, const kj::String& key) const;
+
+  // Returns the Stats while the cache's data is locked exclusively.
+  Stats getStatsWhileLocked(const ThreadUnsafeData& data) const;
+
+  // Logs the Stats if the cache uses TINY_LFU and STATS_LOG_INTERVAL has passed since they were
+  // last logged.
+  void maybeLogStatsWhileLocked(ThreadUnsafeData& data) const;
 
   // Stores a value in the cache, with an optional expiration timestamp. It is
   // marked as the most recently used entry.
@@ -288,7 +394,42 @@ class SharedMemoryCache: public kj::AtomicRefcounted {
   // the calling thread, and the cache must not be empty. Expiration timestamps
   // are only considered if called from within an I/O context or if
   // allowOutsideIoContext is true.
+  //
+  // If no entry has expired, this evicts the least recently used of
+  // EVICTION_SAMPLE_SIZE randomly chosen entries, like Redis' approximated
+  // LRU. Caches with no more entries than that are scanned in full, so they
+  // get exact LRU.
   void evictNextWhileLocked(ThreadUnsafeData& data, bool allowOutsideIoContext = false) const;
+  static constexpr uint EVICTION_SAMPLE_SIZE = 16;
+
+  // Evicts the entry that expires first if it has expired, returning whether
+  // there was one.
+  bool evictExpiredWhileLocked(ThreadUnsafeData& data, bool allowOutsideIoContext) const;
+
+  // Returns the least recently used of EVICTION_SAMPLE_SIZE randomly chosen
+  // entries for which `eligible` returns true, or of all such entries if the
+  // cache is small or the sample contained none of them.
+  kj::Maybe<MemoryCacheEntry&> sampleLeastRecentlyUsed(ThreadUnsafeData& data,
+      kj::FunctionParam<bool(const MemoryCacheEntry&)> eligible) const;
+
+  // Inserts a new entry into TINY_LFU's admission window, and then moves
+  // entries out of the window, or evicts them, until it is within its share of
+  // the cache again.
+  void insertIntoWindowWhileLocked(ThreadUnsafeData& data,
+      const kj::String& key,
+      kj::Own<CacheValue>&& value,
+      kj::Maybe<double> expiration) const;
+
+  // Decides whether `candidate`, which is the oldest entry in the admission
+  // window of a cache that is over its limits, is admitted to the rest of the
+  // cache, evicting the entries it displaces, or evicted itself.
+  void admitOrRejectWhileLocked(ThreadUnsafeData& data, MemoryCacheEntry& candidate) const;
+
+  // Moves an entry out of the admission window, into the rest of the cache.
+  void promoteWhileLocked(ThreadUnsafeData& data, MemoryCacheEntry& entry) const;
+
+  // Removes an entry, keeping track of the sizes of the cache and the window.
+  void eraseWhileLocked(ThreadUnsafeData& data, MemoryCacheEntry& entry) const;
 
   // Removes the cache entry with the given key, if it exists.
   void removeIfExistsWhileLocked(ThreadUnsafeData& data, const kj::String& key) const;
@@ -313,25 +454,6 @@ class SharedMemoryCache: public kj::AtomicRefcounted {
     }
   };
 
-  // Callbacks for a TreeIndex that allow sorting cache entries by their
-  // liveliness. This is used to evict the least recently used entry.
-  class LivelinessCallbacks {
-   public:
-    inline const uint64_t& keyForRow(const MemoryCacheEntry& entry) const {
-      return entry.liveliness;
-    }
-
-    template <typename KeyLike>
-    inline bool matches(const MemoryCacheEntry& e, KeyLike&& key) const {
-      return e.liveliness == key;
-    }
-
-    template <typename KeyLike>
-    inline bool isBefore(const MemoryCacheEntry& e, KeyLike&& key) const {
-      return e.liveliness < key;
-    }
-  };
-
   // Callbacks for a TreeIndex that allow sorting cache entries by the sizes
   // of the serialized values. The entries are sorted in reverse order, i.e.,
   // the first entry contains the largest value. This is used to quickly evict
@@ -393,6 +515,75 @@ class SharedMemoryCache: public kj::AtomicRefcounted {
     }
   };
 
+  // Callbacks for a TreeIndex that sorts the entries in TINY_LFU's admission
+  // window from oldest to newest, ahead of all other entries, which are
+  // ordered by their keys. This is used to find the entry that leaves the
+  // window next.
+  class WindowCallbacks {
+   public:
+    inline const MemoryCacheEntry& keyForRow(const MemoryCacheEntry& entry) const {
+      return entry;
+    }
+
+    template <typename KeyLike>
+    inline bool matches(const MemoryCacheEntry& e, KeyLike&& key) const {
+      return e.inWindow == key.inWindow && e.windowSeq == key.windowSeq && e.key == key.key;
+    }
+
+    template <typename KeyLike>
+    inline bool isBefore(const MemoryCacheEntry& e, KeyLike&& key) const {
+      if (e.inWindow != key.inWindow) return e.inWindow;
+      if (e.inWindow) return e.windowSeq < key.windowSeq;
+      return e.key < key.key;
+    }
+  };
+
+  // A count-min sketch estimating how often each key has been read recently,
+  // used by TINY_LFU to decide which entries are worth keeping. Each key maps
+  // to one counter in each of four rows, and its estimate is the smallest of
+  // them. Counters saturate at 15, and once enough reads have been recorded,
+  // all of them are halved, so that the sketch forgets what used to be popular.
+  //
+  // Reads only hold a shared lock, so the counters are atomic, but they are
+  // not updated with read-modify-write operations: concurrent increments of the
+  // same counter may get lost, which only makes an estimate slightly lower.
+  // Once a key's counters have saturated, reading it doesn't write to the
+  // sketch at all.
+  class FrequencySketch {
+   public:
+    // Sizes the sketch for a cache of up to `maxKeys` entries. Everything
+    // recorded so far is forgotten, unless the size stays the same. A size of
+    // zero disables the sketch.
+    void resize(uint32_t maxKeys);
+
+    // Records a read of `key`, and halves all counters if enough reads have been recorded since
+    // they were last halved. Safe to call with only a shared lock.
+    void increment(kj::StringPtr key) const;
+
+    // Returns an estimate of how often `key` has been read recently.
+    uint estimate(kj::StringPtr key) const;
+
+   private:
+    static constexpr uint ROWS = 4;
+    static constexpr uint8_t MAX_COUNT = 15;
+
+    mutable kj::Array<std::atomic<uint8_t>> counters;
+    size_t width = 0;
+
+    // How many reads have been recorded since the counters were last halved,
+    // and how many to record before halving them again.
+    mutable std::atomic<uint64_t> additions = 0;
+    uint64_t sampleSize = 0;
+
+    // Returns the position of the counter for a key with the given hash code
+    // in the given row.
+    size_t indexOf(uint hashCode, uint row) const;
+
+    // Halves all counters. Increments that race with this may be lost, like
+    // concurrent increments of the same counter.
+    void age() const;
+  };
+
  public:
   struct ThreadUnsafeData {
     KJ_DISALLOW_COPY_AND_MOVE(ThreadUnsafeData);
@@ -407,16 +598,17 @@ class SharedMemoryCache: public kj::AtomicRefcounted {
     // are attached to this cache.
     Limits effectiveLimits = Limits::min();
 
-    // Returns the next liveliness and increments it so that the next call to
-    // this function will return a different value.
-    inline uint64_t stepLiveliness() {
-      return nextLiveliness++;
+    // Returns the index of a random cache entry to consider for eviction. This
+    // is a xorshift generator: it doesn't need to be unpredictable, only cheap
+    // and well spread.
+    inline size_t nextEvictionSample() {
+      evictionSampleState ^= evictionSampleState << 13;
+      evictionSampleState ^= evictionSampleState >> 7;
+      evictionSampleState ^= evictionSampleState << 17;
+      return evictionSampleState % cache.size();
     }
 
-    // We do not handle integer overflow, but a 64-bit counter should never wrap
-    // around, at least not in the foreseeable future. (Even at a billion cache
-    // operations per second, it would take almost 600 years.)
-    uint64_t nextLiveliness = 0;
+    uint64_t evictionSampleState = 0x9e3779b97f4a7c15;
 
     // The sum of the sizes of all values that are currently stored in the cache.
     // This is technically redundant information, but more efficient than
@@ -426,12 +618,31 @@ class SharedMemoryCache: public kj::AtomicRefcounted {
     // The actual cache contents.
     kj::Table<MemoryCacheEntry,              // row type
         kj::HashIndex<KeyCallbacks>,         // index over keys
-        kj::TreeIndex<LivelinessCallbacks>,  // index over liveliness
         kj::TreeIndex<ValueSizeCallbacks>,   // index over value sizes
-        kj::TreeIndex<ExpirationCallbacks>   // index over expiration
+        kj::TreeIndex<ExpirationCallbacks>,  // index over expiration
+        kj::TreeIndex<WindowCallbacks>       // index over the admission window
         >
         cache;
 
+    // How often keys have been read recently, if the policy is TINY_LFU.
+    FrequencySketch sketch;
+
+    // The number of entries in TINY_LFU's admission window, the sum of their
+    // value sizes, and the sequence number for the next entry to enter it.
+    size_t windowCount = 0;
+    size_t windowValueSize = 0;
+    uint64_t nextWindowSeq = 0;
+
+    // See Stats. Reads that only take a shared lock count their hits and
+    // misses in `readerShards` instead.
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t rejections = 0;
+
+    // When the Stats are due to be logged next, see STATS_LOG_INTERVAL.
+    kj::Maybe<kj::TimePoint> nextStatsLog;
+
     // Whenever a fallback is active for a particular key, this table will
     // contain one corresponding row. Other concurrent read operations can add
     // themselves to the InProgress struct to be notified once the fallback
@@ -442,11 +653,80 @@ class SharedMemoryCache: public kj::AtomicRefcounted {
   };
 
  private:
-  // To ensure thread-safety, all mutable data is guarded by a mutex. Each cache
-  // operation requires an exclusive lock. Even read-only operations need to
-  // update the liveliness of cache entries, which currently requires a lock.
+  // To ensure thread-safety, all mutable data is guarded by a mutex. Anything
+  // that modifies it needs an exclusive lock on it, and anything that modifies
+  // the cache entries also needs one on all of `readerShards`, see
+  // ExclusiveLock. Cache hits only need a shared lock on one reader shard, see
+  // lockShared().
   kj::MutexGuarded<ThreadUnsafeData> data;
 
+  // Locks that cache hits take instead of locking `data`. If all readers
+  // shared one lock, every hit would write to the same cache line to take and
+  // release it, which stops hits from scaling across threads. Instead, each
+  // Use is assigned a shard round-robin, and readers only contend with readers
+  // on the same shard, and with writers. Each shard is on its own cache line.
+  static constexpr uint READER_SHARD_COUNT = 16;
+  struct ReaderShardTag {};
+  struct alignas(64) ReaderShard {
+    kj::MutexGuarded<ReaderShardTag> lock;
+
+    // Hits and misses of reads that took this shard's lock.
+    mutable std::atomic<uint64_t> hits = 0;
+    mutable std::atomic<uint64_t> misses = 0;
+  };
+  ReaderShard readerShards[READER_SHARD_COUNT];
+  mutable std::atomic<uint> nextReaderShard = 0;
+
+  uint assignReaderShard() const;
+
+  // A shared lock on one reader shard, granting read access to `data`.
+  class SharedLock {
+   public:
+    SharedLock(kj::Locked<const ReaderShardTag> shard, const ThreadUnsafeData& data)
+        : shard(kj::mv(shard)),
+          data(data) {}
+
+    const ThreadUnsafeData& operator*() const {
+      return data;
+    }
+    const ThreadUnsafeData* operator->() const {
+      return &data;
+    }
+
+   private:
+    kj::Locked<const ReaderShardTag> shard;
+    const ThreadUnsafeData& data;
+  };
+
+  // An exclusive lock on `data`. This keeps other writers out and lets the holder read the cache
+  // entries, but readers may still be reading them too: anything that modifies `data.cache` must
+  // call excludeReaders() first. Writes that don't, such as counting a miss or queueing a fallback,
+  // don't have to wait for readers at all.
+  class ExclusiveLock {
+   public:
+    ExclusiveLock(kj::Locked<ThreadUnsafeData> data, const SharedMemoryCache& cache)
+        : data(kj::mv(data)),
+          cache(cache) {}
+
+    ThreadUnsafeData& operator*() {
+      return *data;
+    }
+    ThreadUnsafeData* operator->() {
+      return data.get();
+    }
+
+    // Locks every reader shard exclusively, unless that has been done already.
+    void excludeReaders();
+
+   private:
+    kj::Locked<ThreadUnsafeData> data;
+    const SharedMemoryCache& cache;
+    kj::Maybe<kj::Locked<ReaderShardTag>> shards[READER_SHARD_COUNT];
+  };
+
+  SharedLock lockShared(uint readerShard) const;
+  ExclusiveLock lockExclusive() const;
+
   // The MemoryCacheProvider instance needs to be guaranteed to outlive the SharedMemoryCache
   // instance. When the SharedMemoryCache is destroyed, it will remove itself from the provider.
   // TODO(cleanup): Eventually, assuming/once the kj::Ptr<T> work progresses, it would be safer
@@ -1394,6 +1394,64 @@ export class DurableObjectExample extends DurableObject {
 
     assert.deepEqual([...cursor], [{ i: 123 }]);
   }
+
+  async testSnapshotReads() {
+    const sql = this.state.storage.sql;
+    sql.exec('CREATE TABLE snap (i INTEGER)');
+    sql.exec('INSERT INTO snap VALUES (1), (2)');
+    await scheduler.wait(1); // commit
+
+    // Snapshot reads don't see writes that haven't been committed yet.
+    sql.exec('INSERT INTO snap VALUES (3)');
+    assert.equal(sql.execSnapshot('SELECT count(*) AS n FROM snap').one().n, 2);
+
+    // An open cursor keeps its snapshot across commits, while new reads see them.
+    const cursor = sql.execSnapshot('SELECT i FROM snap ORDER BY i');
+    assert.deepEqual(cursor.next().value, { i: 1 });
+    await scheduler.wait(1);
+    assert.equal(sql.execSnapshot('SELECT count(*) AS n FROM snap').one().n, 3);
+    assert.deepEqual([...cursor], [{ i: 2 }]);
+
+    assert.throws(() => sql.execSnapshot('INSERT INTO snap VALUES (4)'), {
+      message: /readonly database/,
+    });
+  }
+
+  async testRangeOperations() {
+    const storage = this.state.storage;
+    for (const prefix of ['a', 'b', 'c']) {
+      for (let i = 0; i < 10; i++) {
+        storage.put(`${prefix}:${i}`, i);
+      }
+    }
+
+    assert.equal(await storage.countRange(), 30);
+    assert.equal(await storage.countRange({ prefix: 'b:' }), 10);
+    assert.equal(await storage.countRange({ start: 'b:3', end: 'b:7' }), 4);
+    assert.equal(await storage.countRange({ startAfter: 'b:3', prefix: 'b:' }), 6);
+    assert.equal(await storage.countRange({ start: 'z' }), 0);
+    await assert.rejects(storage.countRange({ start: 'a', startAfter: 'a' }), {
+      name: 'TypeError',
+      message:
+        'countRange() cannot be called with both start and startAfter values.',
+    });
+
+    assert.equal(await storage.deleteRange({ prefix: 'b:' }), 10);
+    assert.equal(await storage.countRange({ prefix: 'b:' }), 0);
+    assert.equal(await storage.deleteRange({ start: 'c:5' }), 5);
+    assert.deepEqual(
+      [...(await storage.list()).keys()].filter((k) => k.startsWith('c:')),
+      ['c:0', 'c:1', 'c:2', 'c:3', 'c:4']
+    );
+
+    // Range operations are also available in transactions, and roll back with them.
+    await storage.transaction(async (txn) => {
+      assert.equal(await txn.deleteRange({ prefix: 'a:' }), 10);
+      assert.equal(await txn.countRange({ prefix: 'a:' }), 0);
+      txn.rollback();
+    });
+    assert.equal(await storage.countRange({ prefix: 'a:' }), 10);
+  }
 }
 
 export default {
@@ -1487,6 +1545,20 @@ export let testMultiStatement = {
   },
 };
 
+export let testSnapshotReads = {
+  async test(ctrl, env, ctx) {
+    let stub = env.ns.get(env.ns.idFromName('snapshot-reads-test'));
+    await stub.testSnapshotReads();
+  },
+};
+
+export let testRangeOperations = {
+  async test(ctrl, env, ctx) {
+    let stub = env.ns.get(env.ns.idFromName('range-operations-test'));
+    await stub.testRangeOperations();
+  },
+};
+
 const INSERT_36_ROWS = ['a', 'b', 'c', 'd', 'e', 'f']
   .map(
     (prefix) =>
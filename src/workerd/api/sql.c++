@@ -25,25 +25,43 @@ SqlStorage::~SqlStorage() {}
 
 jsg::Ref<SqlStorage::Cursor> SqlStorage::exec(
     jsg::Lock& js, jsg::JsString querySql, jsg::Arguments<BindingValue> bindings) {
+  return execImpl(js, getDb(js), *statementCache, querySql, kj::mv(bindings));
+}
+
+jsg::Ref<SqlStorage::Cursor> SqlStorage::execSnapshot(
+    jsg::Lock& js, jsg::JsString querySql, jsg::Arguments<BindingValue> bindings) {
+  auto& db = getDb(js).getReadOnlyConnection();
+  StatementCache* cache;
+  KJ_IF_SOME(c, snapshotStatementCache) {
+    cache = &*c;
+  } else {
+    cache = &*snapshotStatementCache.emplace(
+        IoContext::current().addObject(kj::heap<StatementCache>()));
+  }
+  return execImpl(js, db, *cache, querySql, kj::mv(bindings));
+}
+
+jsg::Ref<SqlStorage::Cursor> SqlStorage::execImpl(jsg::Lock& js,
+    SqliteDatabase& db,
+    StatementCache& cache,
+    jsg::JsString querySql,
+    jsg::Arguments<BindingValue> bindings) {
   // Internalize the string, so that the cache can be keyed by string identity rather than content.
   // Any string we put into the cache is expected to live there for a while anyway, so even if it
   // is a one-off, internalizing it (which moves it to the old generation) shouldn't hurt.
   querySql = querySql.internalize(js);
 
-  auto& db = getDb(js);
-  auto& statementCache = *this->statementCache;
-
-  kj::Rc<CachedStatement>& slot = statementCache.map.findOrCreate(querySql, [&]() {
+  kj::Rc<CachedStatement>& slot = cache.map.findOrCreate(querySql, [&]() {
     auto result = kj::rc<CachedStatement>(js, *this, db, querySql, js.toString(querySql));
-    statementCache.totalSize += result->statementSize;
+    cache.totalSize += result->statementSize;
     return result;
   });
 
   // Move cached statement to end of LRU queue.
   if (slot->lruLink.isLinked()) {
-    statementCache.lru.remove(*slot.get());
+    cache.lru.remove(*slot.get());
   }
-  statementCache.lru.add(*slot.get());
+  cache.lru.add(*slot.get());
 
   if (slot->isShared()) {
     // Oops, this CachedStatement is currently in-use (presumably by a Cursor).
@@ -60,12 +78,12 @@ jsg::Ref<SqlStorage::Cursor> SqlStorage::exec(
   auto result = jsg::alloc<Cursor>(js, slot.addRef(), kj::mv(bindings));
 
   // If the statement cache grew too big, drop the least-recently-used entry.
-  while (statementCache.totalSize > SQL_STATEMENT_CACHE_MAX_SIZE) {
-    auto& toRemove = *statementCache.lru.begin();
+  while (cache.totalSize > SQL_STATEMENT_CACHE_MAX_SIZE) {
+    auto& toRemove = *cache.lru.begin();
     auto oldQuery = jsg::JsString(toRemove.query.getHandle(js));
-    statementCache.totalSize -= toRemove.statementSize;
-    statementCache.lru.remove(toRemove);
-    KJ_ASSERT(statementCache.map.eraseMatch(oldQuery));
+    cache.totalSize -= toRemove.statementSize;
+    cache.lru.remove(toRemove);
+    KJ_ASSERT(cache.map.eraseMatch(oldQuery));
   }
 
   return result;
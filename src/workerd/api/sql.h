@@ -30,6 +30,12 @@ class SqlStorage final: public jsg::Object, private SqliteDatabase::Regulator {
   using SqlValue = kj::Maybe<kj::OneOf<kj::Array<byte>, kj::StringPtr, double>>;
 
   jsg::Ref<Cursor> exec(jsg::Lock& js, jsg::JsString query, jsg::Arguments<BindingValue> bindings);
+
+  // Like exec(), but runs the query on a separate read-only connection. The query sees the
+  // database as of the last commit before it started -- not including this turn's writes -- and
+  // keeps seeing that snapshot until the cursor is exhausted, without delaying later commits.
+  jsg::Ref<Cursor> execSnapshot(
+      jsg::Lock& js, jsg::JsString query, jsg::Arguments<BindingValue> bindings);
   IngestResult ingest(jsg::Lock& js, kj::String query);
 
   jsg::Ref<Statement> prepare(jsg::Lock& js, jsg::JsString query);
@@ -46,6 +52,8 @@ class SqlStorage final: public jsg::Object, private SqliteDatabase::Regulator {
 
       // 'ingest' functionality is still experimental-only
       JSG_METHOD(ingest);
+
+      JSG_METHOD(execSnapshot);
     }
 
     JSG_READONLY_PROTOTYPE_PROPERTY(databaseSize, getDatabaseSize);
@@ -55,6 +63,7 @@ class SqlStorage final: public jsg::Object, private SqliteDatabase::Regulator {
 
     JSG_TS_OVERRIDE({
       exec<T extends Record<string, SqlStorageValue>>(query: string, ...bindings: any[]): SqlStorageCursor<T>
+      execSnapshot<T extends Record<string, SqlStorageValue>>(query: string, ...bindings: any[]): SqlStorageCursor<T>
     });
   }
 
@@ -134,6 +143,15 @@ class SqlStorage final: public jsg::Object, private SqliteDatabase::Regulator {
   };
   IoOwn<StatementCache> statementCache;
 
+  // Statement cache for the read-only connection used by execSnapshot(), created on first use.
+  kj::Maybe<IoOwn<StatementCache>> snapshotStatementCache;
+
+  jsg::Ref<Cursor> execImpl(jsg::Lock& js,
+      SqliteDatabase& db,
+      StatementCache& cache,
+      jsg::JsString query,
+      jsg::Arguments<BindingValue> bindings);
+
   template <size_t size, typename... Params>
   SqliteDatabase::Query execMemoized(SqliteDatabase& db,
       kj::Maybe<IoOwn<SqliteDatabase::Statement>>& slot,
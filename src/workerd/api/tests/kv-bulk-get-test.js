@@ -0,0 +1,48 @@
+import assert from 'node:assert';
+
+async function populate(env) {
+  await env.KV.put('a', 'apple');
+  await env.KV.put('b', JSON.stringify({ fruit: 'banana' }));
+  await env.KV.put('a,b', 'joined');
+}
+
+export const getArray = {
+  async test(ctrl, env) {
+    await populate(env);
+
+    // Only the worker with the experimental flag gets bulk get(). The other one coerces the array
+    // to a single key, as get() always has.
+    if (globalThis.Cloudflare.compatibilityFlags['experimental']) {
+      const text = await env.KV.get(['a', 'b', 'missing']);
+      assert.ok(text instanceof Map);
+      assert.deepStrictEqual(
+        [...text.entries()],
+        [
+          ['a', 'apple'],
+          ['b', '{"fruit":"banana"}'],
+          ['missing', null],
+        ]
+      );
+
+      const json = await env.KV.get(['b'], 'json');
+      assert.deepStrictEqual(json.get('b'), { fruit: 'banana' });
+
+      await assert.rejects(env.KV.get([]), {
+        name: 'TypeError',
+        message: 'KV GET_BULK requires at least one key.',
+      });
+      await assert.rejects(env.KV.get(['a'], 'arrayBuffer'), { name: 'TypeError' });
+    } else {
+      assert.strictEqual(await env.KV.get(['a', 'b']), 'joined');
+
+      // [null] coerces to the empty string, not to "null".
+      await assert.rejects(env.KV.get([null]), {
+        name: 'TypeError',
+        message: 'Key name cannot be empty.',
+      });
+    }
+
+    // A single key works the same either way.
+    assert.strictEqual(await env.KV.get('a'), 'apple');
+  },
+};
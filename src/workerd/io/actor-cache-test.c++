@@ -210,6 +210,9 @@ struct ActorCacheTestOptions {
   size_t maxKeysPerRpc = 128;
   bool noCache = false;
   bool neverFlush = false;
+  size_t maxFlushBatchesInFlight = 0;
+  size_t maxFlushWordsInFlight = 0;
+  size_t cleanListShards = 1;
 };
 
 struct ActorCacheTest: public ActorCacheConvenienceWrappers {
@@ -233,8 +236,16 @@ struct ActorCacheTest: public ActorCacheConvenienceWrappers {
       : ActorCacheConvenienceWrappers(cache),
         ws(loop),
         mockStorage(kj::mv(mockPair.mock)),
-        lru({options.softLimit, options.hardLimit, options.staleTimeout, options.dirtyListByteLimit,
-          options.maxKeysPerRpc, options.noCache, options.neverFlush}),
+        lru({.softLimit = options.softLimit,
+          .hardLimit = options.hardLimit,
+          .staleTimeout = options.staleTimeout,
+          .dirtyListByteLimit = options.dirtyListByteLimit,
+          .maxKeysPerRpc = options.maxKeysPerRpc,
+          .noCache = options.noCache,
+          .neverFlush = options.neverFlush,
+          .cleanListShards = options.cleanListShards,
+          .maxFlushBatchesInFlight = options.maxFlushBatchesInFlight,
+          .maxFlushWordsInFlight = options.maxFlushWordsInFlight}),
         cache(kj::mv(mockPair.client), lru, gate),
         gateBrokenPromise(options.monitorOutputGate ? eagerlyReportExceptions(gate.onBroken())
                                                     : kj::Promise<void>(kj::READY_NOW)) {}
@@ -3699,6 +3710,34 @@ KJ_TEST("ActorCache LRU purge") {
   (void)expectUncached(test.get("baz"));
 }
 
+KJ_TEST("ActorCache LRU purge sweeps other shards") {
+  ActorCacheTest test({.softLimit = 2 * ENTRY_SIZE, .cleanListShards = 2});
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  // A second cache sharing the same LRU, which will be assigned to the other shard.
+  auto otherPair = MockServer::make<rpc::ActorStorage::Stage>();
+  OutputGate otherGate;
+  ActorCache otherCache(kj::mv(otherPair.client), test.lru, otherGate);
+  ActorCacheConvenienceWrappers other(otherCache);
+
+  test.put("foo", "123");
+  mockStorage->expectCall("put", ws).thenReturn(CAPNP());
+  test.gate.wait().wait(ws);
+  KJ_ASSERT(KJ_ASSERT_NONNULL(expectCached(test.get("foo"))) == "123");
+
+  // The other cache goes over the soft limit with only dirty entries in its own shard, so it has
+  // to evict from ours instead.
+  other.put("bar", "456");
+  other.put("baz", "789");
+  otherPair.mock->expectCall("put", ws).thenReturn(CAPNP());
+  otherGate.wait().wait(ws);
+
+  (void)expectUncached(test.get("foo"));
+  KJ_ASSERT(KJ_ASSERT_NONNULL(expectCached(other.get("bar"))) == "456");
+  KJ_ASSERT(KJ_ASSERT_NONNULL(expectCached(other.get("baz"))) == "789");
+}
+
 KJ_TEST("ActorCache evict on timeout") {
   ActorCacheTest test;
   auto& ws = test.ws;
@@ -4701,6 +4740,142 @@ KJ_TEST("ActorCache transaction multiple put batches") {
   mockTxn->expectDropped(ws);
 }
 
+KJ_TEST("ActorCache flush paces batches when maxFlushBatchesInFlight is set") {
+  ActorCacheTest test({.maxKeysPerRpc = 2, .maxFlushBatchesInFlight = 1});
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  test.put({{"foo", "123"}, {"bar", "456"}, {"baz", "789"}});
+  test.delete_({"qux"_kj, "corge"_kj, "grault"_kj});
+
+  auto mockTxn = mockStorage->expectCall("txn", ws).returnMock("transaction");
+
+  // Only one batch may be outstanding, so each one is held back until the previous one returns.
+  auto firstDelete =
+      mockTxn->expectCall("delete", ws).withParams(CAPNP(keys = [ "qux", "corge" ]));
+  mockTxn->expectNoActivity(ws);
+  kj::mv(firstDelete).thenReturn(CAPNP(numDeleted = 0));
+
+  auto secondDelete = mockTxn->expectCall("delete", ws).withParams(CAPNP(keys = ["grault"]));
+  mockTxn->expectNoActivity(ws);
+  kj::mv(secondDelete).thenReturn(CAPNP(numDeleted = 0));
+
+  auto firstPut = mockTxn->expectCall("put", ws)
+                      .withParams(CAPNP(entries = [ (key = "foo", value = "123"),
+                                                    (key = "bar", value = "456") ]));
+  mockTxn->expectNoActivity(ws);
+
+  // Overwriting a key whose batch hasn't been built yet doesn't change what this flush writes,
+  // since the flush holds onto the original entry.
+  test.put("baz", "999");
+
+  kj::mv(firstPut).thenReturn(CAPNP());
+
+  mockTxn->expectCall("put", ws)
+      .withParams(CAPNP(entries = [(key = "baz", value = "789")]))
+      .thenReturn(CAPNP());
+  mockTxn->expectCall("commit", ws).thenReturn(CAPNP());
+  mockTxn->expectDropped(ws);
+
+  mockStorage->expectCall("put", ws)
+      .withParams(CAPNP(entries = [(key = "baz", value = "999")]))
+      .thenReturn(CAPNP());
+}
+
+KJ_TEST("ActorCache flush paces batches when maxFlushWordsInFlight is set") {
+  // Each of these puts makes a 4-word batch, so two of them fit in the window at once.
+  ActorCacheTest test({.maxKeysPerRpc = 1, .maxFlushWordsInFlight = 8});
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  test.put({{"foo", "123"}, {"bar", "456"}, {"baz", "789"}});
+
+  auto mockTxn = mockStorage->expectCall("txn", ws).returnMock("transaction");
+
+  auto firstPut = mockTxn->expectCall("put", ws)
+                      .withParams(CAPNP(entries = [(key = "foo", value = "123")]));
+  auto secondPut = mockTxn->expectCall("put", ws)
+                       .withParams(CAPNP(entries = [(key = "bar", value = "456")]));
+  mockTxn->expectNoActivity(ws);
+
+  // Returning the first batch makes room for the third.
+  kj::mv(firstPut).thenReturn(CAPNP());
+  auto thirdPut = mockTxn->expectCall("put", ws)
+                      .withParams(CAPNP(entries = [(key = "baz", value = "789")]));
+  mockTxn->expectNoActivity(ws);
+
+  kj::mv(secondPut).thenReturn(CAPNP());
+  kj::mv(thirdPut).thenReturn(CAPNP());
+  mockTxn->expectCall("commit", ws).thenReturn(CAPNP());
+  mockTxn->expectDropped(ws);
+}
+
+KJ_TEST("ActorCache flush sends a batch larger than maxFlushWordsInFlight on its own") {
+  ActorCacheTest test({.maxKeysPerRpc = 1, .maxFlushWordsInFlight = 2});
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  test.put({{"foo", "123"}, {"bar", "456"}});
+
+  auto mockTxn = mockStorage->expectCall("txn", ws).returnMock("transaction");
+
+  // Neither 4-word batch fits in the window, but each is sent once it has the window to itself.
+  auto firstPut = mockTxn->expectCall("put", ws)
+                      .withParams(CAPNP(entries = [(key = "foo", value = "123")]));
+  mockTxn->expectNoActivity(ws);
+  kj::mv(firstPut).thenReturn(CAPNP());
+
+  mockTxn->expectCall("put", ws)
+      .withParams(CAPNP(entries = [(key = "bar", value = "456")]))
+      .thenReturn(CAPNP());
+  mockTxn->expectCall("commit", ws).thenReturn(CAPNP());
+  mockTxn->expectDropped(ws);
+}
+
+KJ_TEST("ActorCache flush deletes a deferred alarm as it was when the flush started") {
+  ActorCacheTest test({.maxKeysPerRpc = 1, .maxFlushBatchesInFlight = 1});
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  auto oneMs = 1 * kj::MILLISECONDS + kj::UNIX_EPOCH;
+  auto twoMs = 2 * kj::MILLISECONDS + kj::UNIX_EPOCH;
+
+  test.setAlarm(oneMs);
+  mockStorage->expectCall("setAlarm", ws)
+      .withParams(CAPNP(scheduledTimeMs = 1))
+      .thenReturn(CAPNP());
+
+  // The alarm handler writes some keys, and its alarm is deleted when the handle is dropped.
+  {
+    auto armResult = test.cache.armAlarmHandler(oneMs, false);
+    KJ_ASSERT(armResult.is<ActorCache::RunAlarmHandler>());
+    test.put({{"foo", "123"}, {"bar", "456"}});
+  }
+
+  auto mockTxn = mockStorage->expectCall("txn", ws).returnMock("transaction");
+  auto firstPut = mockTxn->expectCall("put", ws)
+                      .withParams(CAPNP(entries = [(key = "foo", value = "123")]));
+  mockTxn->expectNoActivity(ws);
+
+  // A new alarm is set while the flush waits for room to send its next batch. The flush must
+  // still delete the old alarm only if it's unchanged, rather than delete whatever alarm is set.
+  test.setAlarm(twoMs);
+
+  kj::mv(firstPut).thenReturn(CAPNP());
+  mockTxn->expectCall("put", ws)
+      .withParams(CAPNP(entries = [(key = "bar", value = "456")]))
+      .thenReturn(CAPNP());
+  mockTxn->expectCall("deleteAlarm", ws)
+      .withParams(CAPNP(timeToDeleteMs = 1))
+      .thenReturn(CAPNP(deleted = true));
+  mockTxn->expectCall("commit", ws).thenReturn(CAPNP());
+  mockTxn->expectDropped(ws);
+
+  mockStorage->expectCall("setAlarm", ws)
+      .withParams(CAPNP(scheduledTimeMs = 2))
+      .thenReturn(CAPNP());
+}
+
 KJ_TEST("ActorCache transaction multiple counted delete batches") {
   // Do a transaction with a big counted delete. The rpc getMultiple and delete should batch
   // according to maxKeysPerRpc.
@@ -5476,5 +5651,41 @@ KJ_TEST("ActorCache can shutdown") {
   });
 }
 
+KJ_TEST("ActorCache countRange() pages through large ranges") {
+  ActorCacheTest test;
+  auto& ws = test.ws;
+  auto& mockStorage = test.mockStorage;
+
+  // One more key than fits in a page. Keys are "k10000" through "k11024", six bytes each.
+  constexpr uint keyCount = ActorCacheOps::RANGE_PAGE_SIZE + 1;
+  kj::Vector<kj::String> entries;
+  for (uint i: kj::zeroTo(keyCount)) {
+    entries.add(kj::str("(key = \"k", 10000 + i, "\", value = \"v\")"));
+  }
+  auto values = kj::str("(list = [", kj::strArray(entries, ", "), "])");
+
+  {
+    auto promise = expectUncached(test.list(nullptr, nullptr));
+
+    mockStorage->expectCall("list", ws)
+        .withParams(CAPNP(), "stream"_kj)
+        .useCallback("stream", [&](MockClient stream) {
+      stream.call("values", values).expectReturns(CAPNP(), ws);
+      stream.call("end", CAPNP()).expectReturns(CAPNP(), ws);
+    }).expectCanceled();
+
+    KJ_ASSERT(promise.wait(ws).size() == keyCount);
+  }
+
+  // The whole range is cached, so every page is served synchronously.
+  auto all = expectCached(test.cache.countRange(kj::str(""), kj::none, {}));
+  KJ_EXPECT(all.count == keyCount);
+  KJ_EXPECT(all.keyBytes == keyCount * 6);
+
+  auto some = expectCached(test.cache.countRange(kj::str("k10500"), kj::str("k10600"), {}));
+  KJ_EXPECT(some.count == 100);
+  KJ_EXPECT(some.keyBytes == 600);
+}
+
 }  // namespace
 }  // namespace workerd
@@ -45,14 +45,15 @@ ActorCache::ActorCache(
     rpc::ActorStorage::Stage::Client storage, const SharedLru& lru, OutputGate& gate, Hooks& hooks)
     : storage(kj::mv(storage)),
       lru(lru),
+      cleanList(lru.assignShard()),
       gate(gate),
       hooks(hooks),
       clock(kj::systemPreciseMonotonicClock()),
-      currentValues(lru.cleanList.lockExclusive()) {}
+      currentValues(cleanList.lockExclusive()) {}
 
 ActorCache::~ActorCache() noexcept(false) {
   // Need to remove all entries from any lists they might be in.
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = cleanList.lockExclusive();
   clear(lock);
 }
 
@@ -127,11 +128,15 @@ ActorCache::Entry::~Entry() noexcept(false) {
   }
 }
 
-ActorCache::SharedLru::SharedLru(Options options): options(options) {}
+ActorCache::SharedLru::SharedLru(Options options)
+    : options(options),
+      cleanListShards(kj::heapArray<CleanList>(kj::max(options.cleanListShards, size_t(1)))) {}
 
 ActorCache::SharedLru::~SharedLru() noexcept(false) {
-  KJ_REQUIRE(cleanList.getWithoutLock().empty(),
-      "ActorCache::SharedLru destroyed while an ActorCache still exists?");
+  for (auto& shard: cleanListShards) {
+    KJ_REQUIRE(shard.getWithoutLock().empty(),
+        "ActorCache::SharedLru destroyed while an ActorCache still exists?");
+  }
   if (size.load(std::memory_order_relaxed) != 0) {
     KJ_LOG(ERROR,
         "SharedLru destroyed while cache entries still exist, "
@@ -146,14 +151,18 @@ kj::Maybe<kj::Promise<void>> ActorCache::evictStale(kj::Date now) {
   if (nowNs >= oldValue) {
     int64_t newValue = nowNs + lru.options.staleTimeout / kj::NANOSECONDS;
     if (lru.nextStaleCheckNs.compare_exchange_strong(oldValue, newValue)) {
-      auto lock = lru.cleanList.lockExclusive();
-      for (auto& entry: *lock) {
-        if (entry.isStale) {
-          auto& cache = KJ_ASSERT_NONNULL(entry.maybeCache);
-          cache.removeEntry(lock, entry);
-          cache.evictEntry(lock, entry);
-        } else {
-          entry.isStale = true;
+      // Sweep every shard, not just our own, since only one cache wins the race to do the check.
+      // We only ever hold one shard lock at a time here.
+      for (auto& shard: lru.cleanListShards) {
+        auto lock = shard.lockExclusive();
+        for (auto& entry: *lock) {
+          if (entry.isStale) {
+            auto& cache = KJ_ASSERT_NONNULL(entry.maybeCache);
+            cache.removeEntry(lock, entry);
+            cache.evictEntry(lock, entry);
+          } else {
+            entry.isStale = true;
+          }
         }
       }
     }
@@ -280,18 +289,72 @@ void ActorCache::evictOrOomIfNeeded(Lock& lock) {
   }
 }
 
+const ActorCache::SharedLru::CleanList& ActorCache::SharedLru::assignShard() const {
+  uint n = nextShard.fetch_add(1, std::memory_order_relaxed);
+  return cleanListShards[n % cleanListShards.size()];
+}
+
 bool ActorCache::SharedLru::evictIfNeeded(Lock& lock) const {
+  if (evictFromShard(lock)) {
+    return false;
+  }
+
+  // Our own shard has run out of clean entries but we're still over the soft limit, so evict
+  // from the others. We already hold our own shard's lock, and another cache doing the same
+  // thing could be holding the lock we want while waiting on ours, so we must not block here.
+  // Shards that are busy are skipped for now.
+  size_t ownIndex = 0;
+  kj::Vector<size_t> busyShards;
+  for (auto i: kj::indices(cleanListShards)) {
+    auto& shard = cleanListShards[i];
+    if (&shard.getWithoutLock() == lock.get()) {
+      ownIndex = i;
+      continue;
+    }
+    KJ_IF_SOME(otherLock, shard.lockExclusiveWithTimeout(0 * kj::NANOSECONDS)) {
+      if (evictFromShard(otherLock)) {
+        return false;
+      }
+    } else {
+      busyShards.add(i);
+    }
+  }
+
+  if (size.load(std::memory_order_relaxed) > options.hardLimit) {
+    // Before failing the operation, wait for the busy shards and evict from them too. Blocking
+    // while holding our own shard is safe for shards after ours: this is the only place that
+    // holds two shard locks at once, and it only ever blocks on a later shard. A shard before
+    // ours may be held by a cache that is blocked on ours here, so we only wait a bounded time.
+    for (auto i: busyShards) {
+      auto& shard = cleanListShards[i];
+      kj::Maybe<Lock> otherLock;
+      if (i > ownIndex) {
+        otherLock = shard.lockExclusive();
+      } else {
+        otherLock = shard.lockExclusiveWithTimeout(EARLIER_SHARD_LOCK_TIMEOUT);
+      }
+      KJ_IF_SOME(l, otherLock) {
+        if (evictFromShard(l)) {
+          return false;
+        }
+      }
+    }
+  }
+
+  // Nothing left to evict.
+  return size.load(std::memory_order_relaxed) > options.hardLimit;
+}
+
+bool ActorCache::SharedLru::evictFromShard(Lock& lock) const {
   for (;;) {
-    size_t current = size.load(std::memory_order_relaxed);
-    if (current <= options.softLimit) {
+    if (size.load(std::memory_order_relaxed) <= options.softLimit) {
       // All good.
-      return false;
+      return true;
     }
 
     // We're over the limit, let's evict stuff.
     if (lock->empty()) {
-      // Nothing to evict.
-      return current > options.hardLimit;
+      return false;
     }
 
     Entry& entry = lock->front();
@@ -362,7 +425,7 @@ void ActorCache::evictEntry(Lock& lock, Entry& entry) {
 }
 
 void ActorCache::verifyConsistencyForTest() {
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = cleanList.lockExclusive();
   currentValues.get(lock).verify();  // verify the table's BTreeIndex
   bool prevGapIsKnownEmpty = false;
   kj::Maybe<kj::StringPtr> prevKey = kj::none;
@@ -406,7 +469,7 @@ kj::OneOf<kj::Maybe<ActorCache::Value>, kj::Promise<kj::Maybe<ActorCache::Value>
   options.noCache = options.noCache || lru.options.noCache;
   requireNotTerminal();
 
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = cleanList.lockExclusive();
   auto entry = findInCache(lock, kj::mv(key), options);
   switch (entry->getValueStatus()) {
     case EntryValueStatus::PRESENT:
@@ -432,7 +495,7 @@ auto ActorCache::getImpl(
   if (response.hasValue()) {
     value = response.getValue();
   }
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = cleanList.lockExclusive();
   auto newEntry = addReadResultToCache(lock, cloneKey(entry->key), value, options);
   evictOrOomIfNeeded(lock);
   co_return newEntry->getValue();
@@ -459,7 +522,7 @@ class ActorCache::GetMultiStreamImpl final: public rpc::ActorStorage::ListStream
       return KJ_EXCEPTION(DISCONNECTED, "canceled");
     }
 
-    auto lock = cache.lru.cleanList.lockExclusive();
+    auto lock = cache.cleanList.lockExclusive();
     auto params = context.getParams();
     kj::String prevKey;
     for (auto kv: params.getList()) {
@@ -509,7 +572,7 @@ class ActorCache::GetMultiStreamImpl final: public rpc::ActorStorage::ListStream
 
     if (nextExpectedKey < keysToFetch.end()) {
       // Some trailing keys weren't seen, better mark them as not present.
-      auto lock = cache.lru.cleanList.lockExclusive();
+      auto lock = cache.cleanList.lockExclusive();
       while (nextExpectedKey < keysToFetch.end()) {
         cache.addReadResultToCache(lock, kj::mv(*nextExpectedKey++), kj::none, options);
       }
@@ -582,7 +645,7 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>> Act
   capnp::MessageSize sizeHint{4, 1};
 
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = cleanList.lockExclusive();
     for (auto& key: keys) {
       auto entry = findInCache(lock, key, options);
       switch (entry->getValueStatus()) {
@@ -770,7 +833,7 @@ class ActorCache::ForwardListStreamImpl final: public rpc::ActorStorage::ListStr
     }
 
     {
-      auto lock = cache.lru.cleanList.lockExclusive();
+      auto lock = cache.cleanList.lockExclusive();
       auto list = context.getParams().getList();
 
       bool insertedAny = false;
@@ -828,7 +891,7 @@ class ActorCache::ForwardListStreamImpl final: public rpc::ActorStorage::ListStr
 
     // Mark the rest of the range as empty.
     {
-      auto lock = cache.lru.cleanList.lockExclusive();
+      auto lock = cache.cleanList.lockExclusive();
 
       if (!beginKeyIsKnown) {
         // We received no results at all, so the start of the list is definitely not in storage.
@@ -935,7 +998,7 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>> Act
   // negative entries in the range, since each of those negative entries could potentially negate a
   // positive entry read from disk.
 
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = cleanList.lockExclusive();
   auto& map = currentValues.get(lock);
   auto ordered = map.ordered();
 
@@ -1148,7 +1211,7 @@ class ActorCache::ReverseListStreamImpl final: public rpc::ActorStorage::ListStr
     }
 
     {
-      auto lock = cache.lru.cleanList.lockExclusive();
+      auto lock = cache.cleanList.lockExclusive();
       auto list = context.getParams().getList();
 
       bool insertedAny = false;
@@ -1196,7 +1259,7 @@ class ActorCache::ReverseListStreamImpl final: public rpc::ActorStorage::ListStr
 
     // Mark the rest of the range as empty.
     {
-      auto lock = cache.lru.cleanList.lockExclusive();
+      auto lock = cache.cleanList.lockExclusive();
 
       if (fetchedEntries.size() < adjustedLimit.orDefault(kj::maxValue)) {
         // We didn't reach the limit, so the rest of the range must be empty.
@@ -1283,7 +1346,7 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>> Act
   // negative entries in the range, since each of those negative entries could potentially negate a
   // positive entry read from disk.
 
-  auto lock = lru.cleanList.lockExclusive();
+  auto lock = cleanList.lockExclusive();
   auto& map = currentValues.get(lock);
   auto ordered = map.ordered();
 
@@ -1855,7 +1918,7 @@ kj::Maybe<kj::Promise<void>> ActorCache::put(Key key, Value value, WriteOptions
   options.noCache = options.noCache || lru.options.noCache;
   requireNotTerminal();
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = cleanList.lockExclusive();
     kj::Maybe<CountedDelete> maybeCountedDelete;
     auto entry = kj::atomicRefcounted<Entry>(*this, kj::mv(key), kj::mv(value));
     putImpl(lock, kj::mv(entry), options, maybeCountedDelete);
@@ -1874,7 +1937,7 @@ kj::Maybe<kj::Promise<void>> ActorCache::put(kj::Array<KeyValuePair> pairs, Writ
   options.noCache = options.noCache || lru.options.noCache;
   requireNotTerminal();
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = cleanList.lockExclusive();
     for (auto& pair: pairs) {
       kj::Maybe<CountedDelete> maybeCountedDelete;
       auto entry = kj::atomicRefcounted<Entry>(*this, kj::mv(pair.key), kj::mv(pair.value));
@@ -1934,7 +1997,7 @@ kj::OneOf<bool, kj::Promise<bool>> ActorCache::delete_(Key key, WriteOptions opt
 
   auto countedDelete = kj::refcounted<CountedDelete>();
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = cleanList.lockExclusive();
     auto entry = kj::atomicRefcounted<Entry>(*this, kj::mv(key), EntryValueStatus::ABSENT);
     putImpl(lock, kj::mv(entry), options, *countedDelete);
     evictOrOomIfNeeded(lock);
@@ -1962,7 +2025,7 @@ kj::OneOf<uint, kj::Promise<uint>> ActorCache::delete_(kj::Array<Key> keys, Writ
 
   auto countedDelete = kj::refcounted<CountedDelete>();
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = cleanList.lockExclusive();
     for (auto& key: keys) {
       auto entry = kj::atomicRefcounted<Entry>(*this, kj::mv(key), EntryValueStatus::ABSENT);
       putImpl(lock, kj::mv(entry), options, *countedDelete);
@@ -2001,7 +2064,7 @@ ActorCache::DeleteAllResults ActorCache::deleteAll(WriteOptions options) {
   kj::Promise<uint> result{(uint)0};
 
   {
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = cleanList.lockExclusive();
     auto& map = currentValues.get(lock);
 
     kj::Vector<kj::Own<Entry>> deletedDirty;
@@ -2289,6 +2352,71 @@ using RpcPutRequest = capnp::Request<rpc::ActorStorage::Operations::PutParams,
 
 using RpcDeleteRequest = capnp::Request<rpc::ActorStorage::Operations::DeleteParams,
     rpc::ActorStorage::Operations::DeleteResults>;
+
+// Tracks the put and delete batches of a flush transaction that have been sent but not yet
+// acknowledged, enforcing ActorCacheSharedLruOptions::maxFlushBatchesInFlight and
+// maxFlushWordsInFlight. With both limits set to zero, every batch has room immediately and this
+// just collects the promises to be joined.
+class FlushWindow {
+ public:
+  FlushWindow(size_t maxBatches, size_t maxWords): maxBatches(maxBatches), maxWords(maxWords) {}
+
+  // Returns kj::none if a batch of `words` size may be sent right away. Otherwise, returns a
+  // promise which resolves once enough of the earlier batches have completed.
+  kj::Maybe<kj::Promise<void>> waitForRoom(size_t words) {
+    if (hasRoom(words)) {
+      return kj::none;
+    }
+    return waitForRoomImpl(words);
+  }
+
+  void add(kj::Promise<void> promise, size_t words) {
+    inFlight.add(InFlightBatch{.promise = kj::mv(promise), .words = words});
+    wordsInFlight += words;
+  }
+
+  // Waits for all batches still in flight.
+  kj::Promise<void> drain() {
+    auto promises = KJ_MAP(batch, inFlight.slice(head, inFlight.size())) {
+      return kj::mv(batch.promise);
+    };
+    head = inFlight.size();
+    wordsInFlight = 0;
+    return kj::joinPromises(kj::mv(promises));
+  }
+
+ private:
+  struct InFlightBatch {
+    kj::Promise<void> promise;
+    size_t words;
+  };
+
+  size_t maxBatches;
+  size_t maxWords;
+  kj::Vector<InFlightBatch> inFlight;
+  size_t head = 0;
+  size_t wordsInFlight = 0;
+
+  bool hasRoom(size_t words) const {
+    size_t count = inFlight.size() - head;
+    if (count == 0) {
+      // Always let at least one batch through, even if it alone exceeds the word limit.
+      return true;
+    }
+    return (maxBatches == 0 || count < maxBatches) &&
+        (maxWords == 0 || wordsInFlight + words <= maxWords);
+  }
+
+  kj::Promise<void> waitForRoomImpl(size_t words) {
+    // Batches are awaited in the order they were sent. They'll typically complete in that order
+    // anyway since they're all part of the same transaction on the same connection.
+    while (!hasRoom(words)) {
+      auto batch = kj::mv(inFlight[head++]);
+      wordsInFlight -= batch.words;
+      co_await batch.promise;
+    }
+  }
+};
 }  // namespace
 
 kj::Promise<void> ActorCache::startFlushTransaction() {
@@ -2303,7 +2431,7 @@ kj::Promise<void> ActorCache::startFlushTransaction() {
   // Perhaps this would be possible to fix by adding more complex logic. But, it doesn't seem
   // like a big deal to require all flushes to be complete flushes.
 
-  // We don't take a lock on `lru.cleanList` here, because we don't need it. We only access
+  // We don't take a lock on `cleanList` here, because we don't need it. We only access
   // `dirtyList`, which is only ever accessed within the actor's thread, so it's safe. We know
   // that `SharedLru` will only ever mess with CLEAN entries, which we don't look at here.
 
@@ -2324,11 +2452,13 @@ kj::Promise<void> ActorCache::startFlushTransaction() {
   // muted deletes, we go ahead and construct batches of no more than 128 keys. They all end up
   // being part of the same transaction in the end, though.
   //
-  // TODO(perf): Currently we send all the batches at the same time. If the batches are large,
-  //   it could be worth spacing them out a bit so we don't saturate the connection. However, we
-  //   still need to make sure that the whole transaction represents a consistent snapshot in time,
-  //   so getting this right, without making a copy of everything upfront, could get complicated.
-  //   Punting for now.
+  // By default we send all the batches at the same time. If the batches are large, this can
+  // saturate the connection, so `maxFlushBatchesInFlight` and `maxFlushWordsInFlight` can be used
+  // to space them out (see flushImplUsingTxn()). The whole transaction must still represent a
+  // consistent snapshot in time, but we don't need to copy anything upfront to achieve that:
+  // flushImplUsingTxn() holds strong references to the entries being flushed, and entries are
+  // immutable once created (an overwrite replaces the entry rather than modifying it), so batches
+  // built later still see the values as they were when the flush started.
 
   PutFlush putFlush;
   MutedDeleteFlush mutedDeleteFlush;
@@ -2575,7 +2705,7 @@ kj::Promise<void> ActorCache::flushImpl(uint retryCount) {
       return flushImplDeleteAll();
     }
 
-    auto lock = lru.cleanList.lockExclusive();
+    auto lock = cleanList.lockExclusive();
 
     KJ_IF_SOME(r, requestedDeleteAll) {
       // It would appear that all dirty entries were moved into `requestedDeleteAll` during the
@@ -2798,6 +2928,19 @@ kj::Promise<void> ActorCache::flushImplUsingTxn(PutFlush putFlush,
     MutedDeleteFlush mutedDeleteFlush,
     CountedDeleteFlushes countedDeleteFlushes,
     MaybeAlarmChange maybeAlarmChange) {
+  // Take note of any deferred alarm delete now, before the first suspension below: while we wait
+  // for room in the flush window, `currentAlarmTime` can move on (e.g. because of a setAlarm() or
+  // a finished alarm run), but the alarm change in this flush was decided by the state as it is
+  // now. `deferredDeleteTime` is set only if the deferred delete is FLUSHING.
+  bool isDeferredDelete = false;
+  kj::Maybe<kj::Date> deferredDeleteTime;
+  KJ_IF_SOME(deferredDelete, currentAlarmTime.tryGet<DeferredAlarmDelete>()) {
+    isDeferredDelete = true;
+    if (deferredDelete.status == DeferredAlarmDelete::Status::FLUSHING) {
+      deferredDeleteTime = deferredDelete.timeToDelete;
+    }
+  }
+
   auto txnProm = storage.txnRequest(capnp::MessageSize{4, 0}).send();
   auto txn = txnProm.getTransaction();
 
@@ -2806,8 +2949,6 @@ kj::Promise<void> ActorCache::flushImplUsingTxn(PutFlush putFlush,
     kj::Array<RpcDeleteRequest> rpcDeletes;
   };
   auto rpcCountedDeletes = kj::heapArrayBuilder<RpcCountedDelete>(countedDeleteFlushes.size());
-  auto rpcMutedDeletes = kj::heapArrayBuilder<RpcDeleteRequest>(mutedDeleteFlush.batches.size());
-  auto rpcPuts = kj::heapArrayBuilder<RpcPutRequest>(putFlush.batches.size());
 
   for (auto& flush: countedDeleteFlushes) {
     auto countedDelete = kj::mv(flush.countedDelete);
@@ -2834,46 +2975,6 @@ kj::Promise<void> ActorCache::flushImplUsingTxn(PutFlush putFlush,
   }
   countedDeleteFlushes = nullptr;
 
-  {
-    auto entryIt = mutedDeleteFlush.entries.begin();
-    for (auto& batch: mutedDeleteFlush.batches) {
-      KJ_ASSERT(batch.wordCount < MAX_ACTOR_STORAGE_RPC_WORDS);
-
-      auto request = txn.deleteRequest(capnp::MessageSize{4 + batch.wordCount, 0});
-      auto listBuilder = request.initKeys(batch.pairCount);
-      for (size_t i = 0; i < batch.pairCount; ++i) {
-        KJ_ASSERT(entryIt != mutedDeleteFlush.entries.end());
-        auto& entry = **(entryIt++);
-        listBuilder.set(i, entry.key.asBytes());
-      }
-      rpcMutedDeletes.add(kj::mv(request));
-    }
-    KJ_ASSERT(entryIt == mutedDeleteFlush.entries.end());
-  }
-  mutedDeleteFlush.entries.clear();
-  mutedDeleteFlush.batches.clear();
-
-  {
-    auto entryIt = putFlush.entries.begin();
-    for (auto& batch: putFlush.batches) {
-      KJ_ASSERT(batch.wordCount < MAX_ACTOR_STORAGE_RPC_WORDS);
-
-      auto request = txn.putRequest(capnp::MessageSize{4 + batch.wordCount, 0});
-      auto listBuilder = request.initEntries(batch.pairCount);
-      for (auto kv: listBuilder) {
-        KJ_ASSERT(entryIt != putFlush.entries.end());
-        auto& entry = **(entryIt++);
-        auto v = KJ_ASSERT_NONNULL(entry.getValuePtr());
-        kv.setKey(entry.key.asBytes());
-        kv.setValue(v);
-      }
-      rpcPuts.add(kj::mv(request));
-    }
-    KJ_ASSERT(entryIt == putFlush.entries.end());
-  }
-  putFlush.entries.clear();
-  putFlush.batches.clear();
-
   // Send all the RPCs. It's important that counted deletes are sent first since they can overlap
   // with puts. Specifically this can happen if someone does a delete() immediately followed by a
   // put() on the same key. These two writes may have been coalesced into a single flush.
@@ -2881,9 +2982,10 @@ kj::Promise<void> ActorCache::flushImplUsingTxn(PutFlush putFlush,
   // a delete, followed by a put, in the same transaction.
   // The constant extra 2 promises are those added outside of the rpc batches, currently one
   // to work around a bug in capnp::autoreconnect, and one to actually commit the flush txn
-  // A 3rd promise may be added to write the alarm time if necessary.
-  auto promises = kj::heapArrayBuilder<kj::Promise<void>>(rpcPuts.size() + rpcMutedDeletes.size() +
-      rpcCountedDeletes.size() + 2 + !maybeAlarmChange.is<CleanAlarm>());
+  // A 3rd promise may be added to write the alarm time if necessary. The last one joins the muted
+  // delete and put batches tracked by `window`.
+  auto promises = kj::heapArrayBuilder<kj::Promise<void>>(
+      rpcCountedDeletes.size() + 3 + !maybeAlarmChange.is<CleanAlarm>());
 
   auto joinCountedDelete = [](RpcCountedDelete& rpcCountedDelete) -> kj::Promise<void> {
     auto promises = KJ_MAP(request, rpcCountedDelete.rpcDeletes) {
@@ -2914,13 +3016,60 @@ kj::Promise<void> ActorCache::flushImplUsingTxn(PutFlush putFlush,
     promises.add(joinCountedDelete(rpcCountedDelete));
   }
 
-  for (auto& request: rpcMutedDeletes) {
-    promises.add(request.send().ignoreResult());
+  // Muted deletes and puts are built just before they're sent, so that when the window is limited
+  // we don't hold more than a window's worth of serialized batches at once. Counted deletes are
+  // excluded from the window: they must all be sent before any puts anyway.
+  FlushWindow window(lru.options.maxFlushBatchesInFlight, lru.options.maxFlushWordsInFlight);
+
+  {
+    auto entryIt = mutedDeleteFlush.entries.begin();
+    for (auto& batch: mutedDeleteFlush.batches) {
+      KJ_ASSERT(batch.wordCount < MAX_ACTOR_STORAGE_RPC_WORDS);
+
+      KJ_IF_SOME(promise, window.waitForRoom(batch.wordCount)) {
+        co_await promise;
+      }
+
+      auto request = txn.deleteRequest(capnp::MessageSize{4 + batch.wordCount, 0});
+      auto listBuilder = request.initKeys(batch.pairCount);
+      for (size_t i = 0; i < batch.pairCount; ++i) {
+        KJ_ASSERT(entryIt != mutedDeleteFlush.entries.end());
+        auto& entry = **(entryIt++);
+        listBuilder.set(i, entry.key.asBytes());
+      }
+      window.add(request.send().ignoreResult(), batch.wordCount);
+    }
+    KJ_ASSERT(entryIt == mutedDeleteFlush.entries.end());
   }
+  mutedDeleteFlush.entries.clear();
+  mutedDeleteFlush.batches.clear();
+
+  {
+    auto entryIt = putFlush.entries.begin();
+    for (auto& batch: putFlush.batches) {
+      KJ_ASSERT(batch.wordCount < MAX_ACTOR_STORAGE_RPC_WORDS);
 
-  for (auto& request: rpcPuts) {
-    promises.add(request.send().ignoreResult());
+      KJ_IF_SOME(promise, window.waitForRoom(batch.wordCount)) {
+        co_await promise;
+      }
+
+      auto request = txn.putRequest(capnp::MessageSize{4 + batch.wordCount, 0});
+      auto listBuilder = request.initEntries(batch.pairCount);
+      for (auto kv: listBuilder) {
+        KJ_ASSERT(entryIt != putFlush.entries.end());
+        auto& entry = **(entryIt++);
+        auto v = KJ_ASSERT_NONNULL(entry.getValuePtr());
+        kv.setKey(entry.key.asBytes());
+        kv.setValue(v);
+      }
+      window.add(request.send().ignoreResult(), batch.wordCount);
+    }
+    KJ_ASSERT(entryIt == putFlush.entries.end());
   }
+  putFlush.entries.clear();
+  putFlush.batches.clear();
+
+  promises.add(window.drain());
 
   KJ_SWITCH_ONEOF(maybeAlarmChange) {
     KJ_CASE_ONEOF(dirty, DirtyAlarm) {
@@ -2930,10 +3079,9 @@ kj::Promise<void> ActorCache::flushImplUsingTxn(PutFlush putFlush,
         promises.add(req.send().ignoreResult());
       } else {
         auto req = txn.deleteAlarmRequest();
-        KJ_IF_SOME(deferredDelete, currentAlarmTime.tryGet<DeferredAlarmDelete>()) {
-          if (deferredDelete.status == DeferredAlarmDelete::Status::FLUSHING) {
-            req.setTimeToDeleteMs(
-                (deferredDelete.timeToDelete - kj::UNIX_EPOCH) / kj::MILLISECONDS);
+        if (isDeferredDelete) {
+          KJ_IF_SOME(timeToDelete, deferredDeleteTime) {
+            req.setTimeToDeleteMs((timeToDelete - kj::UNIX_EPOCH) / kj::MILLISECONDS);
             auto prom = req.send().then([this](auto response) {
               KJ_IF_SOME(deferredDelete, currentAlarmTime.tryGet<DeferredAlarmDelete>()) {
                 if (deferredDelete.status == DeferredAlarmDelete::Status::FLUSHING) {
@@ -3008,7 +3156,7 @@ kj::Promise<void> ActorCache::flushImplDeleteAll(uint retryCount) {
     requestedDeleteAll = kj::none;
 
     {
-      auto lock = lru.cleanList.lockExclusive();
+      auto lock = cleanList.lockExclusive();
       evictOrOomIfNeeded(lock);
     }
 
@@ -3049,7 +3197,7 @@ ActorCache::Transaction::~Transaction() noexcept(false) {
 
 kj::Maybe<kj::Promise<void>> ActorCache::Transaction::commit() {
   {
-    auto lock = cache.lru.cleanList.lockExclusive();
+    auto lock = cache.cleanList.lockExclusive();
     for (auto& change: entriesToWrite) {
       cache.putImpl(lock, kj::mv(change.entry), change.options, kj::none);
     }
@@ -3195,7 +3343,7 @@ kj::OneOf<ActorCache::GetResultList, kj::Promise<ActorCache::GetResultList>> Act
 kj::Maybe<kj::Promise<void>> ActorCache::Transaction::put(
     Key key, Value value, WriteOptions options) {
   options.noCache = options.noCache || cache.lru.options.noCache;
-  auto lock = cache.lru.cleanList.lockExclusive();
+  auto lock = cache.cleanList.lockExclusive();
   auto entry = kj::atomicRefcounted<Entry>(cache, kj::mv(key), kj::mv(value));
   putImpl(lock, kj::mv(entry), options);
 
@@ -3206,7 +3354,7 @@ kj::Maybe<kj::Promise<void>> ActorCache::Transaction::put(
 kj::Maybe<kj::Promise<void>> ActorCache::Transaction::put(
     kj::Array<KeyValuePair> pairs, WriteOptions options) {
   options.noCache = options.noCache || cache.lru.options.noCache;
-  auto lock = cache.lru.cleanList.lockExclusive();
+  auto lock = cache.cleanList.lockExclusive();
 
   for (auto& pair: pairs) {
     auto entry = kj::atomicRefcounted<Entry>(cache, kj::mv(pair.key), kj::mv(pair.value));
@@ -3232,7 +3380,7 @@ kj::OneOf<bool, kj::Promise<bool>> ActorCache::Transaction::delete_(Key key, Wri
   kj::Maybe<KeyPtr> keyToCount;
 
   {
-    auto lock = cache.lru.cleanList.lockExclusive();
+    auto lock = cache.cleanList.lockExclusive();
     auto entry = kj::atomicRefcounted<Entry>(cache, kj::mv(key), EntryValueStatus::ABSENT);
     keyToCount = putImpl(lock, kj::mv(entry), options, count);
   }
@@ -3267,7 +3415,7 @@ kj::OneOf<uint, kj::Promise<uint>> ActorCache::Transaction::delete_(
   auto currentBatch = startNewBatch();
 
   {
-    auto lock = cache.lru.cleanList.lockExclusive();
+    auto lock = cache.cleanList.lockExclusive();
     for (auto& key: keys) {
       auto entry = kj::atomicRefcounted<Entry>(cache, kj::mv(key), EntryValueStatus::ABSENT);
       KJ_IF_SOME(keyToCount, putImpl(lock, kj::mv(entry), options, count)) {
@@ -3339,4 +3487,151 @@ kj::Maybe<ActorCache::KeyPtr> ActorCache::Transaction::putImpl(
     return KeyPtr(slot.entry->key);
   }
 }
+
+// =======================================================================================
+// ActorCacheOps default range operations
+
+namespace {
+
+using GetResultList = ActorCacheOps::GetResultList;
+using Key = ActorCacheOps::Key;
+
+template <typename T>
+kj::Promise<T> toPromise(kj::OneOf<T, kj::Promise<T>> result) {
+  KJ_SWITCH_ONEOF(result) {
+    KJ_CASE_ONEOF(value, T) {
+      return kj::mv(value);
+    }
+    KJ_CASE_ONEOF(promise, kj::Promise<T>) {
+      return kj::mv(promise);
+    }
+  }
+  KJ_UNREACHABLE;
+}
+
+kj::Maybe<Key> cloneKey(const kj::Maybe<Key>& key) {
+  return key.map([](const Key& k) { return kj::str(k); });
+}
+
+// Returns where the page after `page` starts, or null if `page` is the last one. The next page
+// starts at the successor of the last key listed, which is that key with a zero byte appended.
+kj::Maybe<Key> nextPageStart(const GetResultList& page) {
+  if (page.size() < ActorCacheOps::RANGE_PAGE_SIZE) {
+    return kj::none;
+  }
+  ActorCacheOps::KeyPtr lastKey;
+  for (auto entry: page) {
+    lastKey = entry.key;
+  }
+  return kj::str(lastKey, '\0');
+}
+
+kj::Array<Key> pageKeys(const GetResultList& page) {
+  auto keys = kj::heapArrayBuilder<Key>(page.size());
+  for (auto entry: page) {
+    keys.add(kj::str(entry.key));
+  }
+  return keys.finish();
+}
+
+void addToCount(ActorCacheOps::RangeCount& count, const GetResultList& page) {
+  for (auto entry: page) {
+    ++count.count;
+    count.keyBytes += entry.key.size();
+  }
+}
+
+kj::Promise<uint> deleteRangePages(ActorCacheOps& ops,
+    kj::Promise<GetResultList> page,
+    kj::Maybe<Key> end,
+    ActorCacheOps::WriteOptions options,
+    uint total) {
+  for (;;) {
+    auto results = co_await page;
+    auto next = nextPageStart(results);
+    total += co_await toPromise(ops.delete_(pageKeys(results), options));
+    KJ_IF_SOME(n, next) {
+      page = toPromise(ops.list(kj::mv(n), cloneKey(end), ActorCacheOps::RANGE_PAGE_SIZE,
+          {.noCache = options.noCache}));
+    } else {
+      co_return total;
+    }
+  }
+}
+
+kj::Promise<ActorCacheOps::RangeCount> countRangePages(ActorCacheOps& ops,
+    kj::Promise<GetResultList> page,
+    kj::Maybe<Key> end,
+    ActorCacheOps::ReadOptions options,
+    ActorCacheOps::RangeCount total) {
+  for (;;) {
+    auto results = co_await page;
+    addToCount(total, results);
+    KJ_IF_SOME(n, nextPageStart(results)) {
+      page = toPromise(ops.list(kj::mv(n), cloneKey(end), ActorCacheOps::RANGE_PAGE_SIZE, options));
+    } else {
+      co_return total;
+    }
+  }
+}
+
+}  // namespace
+
+kj::OneOf<uint, kj::Promise<uint>> ActorCacheOps::deleteRange(
+    Key begin, kj::Maybe<Key> end, WriteOptions options) {
+  // Pages that are entirely in cache are handled synchronously. Once a page has to wait for
+  // storage, the rest of the range is handled asynchronously.
+  uint total = 0;
+  for (;;) {
+    auto listed = list(kj::mv(begin), cloneKey(end), RANGE_PAGE_SIZE, {.noCache = options.noCache});
+    KJ_IF_SOME(promise, listed.tryGet<kj::Promise<GetResultList>>()) {
+      return deleteRangePages(*this, kj::mv(promise), kj::mv(end), options, total);
+    }
+
+    auto& results = listed.get<GetResultList>();
+    auto next = nextPageStart(results);
+    KJ_SWITCH_ONEOF(delete_(pageKeys(results), options)) {
+      KJ_CASE_ONEOF(count, uint) {
+        total += count;
+      }
+      KJ_CASE_ONEOF(promise, kj::Promise<uint>) {
+        return promise.then([this, next = kj::mv(next), end = kj::mv(end), options, total](
+                                uint count) mutable -> kj::Promise<uint> {
+          total += count;
+          KJ_IF_SOME(n, next) {
+            return toPromise(deleteRange(kj::mv(n), kj::mv(end), options))
+                .then([total](uint rest) { return total + rest; });
+          }
+          return total;
+        });
+      }
+    }
+
+    KJ_IF_SOME(n, next) {
+      begin = kj::mv(n);
+    } else {
+      return total;
+    }
+  }
+}
+
+kj::OneOf<ActorCacheOps::RangeCount, kj::Promise<ActorCacheOps::RangeCount>> ActorCacheOps::
+    countRange(Key begin, kj::Maybe<Key> end, ReadOptions options) {
+  RangeCount total{.count = 0, .keyBytes = 0};
+  for (;;) {
+    auto listed = list(kj::mv(begin), cloneKey(end), RANGE_PAGE_SIZE, options);
+    KJ_IF_SOME(promise, listed.tryGet<kj::Promise<GetResultList>>()) {
+      return countRangePages(*this, kj::mv(promise), kj::mv(end), options, total);
+    }
+
+    auto& results = listed.get<GetResultList>();
+    addToCount(total, results);
+    KJ_IF_SOME(n, nextPageStart(results)) {
+      begin = kj::mv(n);
+    } else {
+      return total;
+    }
+  }
+}
+
 }  // namespace workerd
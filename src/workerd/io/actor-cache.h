@@ -9,6 +9,7 @@
 
 #include <kj/async.h>
 #include <kj/debug.h>
+#include <kj/function.h>
 #include <kj/list.h>
 #include <kj/map.h>
 #include <kj/mutex.h>
@@ -132,6 +133,39 @@ class ActorCacheOps {
   virtual kj::OneOf<GetResultList, kj::Promise<GetResultList>> listReverse(
       Key begin, kj::Maybe<Key> end, kj::Maybe<uint> limit, ReadOptions options) = 0;
 
+  // Callback invoked by the in-place read methods below. `value` points into memory owned by the
+  // underlying storage and is only valid for the duration of the call.
+  using InPlaceCallback = kj::FunctionParam<void(KeyPtr key, ValuePtr value)>;
+
+  // Optional read path for implementations whose reads always complete synchronously against
+  // storage that already owns the bytes (i.e. ActorSqlite). Rather than copying each value into a
+  // GetResultList, these invoke `callback` for each result while the underlying row is still live,
+  // so that the caller can parse the value in place. Returns the number of results delivered, or
+  // kj::none if the implementation doesn't support in-place reads, in which case the caller must
+  // fall back to get()/list()/listReverse() above.
+  //
+  // getInPlace() delivers results for the keys that exist, in no particular order. Its `key` is
+  // one of `keys`, so unlike `value` it may be kept until the call returns. listInPlace() and
+  // listReverseInPlace() have the same semantics as list() and listReverse().
+  virtual kj::Maybe<uint> getInPlace(
+      kj::ArrayPtr<const Key> keys, ReadOptions options, InPlaceCallback callback) {
+    return kj::none;
+  }
+  virtual kj::Maybe<uint> listInPlace(KeyPtr begin,
+      kj::Maybe<KeyPtr> end,
+      kj::Maybe<uint> limit,
+      ReadOptions options,
+      InPlaceCallback callback) {
+    return kj::none;
+  }
+  virtual kj::Maybe<uint> listReverseInPlace(KeyPtr begin,
+      kj::Maybe<KeyPtr> end,
+      kj::Maybe<uint> limit,
+      ReadOptions options,
+      InPlaceCallback callback) {
+    return kj::none;
+  }
+
   typedef ActorCacheWriteOptions WriteOptions;
 
   // Writes a key/value into cache and schedules it to be flushed to disk later.
@@ -157,6 +191,26 @@ class ActorCacheOps {
   // from underlying storage. The promise also applies backpressure if needed, as with put().
   virtual kj::OneOf<bool, kj::Promise<bool>> delete_(Key key, WriteOptions options) = 0;
   virtual kj::OneOf<uint, kj::Promise<uint>> delete_(kj::Array<Key> keys, WriteOptions options) = 0;
+
+  // Result of countRange(). Only keys are read, so the operation is billed by `keyBytes`.
+  struct RangeCount {
+    uint count;
+    size_t keyBytes;
+  };
+
+  // Delete or count every key in the range [begin, end), with the same range semantics as
+  // list(). deleteRange() returns the number of keys deleted.
+  //
+  // The default implementations list the range RANGE_PAGE_SIZE keys at a time and delete or count
+  // each page, which costs as much as doing so from the application but never holds more than a
+  // page in memory. Implementations that can operate on a range directly (i.e. ActorSqlite)
+  // override these so that values are never read.
+  virtual kj::OneOf<uint, kj::Promise<uint>> deleteRange(
+      Key begin, kj::Maybe<Key> end, WriteOptions options);
+  virtual kj::OneOf<RangeCount, kj::Promise<RangeCount>> countRange(
+      Key begin, kj::Maybe<Key> end, ReadOptions options);
+
+  static constexpr uint RANGE_PAGE_SIZE = 1024;
 };
 
 // Abstract interface that is implemented by ActorCache as well as ActorSqlite.
@@ -411,8 +465,8 @@ class ActorCache final: public ActorCacheInterface {
     // strong references to the entries they are reading, so that if the entries are overwritten,
     // the read operation still has the original value from when it was called.
     //
-    // The mutable content of an `Entry` is protected by the same mutex that protects
-    // `lru.cleanList`. `key` and `value` are declared `const` so that they can safely be used
+    // The mutable content of an `Entry` is protected by the same mutex that protects the cache's
+    // `cleanList` shard. `key` and `value` are declared `const` so that they can safely be used
     // without a lock.
 
     Entry(ActorCache& cache, Key key, Value value);
@@ -519,7 +573,7 @@ class ActorCache final: public ActorCacheInterface {
     // we won't include this entry as part of our retried delete.
     bool overwritingCountedDelete = false;
 
-    // If CLEAN, the entry will be in the SharedLru's `cleanList`.
+    // If CLEAN, the entry will be in the cache's `cleanList` shard of the SharedLru.
     //
     // If DIRTY, the entry will be in `dirtyList`.
     kj::ListLink<Entry> link;
@@ -622,6 +676,11 @@ class ActorCache final: public ActorCacheInterface {
 
   rpc::ActorStorage::Stage::Client storage;
   const SharedLru& lru;
+
+  // The shard of `lru`'s clean list that this cache's clean entries live in. The shard's lock
+  // also protects `currentValues`.
+  const kj::MutexGuarded<kj::List<Entry, &Entry::link>>& cleanList;
+
   OutputGate& gate;
   Hooks& hooks;
   const kj::MonotonicClock& clock;
@@ -661,7 +720,7 @@ class ActorCache final: public ActorCacheInterface {
 
   // Map of current known values for keys. Searchable by key, including ordered iteration.
   //
-  // This map is protected by the same lock as lru.cleanList. ExternalMutexGuarded helps enforce
+  // This map is protected by the same lock as `cleanList`. ExternalMutexGuarded helps enforce
   // this.
   kj::ExternalMutexGuarded<kj::Table<kj::Own<Entry>, kj::TreeIndex<EntryTableCallbacks>>>
       currentValues;
@@ -737,7 +796,8 @@ class ActorCache final: public ActorCacheInterface {
   // Will be canceled if and when `oomException` becomes non-null.
   kj::Canceler oomCanceler;
 
-  // Type of a lock on `SharedLru::cleanList`. We use the same lock to protect `currentValues`.
+  // Type of a lock on a `SharedLru` clean list shard. We use the same lock to protect
+  // `currentValues`.
   typedef kj::Locked<kj::List<Entry, &Entry::link>> Lock;
 
   // Add this entry to the clean list and set its status to CLEAN.
@@ -968,6 +1028,20 @@ struct ActorCacheSharedLruOptions {
   // If true, don't actually flush anything. This is used in preview sessions, since they keep
   // state strictly in memory.
   bool neverFlush = false;
+
+  // Number of independently-locked shards to split the clean list into. Each ActorCache is
+  // assigned to one shard, so caches in different shards never contend on the same lock. LRU
+  // order is maintained per shard rather than globally, while `softLimit` and `hardLimit` still
+  // apply to the total size across all shards.
+  size_t cleanListShards = 1;
+
+  // When a flush is split into multiple put or delete RPCs, limits how many of those RPCs may be
+  // outstanding at once, and how many words of message data they may occupy in total. Further
+  // batches are not built or sent until earlier ones have returned. A single batch is always
+  // allowed to proceed even if it alone exceeds `maxFlushWordsInFlight`. Zero means unlimited,
+  // in which case every batch is sent immediately.
+  size_t maxFlushBatchesInFlight = 0;
+  size_t maxFlushWordsInFlight = 0;
 };
 
 class ActorCache::SharedLru {
@@ -987,9 +1061,12 @@ class ActorCache::SharedLru {
  private:
   const Options options;
 
-  // List of clean values, across all caches, ordered from least-recently-used to
-  // most-recently-used.
-  kj::MutexGuarded<kj::List<Entry, &Entry::link>> cleanList;
+  using CleanList = kj::MutexGuarded<kj::List<Entry, &Entry::link>>;
+
+  // Lists of clean values, each ordered from least-recently-used to most-recently-used. Every
+  // ActorCache is assigned to one shard for its whole lifetime, round-robin.
+  kj::Array<CleanList> cleanListShards;
+  mutable std::atomic<uint> nextShard = 0;
 
   // Total byte size of everything that is cached, including dirty values that aren't in `cleanList`.
   mutable std::atomic<size_t> size = 0;
@@ -998,11 +1075,24 @@ class ActorCache::SharedLru {
   // instead of kj::TimePoint to allow for atomic operations.
   mutable std::atomic<int64_t> nextStaleCheckNs = 0;
 
-  // Evict cache entries as needed according to the cache limits. Returns true if the hard limit
-  // is exceeded and nothing can be evicted, in which case the caller should fail out in the
-  // appropriate way for the kind of operation being performed.
+  // Picks the shard for a newly-constructed ActorCache.
+  const CleanList& assignShard() const;
+
+  // Evict cache entries as needed according to the cache limits. `lock` is the caller's own shard,
+  // which is swept first; other shards are swept if they can be locked without blocking, and the
+  // busy ones are waited for only if the hard limit would otherwise be exceeded. Returns true if
+  // the hard limit is exceeded and nothing can be evicted, in which case the caller should fail
+  // out in the appropriate way for the kind of operation being performed.
   bool evictIfNeeded(Lock& lock) const KJ_WARN_UNUSED_RESULT;
 
+  // How long evictIfNeeded() waits for a busy shard that comes before the caller's own, before
+  // giving up on evicting from it.
+  static constexpr kj::Duration EARLIER_SHARD_LOCK_TIMEOUT = 10 * kj::MILLISECONDS;
+
+  // Evicts from the front of the shard locked by `lock` until the total size is within
+  // `softLimit`, returning true, or until the shard has no clean entries left, returning false.
+  bool evictFromShard(Lock& lock) const;
+
   friend class ActorCache;
 };
 
@@ -11,6 +11,8 @@
 #include <kj/debug.h>
 #include <kj/test.h>
 
+#include <algorithm>
+
 namespace workerd {
 namespace {
 
@@ -1277,5 +1279,62 @@ KJ_TEST("database write operations check for brokenness") {
   test.pollAndExpectCalls({});
 }
 
+KJ_TEST("in-place reads deliver values without copying into a result list") {
+  ActorSqliteTest test;
+
+  test.put("bar", "456");
+  test.put("baz", "789");
+  test.put("foo", "123");
+  test.pollAndExpectCalls({"commit"})[0]->fulfill();
+
+  kj::Vector<kj::String> seen;
+  auto record = [&](kj::StringPtr key, kj::ArrayPtr<const kj::byte> value) {
+    seen.add(kj::str(key, "=", value.asChars()));
+  };
+
+  auto keys = kj::heapArray<kj::String>({kj::str("foo"), kj::str("qux"), kj::str("bar")});
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.actor.getInPlace(keys, {}, record)) == 2);
+  // getInPlace() doesn't promise any particular order.
+  std::sort(seen.begin(), seen.end());
+  KJ_EXPECT(seen.releaseAsArray() == kj::arr(kj::str("bar=456"), kj::str("foo=123")));
+
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.actor.listInPlace("bar", "foo"_kj, kj::none, {}, record)) == 2);
+  KJ_EXPECT(seen.releaseAsArray() == kj::arr(kj::str("bar=456"), kj::str("baz=789")));
+
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.actor.listReverseInPlace("", kj::none, 2u, {}, record)) == 2);
+  KJ_EXPECT(seen.releaseAsArray() == kj::arr(kj::str("foo=123"), kj::str("baz=789")));
+
+  // Explicit transactions forward to the same implementation and observe their own writes.
+  auto txn = test.actor.startTransaction();
+  txn->put(kj::str("bar"), kj::heapArray("000"_kj.asBytes()), {});
+  KJ_EXPECT(KJ_ASSERT_NONNULL(txn->listInPlace("", kj::none, kj::none, {}, record)) == 3);
+  KJ_EXPECT(seen.releaseAsArray() ==
+      kj::arr(kj::str("bar=000"), kj::str("baz=789"), kj::str("foo=123")));
+  txn->rollback().wait(test.ws);
+
+  test.pollAndExpectCalls({});
+}
+
+KJ_TEST("in-place multi-key reads deliver keys that outlive the call") {
+  ActorSqliteTest test;
+
+  // Enough keys to be read in batches, as well as one at a time.
+  kj::Vector<kj::String> keys;
+  for (auto i: kj::zeroTo(11)) {
+    keys.add(kj::str("key", i));
+    test.put(keys.back(), kj::str("value", i));
+  }
+  test.pollAndExpectCalls({"commit"})[0]->fulfill();
+
+  // Like `tryGetMultipleInPlace()`, hold onto the keys and only read them after the call, which
+  // would be a use-after-free if they pointed into SQLite's rows.
+  kj::Vector<kj::StringPtr> seen;
+  KJ_EXPECT(KJ_ASSERT_NONNULL(test.actor.getInPlace(keys.asPtr(), {},
+                [&](kj::StringPtr key, kj::ArrayPtr<const kj::byte>) { seen.add(key); })) == 11);
+  std::sort(seen.begin(), seen.end());
+  auto joined = kj::strArray(seen, ",");
+  KJ_EXPECT(joined == "key0,key1,key10,key2,key3,key4,key5,key6,key7,key8,key9", joined);
+}
+
 }  // namespace
 }  // namespace workerd
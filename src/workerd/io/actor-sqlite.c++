@@ -269,6 +269,9 @@ kj::Promise<void> ActorSqlite::commitImpl(ActorSqlite::PrecommitAlarmState preco
   // We assume that exceptions thrown during commit will propagate to the caller, such that they
   // will ensure cancelDeferredAlarmDeletion() is called, if necessary.
 
+  // Page cache hit rates are reported per commit, since reporting per query costs too much.
+  db->reportPageCacheStats();
+
   KJ_IF_SOME(pending, pendingCommit) {
     // If an earlier commitImpl() invocation is already in the process of updating precommit
     // alarms but has not yet made the commitCallback() call, it should be OK to wait on it to
@@ -377,11 +380,11 @@ kj::OneOf<ActorCacheOps::GetResultList, kj::Promise<ActorCacheOps::GetResultList
     kj::Array<Key> keys, ReadOptions options) {
   requireNotBroken();
 
+  auto keyPtrs = KJ_MAP(key, keys) -> KeyPtr { return key; };
   kj::Vector<KeyValuePair> results;
-  for (auto& key: keys) {
-    kv.get(
-        key, [&](ValuePtr value) { results.add(KeyValuePair{kj::mv(key), kj::heapArray(value)}); });
-  }
+  kv.get(keyPtrs.asPtr(), [&](KeyPtr key, ValuePtr value) {
+    results.add(KeyValuePair{kj::str(key), kj::heapArray(value)});
+  });
   std::sort(results.begin(), results.end(), [](auto& a, auto& b) { return a.key < b.key; });
   return GetResultList(kj::mv(results));
 }
@@ -431,6 +434,36 @@ kj::OneOf<ActorCacheOps::GetResultList, kj::Promise<ActorCacheOps::GetResultList
   return GetResultList(kj::mv(results));
 }
 
+kj::Maybe<uint> ActorSqlite::getInPlace(
+    kj::ArrayPtr<const Key> keys, ReadOptions options, InPlaceCallback callback) {
+  requireNotBroken();
+
+  auto keyPtrs = KJ_MAP(key, keys) -> KeyPtr { return key; };
+  return kv.get(keyPtrs.asPtr(), [&](KeyPtr key, ValuePtr value) { callback(key, value); });
+}
+
+kj::Maybe<uint> ActorSqlite::listInPlace(KeyPtr begin,
+    kj::Maybe<KeyPtr> end,
+    kj::Maybe<uint> limit,
+    ReadOptions options,
+    InPlaceCallback callback) {
+  requireNotBroken();
+
+  return kv.list(begin, end, limit, SqliteKv::FORWARD,
+      [&](KeyPtr key, ValuePtr value) { callback(key, value); });
+}
+
+kj::Maybe<uint> ActorSqlite::listReverseInPlace(KeyPtr begin,
+    kj::Maybe<KeyPtr> end,
+    kj::Maybe<uint> limit,
+    ReadOptions options,
+    InPlaceCallback callback) {
+  requireNotBroken();
+
+  return kv.list(begin, end, limit, SqliteKv::REVERSE,
+      [&](KeyPtr key, ValuePtr value) { callback(key, value); });
+}
+
 kj::Maybe<kj::Promise<void>> ActorSqlite::put(Key key, Value value, WriteOptions options) {
   requireNotBroken();
 
@@ -441,9 +474,10 @@ kj::Maybe<kj::Promise<void>> ActorSqlite::put(Key key, Value value, WriteOptions
 kj::Maybe<kj::Promise<void>> ActorSqlite::put(kj::Array<KeyValuePair> pairs, WriteOptions options) {
   requireNotBroken();
 
-  for (auto& pair: pairs) {
-    kv.put(pair.key, pair.value);
-  }
+  auto pairPtrs = KJ_MAP(pair, pairs) -> SqliteKv::KeyValuePtrPair {
+    return {.key = pair.key, .value = pair.value};
+  };
+  kv.put(pairPtrs.asPtr());
   return kj::none;
 }
 
@@ -456,11 +490,23 @@ kj::OneOf<bool, kj::Promise<bool>> ActorSqlite::delete_(Key key, WriteOptions op
 kj::OneOf<uint, kj::Promise<uint>> ActorSqlite::delete_(kj::Array<Key> keys, WriteOptions options) {
   requireNotBroken();
 
-  uint count = 0;
-  for (auto& key: keys) {
-    count += kv.delete_(key);
-  }
-  return count;
+  auto keyPtrs = KJ_MAP(key, keys) -> KeyPtr { return key; };
+  return kv.delete_(keyPtrs.asPtr());
+}
+
+kj::OneOf<uint, kj::Promise<uint>> ActorSqlite::deleteRange(
+    Key begin, kj::Maybe<Key> end, WriteOptions options) {
+  requireNotBroken();
+
+  return kv.deleteRange(begin, end);
+}
+
+kj::OneOf<ActorSqlite::RangeCount, kj::Promise<ActorSqlite::RangeCount>> ActorSqlite::countRange(
+    Key begin, kj::Maybe<Key> end, ReadOptions options) {
+  requireNotBroken();
+
+  auto result = kv.countRange(begin, end);
+  return RangeCount{.count = result.count, .keyBytes = result.keyBytes};
 }
 
 kj::Maybe<kj::Promise<void>> ActorSqlite::setAlarm(
@@ -720,9 +766,35 @@ kj::OneOf<uint, kj::Promise<uint>> ActorSqlite::ExplicitTxn::delete_(
     kj::Array<Key> keys, WriteOptions options) {
   return actorSqlite.delete_(kj::mv(keys), options);
 }
+kj::OneOf<uint, kj::Promise<uint>> ActorSqlite::ExplicitTxn::deleteRange(
+    Key begin, kj::Maybe<Key> end, WriteOptions options) {
+  return actorSqlite.deleteRange(kj::mv(begin), kj::mv(end), options);
+}
+kj::OneOf<ActorSqlite::RangeCount, kj::Promise<ActorSqlite::RangeCount>> ActorSqlite::ExplicitTxn::
+    countRange(Key begin, kj::Maybe<Key> end, ReadOptions options) {
+  return actorSqlite.countRange(kj::mv(begin), kj::mv(end), options);
+}
 kj::Maybe<kj::Promise<void>> ActorSqlite::ExplicitTxn::setAlarm(
     kj::Maybe<kj::Date> newAlarmTime, WriteOptions options) {
   return actorSqlite.setAlarm(newAlarmTime, options);
 }
+kj::Maybe<uint> ActorSqlite::ExplicitTxn::getInPlace(
+    kj::ArrayPtr<const Key> keys, ReadOptions options, InPlaceCallback callback) {
+  return actorSqlite.getInPlace(keys, options, kj::mv(callback));
+}
+kj::Maybe<uint> ActorSqlite::ExplicitTxn::listInPlace(KeyPtr begin,
+    kj::Maybe<KeyPtr> end,
+    kj::Maybe<uint> limit,
+    ReadOptions options,
+    InPlaceCallback callback) {
+  return actorSqlite.listInPlace(begin, end, limit, options, kj::mv(callback));
+}
+kj::Maybe<uint> ActorSqlite::ExplicitTxn::listReverseInPlace(KeyPtr begin,
+    kj::Maybe<KeyPtr> end,
+    kj::Maybe<uint> limit,
+    ReadOptions options,
+    InPlaceCallback callback) {
+  return actorSqlite.listReverseInPlace(begin, end, limit, options, kj::mv(callback));
+}
 
 }  // namespace workerd
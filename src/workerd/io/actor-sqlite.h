@@ -13,11 +13,10 @@ namespace workerd {
 
 // An implementation of ActorCacheOps that is backed by SqliteKv.
 class ActorSqlite final: public ActorCacheInterface, private kj::TaskSet::ErrorHandler {
-  // TODO(perf): This interface is not designed ideally for wrapping SqliteKv. In particular, we
-  //   end up allocating extra copies of all the results. It would be nicer if we could actually
-  //   parse the V8-serialized values directly from the blob pointers that SQLite spits out.
-  //   However, that probably requires rewriting `DurableObjectStorageOperations`. For now, hooking
-  //   here is easier and not too costly.
+  // Note that get(), list(), and listReverse() allocate copies of all the results, since
+  // GetResultList must own its values. `DurableObjectStorageOperations` avoids this by using the
+  // in-place variants (getInPlace(), listInPlace(), listReverseInPlace()), which hand out the blob
+  // pointers that SQLite spits out so that the V8-serialized values can be parsed directly.
 
  public:
   // Hooks to configure ActorSqlite behavior, right now only used to allow plugging in a backend
@@ -68,8 +67,24 @@ class ActorSqlite final: public ActorCacheInterface, private kj::TaskSet::ErrorH
   kj::Maybe<kj::Promise<void>> put(kj::Array<KeyValuePair> pairs, WriteOptions options) override;
   kj::OneOf<bool, kj::Promise<bool>> delete_(Key key, WriteOptions options) override;
   kj::OneOf<uint, kj::Promise<uint>> delete_(kj::Array<Key> keys, WriteOptions options) override;
+  kj::OneOf<uint, kj::Promise<uint>> deleteRange(
+      Key begin, kj::Maybe<Key> end, WriteOptions options) override;
+  kj::OneOf<RangeCount, kj::Promise<RangeCount>> countRange(
+      Key begin, kj::Maybe<Key> end, ReadOptions options) override;
   kj::Maybe<kj::Promise<void>> setAlarm(
       kj::Maybe<kj::Date> newAlarmTime, WriteOptions options) override;
+  kj::Maybe<uint> getInPlace(
+      kj::ArrayPtr<const Key> keys, ReadOptions options, InPlaceCallback callback) override;
+  kj::Maybe<uint> listInPlace(KeyPtr begin,
+      kj::Maybe<KeyPtr> end,
+      kj::Maybe<uint> limit,
+      ReadOptions options,
+      InPlaceCallback callback) override;
+  kj::Maybe<uint> listReverseInPlace(KeyPtr begin,
+      kj::Maybe<KeyPtr> end,
+      kj::Maybe<uint> limit,
+      ReadOptions options,
+      InPlaceCallback callback) override;
   // See ActorCacheOps.
 
   kj::Own<ActorCacheInterface::Transaction> startTransaction() override;
@@ -147,8 +162,24 @@ class ActorSqlite final: public ActorCacheInterface, private kj::TaskSet::ErrorH
     kj::Maybe<kj::Promise<void>> put(kj::Array<KeyValuePair> pairs, WriteOptions options) override;
     kj::OneOf<bool, kj::Promise<bool>> delete_(Key key, WriteOptions options) override;
     kj::OneOf<uint, kj::Promise<uint>> delete_(kj::Array<Key> keys, WriteOptions options) override;
+    kj::OneOf<uint, kj::Promise<uint>> deleteRange(
+        Key begin, kj::Maybe<Key> end, WriteOptions options) override;
+    kj::OneOf<RangeCount, kj::Promise<RangeCount>> countRange(
+        Key begin, kj::Maybe<Key> end, ReadOptions options) override;
     kj::Maybe<kj::Promise<void>> setAlarm(
         kj::Maybe<kj::Date> newAlarmTime, WriteOptions options) override;
+    kj::Maybe<uint> getInPlace(
+        kj::ArrayPtr<const Key> keys, ReadOptions options, InPlaceCallback callback) override;
+    kj::Maybe<uint> listInPlace(KeyPtr begin,
+        kj::Maybe<KeyPtr> end,
+        kj::Maybe<uint> limit,
+        ReadOptions options,
+        InPlaceCallback callback) override;
+    kj::Maybe<uint> listReverseInPlace(KeyPtr begin,
+        kj::Maybe<KeyPtr> end,
+        kj::Maybe<uint> limit,
+        ReadOptions options,
+        InPlaceCallback callback) override;
     // Implements ActorCacheOps. These will all forward to the ActorSqlite instance.
 
    private:
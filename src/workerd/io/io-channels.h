@@ -6,6 +6,7 @@
 
 #include <workerd/io/actor-id.h>
 #include <workerd/io/io-util.h>
+#include <workerd/io/kv-client.h>
 #include <workerd/io/trace.h>
 
 #include <capnp/capability.h>  // for Capability
@@ -117,6 +118,13 @@ class IoChannelFactory {
   // Get a CacheClient, used to implement the Cache API.
   virtual kj::Own<CacheClient> getCache() = 0;
 
+  // Returns a KvClient that `kvNamespace` bindings on the given subrequest channel can call
+  // directly, if the channel leads to an in-process KV namespace. Otherwise, they make HTTP
+  // requests through startSubrequest().
+  virtual kj::Maybe<KvClient&> getKvClient(uint channel) {
+    return kj::none;
+  }
+
   // Get the singleton timer instance, used to back Date.now(), setTimeout(), etc. This object
   // may implement Spectre mitigations.
   virtual TimerChannel& getTimer() = 0;
@@ -750,6 +750,10 @@ class IoContext final: public kj::Refcounted, private kj::TaskSet::ErrorHandler
     return getIoChannelFactory().getCapability(channel);
   }
 
+  kj::Maybe<KvClient&> getKvClient(uint channel) {
+    return getIoChannelFactory().getKvClient(channel);
+  }
+
   kj::Own<IoChannelFactory::ActorChannel> getGlobalActorChannel(uint channel,
       const ActorIdFactory::ActorId& id,
       kj::Maybe<kj::String> locationHint,
@@ -0,0 +1,73 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/array.h>
+#include <kj/async.h>
+#include <kj/string.h>
+
+namespace workerd {
+
+// A KV namespace that `kvNamespace` bindings can call directly, rather than speaking the KV HTTP
+// protocol over their subrequest channel. Only namespaces implemented in-process offer one, see
+// IoChannelFactory::getKvClient().
+//
+// Keys have already been validated by the binding. Arguments only need to stay valid until the
+// method returns. Requests that the HTTP protocol would refuse with an error status throw an
+// exception saying what the binding would have reported for that status, e.g.
+// "KV PUT failed: 400 Bad Request".
+class KvClient {
+ public:
+  struct Value {
+    kj::Array<kj::byte> value;
+
+    // The key's metadata, as JSON.
+    kj::Maybe<kj::String> metadata;
+  };
+
+  struct ListKey {
+    kj::String name;
+
+    // In seconds since the Unix epoch.
+    kj::Maybe<int64_t> expiration;
+
+    // As JSON.
+    kj::Maybe<kj::String> metadata;
+  };
+
+  struct ListResult {
+    kj::Array<ListKey> keys;
+
+    // Where the next list() continues from, or none if this was the end of the listing.
+    kj::Maybe<kj::String> cursor;
+  };
+
+  struct PutOptions {
+    // In seconds since the Unix epoch, or from now, respectively.
+    kj::Maybe<int64_t> expiration;
+    kj::Maybe<int64_t> expirationTtl;
+
+    // As JSON.
+    kj::Maybe<kj::StringPtr> metadata;
+  };
+
+  virtual kj::Promise<kj::Maybe<Value>> get(kj::StringPtr key) = 0;
+
+  // Returns the values of `keys`, in the same order.
+  virtual kj::Promise<kj::Array<kj::Maybe<Value>>> getBulk(
+      kj::ArrayPtr<const kj::String> keys) = 0;
+
+  // Lists keys starting with `prefix` in order, after `cursor` if given. Without `limit`, returns
+  // as many as the namespace allows at once.
+  virtual kj::Promise<ListResult> list(
+      kj::StringPtr prefix, kj::Maybe<kj::StringPtr> cursor, kj::Maybe<uint> limit) = 0;
+
+  virtual kj::Promise<void> put(
+      kj::StringPtr key, kj::ArrayPtr<const kj::byte> value, PutOptions options) = 0;
+
+  virtual kj::Promise<void> delete_(kj::StringPtr key) = 0;
+};
+
+}  // namespace workerd
@@ -340,7 +340,7 @@ uint64_t getCurrentThreadId() {
 
 }  // namespace
 
-// Represents a thread's attempt to take an async lock. Each Isolate has a linked list of
+// Represents a thread's attempt to take an async lock. Each Isolate has a queue of
 // `AsyncWaiter`s. A particular thread only ever owns one `AsyncWaiter` at a time.
 class Worker::AsyncWaiter: public kj::Refcounted {
  public:
@@ -355,10 +355,10 @@ class Worker::AsyncWaiter: public kj::Refcounted {
   // The isolate for which this waiter is currently waiting.
   kj::Own<const Isolate> isolate;
 
-  // Promise/fulfiller to fire when the waiter reaches the front of the list for the corresponding
-  // isolate.
+  // Our place in the isolate's `asyncWaiters` queue, and the promise that fires when we reach the
+  // front of it.
+  kj::Own<WaiterQueue::Ticket> ticket;
   kj::ForkedPromise<void> readyPromise = nullptr;
-  kj::Own<kj::CrossThreadPromiseFulfiller<void>> readyFulfiller;
 
   // Promise/fulfiller to fire when the AsyncLock is finally released. This is used when a thread
   // tries to take locks on multiple different isolates concurrently, in order to serialize the
@@ -367,12 +367,6 @@ class Worker::AsyncWaiter: public kj::Refcounted {
   kj::ForkedPromise<void> releasePromise = nullptr;
   kj::Own<kj::PromiseFulfiller<void>> releaseFulfiller;
 
-  // Protected by the lock on `Isolate::asyncWaiters` for the isolate identified by
-  // `currentIsolate`. Must be null if `currentIsolate` is null. (All other members of `Waiter`
-  // can only be accessed by the thread that created the `Waiter`.)
-  kj::Maybe<AsyncWaiter&> next;
-  kj::Maybe<AsyncWaiter&>* prev;
-
   static const kj::EventLoopLocal<AsyncWaiter*> threadCurrentWaiter;
 
   friend class Worker::Isolate;
@@ -2267,14 +2261,6 @@ void Worker::Lock::validateHandlers(ValidationErrorReporter& errorReporter) {
 
 const kj::EventLoopLocal<Worker::AsyncWaiter*> Worker::AsyncWaiter::threadCurrentWaiter;
 
-Worker::Isolate::AsyncWaiterList::~AsyncWaiterList() noexcept {
-  // It should be impossible for this list to be non-empty since each member of the list holds a
-  // strong reference back to us. But if the list is non-empty, we'd better crash here, to avoid
-  // dangling pointers.
-  KJ_ASSERT(head == kj::none, "destroying non-empty waiter list?");
-  KJ_ASSERT(tail == &head, "tail pointer corrupted?");
-}
-
 kj::Promise<Worker::AsyncLock> Worker::Isolate::takeAsyncLockWithoutRequest(
     SpanParent parentSpan) const {
   auto lockTiming = getMetrics().tryCreateLockTiming(kj::mv(parentSpan));
@@ -2346,23 +2332,10 @@ Worker::AsyncWaiter::AsyncWaiter(kj::Own<const Isolate> isolateParam)
     releaseFulfiller = kj::mv(paf.fulfiller);
   }
 
-  // Add ourselves to the wait queue for this isolate.
-  auto lock = isolate->asyncWaiters.lockExclusive();
-  if (lock->tail == &lock->head) {
-    // Looks like the queue is empty, so we immediately get the lock.
-    readyPromise = kj::Promise<void>(kj::READY_NOW).fork();
-    // We can leave `readyFulfiller` null as no one will ever invoke it anyway.
-  } else {
-    // Arrange to get notified later.
-    auto paf = kj::newPromiseAndCrossThreadFulfiller<void>();
-    readyPromise = paf.promise.fork();
-    readyFulfiller = kj::mv(paf.fulfiller);
-  }
-
-  next = kj::none;
-  prev = lock->tail;
-  *lock->tail = this;
-  lock->tail = &next;
+  // Add ourselves to the wait queue for this isolate. If it's empty, we immediately get the lock.
+  auto joined = isolate->asyncWaiters.join();
+  ticket = kj::mv(joined.ticket);
+  readyPromise = joined.ready.fork();
 
   *threadCurrentWaiter = this;
 
@@ -2375,25 +2348,11 @@ Worker::AsyncWaiter::~AsyncWaiter() noexcept {
 
   __atomic_sub_fetch(&isolate->impl->lockAttemptGauge, 1, __ATOMIC_RELAXED);
 
-  auto lock = isolate->asyncWaiters.lockExclusive();
-
   releaseFulfiller->fulfill();
 
-  // Remove ourselves from the list.
-  *prev = next;
-  KJ_IF_SOME(n, next) {
-    n.prev = prev;
-  } else {
-    lock->tail = prev;
-  }
-
-  if (prev == &lock->head) {
-    // We held the lock before now. Alert the next waiter that they are now at the front of the
-    // line.
-    KJ_IF_SOME(n, next) {
-      n.readyFulfiller->fulfill();
-    }
-  }
+  // Leave the queue. If we held the lock, this alerts the next waiter that they are now at the
+  // front of the line. The ticket refers to the isolate, so it must go before `isolate` does.
+  ticket = nullptr;
 
   auto& w = *threadCurrentWaiter;
   KJ_ASSERT(w == this);
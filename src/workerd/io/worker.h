@@ -20,6 +20,7 @@
 #include <workerd/jsg/jsg.h>
 #include <workerd/util/thread-scopes.h>
 #include <workerd/util/uncaught-exception-source.h>
+#include <workerd/util/waiter-queue.h>
 #include <workerd/util/weak-refs.h>
 #include <workerd/util/xthreadnotifier.h>
 
@@ -443,19 +444,10 @@ class Worker::Isolate: public kj::AtomicRefcounted {
   class InspectorChannelImpl;
   kj::Maybe<InspectorChannelImpl&> currentInspectorSession;
 
-  struct AsyncWaiterList {
-    kj::Maybe<AsyncWaiter&> head = kj::none;
-    kj::Maybe<AsyncWaiter&>* tail = &head;
-
-    ~AsyncWaiterList() noexcept;
-  };
-
-  // Mutex-guarded linked list of threads waiting for an async lock on this worker. The lock
-  // protects the `AsyncWaiterList` as well as the next/prev pointers in each `AsyncWaiter` that
-  // is currently in the list.
-  kj::MutexGuarded<AsyncWaiterList> asyncWaiters;
-  // TODO(perf): Use a lock-free list? Tricky to get right. `asyncWaiters` should only be locked
-  //   briefly so there's probably not that much to gain.
+  // Queue of threads waiting for an async lock on this worker. The thread at the front holds the
+  // lock. Lock-free, so that threads contending for a hot isolate don't also contend for a mutex
+  // each time the lock changes hands.
+  WaiterQueue asyncWaiters;
 
   friend class Worker::AsyncLock;
 
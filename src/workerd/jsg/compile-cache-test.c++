@@ -0,0 +1,134 @@
+// Copyright (c) 2017-2022 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "compile-cache.h"
+#include "jsg-test.h"
+
+namespace workerd::jsg::test {
+namespace {
+
+V8System v8System;
+class ContextGlobalObject: public Object, public ContextGlobal {};
+
+struct CompileCacheContext: public ContextGlobalObject {
+  JSG_RESOURCE_TYPE(CompileCacheContext) {}
+};
+JSG_DECLARE_ISOLATE_TYPE(CompileCacheIsolate, CompileCacheContext);
+
+// Runs `callback` in a context of a fresh isolate.
+void runInNewIsolate(auto callback) {
+  CompileCacheIsolate isolate(v8System, kj::heap<IsolateObserver>());
+  isolate.runInLockScope([&](CompileCacheIsolate::Lock& lock) {
+    JSG_WITHIN_CONTEXT_SCOPE(lock, lock.newContext<CompileCacheContext>().getHandle(lock),
+        [&](jsg::Lock& js) { callback(js); });
+  });
+}
+
+// Compiles `content` as the built-in module `name`, as a worker importing it would.
+void compileBuiltin(kj::StringPtr name, kj::StringPtr content) {
+  runInNewIsolate([&](jsg::Lock& js) {
+    CompilationObserver observer;
+    ModuleRegistry::ModuleInfo(
+        js, name, content, nullptr, ModuleInfoCompileOption::BUILTIN, observer);
+  });
+}
+
+// Compiles `content` in a fresh isolate from the cache that CompileCache holds for it, and
+// returns whether V8 rejected the cache.
+bool isCacheRejected(kj::StringPtr name, kj::StringPtr content) {
+  auto cached = KJ_REQUIRE_NONNULL(CompileCache::get().find(name, content));
+  bool rejected = true;
+  runInNewIsolate([&](jsg::Lock& js) {
+    v8::ScriptOrigin origin(v8StrIntern(js.v8Isolate, name), 0, 0, false, -1, {}, false, false,
+        true /* isModule */);
+    v8::ScriptCompiler::Source source(
+        v8Str(js.v8Isolate, content), origin, cached.AsCachedData().release());
+    check(v8::ScriptCompiler::CompileModule(
+        js.v8Isolate, &source, v8::ScriptCompiler::kConsumeCodeCache));
+    rejected = source.GetCachedData()->rejected;
+  });
+  return rejected;
+}
+
+KJ_TEST("built-in module code caches are consumed by other isolates") {
+  constexpr auto name = "test:compile-cache-shared"_kjc;
+  constexpr auto content = "export function run() { return 123; }"_kjc;
+
+  KJ_EXPECT(CompileCache::get().find(name, content) == kj::none);
+  compileBuiltin(name, content);
+  KJ_EXPECT(!isCacheRejected(name, content));
+
+  // Another isolate importing the module leaves the cache as it is.
+  compileBuiltin(name, content);
+  KJ_EXPECT(!isCacheRejected(name, content));
+}
+
+KJ_TEST("built-in module code caches are replaced when the source changes") {
+  constexpr auto name = "test:compile-cache-replaced"_kjc;
+  constexpr auto first = "export function run() { return 123; }"_kjc;
+  constexpr auto second = "export function run() { return 321; }"_kjc;
+
+  compileBuiltin(name, first);
+  KJ_EXPECT(CompileCache::get().find(name, second) == kj::none);
+
+  compileBuiltin(name, second);
+  KJ_EXPECT(CompileCache::get().find(name, first) == kj::none);
+  KJ_EXPECT(!isCacheRejected(name, second));
+}
+
+// ========================================================================================
+
+// A CodeCacheStore in memory, which counts the caches written to it.
+class MemoryCodeCacheStore final: public CodeCacheStore {
+ public:
+  kj::Maybe<kj::Array<kj::byte>> read(
+      kj::StringPtr kind, kj::ArrayPtr<const char> source) const override {
+    KJ_IF_SOME(data, entries.find(kj::str(kind, ':', source))) {
+      return kj::heapArray(data.asPtr());
+    }
+    return kj::none;
+  }
+  void write(kj::StringPtr kind,
+      kj::ArrayPtr<const char> source,
+      kj::ArrayPtr<const kj::byte> data) const override {
+    ++writeCount;
+    entries.upsert(kj::str(kind, ':', source), kj::heapArray(data),
+        [](auto& existing, auto&& replacement) { existing = kj::mv(replacement); });
+  }
+
+  mutable kj::HashMap<kj::String, kj::Array<kj::byte>> entries;
+  mutable uint writeCount = 0;
+};
+
+KJ_TEST("bundle module code caches that V8 rejects are rewritten") {
+  constexpr auto content = "export function run() { return 123; }"_kjc;
+  MemoryCodeCacheStore store;
+  auto compile = [&]() {
+    runInNewIsolate([&](jsg::Lock& js) {
+      CompilationObserver observer;
+      ModuleRegistry::ModuleInfo(
+          js, "main", content, nullptr, ModuleInfoCompileOption::BUNDLE, observer, store);
+    });
+  };
+
+  // The first compilation stores a cache, and the next consumes it.
+  compile();
+  KJ_EXPECT(store.writeCount == 1);
+  compile();
+  KJ_EXPECT(store.writeCount == 1);
+
+  // Garble the stored cache, as if another version of V8 had written it. V8 rejects it, and it's
+  // replaced by one that the next compilation consumes.
+  auto& stored = KJ_ASSERT_NONNULL(store.entries.find(kj::str("esm:", content)));
+  for (auto& b: stored) {
+    b = ~b;
+  }
+  compile();
+  KJ_EXPECT(store.writeCount == 2);
+  compile();
+  KJ_EXPECT(store.writeCount == 2);
+}
+
+}  // namespace
+}  // namespace workerd::jsg::test
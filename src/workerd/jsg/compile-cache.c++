@@ -14,15 +14,19 @@ std::unique_ptr<v8::ScriptCompiler::CachedData> CompileCache::Data::AsCachedData
 
 // CompileCache
 
-void CompileCache::add(
-    kj::StringPtr key, std::shared_ptr<v8::ScriptCompiler::CachedData> cached) const {
-  cache.lockExclusive()->upsert(kj::str(key), Data(kj::mv(cached)), [](auto&, auto&&) {});
+void CompileCache::add(kj::StringPtr name,
+    kj::ArrayPtr<const char> source,
+    std::shared_ptr<v8::ScriptCompiler::CachedData> cached) const {
+  cache.lockExclusive()->upsert(kj::str(name),
+      Entry{.sourceHash = kj::hashCode(source.asBytes()), .data = Data(kj::mv(cached))},
+      [](Entry& existing, Entry&& replacement) { existing = kj::mv(replacement); });
 }
 
-kj::Maybe<CompileCache::Data&> CompileCache::find(kj::StringPtr key) const {
-  KJ_IF_SOME(value, cache.lockExclusive()->find(key)) {
-    if (value.data != nullptr) {
-      return value;
+kj::Maybe<CompileCache::Data> CompileCache::find(
+    kj::StringPtr name, kj::ArrayPtr<const char> source) const {
+  KJ_IF_SOME(entry, cache.lockExclusive()->find(name)) {
+    if (entry.data.data != nullptr && entry.sourceHash == kj::hashCode(source.asBytes())) {
+      return entry.data;
     }
   }
   return kj::none;
@@ -17,9 +17,10 @@ namespace workerd::jsg {
 // Importantly, this is a process-lifetime in-memory cache that is only appropriate for
 // built-in modules.
 //
-// The memory-safety of this cache depends on the assumption that entries are never removed
-// or replaced. If things are ever changed such that entries are removed/replaced, then
-// we'd likely need to have find return an atomic refcount or something similar.
+// Entries are keyed by the module's name and a hash of its source, since two configs in the same
+// process may define extension modules with the same name but different sources. Adding an entry
+// for a name replaces any entry for a different source. `find()` returns a copy that shares
+// ownership of the cached data, so it stays valid while other threads replace it.
 class CompileCache {
  public:
   class Data {
@@ -42,8 +43,10 @@ class CompileCache {
     std::shared_ptr<void> owningPtr;
   };
 
-  void add(kj::StringPtr key, std::shared_ptr<v8::ScriptCompiler::CachedData> cached) const;
-  kj::Maybe<Data&> find(kj::StringPtr key) const;
+  void add(kj::StringPtr name,
+      kj::ArrayPtr<const char> source,
+      std::shared_ptr<v8::ScriptCompiler::CachedData> cached) const;
+  kj::Maybe<Data> find(kj::StringPtr name, kj::ArrayPtr<const char> source) const;
 
   static const CompileCache& get() {
     static const CompileCache instance;
@@ -51,8 +54,30 @@ class CompileCache {
   }
 
  private:
-  // The key is the address of the static global that was compiled to produce the CachedData.
-  kj::MutexGuarded<kj::HashMap<kj::String, Data>> cache;
+  struct Entry {
+    // kj::hashCode() of the source that was compiled to produce `data`.
+    uint sourceHash;
+    Data data;
+  };
+
+  // The key is the name of the module that was compiled to produce the CachedData.
+  kj::MutexGuarded<kj::HashMap<kj::String, Entry>> cache;
+};
+
+// Keeps V8 code caches for modules that aren't built in, like a worker's own ES and CommonJS
+// modules, somewhere that outlives the process, so that restarts don't compile them from scratch.
+//
+// Caches are looked up by the kind of compilation ("esm", "cjs") and the module's source. A cache
+// made by another version of V8, or with other flags, is useless, so implementations should key on
+// v8::ScriptCompiler::CachedDataVersionTag() too. V8 checks every cache before using it anyway;
+// one it rejects gets replaced. Implementations must be thread-safe.
+class CodeCacheStore {
+ public:
+  virtual kj::Maybe<kj::Array<kj::byte>> read(
+      kj::StringPtr kind, kj::ArrayPtr<const char> source) const = 0;
+  virtual void write(kj::StringPtr kind,
+      kj::ArrayPtr<const char> source,
+      kj::ArrayPtr<const kj::byte> data) const = 0;
 };
 
 }  // namespace workerd::jsg
@@ -320,12 +320,45 @@ static CompilationObserver::Option convertOption(ModuleInfoCompileOption option)
   KJ_UNREACHABLE;
 }
 
+// Compiles `content` with the code cache that `store` has for it, then stores a new cache if there
+// was none or V8 rejected it. `compile` takes the source and the compile options, and
+// `createCodeCache` the compiled result.
+template <typename Compile, typename CreateCodeCache>
+auto compileWithCodeCacheStore(const CodeCacheStore& store,
+    kj::StringPtr kind,
+    kj::ArrayPtr<const char> content,
+    v8::Local<v8::String> contentStr,
+    const v8::ScriptOrigin& origin,
+    Compile&& compile,
+    CreateCodeCache&& createCodeCache) {
+  auto stored = store.read(kind, content);
+  v8::ScriptCompiler::CachedData* cached = nullptr;
+  KJ_IF_SOME(data, stored) {
+    // The Source takes ownership of the CachedData, but not of the buffer, which `stored` keeps.
+    cached = new v8::ScriptCompiler::CachedData(data.begin(), data.size());
+  }
+  v8::ScriptCompiler::Source source(contentStr, origin, cached);
+  auto result = compile(source,
+      cached == nullptr ? v8::ScriptCompiler::kNoCompileOptions
+                        : v8::ScriptCompiler::kConsumeCodeCache);
+
+  auto consumed = source.GetCachedData();
+  if (consumed == nullptr || consumed->rejected) {
+    std::unique_ptr<v8::ScriptCompiler::CachedData> created(createCodeCache(result));
+    if (created != nullptr) {
+      store.write(kind, content, kj::arrayPtr(created->data, created->length));
+    }
+  }
+  return result;
+}
+
 v8::Local<v8::Module> compileEsmModule(jsg::Lock& js,
     kj::StringPtr name,
     kj::ArrayPtr<const char> content,
     kj::ArrayPtr<const kj::byte> compileCache,
     ModuleInfoCompileOption option,
-    const CompilationObserver& observer) {
+    const CompilationObserver& observer,
+    kj::Maybe<const CodeCacheStore&> codeCacheStore) {
   // destroy the observer after compilation finished to indicate the end of the process.
   auto compilationObserver =
       observer.onEsmCompilationStart(js.v8Isolate, name, convertOption(option));
@@ -359,6 +392,40 @@ v8::Local<v8::Module> compileEsmModule(jsg::Lock& js,
         js.v8Isolate, &source, v8::ScriptCompiler::kConsumeCodeCache));
   }
 
+  if (option == ModuleInfoCompileOption::BUILTIN) {
+    // Built-in and extension modules are the same for every isolate in the process, so only the
+    // first isolate to import one compiles it fully; the rest start from its code cache.
+    auto& cache = CompileCache::get();
+    // `source` borrows the cached data, so `cached` must outlive it.
+    auto cached = cache.find(name, content);
+    v8::ScriptCompiler::CachedData* cachedData = nullptr;
+    KJ_IF_SOME(c, cached) {
+      cachedData = c.AsCachedData().release();
+    }
+    v8::ScriptCompiler::Source source(contentStr, origin, cachedData);
+    auto module = jsg::check(v8::ScriptCompiler::CompileModule(js.v8Isolate, &source,
+        cachedData == nullptr ? v8::ScriptCompiler::kNoCompileOptions
+                              : v8::ScriptCompiler::kConsumeCodeCache));
+    // V8 rejects a cache made with other flags. The module still compiles; the cache is replaced.
+    if (cachedData == nullptr || source.GetCachedData()->rejected) {
+      std::shared_ptr<v8::ScriptCompiler::CachedData> created(
+          v8::ScriptCompiler::CreateCodeCache(module->GetUnboundModuleScript()));
+      if (created != nullptr) {
+        cache.add(name, content, kj::mv(created));
+      }
+    }
+    return module;
+  }
+
+  KJ_IF_SOME(store, codeCacheStore) {
+    return compileWithCodeCacheStore(store, "esm"_kj, content, contentStr, origin,
+        [&](v8::ScriptCompiler::Source& source, v8::ScriptCompiler::CompileOptions options) {
+      return jsg::check(v8::ScriptCompiler::CompileModule(js.v8Isolate, &source, options));
+    }, [](v8::Local<v8::Module> module) {
+      return v8::ScriptCompiler::CreateCodeCache(module->GetUnboundModuleScript());
+    });
+  }
+
   v8::ScriptCompiler::Source source(contentStr, origin);
   return jsg::check(v8::ScriptCompiler::CompileModule(js.v8Isolate, &source));
 }
@@ -389,8 +456,11 @@ ModuleRegistry::ModuleInfo::ModuleInfo(jsg::Lock& js,
     kj::ArrayPtr<const char> content,
     kj::ArrayPtr<const kj::byte> compileCache,
     ModuleInfoCompileOption flags,
-    const CompilationObserver& observer)
-    : ModuleInfo(js, compileEsmModule(js, name, content, compileCache, flags, observer)) {}
+    const CompilationObserver& observer,
+    kj::Maybe<const CodeCacheStore&> codeCacheStore)
+    : ModuleInfo(js,
+          compileEsmModule(js, name, content, compileCache, flags, observer,
+              flags == ModuleInfoCompileOption::BUNDLE ? codeCacheStore : kj::none)) {}
 
 ModuleRegistry::ModuleInfo::ModuleInfo(jsg::Lock& js,
     kj::StringPtr name,
@@ -407,6 +477,31 @@ Ref<CommonJsModuleContext> ModuleRegistry::CommonJsModuleInfo::initModuleContext
   return jsg::alloc<jsg::CommonJsModuleContext>(js, kj::Path::parse(name));
 }
 
+v8::Local<v8::Function> ModuleRegistry::CommonJsModuleInfo::compileCommonJsFunction(jsg::Lock& js,
+    kj::StringPtr name,
+    kj::StringPtr content,
+    v8::Local<v8::Object> moduleContext,
+    kj::Maybe<const CodeCacheStore&> codeCacheStore) {
+  v8::ScriptOrigin origin(v8StrIntern(js.v8Isolate, name));
+  auto contentStr = v8Str(js.v8Isolate, content);
+  auto context = js.v8Context();
+  auto compile = [&](v8::ScriptCompiler::Source& source,
+                     v8::ScriptCompiler::CompileOptions options) {
+    return jsg::check(v8::ScriptCompiler::CompileFunction(
+        context, &source, 0, nullptr, 1, &moduleContext, options));
+  };
+
+  KJ_IF_SOME(store, codeCacheStore) {
+    return compileWithCodeCacheStore(store, "cjs"_kj, content.asArray(), contentStr, origin,
+        compile, [](v8::Local<v8::Function> fn) {
+      return v8::ScriptCompiler::CreateCodeCacheForFunction(fn);
+    });
+  }
+
+  v8::ScriptCompiler::Source source(contentStr, origin);
+  return compile(source, v8::ScriptCompiler::kNoCompileOptions);
+}
+
 ModuleRegistry::CapnpModuleInfo::CapnpModuleInfo(
     Value fileScope, kj::HashMap<kj::StringPtr, jsg::Value> topLevelDecls)
     : fileScope(kj::mv(fileScope)),
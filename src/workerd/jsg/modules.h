@@ -16,6 +16,7 @@
 
 namespace workerd::jsg {
 
+class CodeCacheStore;
 class CommonJsModuleContext;
 class CommonJsModuleObject;
 class NodeJsModuleObject;
@@ -120,9 +121,12 @@ class ModuleRegistry {
     Ref<CommonJsModuleContext> moduleContext;
     jsg::Function<void()> evalFunc;
 
-    CommonJsModuleInfo(auto& lock, kj::StringPtr name, kj::StringPtr content)
+    CommonJsModuleInfo(auto& lock,
+        kj::StringPtr name,
+        kj::StringPtr content,
+        kj::Maybe<const CodeCacheStore&> codeCacheStore = kj::none)
         : moduleContext(initModuleContext(lock, name)),
-          evalFunc(initEvalFunc(lock, moduleContext, name, content)) {}
+          evalFunc(initEvalFunc(lock, moduleContext, name, content, codeCacheStore)) {}
 
     CommonJsModuleInfo(CommonJsModuleInfo&&) = default;
     CommonJsModuleInfo& operator=(CommonJsModuleInfo&&) = default;
@@ -132,15 +136,21 @@ class ModuleRegistry {
     static jsg::Function<void()> initEvalFunc(auto& lock,
         Ref<CommonJsModuleContext>& moduleContext,
         kj::StringPtr name,
-        kj::StringPtr content) {
-      v8::ScriptOrigin origin(v8StrIntern(lock.v8Isolate, name));
-      v8::ScriptCompiler::Source source(v8Str(lock.v8Isolate, content), origin);
+        kj::StringPtr content,
+        kj::Maybe<const CodeCacheStore&> codeCacheStore = kj::none) {
       auto context = lock.v8Context();
       auto handle = lock.wrap(context, moduleContext.addRef());
-      auto fn =
-          jsg::check(v8::ScriptCompiler::CompileFunction(context, &source, 0, nullptr, 1, &handle));
+      auto fn = compileCommonJsFunction(lock, name, content, handle, codeCacheStore);
       return lock.template unwrap<jsg::Function<void()>>(context, fn);
     }
+
+    // Compiles the function that evaluates a CommonJS module, with `moduleContext` as the scope
+    // that provides `module`, `exports` and `require`.
+    static v8::Local<v8::Function> compileCommonJsFunction(jsg::Lock& js,
+        kj::StringPtr name,
+        kj::StringPtr content,
+        v8::Local<v8::Object> moduleContext,
+        kj::Maybe<const CodeCacheStore&> codeCacheStore);
   };
 
   template <typename T>
@@ -177,12 +187,14 @@ class ModuleRegistry {
         v8::Local<v8::Module> module,
         kj::Maybe<SyntheticModuleInfo> maybeSynthetic = kj::none);
 
+    // If `compileCache` is empty, BUNDLE modules use the caches in `codeCacheStore`, if given.
     ModuleInfo(jsg::Lock& js,
         kj::StringPtr name,
         kj::ArrayPtr<const char> content,
         kj::ArrayPtr<const kj::byte> compileCache,
         ModuleInfoCompileOption flags,
-        const CompilationObserver& observer);
+        const CompilationObserver& observer,
+        kj::Maybe<const CodeCacheStore&> codeCacheStore = kj::none);
 
     ModuleInfo(jsg::Lock& js,
         kj::StringPtr name,
@@ -288,6 +300,14 @@ class ModuleRegistryImpl final: public ModuleRegistry {
     entries.insert(kj::heap<Entry>(specifier, Type::BUNDLE, kj::fwd<ModuleInfo>(info)));
   }
 
+  // Register a bundle module without compiling it. `factory` compiles the module the first time
+  // it is resolved, so modules that are never imported or required cost nothing at startup. If
+  // `factory` returns kj::none, the module is treated as not found and `factory` is called again
+  // on the next attempt.
+  void add(kj::Path& specifier, ModuleCallback factory) {
+    entries.insert(kj::heap<Entry>(specifier, Type::BUNDLE, kj::mv(factory)));
+  }
+
   void addBuiltinModule(Module::Reader module) {
     if (module.which() != Module::SRC) {
       auto specifier = module.getName();
@@ -0,0 +1,291 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "alarm-scheduler.h"
+
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+// Follows the timer, so that the scheduler's view of the date moves with it.
+class FakeClock final: public kj::Clock {
+ public:
+  FakeClock(kj::TimerImpl& timer): timer(timer) {}
+
+  kj::Date now() const override {
+    return kj::UNIX_EPOCH + (timer.now() - kj::origin<kj::TimePoint>());
+  }
+
+ private:
+  kj::TimerImpl& timer;
+};
+
+struct AlarmRun {
+  kj::String actorId;
+  kj::Date scheduledTime;
+  uint32_t retryCount;
+};
+
+struct FakeNamespace {
+  kj::Vector<AlarmRun> runs;
+
+  // Results to return from upcoming alarm runs, in order. Once empty, alarms succeed.
+  kj::Vector<WorkerInterface::AlarmResult> results;
+  size_t nextResult = 0;
+};
+
+class FakeActor final: public WorkerInterface {
+ public:
+  FakeActor(FakeNamespace& ns, kj::String id): ns(ns), id(kj::mv(id)) {}
+
+  kj::Promise<void> request(kj::HttpMethod method,
+      kj::StringPtr url,
+      const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody,
+      kj::HttpService::Response& response) override {
+    KJ_UNIMPLEMENTED("not used by AlarmScheduler");
+  }
+
+  kj::Promise<void> connect(kj::StringPtr host,
+      const kj::HttpHeaders& headers,
+      kj::AsyncIoStream& connection,
+      ConnectResponse& response,
+      kj::HttpConnectSettings settings) override {
+    KJ_UNIMPLEMENTED("not used by AlarmScheduler");
+  }
+
+  kj::Promise<void> prewarm(kj::StringPtr url) override {
+    KJ_UNIMPLEMENTED("not used by AlarmScheduler");
+  }
+
+  kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime, kj::StringPtr cron) override {
+    KJ_UNIMPLEMENTED("not used by AlarmScheduler");
+  }
+
+  kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime, uint32_t retryCount) override {
+    ns.runs.add(AlarmRun{
+      .actorId = kj::str(id), .scheduledTime = scheduledTime, .retryCount = retryCount});
+    if (ns.nextResult < ns.results.size()) {
+      return ns.results[ns.nextResult++];
+    }
+    return AlarmResult{.retry = false, .outcome = EventOutcome::OK};
+  }
+
+  kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+    KJ_UNIMPLEMENTED("not used by AlarmScheduler");
+  }
+
+ private:
+  FakeNamespace& ns;
+  kj::String id;
+};
+
+struct AlarmFixture {
+  kj::EventLoop loop;
+  kj::WaitScope ws{loop};
+  kj::TimerImpl timer{kj::origin<kj::TimePoint>()};
+  FakeClock clock{timer};
+  kj::Own<const kj::Directory> dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs{*dir};
+  FakeNamespace ns;
+  AlarmScheduler scheduler{clock, timer, vfs, kj::Path({"alarms.sqlite"})};
+
+  AlarmFixture() {
+    scheduler.registerNamespace("ns"_kj, [this](kj::String id) -> kj::Own<WorkerInterface> {
+      return kj::heap<FakeActor>(ns, kj::mv(id));
+    });
+    ws.poll();
+  }
+
+  ActorKey actor(kj::StringPtr id) {
+    return ActorKey{.uniqueKey = "ns"_kj, .actorId = id};
+  }
+
+  // Moves time forward to `offset` from the start of the test, and runs whatever comes due.
+  void advanceTo(kj::Duration offset) {
+    timer.advanceTo(kj::origin<kj::TimePoint>() + offset);
+    ws.poll();
+  }
+
+  // Opens a second connection to the scheduler's database, to tamper with it.
+  kj::Own<SqliteDatabase> openDatabase() {
+    return kj::heap<SqliteDatabase>(vfs, kj::Path({"alarms.sqlite"}), kj::WriteMode::MODIFY);
+  }
+};
+
+KJ_TEST("AlarmScheduler runs alarms when they come due") {
+  AlarmFixture fixture;
+  auto& scheduler = fixture.scheduler;
+
+  // One alarm within the materialize horizon, one beyond it.
+  auto soon = kj::UNIX_EPOCH + 1 * kj::MINUTES;
+  auto later = kj::UNIX_EPOCH + 30 * kj::MINUTES;
+  KJ_EXPECT(scheduler.setAlarm(fixture.actor("a"), soon));
+  KJ_EXPECT(scheduler.setAlarm(fixture.actor("b"), later));
+  scheduler.onBatchCommitted().wait(fixture.ws);
+
+  KJ_EXPECT(scheduler.getAlarm(fixture.actor("a")) == soon);
+  KJ_EXPECT(scheduler.getAlarm(fixture.actor("b")) == later);
+
+  fixture.advanceTo(59 * kj::SECONDS);
+  KJ_EXPECT(fixture.ns.runs.size() == 0);
+
+  fixture.advanceTo(1 * kj::MINUTES);
+  KJ_ASSERT(fixture.ns.runs.size() == 1);
+  KJ_EXPECT(fixture.ns.runs[0].actorId == "a");
+  KJ_EXPECT(fixture.ns.runs[0].scheduledTime == soon);
+  KJ_EXPECT(fixture.ns.runs[0].retryCount == 0);
+  KJ_EXPECT(scheduler.getAlarm(fixture.actor("a")) == kj::none);
+
+  // The later alarm is loaded from the database as it gets close, and still runs on time.
+  fixture.advanceTo(29 * kj::MINUTES);
+  KJ_EXPECT(fixture.ns.runs.size() == 1);
+  fixture.advanceTo(30 * kj::MINUTES);
+  KJ_ASSERT(fixture.ns.runs.size() == 2);
+  KJ_EXPECT(fixture.ns.runs[1].actorId == "b");
+  KJ_EXPECT(scheduler.getAlarm(fixture.actor("b")) == kj::none);
+}
+
+KJ_TEST("AlarmScheduler deleteAlarm cancels and setAlarm reschedules") {
+  AlarmFixture fixture;
+  auto& scheduler = fixture.scheduler;
+
+  KJ_EXPECT(scheduler.setAlarm(fixture.actor("a"), kj::UNIX_EPOCH + 1 * kj::MINUTES));
+  KJ_EXPECT(scheduler.setAlarm(fixture.actor("b"), kj::UNIX_EPOCH + 1 * kj::MINUTES));
+  KJ_EXPECT(scheduler.deleteAlarm(fixture.actor("a")));
+  KJ_EXPECT(!scheduler.deleteAlarm(fixture.actor("c")));
+  KJ_EXPECT(scheduler.setAlarm(fixture.actor("b"), kj::UNIX_EPOCH + 2 * kj::MINUTES));
+  scheduler.onBatchCommitted().wait(fixture.ws);
+
+  KJ_EXPECT(scheduler.getAlarm(fixture.actor("a")) == kj::none);
+
+  fixture.advanceTo(1 * kj::MINUTES);
+  KJ_EXPECT(fixture.ns.runs.size() == 0);
+
+  fixture.advanceTo(2 * kj::MINUTES);
+  KJ_ASSERT(fixture.ns.runs.size() == 1);
+  KJ_EXPECT(fixture.ns.runs[0].actorId == "b");
+  KJ_EXPECT(fixture.ns.runs[0].scheduledTime == kj::UNIX_EPOCH + 2 * kj::MINUTES);
+}
+
+KJ_TEST("AlarmScheduler retries failed alarms with backoff") {
+  AlarmFixture fixture;
+  auto& scheduler = fixture.scheduler;
+
+  fixture.ns.results.add(WorkerInterface::AlarmResult{
+    .retry = true, .retryCountsAgainstLimit = true, .outcome = EventOutcome::EXCEPTION});
+  fixture.ns.results.add(WorkerInterface::AlarmResult{
+    .retry = true, .retryCountsAgainstLimit = true, .outcome = EventOutcome::EXCEPTION});
+
+  auto scheduledTime = kj::UNIX_EPOCH + 1 * kj::MINUTES;
+  scheduler.setAlarm(fixture.actor("a"), scheduledTime);
+  scheduler.onBatchCommitted().wait(fixture.ws);
+
+  fixture.advanceTo(1 * kj::MINUTES);
+  KJ_ASSERT(fixture.ns.runs.size() == 1);
+  KJ_EXPECT(fixture.ns.runs[0].retryCount == 0);
+
+  // The first retry comes RETRY_START_SECONDS later, plus up to 25% jitter.
+  fixture.advanceTo(1 * kj::MINUTES + 1 * kj::SECONDS);
+  KJ_EXPECT(fixture.ns.runs.size() == 1);
+  fixture.advanceTo(1 * kj::MINUTES + 3 * kj::SECONDS);
+  KJ_ASSERT(fixture.ns.runs.size() == 2);
+  KJ_EXPECT(fixture.ns.runs[1].retryCount == 1);
+  KJ_EXPECT(fixture.ns.runs[1].scheduledTime == scheduledTime);
+
+  // The backoff doubles.
+  fixture.advanceTo(1 * kj::MINUTES + 6 * kj::SECONDS);
+  KJ_EXPECT(fixture.ns.runs.size() == 2);
+  fixture.advanceTo(1 * kj::MINUTES + 8 * kj::SECONDS);
+  KJ_ASSERT(fixture.ns.runs.size() == 3);
+  KJ_EXPECT(fixture.ns.runs[2].retryCount == 2);
+
+  // The third attempt succeeded, so the alarm is gone.
+  KJ_EXPECT(scheduler.getAlarm(fixture.actor("a")) == kj::none);
+  fixture.advanceTo(10 * kj::MINUTES);
+  KJ_EXPECT(fixture.ns.runs.size() == 3);
+}
+
+KJ_TEST("AlarmScheduler restarts its timeline after a failure") {
+  AlarmFixture fixture;
+  auto& scheduler = fixture.scheduler;
+  auto other = fixture.openDatabase();
+
+  // Make the timeline's next load from the database fail.
+  other->run("DROP TABLE _cf_ALARM");
+
+  {
+    KJ_EXPECT_LOG(ERROR, "alarm timeline failed, restarting");
+    fixture.advanceTo(AlarmScheduler::MATERIALIZE_HORIZON / 2);
+  }
+
+  other->run(R"(
+    CREATE TABLE _cf_ALARM (
+      actor_unique_key TEXT,
+      actor_id TEXT,
+      scheduled_time INTEGER,
+      PRIMARY KEY (actor_unique_key, actor_id)
+    ) WITHOUT ROWID
+  )");
+  other->run("CREATE INDEX _cf_ALARM_scheduled_time ON _cf_ALARM (scheduled_time)");
+
+  auto scheduledTime = kj::UNIX_EPOCH + AlarmScheduler::MATERIALIZE_HORIZON / 2 + 1 * kj::MINUTES;
+  scheduler.setAlarm(fixture.actor("a"), scheduledTime);
+  scheduler.onBatchCommitted().wait(fixture.ws);
+
+  // The alarm only runs if the timeline came back.
+  fixture.advanceTo(
+      AlarmScheduler::MATERIALIZE_HORIZON / 2 + AlarmScheduler::TIMELINE_RESTART_DELAY);
+  KJ_EXPECT(fixture.ns.runs.size() == 0);
+  fixture.advanceTo(AlarmScheduler::MATERIALIZE_HORIZON / 2 + 1 * kj::MINUTES);
+  KJ_ASSERT(fixture.ns.runs.size() == 1);
+  KJ_EXPECT(fixture.ns.runs[0].actorId == "a");
+}
+
+KJ_TEST("AlarmScheduler reloads alarms after a failed commit") {
+  AlarmFixture fixture;
+  auto& scheduler = fixture.scheduler;
+  auto other = fixture.openDatabase();
+
+  auto scheduledTime = kj::UNIX_EPOCH + 1 * kj::MINUTES;
+  scheduler.setAlarm(fixture.actor("a"), scheduledTime);
+  scheduler.onBatchCommitted().wait(fixture.ws);
+
+  // Writing an alarm for "poison" violates a deferred foreign key, which fails the whole batch at
+  // COMMIT, after the in-memory alarms have already been updated.
+  other->run("CREATE TABLE parent (id TEXT PRIMARY KEY)");
+  other->run(R"(
+    CREATE TABLE child (parent_id TEXT REFERENCES parent(id) DEFERRABLE INITIALLY DEFERRED)
+  )");
+  other->run(R"(
+    CREATE TRIGGER poison AFTER INSERT ON _cf_ALARM WHEN NEW.actor_id = 'poison'
+    BEGIN
+      INSERT INTO child VALUES ('missing');
+    END
+  )");
+
+  KJ_EXPECT(scheduler.deleteAlarm(fixture.actor("a")));
+  KJ_EXPECT(scheduler.setAlarm(fixture.actor("poison"), kj::UNIX_EPOCH + 2 * kj::MINUTES));
+
+  {
+    KJ_EXPECT_LOG(ERROR, "failed to commit alarm changes");
+    KJ_EXPECT_THROW_MESSAGE(
+        "FOREIGN KEY constraint failed", scheduler.onBatchCommitted().wait(fixture.ws));
+  }
+
+  // Neither change took effect.
+  KJ_EXPECT(scheduler.getAlarm(fixture.actor("a")) == scheduledTime);
+  KJ_EXPECT(scheduler.getAlarm(fixture.actor("poison")) == kj::none);
+
+  fixture.advanceTo(1 * kj::MINUTES);
+  KJ_ASSERT(fixture.ns.runs.size() == 1);
+  KJ_EXPECT(fixture.ns.runs[0].actorId == "a");
+
+  fixture.advanceTo(2 * kj::MINUTES);
+  KJ_EXPECT(fixture.ns.runs.size() == 1);
+}
+
+}  // namespace
+}  // namespace workerd::server
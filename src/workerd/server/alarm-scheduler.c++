@@ -4,6 +4,8 @@
 
 #include "alarm-scheduler.h"
 
+#include <kj/vector.h>
+
 #include <cmath>
 
 namespace workerd::server {
@@ -24,6 +26,14 @@ std::default_random_engine makeSeededRandomEngine() {
   return engine;
 }
 
+int64_t toNanos(kj::Date date) {
+  return (date - kj::UNIX_EPOCH) / kj::NANOSECONDS;
+}
+
+kj::Date fromNanos(int64_t nanos) {
+  return kj::UNIX_EPOCH + nanos * kj::NANOSECONDS;
+}
+
 }  // namespace
 
 AlarmScheduler::AlarmScheduler(
@@ -38,7 +48,18 @@ AlarmScheduler::AlarmScheduler(
         return kj::mv(db);
       }()),
       tasks(*this) {
-  loadAlarmsFromDb();
+  // Start on the next turn, so that overdue alarms don't run before the caller has had a chance
+  // to registerNamespace().
+  tasks.add(kj::evalLater([this]() { startTimeline(); }));
+}
+
+AlarmScheduler::~AlarmScheduler() noexcept(false) {
+  if (pendingBatch != kj::none) {
+    // Don't lose writes that were waiting for the end of the turn to be committed.
+    KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() { stmtCommitBatch.run(); })) {
+      KJ_LOG(ERROR, "failed to commit alarm changes on shutdown", exception);
+    }
+  }
 }
 
 void AlarmScheduler::ensureInitialized(SqliteDatabase& db) {
@@ -53,29 +74,10 @@ void AlarmScheduler::ensureInitialized(SqliteDatabase& db) {
       PRIMARY KEY (actor_unique_key, actor_id)
     ) WITHOUT ROWID;
   )");
-}
 
-void AlarmScheduler::loadAlarmsFromDb() {
-  auto now = clock.now();
-
-  // TODO(someday): don't maintain the entire alarm set in memory -- right now for the usecase of
-  // local development, doing so is sufficient.
-  auto query = db->run(R"(
-    SELECT actor_unique_key, actor_id, scheduled_time FROM _cf_ALARM;
+  db.run(R"(
+    CREATE INDEX IF NOT EXISTS _cf_ALARM_scheduled_time ON _cf_ALARM (scheduled_time);
   )");
-
-  while (!query.isDone()) {
-    auto date = kj::UNIX_EPOCH + (kj::NANOSECONDS * query.getInt64(2));
-
-    auto ownUniqueKey = kj::str(query.getText(0));
-    auto ownActorId = kj::str(query.getText(1));
-    auto actor = kj::attachVal(ActorKey{.uniqueKey = ownUniqueKey, .actorId = ownActorId},
-        kj::mv(ownUniqueKey), kj::mv(ownActorId));
-
-    alarms.insert(*actor, scheduleAlarm(now, kj::mv(actor), date));
-
-    query.nextRow();
-  }
 }
 
 void AlarmScheduler::registerNamespace(kj::StringPtr uniqueKey, GetActorFn getActor) {
@@ -86,64 +88,64 @@ kj::Maybe<kj::Date> AlarmScheduler::getAlarm(ActorKey actor) {
   // TODO(someday): Might be able to simplify AlarmScheduler somewhat, now that ActorSqlite no
   // longer relies on it for getAlarm()?
   KJ_IF_SOME(alarm, alarms.find(actor)) {
-    if (alarm.status == AlarmStatus::STARTED) {
+    if (alarm->status == AlarmStatus::STARTED) {
       // getAlarm() when the alarm handler is running should return null,
       // unless an alarm is queued;
-      return alarm.queuedAlarm;
+      return alarm->queuedAlarm;
     } else {
-      return alarm.scheduledTime;
+      return alarm->scheduledTime;
     }
   } else {
-    // We currently retain the entire set of queued alarms in memory, no need to hit sqlite
-    return kj::none;
+    // Alarms that aren't due soon are only in the database.
+    auto query = stmtGetAlarm.run(actor.uniqueKey, actor.actorId);
+    if (query.isDone()) {
+      return kj::none;
+    }
+    return fromNanos(query.getInt64(0));
   }
 }
 
 bool AlarmScheduler::setAlarm(ActorKey actor, kj::Date scheduledTime) {
-  int64_t scheduledTimeNs = (scheduledTime - kj::UNIX_EPOCH) / kj::NANOSECONDS;
-  auto query = stmtSetAlarm.run(actor.uniqueKey, actor.actorId, scheduledTimeNs);
-
-  bool existing = true;
-  auto& entry = alarms.findOrCreate(actor, [&]() {
-    existing = false;
+  startBatch();
+  auto query = stmtSetAlarm.run(actor.uniqueKey, actor.actorId, toNanos(scheduledTime));
 
-    auto ownUniqueKey = kj::str(actor.uniqueKey);
-    auto ownActorId = kj::str(actor.actorId);
-    auto ownActor = kj::attachVal(ActorKey{.uniqueKey = ownUniqueKey, .actorId = ownActorId},
-        kj::mv(ownUniqueKey), kj::mv(ownActorId));
-
-    return decltype(alarms)::Entry{
-      *ownActor, scheduleAlarm(clock.now(), kj::mv(ownActor), scheduledTime)};
-  });
-
-  if (existing) {
-    if (entry.status != AlarmStatus::WAITING) {
+  KJ_IF_SOME(entry, alarms.findEntry(actor)) {
+    auto& alarm = *entry.value;
+    if (alarm.status != AlarmStatus::WAITING) {
       // We queue any new alarm after the existing alarm even if the new alarm has the same scheduled
       // time, as receiving a notification directly maps to a write for that time in the actor.
-      entry.queuedAlarm = scheduledTime;
+      alarm.queuedAlarm = scheduledTime;
+    } else if (isMaterialized(scheduledTime)) {
+      resetAlarm(alarm, scheduledTime);
     } else {
-      entry = scheduleAlarm(clock.now(), kj::mv(entry.actor), scheduledTime);
+      // The alarm moved past the horizon. It'll be loaded from the database again when it gets
+      // closer.
+      eraseAlarm(entry);
     }
+  } else if (isMaterialized(scheduledTime)) {
+    materialize(actor, scheduledTime);
   }
 
   return query.changeCount() > 0;
 }
 
 bool AlarmScheduler::deleteAlarm(ActorKey actor) {
+  startBatch();
   auto query = stmtDeleteAlarm.run(actor.uniqueKey, actor.actorId);
 
   KJ_IF_SOME(entry, alarms.findEntry(actor)) {
-    KJ_IF_SOME(queued, entry.value.queuedAlarm) {
-      if (entry.value.status == AlarmStatus::STARTED) {
+    auto& alarm = *entry.value;
+    KJ_IF_SOME(queued, alarm.queuedAlarm) {
+      if (alarm.status == AlarmStatus::STARTED) {
         // If we are currently running an alarm, we want to delete the queued instead of current.
-        entry.value.queuedAlarm = kj::none;
+        alarm.queuedAlarm = kj::none;
       } else {
-        entry.value = scheduleAlarm(clock.now(), kj::mv(entry.value.actor), queued);
+        resetAlarm(alarm, queued);
       }
     } else {
-      if (entry.value.status != AlarmStatus::STARTED) {
+      if (alarm.status != AlarmStatus::STARTED) {
         // We can't remove running alarms.
-        alarms.erase(entry);
+        eraseAlarm(entry);
       }
     }
   }
@@ -151,48 +153,242 @@ bool AlarmScheduler::deleteAlarm(ActorKey actor) {
   return query.changeCount() > 0;
 }
 
-kj::Promise<AlarmScheduler::RetryInfo> AlarmScheduler::runAlarm(
-    const ActorKey& actor, kj::Date scheduledTime, uint32_t retryCount) {
-  KJ_IF_SOME(ns, namespaces.find(actor.uniqueKey)) {
-    auto result = co_await ns.getActor(kj::str(actor.actorId))->runAlarm(scheduledTime, retryCount);
+kj::Promise<void> AlarmScheduler::onBatchCommitted() {
+  KJ_IF_SOME(batch, pendingBatch) {
+    return batch.addBranch();
+  }
+  return kj::READY_NOW;
+}
 
-    co_return RetryInfo{.retry = result.outcome != EventOutcome::OK && result.retry,
-      .retryCountsAgainstLimit = result.retryCountsAgainstLimit};
+void AlarmScheduler::startBatch() {
+  if (pendingBatch != kj::none) {
+    return;
+  }
+
+  stmtBeginBatch.run();
+  auto paf = kj::newPromiseAndFulfiller<void>();
+  pendingBatch = paf.promise.fork();
+  tasks.add(kj::evalLater([this, fulfiller = kj::mv(paf.fulfiller)]() mutable {
+    commitBatch(kj::mv(fulfiller));
+  }));
+}
+
+void AlarmScheduler::commitBatch(kj::Own<kj::PromiseFulfiller<void>> fulfiller) {
+  pendingBatch = kj::none;
+
+  KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() { stmtCommitBatch.run(); })) {
+    // SQLite may or may not have rolled back already, depending on the error, so a failed
+    // rollback is fine.
+    (void)kj::runCatchingExceptions([&]() { db->run("ROLLBACK TRANSACTION"); });
+    KJ_LOG(ERROR, "failed to commit alarm changes", exception);
+
+    // The changes were already applied to `alarms`, which now disagrees with the database.
+    KJ_IF_SOME(reloadException, kj::runCatchingExceptions([&]() { reloadFromDatabase(); })) {
+      KJ_LOG(ERROR, "failed to reload alarms after failed commit", reloadException);
+    }
+
+    fulfiller->reject(kj::mv(exception));
   } else {
-    throw KJ_EXCEPTION(FAILED, "uniqueKey for stored alarm was not registered?");
+    fulfiller->fulfill();
   }
 }
 
-AlarmScheduler::ScheduledAlarm AlarmScheduler::scheduleAlarm(
-    kj::Date now, kj::Own<ActorKey> actor, kj::Date scheduledTime) {
-  auto task = makeAlarmTask(scheduledTime - now, *actor, scheduledTime);
+void AlarmScheduler::reloadFromDatabase() {
+  kj::Vector<ScheduledAlarm*> stale;
+  for (auto& entry: alarms) {
+    auto& alarm = *entry.value;
+    kj::Maybe<kj::Date> stored;
+    {
+      auto query = stmtGetAlarm.run(alarm.actor->uniqueKey, alarm.actor->actorId);
+      if (!query.isDone()) {
+        stored = fromNanos(query.getInt64(0));
+      }
+    }
+
+    if (alarm.status == AlarmStatus::STARTED) {
+      // A running alarm's row holds either its own time or the time of the alarm queued behind it.
+      alarm.queuedAlarm = kj::none;
+      KJ_IF_SOME(time, stored) {
+        if (time != alarm.scheduledTime) {
+          alarm.queuedAlarm = time;
+        }
+      }
+    } else {
+      // Rows that are still materialized are picked up again by the reload below.
+      KJ_IF_SOME(time, stored) {
+        if (time != alarm.scheduledTime) {
+          stale.add(&alarm);
+        }
+      } else {
+        stale.add(&alarm);
+      }
+    }
+  }
 
-  return ScheduledAlarm{kj::mv(actor), scheduledTime, kj::mv(task)};
+  for (auto alarm: stale) {
+    eraseAlarm(KJ_ASSERT_NONNULL(alarms.findEntry(*alarm->actor)));
+  }
+
+  // Rows whose deletion was rolled back may be anywhere before the horizon, so load it all again.
+  // Alarms still in memory are skipped by loadMore().
+  loadedUntilNs = std::numeric_limits<int64_t>::min();
+  wakeTimeline();
+}
+
+bool AlarmScheduler::isMaterialized(kj::Date scheduledTime) {
+  return toNanos(scheduledTime) < loadedUntilNs;
 }
 
-kj::Promise<void> AlarmScheduler::checkTimestamp(kj::Duration delay, kj::Date scheduledTime) {
-  co_await timer.afterDelay(delay);
-
-  // Since we are waiting on timer.afterDelay, it's possible that timer.now() was behind
-  // the real time by a few ms, leading to premature alarm() execution. This checks it the current
-  // time is >= than scheduledTime to ensure we run alarms only on or after their scheduled time.
-  auto now = clock.now();
-  if (now < scheduledTime) {
-    // If it's not yet time to trigger the alarm, we shall wait a while longer until we can
-    // trigger it. This repeats until it's time for the alarm to run.
-    co_await checkTimestamp(scheduledTime - now, scheduledTime);
+void AlarmScheduler::materialize(const ActorKey& actor, kj::Date scheduledTime) {
+  auto ownActor = actor.clone();
+  auto alarm = kj::heap<ScheduledAlarm>(
+      ScheduledAlarm{.actor = kj::mv(ownActor), .scheduledTime = scheduledTime});
+  auto& ref = *alarm;
+  alarms.insert(*ref.actor, kj::mv(alarm));
+  setRunTime(ref, scheduledTime);
+}
+
+void AlarmScheduler::eraseAlarm(kj::HashMap<ActorKey, kj::Own<ScheduledAlarm>>::Entry& entry) {
+  setRunTime(*entry.value, kj::none);
+  alarms.erase(entry);
+}
+
+void AlarmScheduler::resetAlarm(ScheduledAlarm& alarm, kj::Date scheduledTime) {
+  alarm.scheduledTime = scheduledTime;
+  alarm.queuedAlarm = kj::none;
+  alarm.status = AlarmStatus::WAITING;
+  alarm.previousRetryCountedAgainstLimit = false;
+  alarm.backoff = 0;
+  alarm.retry = 0;
+  alarm.countedRetry = 0;
+  setRunTime(alarm, scheduledTime);
+}
+
+void AlarmScheduler::setRunTime(ScheduledAlarm& alarm, kj::Maybe<kj::Date> runTime) {
+  KJ_IF_SOME(oldTime, alarm.runTime) {
+    timeline.erase(TimelineEntry{oldTime, &alarm});
+  }
+
+  alarm.runTime = runTime;
+
+  KJ_IF_SOME(newTime, runTime) {
+    auto inserted = timeline.insert(TimelineEntry{newTime, &alarm}).first;
+    if (inserted == timeline.begin()) {
+      wakeTimeline();
+    }
   }
 }
 
-kj::Promise<void> AlarmScheduler::makeAlarmTask(
-    kj::Duration delay, const ActorKey& actorRef, kj::Date scheduledTime) {
-  co_await checkTimestamp(delay, scheduledTime);
-  uint32_t retryCount = 0;
-  {
-    auto& entry = KJ_ASSERT_NONNULL(alarms.findEntry(actorRef));
-    entry.value.status = AlarmStatus::STARTED;
-    retryCount = entry.value.countedRetry;
+void AlarmScheduler::wakeTimeline() {
+  KJ_IF_SOME(fulfiller, timelineChanged) {
+    if (fulfiller->isWaiting()) {
+      fulfiller->fulfill();
+    }
   }
+}
+
+void AlarmScheduler::startTimeline() {
+  tasks.add(runTimeline().catch_([this](kj::Exception&& exception) {
+    // Without the timeline no alarm would ever run again, so keep retrying.
+    KJ_LOG(ERROR, "alarm timeline failed, restarting", exception);
+    timelineChanged = kj::none;
+    return timer.afterDelay(TIMELINE_RESTART_DELAY).then([this]() { startTimeline(); });
+  }));
+}
+
+kj::Promise<void> AlarmScheduler::runTimeline() {
+  for (;;) {
+    auto now = clock.now();
+    bool moreToLoad = loadMore(now);
+
+    while (!timeline.empty() && timeline.begin()->runTime <= now) {
+      auto& alarm = *timeline.begin()->alarm;
+      setRunTime(alarm, kj::none);
+      tasks.add(runAlarmTask(alarm));
+    }
+
+    if (moreToLoad) {
+      // Let other events run between batches.
+      co_await kj::evalLater([]() {});
+      continue;
+    }
+
+    // Wake up when the next alarm is due, or when it's time to load more from the database.
+    auto wakeTime = fromNanos(loadedUntilNs) - MATERIALIZE_HORIZON / 2;
+    if (!timeline.empty()) {
+      wakeTime = kj::min(wakeTime, timeline.begin()->runTime);
+    }
+
+    // Since we are waiting on timer.afterDelay, it's possible that timer.now() was behind the
+    // real time by a few ms, so we'll simply go around the loop again if we wake up early.
+    auto paf = kj::newPromiseAndFulfiller<void>();
+    timelineChanged = kj::mv(paf.fulfiller);
+    co_await paf.promise.exclusiveJoin(timer.afterDelay(kj::max(wakeTime - now, 0 * kj::SECONDS)));
+    timelineChanged = kj::none;
+  }
+}
+
+bool AlarmScheduler::loadMore(kj::Date now) {
+  int64_t targetNs = toNanos(now + MATERIALIZE_HORIZON);
+  if (loadedUntilNs >= targetNs) {
+    return false;
+  }
+
+  // Alarms that are already in memory are newer than what's in the database, or are the same, so
+  // rows for them are skipped.
+  auto loadRows = [&](SqliteDatabase::Query& query) {
+    uint count = 0;
+    int64_t lastNs = loadedUntilNs;
+    while (!query.isDone()) {
+      ++count;
+      lastNs = query.getInt64(2);
+      ActorKey actor{.uniqueKey = query.getText(0), .actorId = query.getText(1)};
+      if (alarms.find(actor) == kj::none) {
+        materialize(actor, fromNanos(lastNs));
+      }
+      query.nextRow();
+    }
+    return std::make_pair(count, lastNs);
+  };
+
+  auto query = stmtLoadAlarms.run(loadedUntilNs, targetNs, LOAD_BATCH_SIZE);
+  auto [count, lastNs] = loadRows(query);
+
+  if (count < LOAD_BATCH_SIZE) {
+    loadedUntilNs = targetNs;
+    return false;
+  } else if (lastNs == loadedUntilNs) {
+    // The whole batch was scheduled at the same instant, so paging by time can't make progress.
+    // Load everything at that instant in one go.
+    auto sameTimeQuery = stmtLoadAlarmsAt.run(lastNs);
+    loadRows(sameTimeQuery);
+    loadedUntilNs = lastNs + 1;
+  } else {
+    // Some of the alarms at `lastNs` may not have fit in this batch, so the next one starts there.
+    loadedUntilNs = lastNs;
+  }
+  return true;
+}
+
+kj::Promise<AlarmScheduler::RetryInfo> AlarmScheduler::runAlarm(
+    const ActorKey& actor, kj::Date scheduledTime, uint32_t retryCount) {
+  KJ_IF_SOME(ns, namespaces.find(actor.uniqueKey)) {
+    auto result = co_await ns.getActor(kj::str(actor.actorId))->runAlarm(scheduledTime, retryCount);
+
+    co_return RetryInfo{.retry = result.outcome != EventOutcome::OK && result.retry,
+      .retryCountsAgainstLimit = result.retryCountsAgainstLimit};
+  } else {
+    throw KJ_EXCEPTION(FAILED, "uniqueKey for stored alarm was not registered?");
+  }
+}
+
+kj::Promise<void> AlarmScheduler::runAlarmTask(ScheduledAlarm& alarm) {
+  // Running alarms are never erased, so `alarm` and its key remain valid until we decide what
+  // happens next below.
+  const ActorKey& actorRef = *alarm.actor;
+  auto scheduledTime = alarm.scheduledTime;
+  alarm.status = AlarmStatus::STARTED;
+  uint32_t retryCount = alarm.countedRetry;
 
   auto retryInfo = co_await ([&]() -> kj::Promise<RetryInfo> {
     try {
@@ -211,60 +407,53 @@ kj::Promise<void> AlarmScheduler::makeAlarmTask(
   })();
 
   try {
-    auto& entry = KJ_ASSERT_NONNULL(alarms.findEntry(actorRef));
-
-    // We can't overwrite our entry before moving ourselves out of it, as a promise cannot
-    // delete itself.
-    tasks.add(kj::mv(entry.value.task));
-
     // If an alarm is queued, there's no point in retrying the current one -- proceed
     // to running the queued alarm instead.
-    KJ_IF_SOME(a, entry.value.queuedAlarm) {
-      // creating a new alarm and overwriting the old one will reset
-      // `status` to WAITING and `queuedAlarm` to null
-      entry.value = scheduleAlarm(clock.now(), kj::mv(entry.value.actor), a);
+    KJ_IF_SOME(a, alarm.queuedAlarm) {
+      // Resetting the alarm will reset `status` to WAITING and `queuedAlarm` to null.
+      resetAlarm(alarm, a);
       co_return;
     }
 
     // When we reach this block of code and alarm has either succeeded or failed and may (or may
     // not) retry. Setting the status of an alarm as FINISHED here, will allow deletion of alarms
-    // between retries. If there's a retry, `makeAlarmTask` is called, setting status as RUNNING
-    // again.
-    entry.value.status = AlarmStatus::FINISHED;
+    // between retries. If there's a retry, runAlarmTask() is called again, setting status as
+    // STARTED again.
+    alarm.status = AlarmStatus::FINISHED;
 
     if (retryInfo.retry) {
-      // recreate the task, running after a delay determined using the retry factor
-      if (entry.value.countedRetry >= AlarmScheduler::RETRY_MAX_TRIES) {
-        deleteAlarm(*entry.value.actor);
+      // Schedule the retry, to run after a delay determined using the retry factor.
+      if (alarm.countedRetry >= AlarmScheduler::RETRY_MAX_TRIES) {
+        deleteAlarm(actorRef);
         co_return;
       }
       if (retryInfo.retryCountsAgainstLimit) {
-        entry.value.countedRetry++;
+        alarm.countedRetry++;
 
-        if (!entry.value.previousRetryCountedAgainstLimit) {
+        if (!alarm.previousRetryCountedAgainstLimit) {
           // The last retry didn't count against the limit, indicating it was due to some internal
           // error. However, this retry does, meaning it's due to an error in user code,
           // most likely a different error. We should reset the retry counter used for
           // calculating backoff, so user-caused retries don't have an unnecessarily high backoff
           // time if they come after internal-caused retries.
 
-          entry.value.backoff = 0;
+          alarm.backoff = 0;
         }
       }
-      entry.value.previousRetryCountedAgainstLimit = retryInfo.retryCountsAgainstLimit;
+      alarm.previousRetryCountedAgainstLimit = retryInfo.retryCountsAgainstLimit;
 
-      entry.value.backoff = kj::min(AlarmScheduler::RETRY_BACKOFF_MAX, entry.value.backoff);
-      auto delay = (AlarmScheduler::RETRY_START_SECONDS << entry.value.backoff) * kj::SECONDS;
+      alarm.backoff = kj::min(AlarmScheduler::RETRY_BACKOFF_MAX, alarm.backoff);
+      auto delay = (AlarmScheduler::RETRY_START_SECONDS << alarm.backoff) * kj::SECONDS;
 
       std::uniform_int_distribution<> distribution(0, maxJitterMsForDelay(delay));
       delay += distribution(random) * kj::MILLISECONDS;
 
-      entry.value.backoff++;
-      entry.value.retry++;
+      alarm.backoff++;
+      alarm.retry++;
 
-      entry.value.task = makeAlarmTask(delay, actorRef, scheduledTime);
+      setRunTime(alarm, clock.now() + delay);
     } else {
-      KJ_ASSERT(entry.value.queuedAlarm == kj::none);
+      KJ_ASSERT(alarm.queuedAlarm == kj::none);
       deleteAlarm(actorRef);
     }
   } catch (...) {
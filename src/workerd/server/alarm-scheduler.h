@@ -14,7 +14,9 @@
 #include <kj/time.h>
 #include <kj/timer.h>
 
+#include <limits>
 #include <random>
+#include <set>
 
 namespace workerd::server {
 
@@ -43,6 +45,11 @@ inline uint KJ_HASHCODE(const ActorKey& k) {
 
 // Allows scheduling alarm executions at specific times, returning a promise representing
 // the completion of the alarm event.
+//
+// Only alarms due within MATERIALIZE_HORIZON are kept in memory; later ones stay in the database
+// and are loaded, in order of scheduled time, as they come due. All in-memory alarms share a
+// single timer, set for whichever runs first. Writes made by setAlarm() and deleteAlarm() in the
+// same turn of the event loop are committed together in one transaction.
 class AlarmScheduler final: kj::TaskSet::ErrorHandler {
  public:
   static constexpr auto RETRY_START_SECONDS = WorkerInterface::ALARM_RETRY_START_SECONDS;
@@ -59,15 +66,31 @@ class AlarmScheduler final: kj::TaskSet::ErrorHandler {
   // some common dependency between a set of failed alarms
   static constexpr auto RETRY_JITTER_FACTOR = 0.25;
 
+  // Alarms due within this long are kept in memory. The rest are loaded from the database once
+  // half of the horizon has passed.
+  static constexpr kj::Duration MATERIALIZE_HORIZON = 10 * kj::MINUTES;
+
+  // Maximum number of alarms to load from the database in one turn of the event loop.
+  static constexpr uint LOAD_BATCH_SIZE = 4096;
+
+  // How long to wait before restarting runTimeline() after it fails, e.g. because the database
+  // couldn't be read.
+  static constexpr kj::Duration TIMELINE_RESTART_DELAY = 1 * kj::SECONDS;
+
   using GetActorFn = kj::Function<kj::Own<WorkerInterface>(kj::String)>;
 
   AlarmScheduler(
       const kj::Clock& clock, kj::Timer& timer, const SqliteDatabase::Vfs& vfs, kj::Path path);
+  ~AlarmScheduler() noexcept(false);
 
   kj::Maybe<kj::Date> getAlarm(ActorKey actor);
   bool setAlarm(ActorKey actor, kj::Date scheduledTime);
   bool deleteAlarm(ActorKey actor);
 
+  // Returns a promise that resolves once all setAlarm() and deleteAlarm() calls made so far have
+  // been committed to disk.
+  kj::Promise<void> onBatchCommitted();
+
   void registerNamespace(kj::StringPtr uniqueKey, GetActorFn getActor);
 
  private:
@@ -81,12 +104,15 @@ class AlarmScheduler final: kj::TaskSet::ErrorHandler {
   };
   kj::HashMap<kj::StringPtr, Namespace> namespaces;
   kj::Own<SqliteDatabase> db;
-  kj::TaskSet tasks;
 
   struct ScheduledAlarm {
     kj::Own<ActorKey> actor;
     kj::Date scheduledTime;
-    kj::Promise<void> task;
+
+    // When the alarm will next run: `scheduledTime`, or later if it is waiting to be retried. Null
+    // while the alarm is running. The alarm is in `timeline` exactly when this is non-null.
+    kj::Maybe<kj::Date> runTime = kj::none;
+
     kj::Maybe<kj::Date> queuedAlarm = kj::none;
     // Once started, an alarm can have a single alarm queued behind it.
     AlarmStatus status = AlarmStatus::WAITING;
@@ -104,7 +130,33 @@ class AlarmScheduler final: kj::TaskSet::ErrorHandler {
     uint32_t countedRetry = 0;
   };
 
-  kj::HashMap<ActorKey, ScheduledAlarm> alarms;
+  // Heap-allocated so that `timeline` and running alarm tasks can point at them.
+  kj::HashMap<ActorKey, kj::Own<ScheduledAlarm>> alarms;
+
+  struct TimelineEntry {
+    kj::Date runTime;
+    ScheduledAlarm* alarm;
+
+    bool operator<(const TimelineEntry& other) const {
+      if (runTime != other.runTime) return runTime < other.runTime;
+      return std::less<ScheduledAlarm*>()(alarm, other.alarm);
+    }
+  };
+
+  // Alarms in `alarms` that are waiting to run, in the order they'll run.
+  std::set<TimelineEntry> timeline;
+
+  // Fulfilled when an alarm is added to the front of `timeline`, so that runTimeline() can wake
+  // up earlier than it planned to.
+  kj::Maybe<kj::Own<kj::PromiseFulfiller<void>>> timelineChanged;
+
+  // Every alarm scheduled before this time (in nanoseconds since the epoch) is in `alarms`. Alarms
+  // at or after it may only be in the database.
+  int64_t loadedUntilNs = std::numeric_limits<int64_t>::min();
+
+  // The transaction that setAlarm() and deleteAlarm() are currently writing to, if any. It is
+  // committed on a later turn of the event loop.
+  kj::Maybe<kj::ForkedPromise<void>> pendingBatch;
 
   struct RetryInfo {
     bool retry;
@@ -113,14 +165,44 @@ class AlarmScheduler final: kj::TaskSet::ErrorHandler {
   kj::Promise<RetryInfo> runAlarm(
       const ActorKey& actor, kj::Date scheduledTime, uint32_t retryCount);
 
-  void setAlarmInMemory(kj::Own<ActorKey> actor, kj::Date scheduledTime);
+  bool isMaterialized(kj::Date scheduledTime);
 
-  ScheduledAlarm scheduleAlarm(kj::Date now, kj::Own<ActorKey> actor, kj::Date scheduledTime);
+  // Adds an alarm to `alarms`, scheduled to run at `scheduledTime`.
+  void materialize(const ActorKey& actor, kj::Date scheduledTime);
 
-  kj::Promise<void> makeAlarmTask(
-      kj::Duration delay, const ActorKey& actor, kj::Date scheduledTime);
+  // Removes an alarm from `alarms` and `timeline`.
+  void eraseAlarm(kj::HashMap<ActorKey, kj::Own<ScheduledAlarm>>::Entry& entry);
 
-  kj::Promise<void> checkTimestamp(kj::Duration delay, kj::Date scheduledTime);
+  // Resets an alarm to a fresh, waiting state scheduled for `scheduledTime`.
+  void resetAlarm(ScheduledAlarm& alarm, kj::Date scheduledTime);
+
+  // Moves an alarm to a new place in `timeline`, or takes it out if `runTime` is null.
+  void setRunTime(ScheduledAlarm& alarm, kj::Maybe<kj::Date> runTime);
+
+  // Makes runTimeline() look at `timeline` and the database again, if it's waiting.
+  void wakeTimeline();
+
+  // Starts runTimeline(), and starts it again after TIMELINE_RESTART_DELAY each time it fails.
+  void startTimeline();
+
+  // Runs alarms as they come due and keeps `alarms` filled up to the horizon. Runs for the
+  // lifetime of the scheduler.
+  kj::Promise<void> runTimeline();
+
+  // Loads the next batch of alarms coming due from the database. Returns true if there may be
+  // more to load right away.
+  bool loadMore(kj::Date now);
+
+  kj::Promise<void> runAlarmTask(ScheduledAlarm& alarm);
+
+  // Opens a transaction for setAlarm() or deleteAlarm() to write to, if one isn't open already.
+  void startBatch();
+  void commitBatch(kj::Own<kj::PromiseFulfiller<void>> fulfiller);
+
+  // Brings `alarms` back in line with the database after a batch was rolled back. Alarms that are
+  // running are kept, but what's queued behind them is re-read; other alarms that no longer match
+  // their row are dropped, and everything up to the horizon is loaded again.
+  void reloadFromDatabase();
 
   SqliteDatabase::Statement stmtSetAlarm = db->prepare(R"(
     INSERT INTO _cf_ALARM VALUES(?, ?, ?)
@@ -129,13 +211,28 @@ class AlarmScheduler final: kj::TaskSet::ErrorHandler {
   SqliteDatabase::Statement stmtDeleteAlarm = db->prepare(R"(
     DELETE FROM _cf_ALARM WHERE actor_unique_key = ? AND actor_id = ?
   )");
+  SqliteDatabase::Statement stmtGetAlarm = db->prepare(R"(
+    SELECT scheduled_time FROM _cf_ALARM WHERE actor_unique_key = ? AND actor_id = ?
+  )");
+  SqliteDatabase::Statement stmtLoadAlarms = db->prepare(R"(
+    SELECT actor_unique_key, actor_id, scheduled_time FROM _cf_ALARM
+      WHERE scheduled_time >= ? AND scheduled_time < ?
+      ORDER BY scheduled_time LIMIT ?
+  )");
+  SqliteDatabase::Statement stmtLoadAlarmsAt = db->prepare(R"(
+    SELECT actor_unique_key, actor_id, scheduled_time FROM _cf_ALARM WHERE scheduled_time = ?
+  )");
+  SqliteDatabase::Statement stmtBeginBatch = db->prepare("BEGIN TRANSACTION");
+  SqliteDatabase::Statement stmtCommitBatch = db->prepare("COMMIT TRANSACTION");
 
   void taskFailed(kj::Exception&& exception) override;
 
   int maxJitterMsForDelay(kj::Duration delay);
 
   static void ensureInitialized(SqliteDatabase& db);
-  void loadAlarmsFromDb();
+
+  // Declared last so that the tasks, which refer to everything above, are destroyed first.
+  kj::TaskSet tasks;
 };
 
 }  // namespace workerd::server
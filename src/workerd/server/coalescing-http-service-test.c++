@@ -0,0 +1,257 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "coalescing-http-service.h"
+
+#include <workerd/util/stream-utils.h>
+
+#include <kj/test.h>
+#include <kj/vector.h>
+
+namespace workerd::server {
+namespace {
+
+// Responds to every request with "<url>: hello world", once `gate` opens. If `midway` is set, it
+// also waits for that after writing "hello".
+class FakeUpstream final: public kj::HttpService {
+ public:
+  explicit FakeUpstream(kj::HttpHeaderTable& table): table(table) {}
+
+  uint requestCount = 0;
+  uint cancelCount = 0;
+
+  kj::PromiseFulfillerPair<void> gate = kj::newPromiseAndFulfiller<void>();
+  kj::ForkedPromise<void> gateOpened = gate.promise.fork();
+  kj::Maybe<kj::ForkedPromise<void>> midway;
+
+  kj::Promise<void> request(kj::HttpMethod method,
+      kj::StringPtr url,
+      const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody,
+      Response& response) override {
+    ++requestCount;
+    bool finished = false;
+    KJ_DEFER(if (!finished) ++cancelCount);
+
+    auto start = kj::str(url, ": hello");
+    co_await gateOpened.addBranch();
+    auto out = response.send(200, "OK", kj::HttpHeaders(table), start.size() + 6);
+    co_await out->write(start.asBytes());
+    KJ_IF_SOME(m, midway) {
+      co_await m.addBranch();
+    }
+    co_await out->write(" world"_kj.asBytes());
+    finished = true;
+  }
+
+ private:
+  kj::HttpHeaderTable& table;
+};
+
+// Collects a response, or fails to if `failWrites` is set.
+class TestResponse final: public kj::HttpService::Response {
+ public:
+  uint statusCode = 0;
+  kj::Vector<char> body;
+  bool failWrites = false;
+
+  kj::String text() {
+    return kj::str(body.asPtr());
+  }
+
+  kj::Own<kj::AsyncOutputStream> send(uint statusCode,
+      kj::StringPtr statusText,
+      const kj::HttpHeaders& headers,
+      kj::Maybe<uint64_t> expectedBodySize) override {
+    this->statusCode = statusCode;
+    return kj::heap<Collector>(*this);
+  }
+
+  kj::Own<kj::WebSocket> acceptWebSocket(const kj::HttpHeaders& headers) override {
+    KJ_UNIMPLEMENTED("TestResponse doesn't do WebSockets");
+  }
+
+ private:
+  class Collector final: public kj::AsyncOutputStream {
+   public:
+    explicit Collector(TestResponse& response): response(response) {}
+
+    kj::Promise<void> write(kj::ArrayPtr<const kj::byte> buffer) override {
+      KJ_REQUIRE(!response.failWrites, "client went away");
+      response.body.addAll(buffer.asChars());
+      return kj::READY_NOW;
+    }
+
+    kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> pieces) override {
+      for (auto piece: pieces) {
+        co_await write(piece);
+      }
+    }
+
+    kj::Promise<void> whenWriteDisconnected() override {
+      return kj::NEVER_DONE;
+    }
+
+   private:
+    TestResponse& response;
+  };
+};
+
+struct CoalescingFixture {
+  kj::EventLoop loop;
+  kj::WaitScope ws{loop};
+  kj::HttpHeaderTable::Builder builder;
+  kj::HttpHeaderId hKey = builder.add("X-Key");
+  kj::HttpHeaderId hIfNoneMatch = builder.add("If-None-Match");
+  kj::HttpHeaderId hCacheControl = builder.add("Cache-Control");
+  CoalescingHttpService::BypassHeaders bypassHeaders{builder};
+  kj::Own<kj::HttpHeaderTable> table = builder.build();
+  FakeUpstream upstream{*table};
+  CoalescingHttpService service{
+    {&upstream, kj::NullDisposer::instance}, kj::arr(hKey), kj::mv(bypassHeaders)};
+
+  kj::Promise<void> send(TestResponse& response,
+      kj::StringPtr url,
+      kj::Maybe<kj::StringPtr> key = kj::none,
+      kj::HttpMethod method = kj::HttpMethod::GET,
+      kj::Maybe<kj::HttpHeaderId> extraHeader = kj::none,
+      kj::StringPtr extraValue = nullptr) {
+    kj::HttpHeaders headers(*table);
+    KJ_IF_SOME(k, key) {
+      headers.set(hKey, k);
+    }
+    KJ_IF_SOME(id, extraHeader) {
+      headers.set(id, extraValue);
+    }
+    auto body = newNullInputStream();
+    auto promise = service.request(method, url, headers, *body, response);
+    return promise.attach(kj::mv(headers), kj::mv(body));
+  }
+};
+
+KJ_TEST("CoalescingHttpService collapses concurrent GETs for the same URL and key headers") {
+  CoalescingFixture f;
+
+  TestResponse a, b, c, otherUrl, otherKey, post;
+  auto promises = kj::arr(f.send(a, "/jwks"), f.send(b, "/jwks"), f.send(c, "/jwks"),
+      f.send(otherUrl, "/config"), f.send(otherKey, "/jwks", "tenant"_kj),
+      f.send(post, "/jwks", kj::none, kj::HttpMethod::POST));
+  f.ws.poll();
+  KJ_EXPECT(f.upstream.requestCount == 4);
+  KJ_EXPECT(f.service.getCoalescedCount() == 2);
+
+  f.upstream.gate.fulfiller->fulfill();
+  kj::joinPromises(kj::mv(promises)).wait(f.ws);
+
+  for (auto response: {&a, &b, &c, &otherKey, &post}) {
+    KJ_EXPECT(response->statusCode == 200);
+    KJ_EXPECT(response->text() == "/jwks: hello world");
+  }
+  KJ_EXPECT(otherUrl.text() == "/config: hello world");
+
+  // The flight is over, so the next request goes upstream again.
+  TestResponse later;
+  f.send(later, "/jwks").wait(f.ws);
+  KJ_EXPECT(later.text() == "/jwks: hello world");
+  KJ_EXPECT(f.upstream.requestCount == 5);
+}
+
+KJ_TEST("CoalescingHttpService sends conditional and no-cache requests on their own") {
+  CoalescingFixture f;
+
+  TestResponse a, conditional, noCache, maxAge;
+  auto promises = kj::arr(f.send(a, "/jwks"),
+      f.send(conditional, "/jwks", kj::none, kj::HttpMethod::GET, f.hIfNoneMatch, "\"v1\""),
+      f.send(
+          noCache, "/jwks", kj::none, kj::HttpMethod::GET, f.hCacheControl, "max-age=0, No-Cache"),
+      f.send(maxAge, "/jwks", kj::none, kj::HttpMethod::GET, f.hCacheControl, "max-age=60"));
+  f.ws.poll();
+  // Only the request with an unrelated Cache-Control directive joins the first one.
+  KJ_EXPECT(f.upstream.requestCount == 3);
+  KJ_EXPECT(f.service.getCoalescedCount() == 1);
+
+  f.upstream.gate.fulfiller->fulfill();
+  kj::joinPromises(kj::mv(promises)).wait(f.ws);
+  for (auto response: {&a, &conditional, &noCache, &maxAge}) {
+    KJ_EXPECT(response->text() == "/jwks: hello world");
+  }
+}
+
+KJ_TEST("CoalescingHttpService streams the body to every waiter as it arrives") {
+  CoalescingFixture f;
+  auto midway = kj::newPromiseAndFulfiller<void>();
+  f.upstream.midway = midway.promise.fork();
+
+  TestResponse a, b;
+  auto promiseA = f.send(a, "/doc");
+  auto promiseB = f.send(b, "/doc");
+  f.upstream.gate.fulfiller->fulfill();
+  f.ws.poll();
+
+  // Both have the first chunk before the upstream has written the rest.
+  KJ_EXPECT(a.text() == "/doc: hello");
+  KJ_EXPECT(b.text() == "/doc: hello");
+
+  // A request arriving after the response began can't join it.
+  TestResponse late;
+  auto promiseLate = f.send(late, "/doc");
+  f.ws.poll();
+  KJ_EXPECT(f.upstream.requestCount == 2);
+
+  midway.fulfiller->fulfill();
+  promiseA.wait(f.ws);
+  promiseB.wait(f.ws);
+  promiseLate.wait(f.ws);
+  KJ_EXPECT(a.text() == "/doc: hello world");
+  KJ_EXPECT(b.text() == "/doc: hello world");
+  KJ_EXPECT(late.text() == "/doc: hello world");
+  KJ_EXPECT(f.service.getCoalescedCount() == 1);
+}
+
+KJ_TEST("CoalescingHttpService keeps serving waiters when others go away") {
+  CoalescingFixture f;
+
+  TestResponse leader, failing, remaining;
+  failing.failWrites = true;
+  auto promiseLeader = f.send(leader, "/doc");
+  auto promiseFailing = f.send(failing, "/doc");
+  auto promiseRemaining = f.send(remaining, "/doc");
+  f.ws.poll();
+
+  // The request that started the flight is canceled, but the upstream request carries on.
+  promiseLeader = nullptr;
+  f.upstream.gate.fulfiller->fulfill();
+  promiseRemaining.wait(f.ws);
+  KJ_EXPECT(remaining.text() == "/doc: hello world");
+  KJ_EXPECT(f.upstream.cancelCount == 0);
+
+  // The waiter that couldn't be written to gets its own error.
+  KJ_EXPECT_THROW_MESSAGE("client went away", promiseFailing.wait(f.ws));
+}
+
+KJ_TEST("CoalescingHttpService cancels the upstream request when every waiter has gone away") {
+  CoalescingFixture f;
+
+  TestResponse a, b;
+  auto promiseA = f.send(a, "/doc");
+  auto promiseB = f.send(b, "/doc");
+  f.ws.poll();
+  KJ_EXPECT(f.upstream.requestCount == 1);
+
+  promiseA = nullptr;
+  KJ_EXPECT(f.upstream.cancelCount == 0);
+  promiseB = nullptr;
+  KJ_EXPECT(f.upstream.cancelCount == 1);
+
+  // A new request starts over.
+  TestResponse c;
+  auto promiseC = f.send(c, "/doc");
+  f.upstream.gate.fulfiller->fulfill();
+  promiseC.wait(f.ws);
+  KJ_EXPECT(c.text() == "/doc: hello world");
+  KJ_EXPECT(f.upstream.requestCount == 2);
+}
+
+}  // namespace
+}  // namespace workerd::server
@@ -0,0 +1,265 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "coalescing-http-service.h"
+
+#include <workerd/util/http-util.h>
+#include <workerd/util/stream-utils.h>
+
+#include <kj/debug.h>
+#include <kj/list.h>
+#include <kj/vector.h>
+
+namespace workerd::server {
+
+// An upstream request, along with the requests that its response goes to.
+class CoalescingHttpService::Flight final: public kj::Refcounted,
+                                           private kj::HttpService::Response {
+ public:
+  // One of the requests that the response goes to. Lives in that request's join() call, so it
+  // leaves the flight as soon as the request is canceled.
+  struct Waiter {
+    Flight& flight;
+    kj::HttpService::Response& response;
+    kj::Maybe<kj::Own<kj::AsyncOutputStream>> body;
+    kj::Maybe<kj::Exception> error;
+    // Cancels writes to `body` that are still in progress when the waiter goes away, so it must
+    // come after `body`.
+    kj::Canceler canceler;
+    kj::ListLink<Waiter> link;
+
+    Waiter(Flight& flight, kj::HttpService::Response& response)
+        : flight(flight),
+          response(response) {
+      flight.waiters.add(*this);
+    }
+    ~Waiter() noexcept(false) {
+      flight.waiters.remove(*this);
+    }
+    KJ_DISALLOW_COPY_AND_MOVE(Waiter);
+  };
+
+  Flight(CoalescingHttpService& parent,
+      kj::String key,
+      kj::StringPtr url,
+      const kj::HttpHeaders& headers)
+      : parent(parent),
+        key(kj::mv(key)),
+        url(kj::str(url)),
+        headers(headers.clone()),
+        requestBody(newNullInputStream()) {
+    parent.flights.insert(kj::str(this->key), this);
+  }
+
+  ~Flight() noexcept(false) {
+    detach();
+  }
+
+  bool isStarted() {
+    return done != kj::none;
+  }
+
+  // Sends the upstream request. Called once the first waiter has joined, so that there is someone
+  // to send the response to even if the inner service responds right away.
+  void start() {
+    done = parent.inner->request(kj::HttpMethod::GET, url, headers, *requestBody, *this)
+               .then([this]() { detach(); },
+                   [this](kj::Exception&& exception) {
+      detach();
+      kj::throwFatalException(kj::mv(exception));
+    }).fork();
+  }
+
+  // Resolves when the response has been delivered to every waiter that is still around.
+  kj::Promise<void> whenDone() {
+    return KJ_ASSERT_NONNULL(done).addBranch();
+  }
+
+  // Stops others from joining. Called when the service goes away, too.
+  void detach() {
+    if (attached) {
+      parent.flights.eraseMatch(key);
+      attached = false;
+    }
+  }
+
+ private:
+  class FanOut;
+
+  CoalescingHttpService& parent;
+  kj::String key;
+  bool attached = true;
+
+  // The request that is sent upstream, which must outlive the waiter that made it.
+  kj::String url;
+  kj::HttpHeaders headers;
+  kj::Own<kj::AsyncInputStream> requestBody;
+
+  kj::List<Waiter, &Waiter::link> waiters;
+
+  // The upstream request, which writes to `waiters`, so it must be canceled before they go away.
+  kj::Maybe<kj::ForkedPromise<void>> done;
+
+  kj::Own<kj::AsyncOutputStream> send(uint statusCode,
+      kj::StringPtr statusText,
+      const kj::HttpHeaders& responseHeaders,
+      kj::Maybe<uint64_t> expectedBodySize) override {
+    // Anyone who joined from now on would miss the start of the body.
+    detach();
+
+    for (auto& waiter: waiters) {
+      KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() {
+        waiter.body =
+            waiter.response.send(statusCode, statusText, responseHeaders, expectedBodySize);
+      })) {
+        waiter.error = kj::mv(exception);
+      }
+    }
+    return kj::heap<FanOut>(*this);
+  }
+
+  kj::Own<kj::WebSocket> acceptWebSocket(const kj::HttpHeaders& responseHeaders) override {
+    KJ_FAIL_REQUIRE("coalesced request can't be upgraded to a WebSocket");
+  }
+};
+
+// Writes each chunk of the response body to every waiter, finishing once all of them have it.
+class CoalescingHttpService::Flight::FanOut final: public kj::AsyncOutputStream {
+ public:
+  explicit FanOut(Flight& flight): flight(flight) {}
+
+  kj::Promise<void> write(kj::ArrayPtr<const kj::byte> buffer) override {
+    return writeAll([&](kj::AsyncOutputStream& out) { return out.write(buffer); });
+  }
+
+  kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> pieces) override {
+    return writeAll([&](kj::AsyncOutputStream& out) { return out.write(pieces); });
+  }
+
+  kj::Promise<void> whenWriteDisconnected() override {
+    // Waiters disconnect one at a time, and the upstream request is canceled when the last one
+    // goes away, so there's nothing to report here.
+    return kj::NEVER_DONE;
+  }
+
+ private:
+  Flight& flight;
+
+  kj::Promise<void> writeAll(
+      kj::FunctionParam<kj::Promise<void>(kj::AsyncOutputStream&)> writeTo) {
+    kj::Vector<kj::Promise<void>> writes;
+    for (auto& waiter: flight.waiters) {
+      if (waiter.error != kj::none) continue;
+      KJ_IF_SOME(body, waiter.body) {
+        // A waiter whose write fails is left out of the rest of the body, without failing the
+        // others.
+        auto write = kj::evalNow([&]() { return writeTo(*body); });
+        writes.add(waiter.canceler
+                       .wrap(write.catch_([&waiter](kj::Exception&& exception) {
+          waiter.error = kj::mv(exception);
+        })).catch_([](kj::Exception&&) {}));
+      }
+    }
+    return kj::joinPromises(writes.releaseAsArray());
+  }
+};
+
+CoalescingHttpService::BypassHeaders::BypassHeaders(kj::HttpHeaderTable::Builder& builder)
+    : conditional(kj::arr(builder.add("If-Match"),
+          builder.add("If-None-Match"),
+          builder.add("If-Modified-Since"),
+          builder.add("If-Unmodified-Since"),
+          builder.add("If-Range"))),
+      cacheControl(builder.add("Cache-Control")),
+      pragma(builder.add("Pragma")) {}
+
+CoalescingHttpService::CoalescingHttpService(kj::Own<kj::HttpService> inner,
+    kj::Array<kj::HttpHeaderId> keyHeaders,
+    BypassHeaders bypassHeaders)
+    : inner(kj::mv(inner)),
+      keyHeaders(kj::mv(keyHeaders)),
+      bypassHeaders(kj::mv(bypassHeaders)) {}
+
+CoalescingHttpService::~CoalescingHttpService() noexcept(false) {
+  // Flights still in progress outlive us only as long as the requests waiting on them.
+  kj::Vector<Flight*> remaining;
+  for (auto& entry: flights) {
+    remaining.add(entry.value);
+  }
+  for (auto flight: remaining) {
+    flight->detach();
+  }
+}
+
+kj::Maybe<kj::String> CoalescingHttpService::getKey(kj::HttpMethod method,
+    kj::StringPtr url,
+    const kj::HttpHeaders& headers,
+    kj::AsyncInputStream& requestBody) {
+  // WebSocket upgrades are GETs too, but they're not asking for a document.
+  if (method != kj::HttpMethod::GET || headers.isWebSocket() ||
+      requestBody.tryGetLength().orDefault(1) != 0) {
+    return kj::none;
+  }
+
+  for (auto id: bypassHeaders.conditional) {
+    if (headers.get(id) != kj::none) return kj::none;
+  }
+  bool noCache = false;
+  for (auto id: {bypassHeaders.cacheControl, bypassHeaders.pragma}) {
+    KJ_IF_SOME(value, headers.get(id)) {
+      forEachListElement(value, [&](kj::ArrayPtr<const char> directive) {
+        if (toLower(directive) == "no-cache") noCache = true;
+      });
+    }
+  }
+  if (noCache) return kj::none;
+
+  // Header values can't contain line breaks, so no two different requests have the same key.
+  kj::Vector<kj::String> parts;
+  parts.add(kj::str(url));
+  for (auto id: keyHeaders) {
+    KJ_IF_SOME(value, headers.get(id)) {
+      parts.add(kj::str(':', value));
+    } else {
+      parts.add(kj::str('-'));
+    }
+  }
+  return kj::strArray(parts, "\n");
+}
+
+kj::Promise<void> CoalescingHttpService::request(kj::HttpMethod method,
+    kj::StringPtr url,
+    const kj::HttpHeaders& headers,
+    kj::AsyncInputStream& requestBody,
+    Response& response) {
+  KJ_IF_SOME(key, getKey(method, url, headers, requestBody)) {
+    KJ_IF_SOME(flight, flights.find(key)) {
+      ++coalescedCount;
+      return join(kj::addRef(*flight), response);
+    }
+    return join(kj::refcounted<Flight>(*this, kj::mv(key), url, headers), response);
+  }
+  return inner->request(method, url, headers, requestBody, response);
+}
+
+kj::Promise<void> CoalescingHttpService::connect(kj::StringPtr host,
+    const kj::HttpHeaders& headers,
+    kj::AsyncIoStream& connection,
+    ConnectResponse& response,
+    kj::HttpConnectSettings settings) {
+  return inner->connect(host, headers, connection, response, kj::mv(settings));
+}
+
+kj::Promise<void> CoalescingHttpService::join(kj::Own<Flight> flight, Response& response) {
+  Flight::Waiter waiter(*flight, response);
+  if (!flight->isStarted()) {
+    flight->start();
+  }
+  co_await flight->whenDone();
+  KJ_IF_SOME(exception, waiter.error) {
+    kj::throwFatalException(kj::mv(exception));
+  }
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,89 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/compat/http.h>
+#include <kj/map.h>
+
+namespace workerd::server {
+
+// Wraps an HttpService so that concurrent GET requests for the same URL share a single request to
+// the inner service ("single-flight"). This is for upstreams that many requests ask for the same
+// document at once, like a JWKS key set or a config file, where sending each of them upstream
+// separately only adds load.
+//
+// Two requests share a response if they're both bodiless GETs for the same URL, with the same
+// values of the `keyHeaders`. Other request headers are taken from whichever request came first,
+// so the key must cover any header that the upstream's response depends on. Conditional requests,
+// and requests that ask caches to revalidate with `Cache-Control: no-cache` or `Pragma: no-cache`,
+// never share a response, since they expect an answer of their own.
+//
+// A request can only join another while that one is waiting for the response to begin. Once it
+// has begun, the response is streamed to everyone who joined, as it arrives: each chunk is written
+// to all of them before the next one is read, so the slowest reader sets the pace and the body is
+// never buffered. Requests arriving after that start a new upstream request.
+//
+// A reader that goes away doesn't affect the others, and the upstream request is only canceled
+// once all of them have gone away.
+class CoalescingHttpService final: public kj::HttpService {
+ public:
+  // IDs of the request headers that keep a request from sharing a response. Like the key headers,
+  // they have to be registered while the header table is being built.
+  struct BypassHeaders {
+    explicit BypassHeaders(kj::HttpHeaderTable::Builder& builder);
+
+    // If-Match, If-None-Match, If-Modified-Since, If-Unmodified-Since and If-Range.
+    kj::Array<kj::HttpHeaderId> conditional;
+    kj::HttpHeaderId cacheControl;
+    kj::HttpHeaderId pragma;
+  };
+
+  CoalescingHttpService(kj::Own<kj::HttpService> inner,
+      kj::Array<kj::HttpHeaderId> keyHeaders,
+      BypassHeaders bypassHeaders);
+  ~CoalescingHttpService() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(CoalescingHttpService);
+
+  kj::Promise<void> request(kj::HttpMethod method,
+      kj::StringPtr url,
+      const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody,
+      Response& response) override;
+
+  kj::Promise<void> connect(kj::StringPtr host,
+      const kj::HttpHeaders& headers,
+      kj::AsyncIoStream& connection,
+      ConnectResponse& response,
+      kj::HttpConnectSettings settings) override;
+
+  // Returns how many requests were served by joining an upstream request that another request had
+  // already made.
+  uint64_t getCoalescedCount() const {
+    return coalescedCount;
+  }
+
+ private:
+  class Flight;
+
+  kj::Own<kj::HttpService> inner;
+  kj::Array<kj::HttpHeaderId> keyHeaders;
+  BypassHeaders bypassHeaders;
+
+  // Upstream requests that others can still join, by key.
+  kj::HashMap<kj::String, Flight*> flights;
+
+  uint64_t coalescedCount = 0;
+
+  // Returns the key that requests sharing a response have in common, or none if this request
+  // can't share one.
+  kj::Maybe<kj::String> getKey(kj::HttpMethod method,
+      kj::StringPtr url,
+      const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody);
+
+  static kj::Promise<void> join(kj::Own<Flight> flight, Response& response);
+};
+
+}  // namespace workerd::server
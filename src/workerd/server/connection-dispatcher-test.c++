@@ -0,0 +1,151 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "connection-dispatcher.h"
+
+#include <kj/test.h>
+#include <kj/thread.h>
+
+namespace workerd::server {
+namespace {
+
+// Serves `count` connections from `receiver`, answering each one-byte request with `reply`.
+kj::Promise<void> serve(kj::ConnectionReceiver& receiver, uint count, kj::StringPtr reply) {
+  for (uint i = 0; i < count; ++i) {
+    auto connection = co_await receiver.accept();
+    kj::byte request;
+    co_await connection->read(&request, 1);
+    co_await connection->write(reply.asBytes());
+  }
+}
+
+// Returns which thread served a connection to `port`.
+char askWho(kj::AsyncIoContext& io, uint port) {
+  auto address = io.provider->getNetwork().parseAddress("127.0.0.1", port).wait(io.waitScope);
+  auto connection = address->connect().wait(io.waitScope);
+  connection->write("?"_kj.asBytes()).wait(io.waitScope);
+  char who = 0;
+  connection->read(&who, 1).wait(io.waitScope);
+  return who;
+}
+
+KJ_TEST("ConnectionDispatcher hands connections to each thread in turn") {
+  ConnectionDispatcher dispatcher;
+  auto io = kj::setupAsyncIo();
+
+  auto listener = io.provider->getNetwork()
+                      .parseAddress("127.0.0.1", 0)
+                      .wait(io.waitScope)
+                      ->listen();
+  auto port = listener->getPort();
+  auto local = dispatcher.addReceiver("http", kj::none);
+  auto dispatching = dispatcher.dispatch(kj::str("http"), kj::mv(listener));
+  auto serving = serve(*local, 2, "1").eagerlyEvaluate(nullptr);
+
+  kj::MutexGuarded<bool> ready(false);
+  kj::Thread other([&]() {
+    auto otherIo = kj::setupAsyncIo();
+    auto receiver = dispatcher.addReceiver("http", *otherIo.lowLevelProvider);
+    KJ_EXPECT(receiver->getPort() == port);
+    *ready.lockExclusive() = true;
+    serve(*receiver, 2, "2").wait(otherIo.waitScope);
+  });
+  ready.when([](bool value) { return value; }, [](bool) {});
+
+  kj::Vector<char> servedBy;
+  for (auto i KJ_UNUSED: kj::zeroTo(4)) {
+    servedBy.add(askWho(io, port));
+  }
+  KJ_EXPECT(kj::str(servedBy.asPtr()) == "1212");
+  KJ_EXPECT(dispatcher.getHandedOverCount() == 2);
+  serving.wait(io.waitScope);
+}
+
+// Accepts a few in-memory connections, which have no file descriptor.
+class PipeListener final: public kj::ConnectionReceiver {
+ public:
+  uint remaining = 3;
+  kj::Vector<kj::Own<kj::AsyncIoStream>> clients;
+
+  kj::Promise<kj::Own<kj::AsyncIoStream>> accept() override {
+    if (remaining == 0) return kj::NEVER_DONE;
+    --remaining;
+    auto pipe = kj::newTwoWayPipe();
+    clients.add(kj::mv(pipe.ends[0]));
+    return kj::mv(pipe.ends[1]);
+  }
+
+  uint getPort() override {
+    return 1234;
+  }
+};
+
+KJ_TEST("ConnectionDispatcher serves connections without a file descriptor on its own thread") {
+  ConnectionDispatcher dispatcher;
+  auto io = kj::setupAsyncIo();
+
+  auto local = dispatcher.addReceiver("http", kj::none);
+  auto remote = dispatcher.addReceiver("http", *io.lowLevelProvider);
+  auto listener = kj::heap<PipeListener>();
+  auto& pipes = *listener;
+  auto dispatching = dispatcher.dispatch(kj::str("http"), kj::mv(listener));
+  io.waitScope.poll();
+
+  KJ_EXPECT(local->getPort() == 1234);
+  KJ_EXPECT(pipes.clients.size() == 3);
+  for (auto i KJ_UNUSED: kj::zeroTo(3)) {
+    local->accept().wait(io.waitScope);
+  }
+  KJ_EXPECT(!remote->accept().poll(io.waitScope));
+  KJ_EXPECT(dispatcher.getHandedOverCount() == 0);
+}
+
+KJ_TEST("canListenWithReusePort accepts only numeric addresses with a fixed port") {
+#if __linux__
+  KJ_EXPECT(canListenWithReusePort("127.0.0.1:8080", 80));
+  KJ_EXPECT(canListenWithReusePort("127.0.0.1", 80));
+  KJ_EXPECT(canListenWithReusePort("*:8080", 80));
+  KJ_EXPECT(canListenWithReusePort("*", 443));
+  KJ_EXPECT(canListenWithReusePort("[::1]:8080", 80));
+  KJ_EXPECT(canListenWithReusePort("[::1]", 80));
+  KJ_EXPECT(canListenWithReusePort("::1", 80));
+#endif
+
+  KJ_EXPECT(!canListenWithReusePort("127.0.0.1:0", 80));
+  KJ_EXPECT(!canListenWithReusePort("*", 0));
+  KJ_EXPECT(!canListenWithReusePort("localhost:8080", 80));
+  KJ_EXPECT(!canListenWithReusePort("unix:/tmp/workerd.sock", 80));
+  KJ_EXPECT(!canListenWithReusePort("127.0.0.1:http", 80));
+  KJ_EXPECT(!canListenWithReusePort("[::1]8080", 80));
+}
+
+#if __linux__
+KJ_TEST("listenWithReusePort lets several sockets listen on one port") {
+  auto io = kj::setupAsyncIo();
+
+  // Find a free port.
+  uint port = io.provider->getNetwork()
+                  .parseAddress("127.0.0.1", 0)
+                  .wait(io.waitScope)
+                  ->listen()
+                  ->getPort();
+  auto address = kj::str("127.0.0.1:", port);
+
+  auto first = listenWithReusePort(*io.lowLevelProvider, address, 80);
+  auto second = listenWithReusePort(*io.lowLevelProvider, address, 80);
+  KJ_EXPECT(first->getPort() == port);
+  KJ_EXPECT(second->getPort() == port);
+
+  for (auto i KJ_UNUSED: kj::zeroTo(4)) {
+    auto serving =
+        serve(*first, 1, "1").exclusiveJoin(serve(*second, 1, "2")).eagerlyEvaluate(nullptr);
+    auto who = askWho(io, port);
+    KJ_EXPECT(who == '1' || who == '2', who);
+    serving.wait(io.waitScope);
+  }
+}
+#endif
+
+}  // namespace
+}  // namespace workerd::server
@@ -0,0 +1,288 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "connection-dispatcher.h"
+
+#include <kj/debug.h>
+
+#if !_WIN32
+#include <fcntl.h>
+#endif
+
+#if __linux__
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace workerd::server {
+
+class ConnectionDispatcher::Receiver final: public kj::ConnectionReceiver {
+ public:
+  Receiver(const ConnectionDispatcher& dispatcher,
+      kj::StringPtr name,
+      kj::Maybe<kj::LowLevelAsyncIoProvider&> provider)
+      : dispatcher(dispatcher),
+        name(kj::str(name)),
+        provider(provider),
+        inbox{.remote = provider != kj::none} {
+    auto lock = dispatcher.state.lockExclusive();
+    auto& socket = lock->sockets.findOrCreate(
+        this->name, [&]() -> decltype(lock->sockets)::Entry { return {kj::str(name), {}}; });
+    socket.inboxes.add(&inbox);
+  }
+
+  ~Receiver() noexcept(false) {
+    auto lock = dispatcher.state.lockExclusive();
+    auto& socket = KJ_ASSERT_NONNULL(lock->sockets.find(name));
+    for (auto i: kj::indices(socket.inboxes)) {
+      if (socket.inboxes[i] == &inbox) {
+        socket.inboxes[i] = socket.inboxes.back();
+        socket.inboxes.removeLast();
+        break;
+      }
+    }
+    // Connections still waiting in `inbox` are closed as it goes away.
+    inbox.waiting = kj::none;
+  }
+
+  kj::Promise<kj::Own<kj::AsyncIoStream>> accept() override {
+    for (;;) {
+      kj::Promise<void> ready = nullptr;
+      {
+        auto lock = dispatcher.state.lockExclusive();
+        if (!inbox.connections.empty()) {
+          auto connection = kj::mv(inbox.connections.front());
+          inbox.connections.pop_front();
+          KJ_SWITCH_ONEOF(connection) {
+            KJ_CASE_ONEOF(stream, kj::Own<kj::AsyncIoStream>) {
+              co_return kj::mv(stream);
+            }
+            KJ_CASE_ONEOF(fd, kj::OwnFd) {
+              co_return KJ_ASSERT_NONNULL(provider).wrapSocketFd(fd.release(),
+                  kj::LowLevelAsyncIoProvider::TAKE_OWNERSHIP |
+                      kj::LowLevelAsyncIoProvider::ALREADY_CLOEXEC |
+                      kj::LowLevelAsyncIoProvider::ALREADY_NONBLOCK);
+            }
+          }
+          KJ_UNREACHABLE;
+        }
+        auto paf = kj::newPromiseAndCrossThreadFulfiller<void>();
+        inbox.waiting = kj::mv(paf.fulfiller);
+        ready = kj::mv(paf.promise);
+      }
+      co_await ready;
+    }
+  }
+
+  uint getPort() override {
+    return KJ_ASSERT_NONNULL(dispatcher.state.lockShared()->sockets.find(name)).port;
+  }
+
+ private:
+  const ConnectionDispatcher& dispatcher;
+  kj::String name;
+  kj::Maybe<kj::LowLevelAsyncIoProvider&> provider;
+
+  // Protected by the dispatcher's lock.
+  Inbox inbox;
+};
+
+ConnectionDispatcher::~ConnectionDispatcher() noexcept(false) {
+  for (auto& socket: state.getWithoutLock().sockets) {
+    KJ_ASSERT(socket.value.inboxes.empty(), "receiver outlived its dispatcher", socket.key);
+  }
+}
+
+kj::Own<kj::ConnectionReceiver> ConnectionDispatcher::addReceiver(
+    kj::StringPtr name, kj::Maybe<kj::LowLevelAsyncIoProvider&> provider) const {
+  return kj::heap<Receiver>(*this, name, provider);
+}
+
+kj::Promise<void> ConnectionDispatcher::dispatch(
+    kj::String name, kj::Own<kj::ConnectionReceiver> listener) const {
+  {
+    auto lock = state.lockExclusive();
+    auto& socket = KJ_REQUIRE_NONNULL(
+        lock->sockets.find(name), "the accepting thread must add its receiver first", name);
+    socket.port = listener->getPort();
+  }
+
+  for (;;) {
+    handOver(name, co_await listener->accept());
+  }
+}
+
+void ConnectionDispatcher::handOver(kj::StringPtr name, kj::Own<kj::AsyncIoStream> stream) const {
+  auto lock = state.lockExclusive();
+  auto& socket = KJ_ASSERT_NONNULL(lock->sockets.find(name));
+  KJ_REQUIRE(!socket.inboxes.empty(), "no thread is serving this socket", name);
+
+  // Round-robin over the receivers. A stream with no file descriptor can only go to the local one.
+  kj::Maybe<int> fd;
+#if !_WIN32
+  fd = stream->getFd();
+#endif
+  Inbox* target = nullptr;
+  for (uint tries = 0; tries < socket.inboxes.size(); ++tries) {
+    auto inbox = socket.inboxes[socket.next++ % socket.inboxes.size()];
+    if (!inbox->remote || fd != kj::none) {
+      target = inbox;
+      break;
+    }
+  }
+  KJ_REQUIRE(target != nullptr, "the accepting thread isn't serving this socket", name);
+
+  if (target->remote) {
+#if !_WIN32
+    // The stream closes its own descriptor when dropped, so the other thread gets a duplicate.
+    int copy;
+    KJ_SYSCALL(copy = fcntl(KJ_ASSERT_NONNULL(fd), F_DUPFD_CLOEXEC, 0));
+    target->connections.push_back(kj::OwnFd(copy));
+    ++lock->handedOverCount;
+#endif
+  } else {
+    target->connections.push_back(kj::mv(stream));
+  }
+
+  KJ_IF_SOME(waiting, target->waiting) {
+    waiting->fulfill();
+    target->waiting = kj::none;
+  }
+}
+
+#if __linux__
+namespace {
+
+struct ReusePortAddress {
+  sockaddr_storage storage;
+  socklen_t length;
+  // Set for `*`, which listens on every interface, over IPv6 if possible and IPv4 otherwise.
+  bool wildcard;
+  uint port;
+};
+
+// Parses the forms of address that `kj::Network::parseAddress()` accepts and that are numeric,
+// i.e. `host`, `host:port`, `[ipv6]`, `[ipv6]:port` and a bare IPv6 address, where `host` may be
+// `*`.
+kj::Maybe<ReusePortAddress> parseReusePortAddress(kj::StringPtr address, uint defaultPort) {
+  kj::String host = kj::str(address);
+  kj::Maybe<kj::StringPtr> portText;
+  if (address.startsWith("[")) {
+    auto close = KJ_UNWRAP_OR(address.findFirst(']'), return kj::none);
+    host = kj::str(address.slice(1, close));
+    auto rest = address.slice(close + 1);
+    if (rest.size() > 0) {
+      if (!rest.startsWith(":")) return kj::none;
+      portText = rest.slice(1);
+    }
+  } else KJ_IF_SOME(colon, address.findLast(':')) {
+    // More than one colon means a bare IPv6 address, without a port.
+    if (KJ_ASSERT_NONNULL(address.findFirst(':')) == colon) {
+      host = kj::str(address.slice(0, colon));
+      portText = address.slice(colon + 1);
+    }
+  }
+
+  ReusePortAddress result;
+  memset(&result, 0, sizeof(result));
+  result.port = defaultPort;
+  KJ_IF_SOME(text, portText) {
+    result.port = KJ_UNWRAP_OR(text.tryParseAs<uint>(), return kj::none);
+  }
+  if (result.port == 0 || result.port > 65535) return kj::none;
+
+  if (host == "*") {
+    result.wildcard = true;
+    return result;
+  }
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV | AI_PASSIVE;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* info;
+  auto portStr = kj::str(result.port);
+  if (getaddrinfo(host.cStr(), portStr.cStr(), &hints, &info) != 0) return kj::none;
+  KJ_DEFER(freeaddrinfo(info));
+  KJ_ASSERT(info->ai_addrlen <= sizeof(result.storage));
+  memcpy(&result.storage, info->ai_addr, info->ai_addrlen);
+  result.length = info->ai_addrlen;
+  return result;
+}
+
+// Fills in the wildcard address of the given family.
+void setWildcard(ReusePortAddress& address, int family) {
+  memset(&address.storage, 0, sizeof(address.storage));
+  if (family == AF_INET6) {
+    auto& in6 = reinterpret_cast<sockaddr_in6&>(address.storage);
+    in6.sin6_family = AF_INET6;
+    in6.sin6_addr = in6addr_any;
+    in6.sin6_port = htons(address.port);
+    address.length = sizeof(in6);
+  } else {
+    auto& in = reinterpret_cast<sockaddr_in&>(address.storage);
+    in.sin_family = AF_INET;
+    in.sin_addr.s_addr = htonl(INADDR_ANY);
+    in.sin_port = htons(address.port);
+    address.length = sizeof(in);
+  }
+}
+
+}  // namespace
+#endif
+
+bool canListenWithReusePort(kj::StringPtr address, uint defaultPort) {
+#if __linux__
+  return parseReusePortAddress(address, defaultPort) != kj::none;
+#else
+  // Elsewhere, SO_REUSEPORT either doesn't exist or sends every connection to one of the sockets.
+  return false;
+#endif
+}
+
+kj::Own<kj::ConnectionReceiver> listenWithReusePort(
+    kj::LowLevelAsyncIoProvider& provider, kj::StringPtr address, uint defaultPort) {
+#if __linux__
+  auto parsed = KJ_REQUIRE_NONNULL(
+      parseReusePortAddress(address, defaultPort), "can't listen with SO_REUSEPORT", address);
+
+  int fd;
+  if (parsed.wildcard) {
+    fd = socket(AF_INET6, SOCK_STREAM, 0);
+    if (fd >= 0) {
+      setWildcard(parsed, AF_INET6);
+    } else if (errno == EAFNOSUPPORT) {
+      setWildcard(parsed, AF_INET);
+      KJ_SYSCALL(fd = socket(AF_INET, SOCK_STREAM, 0));
+    } else {
+      KJ_FAIL_SYSCALL("socket(AF_INET6)", errno);
+    }
+  } else {
+    KJ_SYSCALL(fd = socket(parsed.storage.ss_family, SOCK_STREAM, 0));
+  }
+  kj::OwnFd ownFd(fd);
+
+  int one = 1;
+  KJ_SYSCALL(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+  KJ_SYSCALL(setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)));
+  if (parsed.wildcard && parsed.storage.ss_family == AF_INET6) {
+    // Like kj's own listen(), accept IPv4 connections on the IPv6 wildcard too.
+    int zero = 0;
+    KJ_SYSCALL(setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero)));
+  }
+  KJ_SYSCALL(bind(fd, reinterpret_cast<sockaddr*>(&parsed.storage), parsed.length), address);
+  KJ_SYSCALL(::listen(fd, SOMAXCONN));
+
+  return provider.wrapListenSocketFd(
+      ownFd.release(), kj::LowLevelAsyncIoProvider::TAKE_OWNERSHIP);
+#else
+  KJ_UNIMPLEMENTED("SO_REUSEPORT listeners are only supported on Linux");
+#endif
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,90 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/async-io.h>
+#include <kj/map.h>
+#include <kj/mutex.h>
+#include <kj/one-of.h>
+#include <kj/vector.h>
+
+#include <deque>
+
+namespace workerd::server {
+
+// Spreads the connections accepted on a socket across several threads, each serving its share on
+// its own event loop, for `Config.threads`. On Linux, sockets bound to a numeric IP address and
+// port don't need this: every thread listens on those itself, see listenWithReusePort(). This is
+// the fallback for all other sockets, e.g. Unix sockets, addresses that need resolving, sockets
+// passed in with `--socket-fd`, or port 0: one thread accepts and hands each connection to the
+// threads in turn.
+//
+// Each thread serves a socket through the ConnectionReceiver that `addReceiver()` gives it, as if
+// it were listening itself. Connections travel to other threads as file descriptors, so those that
+// have none (e.g. in-memory pipes in tests) are always served by the accepting thread.
+class ConnectionDispatcher final {
+ public:
+  ConnectionDispatcher() = default;
+  ~ConnectionDispatcher() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(ConnectionDispatcher);
+
+  // Returns the calling thread's receiver for the socket `name`. `provider` wraps the connections
+  // handed over from the accepting thread, so it may be none only on that thread. The receiver
+  // must be destroyed before the dispatcher. Thread-safe.
+  kj::Own<kj::ConnectionReceiver> addReceiver(
+      kj::StringPtr name, kj::Maybe<kj::LowLevelAsyncIoProvider&> provider) const;
+
+  // Accepts connections from `listener` until canceled, handing each to the next receiver for
+  // `name`. Must be called on the thread whose receiver has no provider, after adding it.
+  kj::Promise<void> dispatch(kj::String name, kj::Own<kj::ConnectionReceiver> listener) const;
+
+  // Returns how many connections have been handed to a thread other than the accepting one.
+  uint64_t getHandedOverCount() const {
+    return state.lockShared()->handedOverCount;
+  }
+
+ private:
+  class Receiver;
+
+  // A connection waiting to be accepted. A stream can only be served by the thread that accepted
+  // it; others get the file descriptor.
+  using Connection = kj::OneOf<kj::Own<kj::AsyncIoStream>, kj::OwnFd>;
+
+  struct Inbox {
+    // False if this is the accepting thread's own receiver.
+    bool remote;
+    std::deque<Connection> connections;
+
+    // Set while the receiver waits for `connections` to become non-empty.
+    kj::Maybe<kj::Own<kj::CrossThreadPromiseFulfiller<void>>> waiting;
+  };
+
+  struct Socket {
+    kj::Vector<Inbox*> inboxes;
+    uint next = 0;
+    uint port = 0;
+  };
+
+  struct State {
+    kj::HashMap<kj::String, Socket> sockets;
+    uint64_t handedOverCount = 0;
+  };
+  kj::MutexGuarded<State> state;
+
+  void handOver(kj::StringPtr name, kj::Own<kj::AsyncIoStream> stream) const;
+};
+
+// Returns whether every thread can listen on `address` itself with listenWithReusePort(). That
+// takes a numeric IPv4 or IPv6 address, or `*`, with a port other than 0 (which would give each
+// thread a port of its own), and a platform whose SO_REUSEPORT spreads connections across the
+// sockets sharing a port, i.e. Linux.
+bool canListenWithReusePort(kj::StringPtr address, uint defaultPort);
+
+// Listens on `address`, which canListenWithReusePort() must accept, with SO_REUSEPORT set. Each
+// thread calls this for its own socket, and the kernel spreads incoming connections across them.
+kj::Own<kj::ConnectionReceiver> listenWithReusePort(
+    kj::LowLevelAsyncIoProvider& provider, kj::StringPtr address, uint defaultPort);
+
+}  // namespace workerd::server
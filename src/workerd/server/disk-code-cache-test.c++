@@ -0,0 +1,35 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "disk-code-cache.h"
+
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+KJ_TEST("DiskCodeCache keys caches by V8 version tag, kind and source") {
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+  DiskCodeCache cache(dir->clone(), 1234);
+
+  auto source = "export default 1;"_kj.asArray();
+  KJ_EXPECT(cache.read("esm", source) == kj::none);
+
+  cache.write("esm", source, "compiled"_kj.asBytes());
+  KJ_EXPECT(KJ_ASSERT_NONNULL(cache.read("esm", source)) == "compiled"_kj.asBytes());
+  KJ_EXPECT(dir->listNames().size() == 1);
+
+  // Another kind of compilation, another source, or another V8 doesn't find it.
+  KJ_EXPECT(cache.read("cjs", source) == kj::none);
+  KJ_EXPECT(cache.read("esm", "export default 2;"_kj.asArray()) == kj::none);
+  KJ_EXPECT(DiskCodeCache(dir->clone(), 4321).read("esm", source) == kj::none);
+
+  // A rejected cache gets rewritten in place.
+  cache.write("esm", source, "recompiled"_kj.asBytes());
+  KJ_EXPECT(KJ_ASSERT_NONNULL(cache.read("esm", source)) == "recompiled"_kj.asBytes());
+  KJ_EXPECT(dir->listNames().size() == 1);
+}
+
+}  // namespace
+}  // namespace workerd::server
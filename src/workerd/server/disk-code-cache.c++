@@ -0,0 +1,60 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "disk-code-cache.h"
+
+#include <openssl/sha.h>
+
+#include <kj/debug.h>
+#include <kj/encoding.h>
+
+namespace workerd::server {
+
+DiskCodeCache::DiskCodeCache(kj::Own<const kj::Directory> directory, uint32_t versionTag)
+    : directory(kj::mv(directory)),
+      versionTag(versionTag) {}
+
+kj::Maybe<kj::Array<kj::byte>> DiskCodeCache::read(
+    kj::StringPtr kind, kj::ArrayPtr<const char> source) const {
+  kj::Maybe<kj::Array<kj::byte>> result;
+  KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() {
+    KJ_IF_SOME(file, directory->tryOpenFile(getPath(kind, source))) {
+      result = file->readAllBytes();
+    }
+  })) {
+    KJ_LOG(WARNING, "couldn't read code cache", exception);
+  }
+  return result;
+}
+
+void DiskCodeCache::write(kj::StringPtr kind,
+    kj::ArrayPtr<const char> source,
+    kj::ArrayPtr<const kj::byte> data) const {
+  KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() {
+    auto replacer = directory->replaceFile(
+        getPath(kind, source), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+    replacer->get().writeAll(data);
+    replacer->commit();
+  })) {
+    KJ_LOG(WARNING, "couldn't write code cache", exception);
+  }
+}
+
+kj::Path DiskCodeCache::getPath(kj::StringPtr kind, kj::ArrayPtr<const char> source) const {
+  SHA256_CTX context;
+  SHA256_Init(&context);
+  kj::byte tag[sizeof(versionTag)];
+  for (auto i: kj::indices(tag)) {
+    tag[i] = versionTag >> (i * 8);
+  }
+  SHA256_Update(&context, tag, sizeof(tag));
+  // Includes the NUL terminator, so that the kind and the source can't run into each other.
+  SHA256_Update(&context, kind.begin(), kind.size() + 1);
+  SHA256_Update(&context, source.begin(), source.size());
+  kj::byte digest[SHA256_DIGEST_LENGTH];
+  SHA256_Final(digest, &context);
+  return kj::Path({kj::encodeHex(digest)});
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,36 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <workerd/jsg/compile-cache.h>
+
+#include <kj/filesystem.h>
+
+namespace workerd::server {
+
+// Keeps V8 code caches in a directory, for `Config.compileCachePath`. Each cache is a file named
+// after the SHA-256 hash of V8's cached data version tag, which covers V8's version and flags, the
+// kind of compilation and the module's source.
+//
+// Files are replaced atomically, so several threads or processes can share a directory. A cache
+// that can't be read or written only costs a compile, so errors are logged rather than thrown.
+class DiskCodeCache final: public jsg::CodeCacheStore {
+ public:
+  DiskCodeCache(kj::Own<const kj::Directory> directory, uint32_t versionTag);
+
+  kj::Maybe<kj::Array<kj::byte>> read(
+      kj::StringPtr kind, kj::ArrayPtr<const char> source) const override;
+  void write(kj::StringPtr kind,
+      kj::ArrayPtr<const char> source,
+      kj::ArrayPtr<const kj::byte> data) const override;
+
+ private:
+  kj::Own<const kj::Directory> directory;
+  uint32_t versionTag;
+
+  kj::Path getPath(kj::StringPtr kind, kj::ArrayPtr<const char> source) const;
+};
+
+}  // namespace workerd::server
@@ -0,0 +1,309 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "local-cache.h"
+
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+class FakeClock final: public kj::Clock {
+ public:
+  kj::Date now() const override {
+    return time;
+  }
+
+  kj::Date time = kj::UNIX_EPOCH + 1'700'000'000 * kj::SECONDS;
+};
+
+struct MatchResult {
+  uint statusCode;
+  kj::HttpHeaders headers;
+  kj::String body;
+};
+
+struct CacheFixture {
+  kj::EventLoop loop;
+  kj::WaitScope ws{loop};
+  FakeClock clock;
+  kj::HttpHeaderTable::Builder builder;
+  LocalCache cache;
+  kj::Own<kj::HttpHeaderTable> table;
+  kj::Own<kj::HttpClient> client;
+
+  explicit CacheFixture(LocalCache::Options options = {})
+      : cache(clock, builder, options),
+        table(builder.build()),
+        client(kj::newHttpClient(cache)) {}
+
+  kj::HttpHeaders headers() {
+    return kj::HttpHeaders(*table);
+  }
+
+  // Stores the serialized response `payload`, as Cache::put() would. If `knownLength` is false,
+  // the PUT is sent without a length, as happens when the response body is a stream.
+  uint put(kj::StringPtr url,
+      kj::StringPtr payload,
+      const kj::HttpHeaders& requestHeaders,
+      bool knownLength = true) {
+    auto request = client->request(kj::HttpMethod::PUT, url, requestHeaders,
+        knownLength ? kj::Maybe<uint64_t>(payload.size()) : kj::none);
+    request.body->write(payload.asBytes()).wait(ws);
+    request.body = nullptr;
+    auto response = request.response.wait(ws);
+    response.body->readAllText().wait(ws);
+    return response.statusCode;
+  }
+  uint put(kj::StringPtr url, kj::StringPtr payload) {
+    return put(url, payload, headers());
+  }
+
+  MatchResult match(kj::StringPtr url, const kj::HttpHeaders& requestHeaders) {
+    auto response = client->request(kj::HttpMethod::GET, url, requestHeaders).response.wait(ws);
+    auto body = response.body->readAllText().wait(ws);
+    return {response.statusCode, response.headers->clone(), kj::mv(body)};
+  }
+  MatchResult match(kj::StringPtr url) {
+    return match(url, headers());
+  }
+
+  uint purge(kj::StringPtr url, const kj::HttpHeaders& requestHeaders) {
+    auto response = client->request(kj::HttpMethod::PURGE, url, requestHeaders).response.wait(ws);
+    response.body->readAllText().wait(ws);
+    return response.statusCode;
+  }
+
+  kj::String header(const MatchResult& result, kj::StringPtr name) {
+    kj::String value;
+    result.headers.forEach([&](kj::StringPtr headerName, kj::StringPtr headerValue) {
+      if (headerName == name) value = kj::str(headerValue);
+    });
+    return value;
+  }
+};
+
+kj::String fill(char c, size_t size) {
+  auto result = kj::heapString(size);
+  for (auto& ch: result) ch = c;
+  return result;
+}
+
+kj::String makePayload(kj::StringPtr headers, kj::StringPtr body) {
+  return kj::str("HTTP/1.1 200 OK\r\n", headers, "Content-Length: ", body.size(), "\r\n\r\n", body);
+}
+
+KJ_TEST("LocalCache stores, matches and purges responses") {
+  CacheFixture f;
+
+  auto miss = f.match("https://example.com/a");
+  KJ_EXPECT(miss.statusCode == 504);
+  KJ_EXPECT(f.header(miss, "CF-Cache-Status") == "MISS");
+
+  KJ_EXPECT(f.put("https://example.com/a",
+                makePayload("Cache-Control: max-age=60\r\nX-Foo: bar\r\n", "hello")) == 204);
+
+  auto hit = f.match("https://example.com/a");
+  KJ_EXPECT(hit.statusCode == 200);
+  KJ_EXPECT(hit.body == "hello");
+  KJ_EXPECT(f.header(hit, "CF-Cache-Status") == "HIT");
+  KJ_EXPECT(f.header(hit, "X-Foo") == "bar");
+  KJ_EXPECT(f.header(hit, "Content-Length") == "5");
+
+  f.clock.time += 10 * kj::SECONDS;
+  KJ_EXPECT(f.header(f.match("https://example.com/a"), "Age") == "10");
+
+  // Named caches are separate from each other and from the default cache.
+  auto namespaced = f.headers();
+  namespaced.add("CF-Cache-Namespace", "other");
+  KJ_EXPECT(f.match("https://example.com/a", namespaced).statusCode == 504);
+  KJ_EXPECT(f.put("https://example.com/a", makePayload("", "other"), namespaced) == 204);
+  KJ_EXPECT(f.match("https://example.com/a", namespaced).body == "other");
+  KJ_EXPECT(f.match("https://example.com/a").body == "hello");
+
+  // A second put replaces the entry.
+  KJ_EXPECT(f.put("https://example.com/a", makePayload("", "replaced")) == 204);
+  KJ_EXPECT(f.match("https://example.com/a").body == "replaced");
+
+  KJ_EXPECT(f.purge("https://example.com/a", f.headers()) == 200);
+  KJ_EXPECT(f.purge("https://example.com/a", f.headers()) == 404);
+  KJ_EXPECT(f.match("https://example.com/a").statusCode == 504);
+  KJ_EXPECT(f.match("https://example.com/a", namespaced).body == "other");
+
+  auto stats = f.cache.getStats();
+  KJ_EXPECT(stats.entryCount == 1);
+  KJ_EXPECT(stats.hits == 6);
+  KJ_EXPECT(stats.misses == 3);
+}
+
+KJ_TEST("LocalCache honors Cache-Control and Expires") {
+  CacheFixture f;
+
+  f.put("https://example.com/no-store", makePayload("Cache-Control: no-store\r\n", "x"));
+  f.put("https://example.com/private", makePayload("Cache-Control: Private, max-age=60\r\n", "x"));
+  f.put("https://example.com/cookie", makePayload("Set-Cookie: a=b\r\n", "x"));
+  f.put("https://example.com/zero", makePayload("Cache-Control: max-age=0\r\n", "x"));
+  f.put("https://example.com/past",
+      makePayload("Expires: Thu, 01 Jan 1970 00:00:00 GMT\r\n", "x"));
+  KJ_EXPECT(f.cache.getStats().entryCount == 0);
+
+  f.put("https://example.com/max-age", makePayload("Cache-Control: max-age=60\r\n", "x"));
+  f.put("https://example.com/s-maxage",
+      makePayload("Cache-Control: max-age=60, s-maxage=\"120\"\r\n", "x"));
+  f.put("https://example.com/expires",
+      makePayload("Expires: Tue, 14 Nov 2023 22:13:50 GMT\r\n", "x"));  // now + 30s
+  f.put("https://example.com/forever", makePayload("", "x"));
+  KJ_EXPECT(f.cache.getStats().entryCount == 4);
+
+  f.clock.time += 30 * kj::SECONDS;
+  KJ_EXPECT(f.match("https://example.com/expires").statusCode == 504);
+  KJ_EXPECT(f.match("https://example.com/max-age").statusCode == 200);
+
+  f.clock.time += 30 * kj::SECONDS;
+  KJ_EXPECT(f.match("https://example.com/max-age").statusCode == 504);
+  KJ_EXPECT(f.match("https://example.com/s-maxage").statusCode == 200);
+
+  f.clock.time += 60 * kj::SECONDS;
+  KJ_EXPECT(f.match("https://example.com/s-maxage").statusCode == 504);
+  KJ_EXPECT(f.match("https://example.com/forever").statusCode == 200);
+  KJ_EXPECT(f.cache.getStats().entryCount == 1);
+}
+
+KJ_TEST("LocalCache honors Vary") {
+  CacheFixture f;
+
+  auto gzip = f.headers();
+  gzip.add("Accept-Encoding", "gzip");
+  auto br = f.headers();
+  br.add("Accept-Encoding", "br");
+
+  f.put("https://example.com/", makePayload("Vary: accept-encoding\r\n", "zipped"), gzip);
+  KJ_EXPECT(f.match("https://example.com/", gzip).body == "zipped");
+  KJ_EXPECT(f.match("https://example.com/", br).statusCode == 504);
+  KJ_EXPECT(f.match("https://example.com/").statusCode == 504);
+
+  // An absent header is a value of its own.
+  f.put("https://example.com/", makePayload("Vary: Accept-Encoding\r\n", "plain"));
+  KJ_EXPECT(f.match("https://example.com/").body == "plain");
+  KJ_EXPECT(f.match("https://example.com/", gzip).statusCode == 504);
+
+  // `Vary: *` matches nothing, so such responses aren't stored.
+  KJ_EXPECT(f.put("https://example.com/star", makePayload("Vary: *\r\n", "x")) == 204);
+  KJ_EXPECT(
+      f.put("https://example.com/star", makePayload("Vary: Accept-Encoding, *\r\n", "x")) == 204);
+  KJ_EXPECT(f.match("https://example.com/star").statusCode == 504);
+  KJ_EXPECT(f.cache.getStats().entryCount == 1);
+}
+
+KJ_TEST("LocalCache answers conditional and range requests") {
+  CacheFixture f;
+
+  f.put("https://example.com/",
+      makePayload(
+          "ETag: \"abc\"\r\nLast-Modified: Tue, 14 Nov 2023 22:00:00 GMT\r\n", "0123456789"));
+
+  auto ifNoneMatch = f.headers();
+  ifNoneMatch.add("If-None-Match", "\"xyz\", W/\"abc\"");
+  auto notModified = f.match("https://example.com/", ifNoneMatch);
+  KJ_EXPECT(notModified.statusCode == 304);
+  KJ_EXPECT(notModified.body == "");
+  KJ_EXPECT(f.header(notModified, "ETag") == "\"abc\"");
+
+  auto otherTag = f.headers();
+  otherTag.add("If-None-Match", "\"xyz\"");
+  KJ_EXPECT(f.match("https://example.com/", otherTag).statusCode == 200);
+
+  auto ifModifiedSince = f.headers();
+  ifModifiedSince.add("If-Modified-Since", "Tue, 14 Nov 2023 22:00:00 GMT");
+  KJ_EXPECT(f.match("https://example.com/", ifModifiedSince).statusCode == 304);
+  auto earlier = f.headers();
+  earlier.add("If-Modified-Since", "Tue, 14 Nov 2023 21:59:59 GMT");
+  KJ_EXPECT(f.match("https://example.com/", earlier).statusCode == 200);
+
+  auto range = f.headers();
+  range.add("Range", "bytes=2-4");
+  auto partial = f.match("https://example.com/", range);
+  KJ_EXPECT(partial.statusCode == 206);
+  KJ_EXPECT(partial.body == "234");
+  KJ_EXPECT(f.header(partial, "Content-Range") == "bytes 2-4/10");
+
+  auto suffix = f.headers();
+  suffix.add("Range", "bytes=-3");
+  KJ_EXPECT(f.match("https://example.com/", suffix).body == "789");
+
+  auto unsatisfiable = f.headers();
+  unsatisfiable.add("Range", "bytes=20-30");
+  auto rangeError = f.match("https://example.com/", unsatisfiable);
+  KJ_EXPECT(rangeError.statusCode == 416);
+  KJ_EXPECT(f.header(rangeError, "Content-Range") == "bytes */10");
+}
+
+KJ_TEST("LocalCache stores payloads of unknown length") {
+  CacheFixture f;
+
+  // Cache::put() leaves `Transfer-Encoding: chunked` in the payload's headers when the body's
+  // length isn't known, but doesn't actually chunk the body.
+  auto payload = kj::str("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n", "streamed body");
+  KJ_EXPECT(f.put("https://example.com/", payload, f.headers(), false) == 204);
+
+  auto hit = f.match("https://example.com/");
+  KJ_EXPECT(hit.body == "streamed body");
+  KJ_EXPECT(f.header(hit, "Transfer-Encoding") == "");
+  KJ_EXPECT(f.header(hit, "Content-Length") == "13");
+}
+
+KJ_TEST("LocalCache spills to disk") {
+  CacheFixture f({.memoryLimitBytes = 8192, .diskLimitBytes = 4096, .maxObjectBytes = 3000});
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+  f.cache.enableDiskTier(*dir);
+
+  // Each entry takes a little over 1000 bytes of memory, so the eighth pushes the first to disk.
+  for (char c: {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h'}) {
+    f.put(kj::str("https://example.com/", c), makePayload("", fill(c, 1000)));
+  }
+  auto stats = f.cache.getStats();
+  KJ_EXPECT(stats.entryCount == 8);
+  KJ_EXPECT(stats.memoryBytes <= 8192);
+  KJ_EXPECT(stats.diskBytes == 1000);
+  KJ_EXPECT(f.match("https://example.com/a").body == fill('a', 1000));
+
+  auto range = f.headers();
+  range.add("Range", "bytes=990-");
+  KJ_EXPECT(f.match("https://example.com/a", range).body == fill('a', 10));
+
+  // Bodies bigger than an eighth of the memory tier go straight to disk...
+  f.put("https://example.com/big", makePayload("", fill('z', 2000)));
+  KJ_EXPECT(f.cache.getStats().diskBytes == 3000);
+  KJ_EXPECT(f.match("https://example.com/big").body == fill('z', 2000));
+
+  // ...as do streamed ones, once they outgrow it.
+  f.put("https://example.com/streamed",
+      kj::str("HTTP/1.1 200 OK\r\n\r\n", fill('s', 2000)), f.headers(), false);
+  KJ_EXPECT(f.match("https://example.com/streamed").body == fill('s', 2000));
+
+  // The disk tier is full now, so the least recently used entries on disk were dropped.
+  stats = f.cache.getStats();
+  KJ_EXPECT(stats.diskBytes <= 4096);
+  KJ_EXPECT(f.match("https://example.com/a").statusCode == 504);
+  KJ_EXPECT(f.match("https://example.com/d").body == fill('d', 1000));
+
+  KJ_EXPECT(f.put("https://example.com/huge", makePayload("", fill('h', 3001))) == 413);
+  KJ_EXPECT(f.put("https://example.com/huge", kj::str("HTTP/1.1 200 OK\r\n\r\n", fill('h', 3001)),
+                f.headers(), false) == 413);
+}
+
+KJ_TEST("LocalCache without a disk tier") {
+  CacheFixture f({.memoryLimitBytes = 4096});
+
+  KJ_EXPECT(f.put("https://example.com/a", makePayload("", fill('a', 3000))) == 204);
+  KJ_EXPECT(f.put("https://example.com/b", makePayload("", fill('b', 3000))) == 204);
+  KJ_EXPECT(f.match("https://example.com/a").statusCode == 504);
+  KJ_EXPECT(f.match("https://example.com/b").statusCode == 200);
+  KJ_EXPECT(f.cache.getStats().diskBytes == 0);
+
+  KJ_EXPECT(f.put("https://example.com/c", makePayload("", fill('c', 5000))) == 413);
+}
+
+}  // namespace
+}  // namespace workerd::server
@@ -0,0 +1,517 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "local-cache.h"
+
+#include <workerd/util/http-util.h>
+#include <workerd/util/strings.h>
+
+#include <kj/debug.h>
+#include <kj/vector.h>
+
+namespace workerd::server {
+
+namespace {
+
+// Reads of the PUT payload are done in chunks of this size.
+constexpr size_t READ_CHUNK_SIZE = 64 * 1024;
+
+// Upper bound on the serialized headers of a stored response.
+constexpr size_t MAX_HEADERS_SIZE = 128 * 1024;
+
+// Bodies larger than this fraction of the memory tier go straight to disk, if there is one, so
+// that a single large object doesn't flush everything else out of memory.
+constexpr uint64_t MEMORY_OBJECT_FRACTION = 8;
+
+// Returns the value of the request header called `name`, which needn't be in the header table,
+// joining repeated headers with commas.
+kj::Maybe<kj::String> getHeaderByName(const kj::HttpHeaders& headers, kj::StringPtr name) {
+  kj::Vector<kj::StringPtr> values;
+  headers.forEach([&](kj::StringPtr headerName, kj::StringPtr value) {
+    if (toLower(headerName) == name) values.add(value);
+  });
+  if (values.size() == 0) return kj::none;
+  return kj::strArray(values, ", ");
+}
+
+// Reads and discards the rest of `input`.
+kj::Promise<void> drain(kj::AsyncInputStream& input) {
+  auto buffer = kj::heapArray<kj::byte>(READ_CHUNK_SIZE);
+  while (co_await input.tryRead(buffer.begin(), 1, buffer.size()) > 0) {}
+}
+
+}  // namespace
+
+LocalCache::LocalCache(
+    const kj::Clock& clock, kj::HttpHeaderTable::Builder& headerTableBuilder, Options options)
+    : clock(clock),
+      headerTable(headerTableBuilder.getFutureTable()),
+      options(options),
+      hAge(headerTableBuilder.add("Age")),
+      hCacheControl(headerTableBuilder.add("Cache-Control")),
+      hCacheNamespace(headerTableBuilder.add("CF-Cache-Namespace")),
+      hCacheStatus(headerTableBuilder.add("CF-Cache-Status")),
+      hETag(headerTableBuilder.add("ETag")),
+      hExpires(headerTableBuilder.add("Expires")),
+      hIfModifiedSince(headerTableBuilder.add("If-Modified-Since")),
+      hIfNoneMatch(headerTableBuilder.add("If-None-Match")),
+      hLastModified(headerTableBuilder.add("Last-Modified")),
+      hSetCookie(headerTableBuilder.add("Set-Cookie")),
+      hVary(headerTableBuilder.add("Vary")) {}
+
+LocalCache::~LocalCache() noexcept(false) {
+  // The lists must be empty before they're destroyed.
+  while (!memoryLru.empty()) memoryLru.remove(memoryLru.front());
+  while (!diskLru.empty()) diskLru.remove(diskLru.front());
+}
+
+void LocalCache::enableDiskTier(const kj::Directory& dir) {
+  diskDir = dir;
+}
+
+LocalCache::Stats LocalCache::getStats() const {
+  return {
+    .entryCount = entries.size(),
+    .memoryBytes = memoryBytes,
+    .diskBytes = diskBytes,
+    .hits = hits,
+    .misses = misses,
+  };
+}
+
+kj::Promise<void> LocalCache::request(kj::HttpMethod method,
+    kj::StringPtr url,
+    const kj::HttpHeaders& headers,
+    kj::AsyncInputStream& requestBody,
+    Response& response) {
+  // A space can't appear in either the URL or the (URI-encoded) namespace name.
+  auto key = kj::str(headers.get(hCacheNamespace).orDefault(""_kj), ' ', url);
+
+  switch (method) {
+    case kj::HttpMethod::GET:
+      return match(kj::mv(key), headers, response);
+    case kj::HttpMethod::PUT:
+      return put(kj::mv(key), headers, requestBody, response);
+    case kj::HttpMethod::PURGE:
+      return purge(kj::mv(key), response);
+    default:
+      return response.sendError(501, "Not Implemented", headerTable);
+  }
+}
+
+kj::Promise<void> LocalCache::match(kj::String key,
+    const kj::HttpHeaders& requestHeaders,
+    kj::HttpService::Response& response) {
+  auto& found = KJ_UNWRAP_OR(lookup(key, requestHeaders), {
+    ++misses;
+    kj::HttpHeaders headers(headerTable);
+    headers.set(hCacheStatus, "MISS");
+    co_return co_await response.sendError(504, "Gateway Timeout", headers);
+  });
+  ++hits;
+
+  // Hold on to the entry, and to its body if it's in memory, in case a concurrent put() replaces
+  // it or it spills to disk while we're writing it out.
+  auto entry = kj::addRef(found);
+  auto memoryBody =
+      entry->memoryBody.map([](kj::Own<MemoryBody>& body) { return kj::addRef(*body); });
+
+  auto headers = entry->headers.cloneShallow();
+  auto age = kj::str((clock.now() - entry->storedAt) / kj::SECONDS);
+  headers.set(hCacheStatus, "HIT");
+  headers.set(hAge, age);
+
+  if (isNotModified(*entry, requestHeaders)) {
+    response.send(304, "Not Modified", headers, uint64_t(0));
+    co_return;
+  }
+
+  uint64_t size = entry->bodySize;
+  uint statusCode = entry->statusCode;
+  kj::StringPtr statusText = entry->statusText;
+  uint64_t start = 0;
+  uint64_t length = size;
+  kj::String contentRange;
+  KJ_IF_SOME(header, requestHeaders.get(kj::HttpHeaderId::RANGE)) {
+    // Like DiskDirectoryService, only a single range is served as partial content.
+    KJ_SWITCH_ONEOF(kj::tryParseHttpRangeHeader(header.asArray(), size)) {
+      KJ_CASE_ONEOF(ranges, kj::Array<kj::HttpByteRange>) {
+        KJ_ASSERT(ranges.size() > 0);
+        if (ranges.size() == 1) {
+          start = ranges[0].start;
+          length = ranges[0].end - ranges[0].start + 1;
+          contentRange = kj::str("bytes ", ranges[0].start, "-", ranges[0].end, "/", size);
+          headers.set(kj::HttpHeaderId::CONTENT_RANGE, contentRange);
+          statusCode = 206;
+          statusText = "Partial Content";
+        }
+      }
+      KJ_CASE_ONEOF(_, kj::HttpEverythingRange) {}
+      KJ_CASE_ONEOF(_, kj::HttpUnsatisfiableRange) {
+        contentRange = kj::str("bytes */", size);
+        headers.set(kj::HttpHeaderId::CONTENT_RANGE, contentRange);
+        co_return co_await response.sendError(416, "Range Not Satisfiable", headers);
+      }
+    }
+  }
+
+  auto contentLength = kj::str(length);
+  headers.set(kj::HttpHeaderId::CONTENT_LENGTH, contentLength);
+  auto out = response.send(statusCode, statusText, headers, length);
+  if (length == 0) co_return;
+
+  KJ_IF_SOME(body, memoryBody) {
+    co_await out->write(body->body.slice(start, start + length));
+  } else {
+    auto& file = KJ_ASSERT_NONNULL(entry->file);
+    auto in = kj::heap<kj::FileInputStream>(*file, start);
+    co_await in->pumpTo(*out, length).ignoreResult();
+  }
+}
+
+kj::Promise<void> LocalCache::put(kj::String key,
+    const kj::HttpHeaders& requestHeaders,
+    kj::AsyncInputStream& requestBody,
+    kj::HttpService::Response& response) {
+  // Read up to the blank line that ends the payload's headers. Whatever follows it is the start
+  // of the body, which is never chunk-encoded even if the headers say so.
+  kj::Vector<kj::byte> buffer;
+  size_t headersSize = 0;
+  size_t scanned = 0;
+  for (;;) {
+    auto bytes = buffer.asPtr();
+    for (size_t i = scanned; i + 4 <= bytes.size(); i++) {
+      if (bytes.slice(i, i + 4) == "\r\n\r\n"_kj.asBytes()) {
+        // Keep the line break ending the last header line, like kj::HttpInputStream does.
+        headersSize = i + 2;
+        break;
+      }
+    }
+    if (headersSize > 0) break;
+    scanned = kj::max(bytes.size(), size_t(3)) - 3;
+
+    size_t oldSize = buffer.size();
+    if (oldSize >= MAX_HEADERS_SIZE) {
+      co_await drain(requestBody);
+      co_return co_await response.sendError(400, "Bad Request", headerTable);
+    }
+    buffer.resize(oldSize + READ_CHUNK_SIZE);
+    size_t n = co_await requestBody.tryRead(buffer.begin() + oldSize, 1, READ_CHUNK_SIZE);
+    buffer.resize(oldSize + n);
+    if (n == 0) {
+      co_return co_await response.sendError(400, "Bad Request", headerTable);
+    }
+  }
+  size_t bodyStart = headersSize + 2;
+
+  auto entry = kj::refcounted<Entry>(
+      headerTable, kj::mv(key), kj::heapArray(buffer.asPtr().first(headersSize).asChars()));
+  KJ_SWITCH_ONEOF(entry->headers.tryParseResponse(entry->headerText)) {
+    KJ_CASE_ONEOF(parsed, kj::HttpHeaders::Response) {
+      entry->statusCode = parsed.statusCode;
+      entry->statusText = parsed.statusText;
+    }
+    KJ_CASE_ONEOF(_, kj::HttpHeaders::ProtocolError) {
+      co_await drain(requestBody);
+      co_return co_await response.sendError(400, "Bad Request", headerTable);
+    }
+  }
+
+  auto now = clock.now();
+  entry->storedAt = now;
+  entry->expiresAt = KJ_UNWRAP_OR(getExpiry(entry->headers, now), {
+    // The response isn't allowed to be stored. This isn't an error as far as the Cache API is
+    // concerned; the entry just won't be found later.
+    co_await drain(requestBody);
+    response.send(204, "No Content", kj::HttpHeaders(headerTable));
+    co_return;
+  });
+
+  kj::Maybe<uint64_t> expectedSize;
+  KJ_IF_SOME(contentLength, entry->headers.get(kj::HttpHeaderId::CONTENT_LENGTH)) {
+    expectedSize = contentLength.tryParseAs<uint64_t>();
+  }
+  // These describe the payload's framing, not the stored body; match() sets its own.
+  entry->headers.unset(kj::HttpHeaderId::CONTENT_LENGTH);
+  entry->headers.unset(kj::HttpHeaderId::TRANSFER_ENCODING);
+
+  KJ_IF_SOME(vary, entry->headers.get(hVary)) {
+    kj::Vector<VaryValue> values;
+    bool varyAll = false;
+    forEachListElement(vary, [&](kj::ArrayPtr<const char> name) {
+      if (name == "*"_kj.asArray()) varyAll = true;
+      auto lowerName = toLower(name);
+      auto value = getHeaderByName(requestHeaders, lowerName);
+      values.add(VaryValue{.name = kj::mv(lowerName), .value = kj::mv(value)});
+    });
+    if (varyAll) {
+      // `Vary: *` never matches a later request (RFC 9111 section 4.1), so there's no point
+      // storing the response.
+      co_await drain(requestBody);
+      response.send(204, "No Content", kj::HttpHeaders(headerTable));
+      co_return;
+    }
+    entry->vary = values.releaseAsArray();
+  }
+
+  uint64_t maxSize = options.maxObjectBytes;
+  uint64_t maxMemorySize = options.memoryLimitBytes;
+  if (diskDir != kj::none) {
+    maxMemorySize /= MEMORY_OBJECT_FRACTION;
+  } else {
+    maxSize = kj::min(maxSize, maxMemorySize);
+  }
+
+  uint64_t bodySize = buffer.size() - bodyStart;
+  KJ_IF_SOME(size, expectedSize) {
+    if (size > maxSize) {
+      co_await drain(requestBody);
+      co_return co_await response.sendError(413, "Payload Too Large", headerTable);
+    }
+    if (bodySize > size) {
+      buffer.truncate(bodyStart + size);
+      bodySize = size;
+    }
+    if (size <= maxMemorySize) buffer.reserve(bodyStart + size);
+  }
+
+  // Read the body into memory, switching to a temporary file once it turns out to be too big.
+  kj::Maybe<kj::Own<const kj::File>> file;
+  kj::Array<kj::byte> chunk;
+  for (;;) {
+    if (bodySize > maxSize) {
+      co_await drain(requestBody);
+      co_return co_await response.sendError(413, "Payload Too Large", headerTable);
+    }
+    KJ_IF_SOME(size, expectedSize) {
+      if (bodySize == size) break;
+    }
+
+    if (file == kj::none && kj::max(bodySize, expectedSize.orDefault(0)) > maxMemorySize) {
+      KJ_IF_SOME(dir, diskDir) {
+        auto& newFile = file.emplace(dir.createTemporary());
+        newFile->write(0, buffer.asPtr().slice(bodyStart));
+        buffer.truncate(bodyStart);
+        chunk = kj::heapArray<kj::byte>(READ_CHUNK_SIZE);
+      }
+    }
+
+    // Don't read past the expected size, so that a buffer reserved for it never has to grow.
+    size_t readSize = READ_CHUNK_SIZE;
+    KJ_IF_SOME(size, expectedSize) {
+      readSize = kj::min(readSize, size - bodySize);
+    }
+
+    size_t n;
+    KJ_IF_SOME(f, file) {
+      n = co_await requestBody.tryRead(chunk.begin(), 1, readSize);
+      f->write(bodySize, chunk.first(n));
+    } else {
+      size_t oldSize = buffer.size();
+      buffer.resize(oldSize + readSize);
+      n = co_await requestBody.tryRead(buffer.begin() + oldSize, 1, readSize);
+      buffer.resize(oldSize + n);
+    }
+    if (n == 0) {
+      if (expectedSize != kj::none) {
+        co_return co_await response.sendError(400, "Bad Request", headerTable);
+      }
+      break;
+    }
+    bodySize += n;
+  }
+
+  entry->bodySize = bodySize;
+  KJ_IF_SOME(f, file) {
+    entry->file = kj::mv(f);
+  } else {
+    entry->memoryBody = kj::refcounted<MemoryBody>(buffer.releaseAsArray(), bodyStart);
+  }
+  insert(kj::mv(entry));
+
+  response.send(204, "No Content", kj::HttpHeaders(headerTable));
+}
+
+kj::Promise<void> LocalCache::purge(kj::String key, kj::HttpService::Response& response) {
+  KJ_IF_SOME(entry, entries.find(key)) {
+    remove(*entry);
+    response.send(200, "OK", kj::HttpHeaders(headerTable));
+    return kj::READY_NOW;
+  } else {
+    return response.sendError(404, "Not Found", headerTable);
+  }
+}
+
+kj::Maybe<LocalCache::Entry&> LocalCache::lookup(
+    kj::StringPtr key, const kj::HttpHeaders& requestHeaders) {
+  auto& entry = *KJ_UNWRAP_OR(entries.find(key), return kj::none);
+
+  KJ_IF_SOME(expiresAt, entry.expiresAt) {
+    if (clock.now() >= expiresAt) {
+      remove(entry);
+      return kj::none;
+    }
+  }
+
+  for (auto& vary: entry.vary) {
+    auto value = getHeaderByName(requestHeaders, vary.name);
+    KJ_IF_SOME(expected, vary.value) {
+      KJ_IF_SOME(actual, value) {
+        if (actual == expected) continue;
+      }
+      return kj::none;
+    } else if (value != kj::none) {
+      return kj::none;
+    }
+  }
+
+  // Move to the most recently used end.
+  if (entry.memoryBody != kj::none) {
+    memoryLru.remove(entry);
+    memoryLru.add(entry);
+  } else {
+    diskLru.remove(entry);
+    diskLru.add(entry);
+  }
+
+  return entry;
+}
+
+bool LocalCache::isNotModified(Entry& entry, const kj::HttpHeaders& requestHeaders) {
+  if (entry.statusCode != 200) return false;
+
+  // If-None-Match takes precedence over If-Modified-Since when both are present.
+  KJ_IF_SOME(ifNoneMatch, requestHeaders.get(hIfNoneMatch)) {
+    auto etag = KJ_UNWRAP_OR(entry.headers.get(hETag), return false);
+    bool matched = false;
+    forEachListElement(ifNoneMatch, [&](kj::ArrayPtr<const char> tag) {
+      if (tag == "*"_kj.asArray() || etagMatches(tag, etag.asArray())) matched = true;
+    });
+    return matched;
+  }
+
+  KJ_IF_SOME(ifModifiedSince, requestHeaders.get(hIfModifiedSince)) {
+    auto lastModified = KJ_UNWRAP_OR(entry.headers.get(hLastModified), return false);
+    KJ_IF_SOME(since, parseHttpDate(ifModifiedSince)) {
+      KJ_IF_SOME(modified, parseHttpDate(lastModified)) {
+        return modified <= since;
+      }
+    }
+  }
+
+  return false;
+}
+
+// Returns kj::none if a response with these headers must not be stored at all. Otherwise, returns
+// when it expires, or kj::none if it doesn't.
+kj::Maybe<kj::Maybe<kj::Date>> LocalCache::getExpiry(const kj::HttpHeaders& headers, kj::Date now) {
+  if (headers.get(hSetCookie) != kj::none) return kj::none;
+
+  bool storable = true;
+  kj::Maybe<uint64_t> maxAge;
+  kj::Maybe<uint64_t> sMaxAge;
+  KJ_IF_SOME(cacheControl, headers.get(hCacheControl)) {
+    forEachListElement(cacheControl, [&](kj::ArrayPtr<const char> directive) {
+      auto lower = toLower(directive);
+      kj::StringPtr name = lower;
+      kj::StringPtr value;
+      KJ_IF_SOME(eq, lower.findFirst('=')) {
+        lower[eq] = '\0';
+        name = kj::StringPtr(lower.begin(), eq);
+        value = lower.slice(eq + 1);
+        if (value.size() >= 2 && value.startsWith("\"") && value.endsWith("\"")) {
+          lower[lower.size() - 1] = '\0';
+          value = kj::StringPtr(value.begin() + 1, value.size() - 2);
+        }
+      }
+
+      if (name == "no-store" || name == "no-cache" || name == "private") {
+        storable = false;
+      } else if (name == "max-age") {
+        maxAge = value.tryParseAs<uint64_t>();
+      } else if (name == "s-maxage") {
+        sMaxAge = value.tryParseAs<uint64_t>();
+      }
+    });
+  }
+  if (!storable) return kj::none;
+
+  if (sMaxAge == kj::none) sMaxAge = maxAge;
+  KJ_IF_SOME(seconds, sMaxAge) {
+    if (seconds == 0) return kj::none;
+    return kj::Maybe<kj::Date>(now + seconds * kj::SECONDS);
+  }
+
+  KJ_IF_SOME(expires, headers.get(hExpires)) {
+    auto date = KJ_UNWRAP_OR(parseHttpDate(expires), return kj::none);
+    if (date <= now) return kj::none;
+    return kj::Maybe<kj::Date>(date);
+  }
+
+  return kj::Maybe<kj::Date>(kj::none);
+}
+
+void LocalCache::insert(kj::Own<Entry> entry) {
+  KJ_IF_SOME(old, entries.find(entry->key)) {
+    remove(*old);
+  }
+
+  auto& ref = *entry;
+  if (ref.memoryBody != kj::none) {
+    memoryLru.add(ref);
+  } else {
+    diskLru.add(ref);
+    diskBytes += ref.bodySize;
+  }
+  memoryBytes += ref.memorySize();
+  entries.insert(ref.key, kj::mv(entry));
+
+  evict();
+}
+
+void LocalCache::remove(Entry& entry) {
+  if (entry.memoryBody != kj::none) {
+    memoryLru.remove(entry);
+  } else {
+    diskLru.remove(entry);
+    diskBytes -= entry.bodySize;
+  }
+  memoryBytes -= entry.memorySize();
+
+  // This may destroy the entry, unless a hit is still writing it out.
+  KJ_ASSERT(entries.erase(entry.key));
+}
+
+void LocalCache::spill(Entry& entry) {
+  auto& dir = KJ_ASSERT_NONNULL(diskDir);
+  auto& body = *KJ_ASSERT_NONNULL(entry.memoryBody);
+
+  auto file = dir.createTemporary();
+  file->write(0, body.body);
+
+  memoryBytes -= entry.memorySize();
+  memoryLru.remove(entry);
+  entry.file = kj::mv(file);
+  entry.memoryBody = kj::none;
+  memoryBytes += entry.memorySize();
+  diskLru.add(entry);
+  diskBytes += entry.bodySize;
+}
+
+void LocalCache::evict() {
+  while (memoryBytes > options.memoryLimitBytes && !memoryLru.empty()) {
+    auto& entry = memoryLru.front();
+    if (diskDir != kj::none && entry.bodySize <= options.diskLimitBytes) {
+      spill(entry);
+    } else {
+      remove(entry);
+    }
+  }
+
+  while (diskBytes > options.diskLimitBytes && !diskLru.empty()) {
+    remove(diskLru.front());
+  }
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,171 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/compat/http.h>
+#include <kj/filesystem.h>
+#include <kj/list.h>
+#include <kj/map.h>
+#include <kj/refcount.h>
+#include <kj/time.h>
+
+namespace workerd::server {
+
+// An in-process backend for the Cache API, speaking the same HTTP protocol that api/cache.c++
+// uses to talk to the service named by `cacheApiOutbound`:
+//
+// * `GET` with `Cache-Control: only-if-cached` looks up an entry, answering with the stored
+//   response and `CF-Cache-Status: HIT`, or a 504 with `CF-Cache-Status: MISS`.
+// * `PUT` stores the HTTP response serialized in the request body.
+// * `PURGE` deletes an entry, answering 200 if it existed and 404 otherwise.
+//
+// Entries are keyed by URL and by the `CF-Cache-Namespace` header, which distinguishes the caches
+// returned by `caches.open()`. Only one variant is kept per key: a response with `Vary` records
+// the values of the request headers it names, and only matches requests with the same values.
+//
+// Responses are only stored if their `Cache-Control` allows a shared cache to do so, i.e. not if
+// they are `no-store`, `no-cache` or `private`, or if they set a cookie. They expire according to
+// `s-maxage`, `max-age` or `Expires`, in that order, or are kept until evicted if none is given.
+// Hits honor `If-None-Match`, `If-Modified-Since` and single-range `Range` requests.
+//
+// Entries are kept in memory up to `memoryLimitBytes`. Once a disk tier is enabled, the least
+// recently used entries spill to anonymous temporary files in that directory instead of being
+// dropped, up to `diskLimitBytes`, and bodies too large to be worth keeping in memory are written
+// there directly. Hits are written straight from the stored buffer or file. The temporary files
+// have no names and disappear when closed, so nothing outlives the process.
+//
+// Like the rest of the server, this is single-threaded.
+class LocalCache final: public kj::HttpService {
+ public:
+  struct Options {
+    // Total size of the headers and bodies kept in memory.
+    uint64_t memoryLimitBytes = 64ull << 20;
+
+    // Total size of the bodies spilled to disk, if the disk tier is enabled.
+    uint64_t diskLimitBytes = 1ull << 30;
+
+    // Largest body that will be stored; bigger responses are refused with 413. Without a disk
+    // tier, bodies are also limited to `memoryLimitBytes`.
+    uint64_t maxObjectBytes = 512ull << 20;
+  };
+
+  LocalCache(
+      const kj::Clock& clock, kj::HttpHeaderTable::Builder& headerTableBuilder, Options options);
+  ~LocalCache() noexcept(false);
+  KJ_DISALLOW_COPY_AND_MOVE(LocalCache);
+
+  // Lets entries spill to temporary files in `dir`, which must outlive this object.
+  void enableDiskTier(const kj::Directory& dir);
+
+  struct Stats {
+    uint64_t entryCount;
+    uint64_t memoryBytes;
+    uint64_t diskBytes;
+    uint64_t hits;
+    uint64_t misses;
+  };
+  Stats getStats() const;
+
+  kj::Promise<void> request(kj::HttpMethod method,
+      kj::StringPtr url,
+      const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody,
+      Response& response) override;
+
+ private:
+  // A body kept in memory. Hits hold their own reference while writing it out, so the entry can
+  // spill to disk or be replaced in the meantime.
+  struct MemoryBody: public kj::Refcounted {
+    // The whole PUT payload, i.e. the serialized headers followed by `body`.
+    kj::Array<kj::byte> payload;
+    kj::ArrayPtr<const kj::byte> body;
+
+    MemoryBody(kj::Array<kj::byte> payload, size_t bodyStart)
+        : payload(kj::mv(payload)),
+          body(this->payload.slice(bodyStart)) {}
+  };
+
+  struct VaryValue {
+    kj::String name;  // lower case
+    kj::Maybe<kj::String> value;
+  };
+
+  struct Entry: public kj::Refcounted {
+    kj::String key;
+    kj::Array<char> headerText;  // backs `headers` and `statusText`
+    kj::HttpHeaders headers;
+    uint statusCode = 0;
+    kj::StringPtr statusText;
+    kj::Array<VaryValue> vary;
+    kj::Date storedAt = kj::UNIX_EPOCH;
+    kj::Maybe<kj::Date> expiresAt;
+
+    // Exactly one of these is set once the entry is stored.
+    uint64_t bodySize = 0;
+    kj::Maybe<kj::Own<MemoryBody>> memoryBody;
+    kj::Maybe<kj::Own<const kj::File>> file;
+
+    // Link in `memoryLru` or `diskLru`, while the entry is in `entries`.
+    kj::ListLink<Entry> link;
+
+    Entry(kj::HttpHeaderTable& headerTable, kj::String key, kj::Array<char> headerText)
+        : key(kj::mv(key)),
+          headerText(kj::mv(headerText)),
+          headers(headerTable) {}
+
+    uint64_t memorySize() const {
+      return headerText.size() + (memoryBody == kj::none ? 0 : bodySize);
+    }
+  };
+
+  const kj::Clock& clock;
+  kj::HttpHeaderTable& headerTable;
+  Options options;
+  kj::Maybe<const kj::Directory&> diskDir;
+
+  kj::HttpHeaderId hAge;
+  kj::HttpHeaderId hCacheControl;
+  kj::HttpHeaderId hCacheNamespace;
+  kj::HttpHeaderId hCacheStatus;
+  kj::HttpHeaderId hETag;
+  kj::HttpHeaderId hExpires;
+  kj::HttpHeaderId hIfModifiedSince;
+  kj::HttpHeaderId hIfNoneMatch;
+  kj::HttpHeaderId hLastModified;
+  kj::HttpHeaderId hSetCookie;
+  kj::HttpHeaderId hVary;
+
+  // Keys point into the entries themselves.
+  kj::HashMap<kj::StringPtr, kj::Own<Entry>> entries;
+
+  // Least recently used entries first.
+  kj::List<Entry, &Entry::link> memoryLru;
+  kj::List<Entry, &Entry::link> diskLru;
+
+  uint64_t memoryBytes = 0;
+  uint64_t diskBytes = 0;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+
+  kj::Promise<void> match(kj::String key,
+      const kj::HttpHeaders& requestHeaders,
+      kj::HttpService::Response& response);
+  kj::Promise<void> put(kj::String key,
+      const kj::HttpHeaders& requestHeaders,
+      kj::AsyncInputStream& requestBody,
+      kj::HttpService::Response& response);
+  kj::Promise<void> purge(kj::String key, kj::HttpService::Response& response);
+
+  kj::Maybe<Entry&> lookup(kj::StringPtr key, const kj::HttpHeaders& requestHeaders);
+  bool isNotModified(Entry& entry, const kj::HttpHeaders& requestHeaders);
+  kj::Maybe<kj::Maybe<kj::Date>> getExpiry(const kj::HttpHeaders& headers, kj::Date now);
+
+  void insert(kj::Own<Entry> entry);
+  void remove(Entry& entry);
+  void spill(Entry& entry);
+  void evict();
+};
+
+}  // namespace workerd::server
@@ -0,0 +1,323 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "local-kv.h"
+
+#include <capnp/compat/json.h>
+#include <capnp/message.h>
+#include <kj/encoding.h>
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+class FakeClock final: public kj::Clock {
+ public:
+  kj::Date now() const override {
+    return time;
+  }
+
+  kj::Date time = kj::UNIX_EPOCH + 1'700'000'000 * kj::SECONDS;
+};
+
+struct GetResult {
+  uint statusCode;
+  kj::String body;
+  kj::Maybe<kj::String> metadata;
+};
+
+struct KvFixture {
+  kj::EventLoop loop;
+  kj::WaitScope ws{loop};
+  FakeClock clock;
+  kj::TimerImpl timer{kj::origin<kj::TimePoint>()};
+  kj::Own<const kj::Directory> dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs{*dir};
+  kj::HttpHeaderTable::Builder builder;
+  kj::HttpHeaderId hMetadata = builder.add("CF-KV-Metadata");
+  LocalKv kv{clock, timer, builder};
+  kj::Own<kj::HttpHeaderTable> table = builder.build();
+  kj::Own<kj::HttpClient> client = kj::newHttpClient(kv);
+
+  KvFixture() {
+    kv.open(vfs, kj::Path({"kv.sqlite"}));
+  }
+
+  // Sends a request the way api/kv.c++ would, returning the status and response body.
+  GetResult send(kj::HttpMethod method,
+      kj::StringPtr url,
+      kj::StringPtr body = nullptr,
+      kj::Maybe<kj::StringPtr> metadata = kj::none) {
+    kj::HttpHeaders headers(*table);
+    KJ_IF_SOME(m, metadata) {
+      headers.set(hMetadata, m);
+    }
+    auto request = client->request(method, url, headers, uint64_t(body.size()));
+    request.body->write(body.asBytes()).wait(ws);
+    request.body = nullptr;
+    auto response = request.response.wait(ws);
+    auto text = response.body->readAllText().wait(ws);
+    return {response.statusCode, kj::mv(text),
+      response.headers->get(hMetadata).map([](kj::StringPtr m) { return kj::str(m); })};
+  }
+
+  GetResult get(kj::StringPtr key) {
+    return send(kj::HttpMethod::GET,
+        kj::str("https://fake-host/", kj::encodeUriComponent(key), "?urlencoded=true"));
+  }
+
+  uint put(kj::StringPtr key,
+      kj::StringPtr value,
+      kj::StringPtr query = ""_kj,
+      kj::Maybe<kj::StringPtr> metadata = kj::none) {
+    return send(kj::HttpMethod::PUT,
+        kj::str("https://fake-host/", kj::encodeUriComponent(key), "?urlencoded=true", query),
+        value, metadata)
+        .statusCode;
+  }
+
+  uint delete_(kj::StringPtr key) {
+    return send(kj::HttpMethod::DELETE,
+        kj::str("https://fake-host/", kj::encodeUriComponent(key), "?urlencoded=true"))
+        .statusCode;
+  }
+
+  void advance(kj::Duration delta) {
+    clock.time = clock.time + delta;
+    timer.advanceTo(timer.now() + delta);
+    ws.poll();
+  }
+};
+
+// Looks up the fields of a parsed JSON object by name.
+struct JsonFields {
+  capnp::JsonValue::Reader value;
+
+  explicit JsonFields(capnp::JsonValue::Reader value): value(value) {}
+
+  kj::Maybe<capnp::JsonValue::Reader> find(kj::StringPtr name) {
+    for (auto field: value.getObject()) {
+      if (field.getName() == name) return field.getValue();
+    }
+    return kj::none;
+  }
+
+  capnp::JsonValue::Reader operator[](kj::StringPtr name) {
+    return KJ_ASSERT_NONNULL(find(name), name);
+  }
+};
+
+// A JSON object parsed from a response body.
+struct JsonObject {
+  capnp::MallocMessageBuilder message;
+  JsonFields fields;
+
+  explicit JsonObject(kj::StringPtr text): fields(parse(text, message)) {}
+
+  capnp::JsonValue::Reader operator[](kj::StringPtr name) {
+    return fields[name];
+  }
+
+  static capnp::JsonValue::Reader parse(kj::StringPtr text, capnp::MallocMessageBuilder& message) {
+    auto root = message.initRoot<capnp::JsonValue>();
+    capnp::JsonCodec().decodeRaw(text, root);
+    return root.asReader();
+  }
+};
+
+kj::String fill(char c, size_t size) {
+  auto result = kj::heapString(size);
+  for (auto& ch: result) ch = c;
+  return result;
+}
+
+KJ_TEST("LocalKv stores, gets and deletes keys") {
+  KvFixture f;
+
+  KJ_EXPECT(f.get("foo").statusCode == 404);
+
+  KJ_EXPECT(f.put("foo", "bar") == 200);
+  KJ_EXPECT(f.put("with/slash", "baz", ""_kj, "{\"a\":1}"_kj) == 200);
+
+  auto foo = f.get("foo");
+  KJ_EXPECT(foo.statusCode == 200);
+  KJ_EXPECT(foo.body == "bar");
+  KJ_EXPECT(foo.metadata == kj::none);
+
+  auto slash = f.get("with/slash");
+  KJ_EXPECT(slash.body == "baz");
+  KJ_EXPECT(KJ_ASSERT_NONNULL(slash.metadata) == "{\"a\":1}");
+
+  // Overwrite, dropping the metadata.
+  KJ_EXPECT(f.put("with/slash", "qux") == 200);
+  slash = f.get("with/slash");
+  KJ_EXPECT(slash.body == "qux");
+  KJ_EXPECT(slash.metadata == kj::none);
+
+  KJ_EXPECT(f.delete_("foo") == 200);
+  KJ_EXPECT(f.get("foo").statusCode == 404);
+
+  // Deleting a key that doesn't exist succeeds, like it does in KV.
+  KJ_EXPECT(f.delete_("foo") == 200);
+}
+
+KJ_TEST("LocalKv validates keys, values and expirations") {
+  KvFixture f;
+
+  KJ_EXPECT(f.get(fill('a', LocalKv::MAX_KEY_BYTES)).statusCode == 404);
+  KJ_EXPECT(f.get(fill('a', LocalKv::MAX_KEY_BYTES + 1)).statusCode == 414);
+
+  KJ_EXPECT(f.put("foo", "bar", "&expiration_ttl=30") == 400);
+  KJ_EXPECT(f.put("foo", "bar", "&expiration_ttl=soon") == 400);
+  KJ_EXPECT(f.put("foo", "bar", "&expiration=1700000030") == 400);
+  KJ_EXPECT(f.put("foo", "bar", ""_kj, fill('x', LocalKv::MAX_METADATA_BYTES + 1)) == 413);
+  KJ_EXPECT(f.get("foo").statusCode == 404);
+}
+
+KJ_TEST("LocalKv expires keys and sweeps them in the background") {
+  KvFixture f;
+
+  KJ_EXPECT(f.put("ttl", "1", "&expiration_ttl=60") == 200);
+  KJ_EXPECT(f.put("absolute", "2", "&expiration=1700000120") == 200);
+  KJ_EXPECT(f.put("forever", "3") == 200);
+
+  f.clock.time = f.clock.time + 59 * kj::SECONDS;
+  KJ_EXPECT(f.get("ttl").statusCode == 200);
+
+  // Expired keys disappear as soon as they expire, even before they're swept.
+  f.clock.time = f.clock.time + 1 * kj::SECONDS;
+  KJ_EXPECT(f.get("ttl").statusCode == 404);
+  KJ_EXPECT(f.get("absolute").statusCode == 200);
+  KJ_EXPECT(f.kv.sweepExpired() == 1);
+
+  // The background sweep picks up the other one.
+  f.advance(LocalKv::SWEEP_INTERVAL);
+  KJ_EXPECT(f.kv.sweepExpired() == 0);
+  KJ_EXPECT(f.get("absolute").statusCode == 404);
+  KJ_EXPECT(f.get("forever").body == "3");
+}
+
+KJ_TEST("LocalKv lists keys by prefix, one page at a time") {
+  KvFixture f;
+
+  for (auto key: {"a/3", "a/1", "b/1", "a/2", "a/4", "a/5"}) {
+    KJ_EXPECT(f.put(key, "x") == 200);
+  }
+  KJ_EXPECT(f.put("a/2", "x", "&expiration_ttl=60", "\"meta\""_kj) == 200);
+
+  kj::Vector<kj::String> names;
+  kj::Maybe<kj::String> cursor;
+  uint pages = 0;
+  for (;;) {
+    auto url = kj::str("https://fake-host/?key_count_limit=2&prefix=a%2F");
+    KJ_IF_SOME(c, cursor) {
+      url = kj::str(url, "&cursor=", kj::encodeUriComponent(c));
+    }
+    auto result = f.send(kj::HttpMethod::GET, url);
+    KJ_ASSERT(result.statusCode == 200);
+    ++pages;
+
+    JsonObject json(result.body);
+    for (auto key: json["keys"].getArray()) {
+      JsonFields fields(key);
+      names.add(kj::str(fields["name"].getString()));
+      if (fields.find("metadata") != kj::none) {
+        KJ_EXPECT(names.back() == "a/2");
+        KJ_EXPECT(fields["metadata"].getString() == "\"meta\"");
+        KJ_EXPECT(fields["expiration"].getNumber() == 1'700'000'060);
+      }
+    }
+
+    if (json["list_complete"].getBoolean()) break;
+    cursor = kj::str(json["cursor"].getString());
+  }
+
+  KJ_EXPECT(pages == 3);
+  KJ_EXPECT(kj::strArray(names, ",") == "a/1,a/2,a/3,a/4,a/5");
+
+  // Expired keys aren't listed.
+  f.clock.time = f.clock.time + 60 * kj::SECONDS;
+  auto result = f.send(kj::HttpMethod::GET, "https://fake-host/?prefix=a%2F");
+  JsonObject json(result.body);
+  KJ_EXPECT(json["keys"].getArray().size() == 4);
+  KJ_EXPECT(json["list_complete"].getBoolean());
+}
+
+KJ_TEST("LocalKv gets many keys at once") {
+  KvFixture f;
+
+  KJ_EXPECT(f.put("a", "1") == 200);
+  KJ_EXPECT(f.put("b", "2", ""_kj, "{\"m\":true}"_kj) == 200);
+
+  auto result = f.send(kj::HttpMethod::POST, "https://fake-host/bulk/get",
+      R"({"keys":["a","b","missing"],"type":"text","withMetadata":false})");
+  KJ_ASSERT(result.statusCode == 200);
+  JsonObject values(result.body);
+  KJ_EXPECT(values["a"].getString() == "1");
+  KJ_EXPECT(values["b"].getString() == "2");
+  KJ_EXPECT(values["missing"].isNull());
+
+  result = f.send(kj::HttpMethod::POST, "https://fake-host/bulk/get",
+      R"({"keys":["a","b"],"withMetadata":true})");
+  JsonObject withMetadata(result.body);
+  JsonFields a(withMetadata["a"]);
+  KJ_EXPECT(a["value"].getString() == "1");
+  KJ_EXPECT(a["metadata"].isNull());
+  JsonFields b(withMetadata["b"]);
+  KJ_EXPECT(b["value"].getString() == "2");
+  KJ_EXPECT(b["metadata"].getString() == "{\"m\":true}");
+
+  KJ_EXPECT(
+      f.send(kj::HttpMethod::POST, "https://fake-host/bulk/get", R"({"keys":[]})").statusCode ==
+      400);
+  KJ_EXPECT(f.send(kj::HttpMethod::POST, "https://fake-host/bulk/get", "not json").statusCode ==
+      400);
+}
+
+KJ_TEST("LocalKv serves in-process bindings without HTTP") {
+  KvFixture f;
+  KvClient& kv = f.kv;
+
+  KJ_EXPECT(kv.get("foo").wait(f.ws) == kj::none);
+  kv.put("foo", "bar"_kj.asBytes(), {.metadata = "{\"a\":1}"_kj}).wait(f.ws);
+  kv.put("ttl", "baz"_kj.asBytes(), {.expirationTtl = 60}).wait(f.ws);
+
+  // Both faces see the same keys.
+  auto foo = KJ_ASSERT_NONNULL(kv.get("foo").wait(f.ws));
+  KJ_EXPECT(kj::str(foo.value.asChars()) == "bar");
+  KJ_EXPECT(KJ_ASSERT_NONNULL(foo.metadata) == "{\"a\":1}");
+  KJ_EXPECT(f.get("ttl").body == "baz");
+  KJ_EXPECT(f.put("http", "qux") == 200);
+
+  auto keys = kj::heapArray<kj::String>({kj::str("http"), kj::str("missing")});
+  auto values = kv.getBulk(keys).wait(f.ws);
+  KJ_ASSERT(values.size() == 2);
+  KJ_EXPECT(kj::str(KJ_ASSERT_NONNULL(values[0]).value.asChars()) == "qux");
+  KJ_EXPECT(values[1] == kj::none);
+
+  auto page = kv.list(""_kj, kj::none, 2u).wait(f.ws);
+  KJ_ASSERT(page.keys.size() == 2);
+  KJ_EXPECT(page.keys[0].name == "foo");
+  KJ_EXPECT(KJ_ASSERT_NONNULL(page.keys[0].metadata) == "{\"a\":1}");
+  KJ_EXPECT(page.keys[1].name == "http");
+  auto last = kv.list(""_kj, KJ_ASSERT_NONNULL(page.cursor).asPtr(), 2u).wait(f.ws);
+  KJ_ASSERT(last.keys.size() == 1);
+  KJ_EXPECT(last.keys[0].name == "ttl");
+  KJ_EXPECT(KJ_ASSERT_NONNULL(last.keys[0].expiration) == 1'700'000'060);
+  KJ_EXPECT(last.cursor == kj::none);
+
+  kv.delete_("foo").wait(f.ws);
+  KJ_EXPECT(f.get("foo").statusCode == 404);
+
+  // Requests that HTTP refuses with a status throw what the binding reports for it.
+  KJ_EXPECT_THROW_MESSAGE("KV PUT failed: 400 Bad Request",
+      kv.put("foo", "bar"_kj.asBytes(), {.expirationTtl = 30}).wait(f.ws));
+  KJ_EXPECT_THROW_MESSAGE("KV PUT failed: 413 Payload Too Large",
+      kv.put("foo", fill('x', LocalKv::MAX_VALUE_BYTES + 1).asBytes(), {}).wait(f.ws));
+  KJ_EXPECT_THROW_MESSAGE(
+      "KV GET failed: 400 Bad Request", kv.list(""_kj, "not base64!"_kj, kj::none).wait(f.ws));
+}
+
+}  // namespace
+}  // namespace workerd::server
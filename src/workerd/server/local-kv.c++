@@ -0,0 +1,495 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "local-kv.h"
+
+#include <workerd/jsg/exception.h>
+#include <workerd/util/mimetype.h>
+
+#include <capnp/compat/json.h>
+#include <capnp/message.h>
+#include <kj/debug.h>
+#include <kj/encoding.h>
+#include <kj/vector.h>
+
+namespace workerd::server {
+
+namespace {
+
+// Expired keys are deleted this many at a time, yielding to the event loop in between.
+constexpr uint SWEEP_BATCH_SIZE = 1000;
+
+// Upper bound on the size of a bulk get request, which only lists keys.
+constexpr size_t MAX_BULK_REQUEST_BYTES = 128 * 1024;
+
+kj::Maybe<kj::StringPtr> getQueryParam(const kj::Url& url, kj::StringPtr name) {
+  for (auto& param: url.query) {
+    if (param.name == name) return param.value.asPtr();
+  }
+  return kj::none;
+}
+
+// Returns the smallest string that is greater than every string starting with `prefix`. Keys are
+// UTF-8, which never contains the byte 0xff, so "\xff" is greater than all of them.
+kj::String prefixEnd(kj::StringPtr prefix) {
+  for (size_t i = prefix.size(); i > 0; --i) {
+    auto c = static_cast<kj::byte>(prefix[i - 1]);
+    if (c != 0xff) {
+      return kj::str(prefix.first(i - 1), static_cast<char>(c + 1));
+    }
+  }
+  return kj::str("\xff");
+}
+
+bool isValidKey(kj::StringPtr key) {
+  return key != ""_kj && key != "."_kj && key != ".."_kj && key.size() <= LocalKv::MAX_KEY_BYTES;
+}
+
+}  // namespace
+
+LocalKv::LocalKv(
+    const kj::Clock& clock, kj::Timer& timer, kj::HttpHeaderTable::Builder& headerTableBuilder)
+    : clock(clock),
+      timer(timer),
+      headerTable(headerTableBuilder.getFutureTable()),
+      hMetadata(headerTableBuilder.add("CF-KV-Metadata")) {}
+
+void LocalKv::open(const SqliteDatabase::Vfs& vfs, kj::Path path) {
+  KJ_REQUIRE(database == kj::none, "LocalKv opened twice");
+
+  auto db = kj::heap<SqliteDatabase>(vfs, kj::mv(path),
+      kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT);
+
+  db->run("PRAGMA journal_mode=WAL;");
+
+  // Keys are TEXT and compared bytewise, so the primary key orders them the way list() returns
+  // them.
+  db->run(R"(
+    CREATE TABLE IF NOT EXISTS _cf_KV (
+      key TEXT PRIMARY KEY,
+      value BLOB,
+      metadata TEXT,
+      expiration INTEGER
+    ) WITHOUT ROWID;
+  )");
+
+  // Only keys that expire are indexed, so keys without an expiration cost the sweep nothing.
+  db->run(R"(
+    CREATE INDEX IF NOT EXISTS _cf_KV_expiration ON _cf_KV (expiration)
+      WHERE expiration IS NOT NULL;
+  )");
+
+  database = kj::heap<Database>(kj::mv(db));
+  sweeper = runSweeper().eagerlyEvaluate(nullptr);
+}
+
+LocalKv::Database& LocalKv::getDatabase() {
+  return *KJ_REQUIRE_NONNULL(database, "LocalKv used before open()");
+}
+
+int64_t LocalKv::nowSeconds() {
+  return (clock.now() - kj::UNIX_EPOCH) / kj::SECONDS;
+}
+
+uint LocalKv::sweepBatch(int64_t now) {
+  return getDatabase().stmtSweep.run(now, SWEEP_BATCH_SIZE).changeCount();
+}
+
+uint LocalKv::sweepExpired() {
+  auto now = nowSeconds();
+  uint total = 0;
+  for (;;) {
+    auto count = sweepBatch(now);
+    total += count;
+    if (count < SWEEP_BATCH_SIZE) return total;
+  }
+}
+
+kj::Promise<void> LocalKv::runSweeper() {
+  for (;;) {
+    co_await timer.afterDelay(SWEEP_INTERVAL);
+
+    auto now = nowSeconds();
+    for (;;) {
+      uint count = 0;
+      KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() { count = sweepBatch(now); })) {
+        KJ_LOG(ERROR, "failed to delete expired KV keys", exception);
+      }
+      if (count < SWEEP_BATCH_SIZE) break;
+      co_await kj::yield();
+    }
+  }
+}
+
+kj::Promise<void> LocalKv::request(kj::HttpMethod method,
+    kj::StringPtr urlStr,
+    const kj::HttpHeaders& headers,
+    kj::AsyncInputStream& requestBody,
+    Response& response) {
+  auto url = KJ_UNWRAP_OR(kj::Url::tryParse(urlStr, kj::Url::HTTP_PROXY_REQUEST),
+      { co_return co_await sendRefusal(response, BAD_REQUEST); });
+
+  if (url.path.size() == 0) {
+    if (method == kj::HttpMethod::GET) {
+      co_return co_await handleList(url, response);
+    }
+  } else if (url.path.size() == 1) {
+    auto& key = url.path[0];
+    if (key.size() > MAX_KEY_BYTES) {
+      co_return co_await response.sendError(414, "URI Too Long", headerTable);
+    } else if (!isValidKey(key)) {
+      co_return co_await sendRefusal(response, BAD_REQUEST);
+    }
+
+    switch (method) {
+      case kj::HttpMethod::GET:
+        co_return co_await handleGet(key, response);
+      case kj::HttpMethod::PUT:
+        co_return co_await handlePut(key, url, headers, requestBody, response);
+      case kj::HttpMethod::DELETE:
+        co_return co_await handleDelete(key, response);
+      default:
+        break;
+    }
+  } else if (url.path.size() == 2 && url.path[0] == "bulk" && url.path[1] == "get") {
+    if (method == kj::HttpMethod::POST) {
+      co_return co_await handleBulkGet(requestBody, response);
+    }
+  } else {
+    co_return co_await response.sendError(404, "Not Found", headerTable);
+  }
+
+  co_return co_await response.sendError(405, "Method Not Allowed", headerTable);
+}
+
+// -----------------------------------------------------------------------------
+// KvClient
+
+kj::Promise<kj::Maybe<KvClient::Value>> LocalKv::get(kj::StringPtr key) {
+  return getValue(key);
+}
+
+kj::Promise<kj::Array<kj::Maybe<KvClient::Value>>> LocalKv::getBulk(
+    kj::ArrayPtr<const kj::String> keys) {
+  return KJ_MAP(key, keys) { return getValue(key); };
+}
+
+kj::Promise<KvClient::ListResult> LocalKv::list(
+    kj::StringPtr prefix, kj::Maybe<kj::StringPtr> cursor, kj::Maybe<uint> limit) {
+  KJ_SWITCH_ONEOF(listKeys(prefix, cursor, limit)) {
+    KJ_CASE_ONEOF(result, ListResult) {
+      return kj::mv(result);
+    }
+    KJ_CASE_ONEOF(refusal, Refusal) {
+      throwRefusal("GET", refusal);
+    }
+  }
+  KJ_UNREACHABLE;
+}
+
+kj::Promise<void> LocalKv::put(
+    kj::StringPtr key, kj::ArrayPtr<const kj::byte> value, PutOptions options) {
+  KJ_SWITCH_ONEOF(checkPutOptions(options)) {
+    KJ_CASE_ONEOF(expiration, kj::Maybe<int64_t>) {
+      if (value.size() > MAX_VALUE_BYTES) throwRefusal("PUT", PAYLOAD_TOO_LARGE);
+      putValue(key, value, options.metadata, expiration);
+      return kj::READY_NOW;
+    }
+    KJ_CASE_ONEOF(refusal, Refusal) {
+      throwRefusal("PUT", refusal);
+    }
+  }
+  KJ_UNREACHABLE;
+}
+
+kj::Promise<void> LocalKv::delete_(kj::StringPtr key) {
+  deleteValue(key);
+  return kj::READY_NOW;
+}
+
+void LocalKv::throwRefusal(kj::StringPtr method, Refusal refusal) {
+  JSG_FAIL_REQUIRE(
+      Error, "KV ", method, " failed: ", refusal.statusCode, ' ', refusal.statusText);
+}
+
+// -----------------------------------------------------------------------------
+// Operations
+
+kj::Maybe<KvClient::Value> LocalKv::getValue(kj::StringPtr key) {
+  auto query = getDatabase().stmtGet.run(key, nowSeconds());
+  if (query.isDone()) return kj::none;
+  return Value{
+    .value = kj::heapArray(query.getBlob(0)),
+    .metadata = query.getMaybeText(1).map([](kj::StringPtr m) { return kj::str(m); }),
+  };
+}
+
+kj::OneOf<KvClient::ListResult, LocalKv::Refusal> LocalKv::listKeys(
+    kj::StringPtr prefix, kj::Maybe<kj::StringPtr> cursor, kj::Maybe<uint> maybeLimit) {
+  uint limit = maybeLimit.orDefault(MAX_LIST_KEYS);
+  if (limit == 0 || limit > MAX_LIST_KEYS) return BAD_REQUEST;
+
+  auto end = prefixEnd(prefix);
+
+  kj::String after;
+  KJ_IF_SOME(c, cursor) {
+    auto decoded = kj::decodeBase64(c);
+    if (decoded.hadErrors) return BAD_REQUEST;
+    after = kj::str(decoded.asChars());
+  } else {
+    after = kj::str();
+  }
+
+  kj::Vector<ListKey> keys;
+  {
+    // Ask for one more key than we need, to find out whether the listing is complete.
+    auto query = getDatabase().stmtList.run(prefix, after.asPtr(), end.asPtr(), nowSeconds(),
+        static_cast<int64_t>(limit) + 1);
+    for (; !query.isDone(); query.nextRow()) {
+      keys.add(ListKey{
+        .name = kj::str(query.getText(0)),
+        .expiration = query.getMaybeInt64(1),
+        .metadata = query.getMaybeText(2).map([](kj::StringPtr m) { return kj::str(m); }),
+      });
+    }
+  }
+
+  kj::Maybe<kj::String> nextCursor;
+  if (keys.size() > limit) {
+    keys.truncate(limit);
+    nextCursor = kj::encodeBase64(keys.back().name.asBytes());
+  }
+  return ListResult{.keys = keys.releaseAsArray(), .cursor = kj::mv(nextCursor)};
+}
+
+kj::OneOf<kj::Maybe<int64_t>, LocalKv::Refusal> LocalKv::checkPutOptions(
+    const PutOptions& options) {
+  auto now = nowSeconds();
+
+  kj::Maybe<int64_t> expiration;
+  KJ_IF_SOME(value, options.expiration) {
+    if (value < now + MIN_EXPIRATION_TTL_SECONDS) return BAD_REQUEST;
+    expiration = value;
+  } else KJ_IF_SOME(value, options.expirationTtl) {
+    if (value < MIN_EXPIRATION_TTL_SECONDS) return BAD_REQUEST;
+    expiration = now + value;
+  }
+
+  KJ_IF_SOME(metadata, options.metadata) {
+    if (metadata.size() > MAX_METADATA_BYTES) return PAYLOAD_TOO_LARGE;
+  }
+
+  return expiration;
+}
+
+void LocalKv::putValue(kj::StringPtr key,
+    kj::ArrayPtr<const kj::byte> value,
+    kj::Maybe<kj::StringPtr> metadata,
+    kj::Maybe<int64_t> expiration) {
+  SqliteDatabase::Query::ValuePtr metadataValue = nullptr;
+  KJ_IF_SOME(m, metadata) {
+    metadataValue = m;
+  }
+  SqliteDatabase::Query::ValuePtr expirationValue = nullptr;
+  KJ_IF_SOME(e, expiration) {
+    expirationValue = e;
+  }
+  getDatabase().stmtPut.run(key, value, metadataValue, expirationValue);
+}
+
+void LocalKv::deleteValue(kj::StringPtr key) {
+  getDatabase().stmtDelete.run(key);
+}
+
+// -----------------------------------------------------------------------------
+// HTTP
+
+kj::Promise<void> LocalKv::handleGet(kj::StringPtr key, Response& response) {
+  auto value = KJ_UNWRAP_OR(getValue(key),
+      { co_return co_await response.sendError(404, "Not Found", headerTable); });
+
+  kj::HttpHeaders headers(headerTable);
+  KJ_IF_SOME(metadata, value.metadata) {
+    headers.set(hMetadata, kj::mv(metadata));
+  }
+  auto out = response.send(200, "OK", headers, value.value.size());
+  co_await out->write(value.value);
+}
+
+kj::Promise<void> LocalKv::handlePut(kj::StringPtr key,
+    const kj::Url& url,
+    const kj::HttpHeaders& headers,
+    kj::AsyncInputStream& requestBody,
+    Response& response) {
+  PutOptions options;
+  KJ_IF_SOME(param, getQueryParam(url, "expiration")) {
+    options.expiration = KJ_UNWRAP_OR(
+        param.tryParseAs<int64_t>(), { co_return co_await sendRefusal(response, BAD_REQUEST); });
+  } else KJ_IF_SOME(param, getQueryParam(url, "expiration_ttl")) {
+    options.expirationTtl = KJ_UNWRAP_OR(
+        param.tryParseAs<int64_t>(), { co_return co_await sendRefusal(response, BAD_REQUEST); });
+  }
+  options.metadata = headers.get(hMetadata);
+
+  kj::Maybe<int64_t> expiration;
+  KJ_SWITCH_ONEOF(checkPutOptions(options)) {
+    KJ_CASE_ONEOF(e, kj::Maybe<int64_t>) {
+      expiration = e;
+    }
+    KJ_CASE_ONEOF(refusal, Refusal) {
+      co_return co_await sendRefusal(response, refusal);
+    }
+  }
+
+  KJ_IF_SOME(length, requestBody.tryGetLength()) {
+    if (length > MAX_VALUE_BYTES) {
+      co_return co_await sendRefusal(response, PAYLOAD_TOO_LARGE);
+    }
+  }
+  auto value = co_await requestBody.readAllBytes(MAX_VALUE_BYTES);
+
+  putValue(key, value, options.metadata, expiration);
+
+  kj::HttpHeaders responseHeaders(headerTable);
+  response.send(200, "OK", responseHeaders, uint64_t(0));
+}
+
+kj::Promise<void> LocalKv::handleDelete(kj::StringPtr key, Response& response) {
+  deleteValue(key);
+
+  kj::HttpHeaders headers(headerTable);
+  response.send(200, "OK", headers, uint64_t(0));
+  co_return;
+}
+
+kj::Promise<void> LocalKv::handleList(const kj::Url& url, Response& response) {
+  kj::Maybe<uint> limit;
+  KJ_IF_SOME(param, getQueryParam(url, "key_count_limit")) {
+    limit = KJ_UNWRAP_OR(
+        param.tryParseAs<uint>(), { co_return co_await sendRefusal(response, BAD_REQUEST); });
+  }
+
+  ListResult result;
+  KJ_SWITCH_ONEOF(listKeys(getQueryParam(url, "prefix").orDefault(""_kj),
+                      getQueryParam(url, "cursor"), limit)) {
+    KJ_CASE_ONEOF(r, ListResult) {
+      result = kj::mv(r);
+    }
+    KJ_CASE_ONEOF(refusal, Refusal) {
+      co_return co_await sendRefusal(response, refusal);
+    }
+  }
+
+  capnp::MallocMessageBuilder message;
+  auto root = message.initRoot<capnp::JsonValue>();
+  auto fields = root.initObject(result.cursor == kj::none ? 2 : 3);
+
+  fields[0].setName("keys");
+  auto keys = fields[0].initValue().initArray(result.keys.size());
+  for (auto i: kj::indices(result.keys)) {
+    auto& key = result.keys[i];
+    auto keyFields =
+        keys[i].initObject(1 + (key.expiration != kj::none) + (key.metadata != kj::none));
+    uint n = 0;
+    keyFields[n].setName("name");
+    keyFields[n++].initValue().setString(key.name);
+    KJ_IF_SOME(expiration, key.expiration) {
+      keyFields[n].setName("expiration");
+      keyFields[n++].initValue().setNumber(expiration);
+    }
+    // api/kv.c++ expects the metadata as a string of JSON, which it parses itself.
+    KJ_IF_SOME(metadata, key.metadata) {
+      keyFields[n].setName("metadata");
+      keyFields[n++].initValue().setString(metadata);
+    }
+  }
+
+  fields[1].setName("list_complete");
+  fields[1].initValue().setBoolean(result.cursor == kj::none);
+
+  KJ_IF_SOME(cursor, result.cursor) {
+    fields[2].setName("cursor");
+    fields[2].initValue().setString(cursor);
+  }
+
+  capnp::JsonCodec json;
+  co_return co_await sendJson(response, json.encodeRaw(root));
+}
+
+kj::Promise<void> LocalKv::handleBulkGet(kj::AsyncInputStream& requestBody, Response& response) {
+  auto text = co_await requestBody.readAllText(MAX_BULK_REQUEST_BYTES);
+
+  capnp::JsonCodec json;
+  capnp::MallocMessageBuilder requestMessage;
+  auto request = requestMessage.initRoot<capnp::JsonValue>();
+  if (kj::runCatchingExceptions([&]() { json.decodeRaw(text, request); }) != kj::none ||
+      !request.isObject()) {
+    co_return co_await sendRefusal(response, BAD_REQUEST);
+  }
+
+  kj::Maybe<capnp::List<capnp::JsonValue>::Reader> maybeKeys;
+  bool withMetadata = false;
+  for (auto field: request.asReader().getObject()) {
+    auto value = field.getValue();
+    if (field.getName() == "keys" && value.isArray()) {
+      maybeKeys = value.getArray();
+    } else if (field.getName() == "withMetadata" && value.isBoolean()) {
+      withMetadata = value.getBoolean();
+    }
+  }
+
+  auto keys = KJ_UNWRAP_OR(maybeKeys, { co_return co_await sendRefusal(response, BAD_REQUEST); });
+  if (keys.size() == 0 || keys.size() > MAX_BULK_KEYS) {
+    co_return co_await sendRefusal(response, BAD_REQUEST);
+  }
+  for (auto key: keys) {
+    if (!key.isString() || !isValidKey(key.getString())) {
+      co_return co_await sendRefusal(response, BAD_REQUEST);
+    }
+  }
+
+  capnp::MallocMessageBuilder responseMessage;
+  auto root = responseMessage.initRoot<capnp::JsonValue>();
+  auto fields = root.initObject(keys.size());
+  for (auto i: kj::indices(keys)) {
+    auto key = keys[i].getString();
+    fields[i].setName(key);
+    auto result = fields[i].initValue();
+
+    auto value = KJ_UNWRAP_OR(getValue(kj::StringPtr(key)), {
+      result.setNull();
+      continue;
+    });
+
+    auto text = kj::str(value.value.asChars());
+    if (withMetadata) {
+      auto valueFields = result.initObject(2);
+      valueFields[0].setName("value");
+      valueFields[0].initValue().setString(text);
+      valueFields[1].setName("metadata");
+      KJ_IF_SOME(metadata, value.metadata) {
+        valueFields[1].initValue().setString(metadata);
+      } else {
+        valueFields[1].initValue().setNull();
+      }
+    } else {
+      result.setString(text);
+    }
+  }
+
+  co_return co_await sendJson(response, json.encodeRaw(root));
+}
+
+kj::Promise<void> LocalKv::sendRefusal(Response& response, Refusal refusal) {
+  return response.sendError(refusal.statusCode, refusal.statusText, headerTable);
+}
+
+kj::Promise<void> LocalKv::sendJson(Response& response, kj::String json) {
+  kj::HttpHeaders headers(headerTable);
+  headers.set(kj::HttpHeaderId::CONTENT_TYPE, MimeType::JSON.toString());
+  auto out = response.send(200, "OK", headers, json.size());
+  co_await out->write(json.asBytes());
+}
+
+}  // namespace workerd::server
@@ -0,0 +1,160 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <workerd/io/kv-client.h>
+#include <workerd/util/sqlite.h>
+
+#include <kj/async.h>
+#include <kj/compat/http.h>
+#include <kj/time.h>
+#include <kj/timer.h>
+
+namespace workerd::server {
+
+// An in-process Workers KV namespace. `kvNamespace` bindings in the same process call it directly
+// through its KvClient interface. Anything else, such as a Worker's fetch() to the service, gets
+// the same HTTP protocol that api/kv.c++ speaks to other KV services:
+//
+// * `GET /<key>` answers with the value, and its metadata in `CF-KV-Metadata`, or 404.
+// * `PUT /<key>` stores the request body, with `?expiration=` (seconds since the epoch) or
+//   `?expiration_ttl=` (seconds from now), and metadata from `CF-KV-Metadata`.
+// * `DELETE /<key>` deletes a key.
+// * `GET /?prefix=&cursor=&key_count_limit=` lists keys in order, as JSON.
+// * `POST /bulk/get` takes a JSON body `{"keys": [...], "withMetadata": bool}` and answers with a
+//   JSON object mapping each key to its value, or to `{"value", "metadata"}` with `withMetadata`,
+//   or to null if the key doesn't exist.
+//
+// Keys are stored in a SQLite table keyed by name, so listing is a range scan of its primary key,
+// and list cursors are simply the last key returned. Expired keys are never returned, and are
+// deleted periodically in the background using an index on the expiration time.
+//
+// Like the rest of the server, this is single-threaded.
+class LocalKv final: public kj::HttpService, public KvClient {
+ public:
+  // Limits on keys, values and metadata, as documented for Workers KV.
+  static constexpr size_t MAX_KEY_BYTES = 512;
+  static constexpr size_t MAX_VALUE_BYTES = 25 << 20;
+  static constexpr size_t MAX_METADATA_BYTES = 1024;
+  static constexpr uint MAX_LIST_KEYS = 1000;
+  static constexpr uint MAX_BULK_KEYS = 100;
+
+  // Expirations must be at least this far in the future.
+  static constexpr int64_t MIN_EXPIRATION_TTL_SECONDS = 60;
+
+  // How often expired keys are deleted.
+  static constexpr kj::Duration SWEEP_INTERVAL = 60 * kj::SECONDS;
+
+  LocalKv(const kj::Clock& clock,
+      kj::Timer& timer,
+      kj::HttpHeaderTable::Builder& headerTableBuilder);
+  KJ_DISALLOW_COPY_AND_MOVE(LocalKv);
+
+  // Opens the database at `path`, creating it if necessary, and starts sweeping expired keys.
+  // Must be called before the first request. `vfs` must outlive this object.
+  void open(const SqliteDatabase::Vfs& vfs, kj::Path path);
+
+  // Deletes keys that have expired, returning how many there were. Called every SWEEP_INTERVAL.
+  uint sweepExpired();
+
+  kj::Promise<void> request(kj::HttpMethod method,
+      kj::StringPtr url,
+      const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody,
+      Response& response) override;
+
+  // implements KvClient
+  kj::Promise<kj::Maybe<Value>> get(kj::StringPtr key) override;
+  kj::Promise<kj::Array<kj::Maybe<Value>>> getBulk(kj::ArrayPtr<const kj::String> keys) override;
+  kj::Promise<ListResult> list(
+      kj::StringPtr prefix, kj::Maybe<kj::StringPtr> cursor, kj::Maybe<uint> limit) override;
+  kj::Promise<void> put(
+      kj::StringPtr key, kj::ArrayPtr<const kj::byte> value, PutOptions options) override;
+  kj::Promise<void> delete_(kj::StringPtr key) override;
+
+ private:
+  // The database and its prepared statements.
+  struct Database {
+    kj::Own<SqliteDatabase> db;
+
+    explicit Database(kj::Own<SqliteDatabase> db): db(kj::mv(db)) {}
+
+    SqliteDatabase::Statement stmtGet = db->prepare(R"(
+      SELECT value, metadata FROM _cf_KV WHERE key = ? AND (expiration IS NULL OR expiration > ?)
+    )");
+    SqliteDatabase::Statement stmtPut = db->prepare(R"(
+      INSERT INTO _cf_KV VALUES(?, ?, ?, ?)
+        ON CONFLICT DO UPDATE SET
+          value = excluded.value, metadata = excluded.metadata, expiration = excluded.expiration
+    )");
+    SqliteDatabase::Statement stmtDelete = db->prepare(R"(
+      DELETE FROM _cf_KV WHERE key = ?
+    )");
+    // The first bound is the prefix, the second the cursor (or '', which is less than any key),
+    // and the third the end of the prefix's range.
+    SqliteDatabase::Statement stmtList = db->prepare(R"(
+      SELECT key, expiration, metadata FROM _cf_KV
+        WHERE key >= ? AND key > ? AND key < ? AND (expiration IS NULL OR expiration > ?)
+        ORDER BY key LIMIT ?
+    )");
+    SqliteDatabase::Statement stmtSweep = db->prepare(R"(
+      DELETE FROM _cf_KV WHERE key IN (
+        SELECT key FROM _cf_KV WHERE expiration <= ? LIMIT ?
+      )
+    )");
+  };
+
+  const kj::Clock& clock;
+  kj::Timer& timer;
+  kj::HttpHeaderTable& headerTable;
+  kj::HttpHeaderId hMetadata;
+
+  kj::Maybe<kj::Own<Database>> database;
+  kj::Promise<void> sweeper = nullptr;
+
+  Database& getDatabase();
+  int64_t nowSeconds();
+  uint sweepBatch(int64_t now);
+
+  // Why a request was refused, as the status the HTTP protocol answers with.
+  struct Refusal {
+    uint statusCode;
+    kj::StringPtr statusText;
+  };
+  static constexpr Refusal BAD_REQUEST{400, "Bad Request"_kj};
+  static constexpr Refusal PAYLOAD_TOO_LARGE{413, "Payload Too Large"_kj};
+
+  // Throws what api/kv.c++ reports when a KV service answers `method` with `refusal`.
+  [[noreturn]] static void throwRefusal(kj::StringPtr method, Refusal refusal);
+
+  // The operations behind both interfaces.
+  kj::Maybe<Value> getValue(kj::StringPtr key);
+  kj::OneOf<ListResult, Refusal> listKeys(
+      kj::StringPtr prefix, kj::Maybe<kj::StringPtr> cursor, kj::Maybe<uint> limit);
+  // Returns the absolute expiration time `options` ask for, if any.
+  kj::OneOf<kj::Maybe<int64_t>, Refusal> checkPutOptions(const PutOptions& options);
+  void putValue(kj::StringPtr key,
+      kj::ArrayPtr<const kj::byte> value,
+      kj::Maybe<kj::StringPtr> metadata,
+      kj::Maybe<int64_t> expiration);
+  void deleteValue(kj::StringPtr key);
+
+  // The HTTP face.
+  kj::Promise<void> handleGet(kj::StringPtr key, Response& response);
+  kj::Promise<void> handlePut(kj::StringPtr key,
+      const kj::Url& url,
+      const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody,
+      Response& response);
+  kj::Promise<void> handleDelete(kj::StringPtr key, Response& response);
+  kj::Promise<void> handleList(const kj::Url& url, Response& response);
+  kj::Promise<void> handleBulkGet(kj::AsyncInputStream& requestBody, Response& response);
+  kj::Promise<void> sendRefusal(Response& response, Refusal refusal);
+
+  kj::Promise<void> sendJson(Response& response, kj::String json);
+  kj::Promise<void> runSweeper();
+};
+
+}  // namespace workerd::server
@@ -0,0 +1,455 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "local-r2.h"
+
+#include <capnp/compat/json.h>
+#include <capnp/message.h>
+#include <kj/test.h>
+
+namespace workerd::server {
+namespace {
+
+class FakeClock final: public kj::Clock {
+ public:
+  kj::Date now() const override {
+    return time;
+  }
+
+  kj::Date time = kj::UNIX_EPOCH + 1'700'000'000 * kj::SECONDS;
+};
+
+// Produces ids that are unique but predictable.
+class FakeEntropySource final: public kj::EntropySource {
+ public:
+  void generate(kj::ArrayPtr<kj::byte> buffer) override {
+    ++counter;
+    for (auto i: kj::indices(buffer)) {
+      buffer[i] = i < sizeof(counter) ? (counter >> (i * 8)) & 0xff : 0;
+    }
+  }
+
+ private:
+  uint64_t counter = 0;
+};
+
+struct Result {
+  uint statusCode;
+  // The JSON that precedes the content of a GET-style response, or the whole body of a PUT-style
+  // one.
+  kj::String metadata;
+  kj::String content;
+  kj::Maybe<kj::String> error;
+};
+
+// Looks up the fields of a parsed JSON object by name.
+struct JsonFields {
+  capnp::JsonValue::Reader value;
+
+  explicit JsonFields(capnp::JsonValue::Reader value): value(value) {}
+
+  kj::Maybe<capnp::JsonValue::Reader> find(kj::StringPtr name) {
+    for (auto field: value.getObject()) {
+      if (field.getName() == name) return field.getValue();
+    }
+    return kj::none;
+  }
+
+  capnp::JsonValue::Reader operator[](kj::StringPtr name) {
+    return KJ_ASSERT_NONNULL(find(name), name);
+  }
+};
+
+// A JSON object parsed from a response.
+struct JsonObject {
+  capnp::MallocMessageBuilder message;
+  JsonFields fields;
+
+  explicit JsonObject(kj::StringPtr text): fields(parse(text, message)) {}
+
+  kj::Maybe<capnp::JsonValue::Reader> find(kj::StringPtr name) {
+    return fields.find(name);
+  }
+
+  capnp::JsonValue::Reader operator[](kj::StringPtr name) {
+    return fields[name];
+  }
+
+  static capnp::JsonValue::Reader parse(kj::StringPtr text, capnp::MallocMessageBuilder& message) {
+    auto root = message.initRoot<capnp::JsonValue>();
+    capnp::JsonCodec().decodeRaw(text, root);
+    return root.asReader();
+  }
+};
+
+struct R2Fixture {
+  kj::EventLoop loop;
+  kj::WaitScope ws{loop};
+  FakeClock clock;
+  FakeEntropySource entropySource;
+  kj::Own<const kj::Directory> dir;
+  kj::HttpHeaderTable::Builder builder;
+  kj::HttpHeaderId hRequest = builder.add("CF-R2-Request");
+  kj::HttpHeaderId hMetadataSize = builder.add("CF-R2-Metadata-Size");
+  kj::HttpHeaderId hError = builder.add("CF-R2-Error");
+  LocalR2 r2{clock, entropySource, builder};
+  kj::Own<kj::HttpHeaderTable> table = builder.build();
+  kj::Own<kj::HttpClient> client = kj::newHttpClient(r2);
+
+  explicit R2Fixture(kj::Own<const kj::Directory> dir = kj::newInMemoryDirectory(kj::nullClock()))
+      : dir(kj::mv(dir)) {
+    r2.open(*this->dir);
+  }
+
+  // Sends a head(), get() or list() request the way api/r2-rpc.c++ would.
+  Result sendGet(kj::StringPtr json) {
+    kj::HttpHeaders headers(*table);
+    headers.set(hRequest, json);
+    auto request = client->request(kj::HttpMethod::GET, "https://fake-host/", headers);
+    return receive(request.response.wait(ws));
+  }
+
+  // Sends any other request the way api/r2-rpc.c++ would, with `content` following the JSON.
+  Result sendPut(kj::StringPtr json, kj::StringPtr content = nullptr) {
+    kj::HttpHeaders headers(*table);
+    headers.set(hMetadataSize, kj::str(json.size()));
+    auto body = kj::str(json, content);
+    auto request =
+        client->request(kj::HttpMethod::PUT, "https://fake-host/", headers, uint64_t(body.size()));
+    request.body->write(body.asBytes()).wait(ws);
+    request.body = nullptr;
+    return receive(request.response.wait(ws));
+  }
+
+  Result receive(kj::HttpClient::Response response) {
+    auto text = response.body->readAllText().wait(ws);
+    Result result{response.statusCode, kj::mv(text), nullptr,
+      response.headers->get(hError).map([](kj::StringPtr e) { return kj::str(e); })};
+    KJ_IF_SOME(sizeText, response.headers->get(hMetadataSize)) {
+      auto size = sizeText.parseAs<size_t>();
+      KJ_ASSERT(size <= result.metadata.size());
+      result.content = kj::str(result.metadata.slice(size));
+      result.metadata = kj::str(result.metadata.first(size));
+    }
+    return result;
+  }
+
+  Result put(kj::StringPtr key, kj::StringPtr content, kj::StringPtr extra = ""_kj) {
+    return sendPut(kj::str(R"({"version":1,"method":"put","object":")", key, '"', extra, '}'),
+        content);
+  }
+
+  Result get(kj::StringPtr key, kj::StringPtr extra = ""_kj) {
+    return sendGet(kj::str(R"({"version":1,"method":"get","object":")", key, '"', extra, '}'));
+  }
+
+  Result head(kj::StringPtr key) {
+    return sendGet(kj::str(R"({"version":1,"method":"head","object":")", key, "\"}"));
+  }
+
+  Result list(kj::StringPtr extra) {
+    return sendGet(kj::str(R"({"version":1,"method":"list","newRuntime":true)", extra, '}'));
+  }
+
+  size_t countBlobs() {
+    return dir->openSubdir(kj::Path({"blobs"}))->listNames().size();
+  }
+};
+
+uint v4code(const Result& result) {
+  JsonObject error(KJ_ASSERT_NONNULL(result.error));
+  return error["v4code"].getNumber();
+}
+
+// MD5 and SHA-256 of "hello world".
+constexpr kj::StringPtr HELLO_MD5 = "5eb63bbbe01eeed093cb22bb8f5acdc3"_kj;
+constexpr kj::StringPtr HELLO_MD5_BASE64 = "XrY7u+Ae7tCTyyK7j1rNww=="_kj;
+constexpr kj::StringPtr HELLO_SHA256 =
+    "b94d27b9934d3e08a52e52d7da7dabfac484efe37a5380ee9088f7ace2efcde9"_kj;
+
+KJ_TEST("LocalR2 puts, heads, gets and deletes objects") {
+  R2Fixture f;
+
+  auto missing = f.get("foo");
+  KJ_EXPECT(missing.statusCode == 404);
+  KJ_EXPECT(v4code(missing) == 10007);
+  KJ_EXPECT(f.head("foo").statusCode == 404);
+
+  auto put = f.put("foo", "hello world",
+      R"(,"httpFields":{"contentType":"text/plain"},"customFields":[{"k":"a","v":"b"}])");
+  KJ_ASSERT(put.statusCode == 200);
+  JsonObject putJson(put.metadata);
+  KJ_EXPECT(putJson["name"].getString() == "foo");
+  KJ_EXPECT(putJson["size"].getString() == "11");
+  KJ_EXPECT(putJson["etag"].getString() == HELLO_MD5);
+  KJ_EXPECT(putJson["uploaded"].getString() == "1700000000000");
+  KJ_EXPECT(putJson["storageClass"].getString() == "Standard");
+  KJ_EXPECT(JsonFields(putJson["checksums"])["0"].getString() == HELLO_MD5);
+
+  auto head = f.head("foo");
+  KJ_EXPECT(head.statusCode == 200);
+  KJ_EXPECT(head.metadata == put.metadata);
+  KJ_EXPECT(head.content == "");
+
+  auto get = f.get("foo");
+  KJ_EXPECT(get.statusCode == 200);
+  KJ_EXPECT(get.metadata == put.metadata);
+  KJ_EXPECT(get.content == "hello world");
+
+  // Replacing the object removes the old version's blob.
+  KJ_EXPECT(f.put("foo", "goodbye").statusCode == 200);
+  KJ_EXPECT(f.get("foo").content == "goodbye");
+  KJ_EXPECT(f.countBlobs() == 1);
+
+  KJ_EXPECT(f.sendPut(R"({"version":1,"method":"delete","object":"foo"})").statusCode == 200);
+  KJ_EXPECT(f.get("foo").statusCode == 404);
+  KJ_EXPECT(f.countBlobs() == 0);
+
+  // Deleting a key that doesn't exist succeeds, like it does in R2.
+  KJ_EXPECT(f.sendPut(R"({"version":1,"method":"delete","object":"foo"})").statusCode == 200);
+
+  KJ_EXPECT(f.put("a", "1").statusCode == 200);
+  KJ_EXPECT(f.put("b", "2").statusCode == 200);
+  KJ_EXPECT(f.sendPut(R"({"version":1,"method":"delete","objects":["a","b","c"]})").statusCode ==
+      200);
+  KJ_EXPECT(f.head("a").statusCode == 404);
+  KJ_EXPECT(f.head("b").statusCode == 404);
+
+  auto invalid = f.put("", "x");
+  KJ_EXPECT(invalid.statusCode == 400);
+  KJ_EXPECT(v4code(invalid) == 10020);
+}
+
+KJ_TEST("LocalR2 gets ranges of objects") {
+  R2Fixture f;
+  KJ_ASSERT(f.put("foo", "hello world").statusCode == 200);
+
+  auto offset = f.get("foo", R"(,"range":{"offset":"6","length":"3"})");
+  KJ_EXPECT(offset.statusCode == 200);
+  KJ_EXPECT(offset.content == "wor");
+  JsonObject offsetJson(offset.metadata);
+  JsonFields echo(offsetJson["range"]);
+  KJ_EXPECT(echo["offset"].getString() == "6");
+  KJ_EXPECT(echo["length"].getString() == "3");
+  // The size is still the object's.
+  KJ_EXPECT(offsetJson["size"].getString() == "11");
+
+  KJ_EXPECT(f.get("foo", R"(,"range":{"offset":"6"})").content == "world");
+  KJ_EXPECT(f.get("foo", R"(,"range":{"suffix":"5"})").content == "world");
+  KJ_EXPECT(f.get("foo", R"(,"range":{"suffix":"50"})").content == "hello world");
+  KJ_EXPECT(f.get("foo", R"(,"rangeHeader":"bytes=0-4")").content == "hello");
+
+  auto unsatisfiable = f.get("foo", R"(,"range":{"offset":"20"})");
+  KJ_EXPECT(unsatisfiable.statusCode == 416);
+  KJ_EXPECT(v4code(unsatisfiable) == 10039);
+  KJ_EXPECT(f.get("foo", R"(,"rangeHeader":"bytes=0-1,3-4")").statusCode == 416);
+}
+
+KJ_TEST("LocalR2 evaluates conditions") {
+  R2Fixture f;
+  KJ_ASSERT(f.put("foo", "hello world").statusCode == 200);
+
+  auto matches = kj::str(R"(,"onlyIf":{"etagMatches":[{"type":"strong","value":")", HELLO_MD5,
+      R"("}]})");
+  KJ_EXPECT(f.get("foo", matches).content == "hello world");
+
+  // A failed get() still returns the metadata, but no content.
+  auto failed = f.get("foo", R"(,"onlyIf":{"etagMatches":[{"type":"strong","value":"nope"}]})");
+  KJ_EXPECT(failed.statusCode == 412);
+  KJ_EXPECT(v4code(failed) == 10031);
+  KJ_EXPECT(JsonObject(failed.metadata)["etag"].getString() == HELLO_MD5);
+  KJ_EXPECT(failed.content == "");
+
+  auto doesNotMatch = kj::str(R"(,"onlyIf":{"etagDoesNotMatch":[{"type":"weak","value":")",
+      HELLO_MD5, R"("}]})");
+  KJ_EXPECT(f.get("foo", doesNotMatch).statusCode == 412);
+
+  KJ_EXPECT(f.get("foo", R"(,"onlyIf":{"uploadedAfter":"1700000000000"})").statusCode == 412);
+  KJ_EXPECT(f.get("foo", R"(,"onlyIf":{"uploadedAfter":"1699999999999"})").statusCode == 200);
+
+  // An etag condition takes the place of the date condition it pairs with.
+  KJ_EXPECT(f.get("foo",
+                 kj::str(R"(,"onlyIf":{"uploadedBefore":"0","etagMatches":[{"type":"strong",)",
+                     R"("value":")", HELLO_MD5, R"("}]})"))
+                 .statusCode == 200);
+
+  // Only create the object if there isn't one already.
+  auto createOnly = R"(,"onlyIf":{"etagDoesNotMatch":[{"type":"wildcard"}]})"_kj;
+  KJ_EXPECT(f.put("foo", "replaced", createOnly).statusCode == 412);
+  KJ_EXPECT(f.get("foo").content == "hello world");
+  KJ_EXPECT(f.put("bar", "created", createOnly).statusCode == 200);
+  KJ_EXPECT(f.get("bar").content == "created");
+
+  // The blob written for the rejected put() is gone.
+  KJ_EXPECT(f.countBlobs() == 2);
+}
+
+KJ_TEST("LocalR2 verifies checksums") {
+  R2Fixture f;
+
+  auto put = f.put("foo", "hello world",
+      kj::str(R"(,"md5":")", HELLO_MD5_BASE64, R"(","sha256":")", HELLO_SHA256, '"'));
+  KJ_ASSERT(put.statusCode == 200);
+  JsonObject putJson(put.metadata);
+  JsonFields checksums(putJson["checksums"]);
+  KJ_EXPECT(checksums["0"].getString() == HELLO_MD5);
+  KJ_EXPECT(checksums["2"].getString() == HELLO_SHA256);
+  KJ_EXPECT(checksums.find("1") == kj::none);
+
+  auto bad = f.put("foo", "hello there", kj::str(R"(,"sha256":")", HELLO_SHA256, '"'));
+  KJ_EXPECT(bad.statusCode == 400);
+  KJ_EXPECT(v4code(bad) == 10037);
+  KJ_EXPECT(f.get("foo").content == "hello world");
+  KJ_EXPECT(f.countBlobs() == 1);
+}
+
+KJ_TEST("LocalR2 lists objects by prefix and delimiter, one page at a time") {
+  R2Fixture f;
+  for (auto key: {"a/1", "a/2", "a/b/1", "a/b/2", "a/c/1", "a/3", "b/1"}) {
+    KJ_ASSERT(f.put(key, "x", R"(,"customFields":[{"k":"m","v":"n"}])").statusCode == 200);
+  }
+
+  kj::Vector<kj::String> names;
+  kj::Vector<kj::String> prefixes;
+  kj::Maybe<kj::String> cursor;
+  uint pages = 0;
+  for (;;) {
+    auto extra = kj::str(R"(,"prefix":"a/","delimiter":"/","limit":2)");
+    KJ_IF_SOME(c, cursor) {
+      extra = kj::str(extra, R"(,"cursor":")", c, '"');
+    }
+    auto result = f.list(extra);
+    KJ_ASSERT(result.statusCode == 200);
+    ++pages;
+
+    JsonObject json(result.metadata);
+    KJ_IF_SOME(objects, json.find("objects")) {
+      for (auto object: objects.getArray()) {
+        JsonFields fields(object);
+        names.add(kj::str(fields["name"].getString()));
+        // Custom metadata wasn't asked for.
+        KJ_EXPECT(fields.find("customFields") == kj::none);
+      }
+    }
+    KJ_IF_SOME(delimited, json.find("delimitedPrefixes")) {
+      for (auto prefix: delimited.getArray()) {
+        prefixes.add(kj::str(prefix.getString()));
+      }
+    }
+
+    if (!json["truncated"].getBoolean()) break;
+    cursor = kj::str(json["cursor"].getString());
+  }
+
+  KJ_EXPECT(pages == 3);
+  KJ_EXPECT(kj::strArray(names, ",") == "a/1,a/2,a/3");
+  KJ_EXPECT(kj::strArray(prefixes, ",") == "a/b/,a/c/");
+
+  auto withCustom = f.list(R"(,"prefix":"b/","include":[1])");
+  JsonObject json(withCustom.metadata);
+  auto objects = json["objects"].getArray();
+  KJ_ASSERT(objects.size() == 1);
+  KJ_EXPECT(JsonFields(objects[0]).find("customFields") != kj::none);
+
+  // "a/3" sorts before "a/b/2", so only "a/c/1" and "b/1" come after it.
+  auto startAfter = f.list(R"(,"startAfter":"a/b/2")");
+  JsonObject startAfterJson(startAfter.metadata);
+  KJ_EXPECT(startAfterJson["objects"].getArray().size() == 2);
+}
+
+KJ_TEST("LocalR2 assembles multipart uploads without copying their parts") {
+  R2Fixture f;
+
+  auto created = f.sendPut(R"({"version":1,"method":"createMultipartUpload","object":"big",)"
+                           R"("customFields":[{"k":"a","v":"b"}]})");
+  KJ_ASSERT(created.statusCode == 200);
+  auto uploadId = kj::str(JsonObject(created.metadata)["uploadId"].getString());
+
+  auto uploadPart = [&](uint part, kj::StringPtr content) {
+    auto result = f.sendPut(kj::str(R"({"version":1,"method":"uploadPart","object":"big",)",
+                                R"("uploadId":")", uploadId, R"(","partNumber":)", part, '}'),
+        content);
+    KJ_ASSERT(result.statusCode == 200);
+    return kj::str(JsonObject(result.metadata)["etag"].getString());
+  };
+
+  uploadPart(1, "stale");
+  auto etag1 = uploadPart(1, "hello ");
+  auto etag2 = uploadPart(2, "world");
+  uploadPart(3, "unused");
+  // The part that was replaced is gone already.
+  KJ_EXPECT(f.countBlobs() == 3);
+
+  auto complete = [&](kj::StringPtr etag2) {
+    return f.sendPut(kj::str(R"({"version":1,"method":"completeMultipartUpload","object":"big",)",
+        R"("uploadId":")", uploadId, R"(","parts":[{"part":1,"etag":")", etag1,
+        R"("},{"part":2,"etag":")", etag2, R"("}]})"));
+  };
+
+  auto wrongEtag = complete("nope");
+  KJ_EXPECT(wrongEtag.statusCode == 400);
+  KJ_EXPECT(v4code(wrongEtag) == 10025);
+
+  auto completed = complete(etag2);
+  KJ_ASSERT(completed.statusCode == 200);
+  JsonObject completedJson(completed.metadata);
+  KJ_EXPECT(completedJson["size"].getString() == "11");
+  KJ_EXPECT(completedJson["etag"].getString().endsWith("-2"));
+  KJ_EXPECT(completedJson.find("customFields") != kj::none);
+
+  // The object is made of the two parts' blobs, and the unused part is gone.
+  KJ_EXPECT(f.countBlobs() == 2);
+  KJ_EXPECT(f.get("big").content == "hello world");
+  KJ_EXPECT(f.get("big", R"(,"range":{"offset":"4","length":"4"})").content == "o wo");
+
+  // The upload is finished, so it can't be completed again.
+  auto again = complete(etag2);
+  KJ_EXPECT(again.statusCode == 404);
+  KJ_EXPECT(v4code(again) == 10024);
+}
+
+KJ_TEST("LocalR2 aborts multipart uploads") {
+  R2Fixture f;
+
+  auto created = f.sendPut(R"({"version":1,"method":"createMultipartUpload","object":"big"})");
+  auto uploadId = kj::str(JsonObject(created.metadata)["uploadId"].getString());
+  auto part = kj::str(R"({"version":1,"method":"uploadPart","object":"big","uploadId":")",
+      uploadId, R"(","partNumber":1})");
+  KJ_ASSERT(f.sendPut(part, "data").statusCode == 200);
+  KJ_EXPECT(f.countBlobs() == 1);
+
+  auto abort = kj::str(R"({"version":1,"method":"abortMultipartUpload","object":"big",)",
+      R"("uploadId":")", uploadId, "\"}");
+  KJ_EXPECT(f.sendPut(abort).statusCode == 200);
+  KJ_EXPECT(f.countBlobs() == 0);
+
+  auto gone = f.sendPut(part, "data");
+  KJ_EXPECT(gone.statusCode == 404);
+  KJ_EXPECT(v4code(gone) == 10024);
+  KJ_EXPECT(f.countBlobs() == 0);
+}
+
+KJ_TEST("LocalR2 keeps objects and removes orphaned blobs when reopened") {
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+
+  {
+    R2Fixture f(dir->clone());
+    KJ_ASSERT(f.put("foo", "hello world").statusCode == 200);
+  }
+
+  // A blob that a write never got to record.
+  dir->openSubdir(kj::Path({"blobs"}), kj::WriteMode::MODIFY)
+      ->openFile(kj::Path({"orphan"}), kj::WriteMode::CREATE)
+      ->writeAll("x");
+
+  {
+    R2Fixture f(dir->clone());
+    KJ_EXPECT(f.countBlobs() == 1);
+    KJ_EXPECT(f.get("foo").content == "hello world");
+    KJ_EXPECT(f.r2.removeOrphanedBlobs() == 0);
+  }
+}
+
+}  // namespace
+}  // namespace workerd::server
@@ -0,0 +1,992 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "local-r2.h"
+
+#include <workerd/util/mimetype.h>
+
+#include <openssl/evp.h>
+#include <openssl/md5.h>
+
+#include <capnp/compat/json.h>
+#include <capnp/message.h>
+#include <kj/debug.h>
+#include <kj/encoding.h>
+#include <kj/vector.h>
+
+namespace workerd::server {
+
+namespace r2 = api::public_beta;
+
+namespace {
+
+// R2 leaves integer fields at this value to mean that they aren't set.
+constexpr uint64_t UNSET = 0xffffffffffffffff;
+
+constexpr LocalR2::ErrorCode BAD_REQUEST = {
+  400, "Bad Request"_kj, 10001, "The request is not valid."_kj};
+constexpr LocalR2::ErrorCode NOT_IMPLEMENTED = {
+  501, "Not Implemented"_kj, 10004, "This operation is not supported by local R2 buckets."_kj};
+constexpr LocalR2::ErrorCode NO_SUCH_KEY = {
+  404, "Not Found"_kj, 10007, "The specified key does not exist."_kj};
+constexpr LocalR2::ErrorCode INVALID_OBJECT_NAME = {
+  400, "Bad Request"_kj, 10020, "The specified object name is not valid."_kj};
+constexpr LocalR2::ErrorCode NO_SUCH_UPLOAD = {
+  404, "Not Found"_kj, 10024, "The specified multipart upload does not exist."_kj};
+constexpr LocalR2::ErrorCode INVALID_PART = {400, "Bad Request"_kj, 10025,
+  "The parts must be uploaded parts, listed in ascending order with their etags."_kj};
+constexpr LocalR2::ErrorCode PRECONDITION_FAILED = {412, "Precondition Failed"_kj, 10031,
+  "At least one of the pre-conditions you specified did not hold."_kj};
+constexpr LocalR2::ErrorCode BAD_DIGEST = {400, "Bad Request"_kj, 10037,
+  "The checksum you specified did not match what we received."_kj};
+constexpr LocalR2::ErrorCode INVALID_RANGE = {
+  416, "Range Not Satisfiable"_kj, 10039, "The requested range is not satisfiable."_kj};
+
+template <typename T, typename Value>
+kj::String encodeJson(Value&& value) {
+  capnp::JsonCodec json;
+  json.handleByAnnotation<T>();
+  return json.encode(kj::fwd<Value>(value));
+}
+
+template <typename T>
+void decodeJson(kj::ArrayPtr<const char> text, typename T::Builder builder) {
+  capnp::JsonCodec json;
+  json.handleByAnnotation<T>();
+  json.decode(text, builder);
+}
+
+bool isValidKey(kj::StringPtr key) {
+  return key.size() > 0 && key.size() <= LocalR2::MAX_KEY_BYTES;
+}
+
+// Returns the smallest string that is greater than every string starting with `prefix`. Keys are
+// UTF-8, which never contains the byte 0xff, so "\xff" is greater than all of them.
+kj::String prefixEnd(kj::StringPtr prefix) {
+  for (size_t i = prefix.size(); i > 0; --i) {
+    auto c = static_cast<kj::byte>(prefix[i - 1]);
+    if (c != 0xff) {
+      return kj::str(prefix.first(i - 1), static_cast<char>(c + 1));
+    }
+  }
+  return kj::str("\xff");
+}
+
+// Returns the smallest string that is greater than `key`.
+kj::String keyAfter(kj::StringPtr key) {
+  return kj::str(key, '\0');
+}
+
+kj::Maybe<size_t> findSubstring(kj::StringPtr haystack, kj::StringPtr needle) {
+  for (size_t i = 0; i + needle.size() <= haystack.size(); ++i) {
+    if (haystack.slice(i).startsWith(needle)) return i;
+  }
+  return kj::none;
+}
+
+bool anyEtagMatches(capnp::List<r2::R2Etag>::Reader etags, kj::StringPtr etag, bool allowWeak) {
+  for (auto candidate: etags) {
+    switch (candidate.getType().which()) {
+      case r2::R2Etag::Type::STRONG:
+        if (candidate.getValue() == etag) return true;
+        break;
+      case r2::R2Etag::Type::WEAK:
+        if (allowWeak && candidate.getValue() == etag) return true;
+        break;
+      case r2::R2Etag::Type::WILDCARD:
+        return true;
+    }
+  }
+  return false;
+}
+
+// Evaluates `onlyIf` against an object with the given etag and upload time, or against a key that
+// has no object if `etag` is none. The conditions stand for the HTTP conditional headers, and are
+// evaluated like them (RFC 9110 section 13.2.2): an etag condition takes the place of the date
+// condition it pairs with.
+bool conditionsHold(
+    r2::R2Conditional::Reader onlyIf, kj::Maybe<kj::StringPtr> maybeEtag, int64_t uploaded) {
+  auto etag = KJ_UNWRAP_OR(maybeEtag, {
+    // Only a put() can get here, and it either expects the key to hold an object already
+    // (`etagMatches`), or doesn't mind.
+    return onlyIf.getEtagMatches().size() == 0;
+  });
+
+  if (onlyIf.getSecondsGranularity()) {
+    uploaded = uploaded / 1000 * 1000;
+  }
+
+  if (onlyIf.getEtagMatches().size() > 0) {
+    if (!anyEtagMatches(onlyIf.getEtagMatches(), etag, false)) return false;
+  } else if (onlyIf.getUploadedBefore() != UNSET) {
+    if (uploaded > static_cast<int64_t>(onlyIf.getUploadedBefore())) return false;
+  }
+
+  if (onlyIf.getEtagDoesNotMatch().size() > 0) {
+    if (anyEtagMatches(onlyIf.getEtagDoesNotMatch(), etag, true)) return false;
+  } else if (onlyIf.getUploadedAfter() != UNSET) {
+    if (uploaded <= static_cast<int64_t>(onlyIf.getUploadedAfter())) return false;
+  }
+
+  return true;
+}
+
+struct ByteRange {
+  uint64_t offset;
+  uint64_t length;
+};
+
+// Returns the part of an object of `size` bytes that `request` asks for, the whole object if it
+// doesn't ask for a range, or none if the range can't be satisfied.
+kj::Maybe<ByteRange> resolveRange(r2::R2GetRequest::Reader request, uint64_t size) {
+  if (request.hasRange()) {
+    auto range = request.getRange();
+    auto offset = range.getOffset();
+    auto length = range.getLength();
+    auto suffix = range.getSuffix();
+    if (suffix != UNSET) {
+      if (offset != UNSET || length != UNSET) return kj::none;
+      suffix = kj::min(suffix, size);
+      return ByteRange{size - suffix, suffix};
+    }
+    if (offset == UNSET) offset = 0;
+    if (offset > size) return kj::none;
+    return ByteRange{offset, kj::min(length, size - offset)};
+  } else if (request.hasRangeHeader()) {
+    KJ_SWITCH_ONEOF(kj::tryParseHttpRangeHeader(request.getRangeHeader().asArray(), size)) {
+      KJ_CASE_ONEOF(ranges, kj::Array<kj::HttpByteRange>) {
+        // Like R2, we only serve one range at a time.
+        if (ranges.size() != 1) return kj::none;
+        return ByteRange{ranges[0].start, ranges[0].end - ranges[0].start + 1};
+      }
+      KJ_CASE_ONEOF(_, kj::HttpEverythingRange) {}
+      KJ_CASE_ONEOF(_, kj::HttpUnsatisfiableRange) {
+        return kj::none;
+      }
+    }
+  }
+  return ByteRange{0, size};
+}
+
+}  // namespace
+
+// Writes a request body to a new blob as it arrives, computing digests of it on the way through.
+// The blob only appears under its name once commit() is called, so a body that fails to arrive in
+// full leaves nothing behind.
+class LocalR2::BlobWriter final: public kj::AsyncOutputStream {
+ public:
+  BlobWriter(
+      const kj::Directory& dir, kj::StringPtr name, kj::ArrayPtr<const EVP_MD* const> algorithms)
+      : replacer(dir.replaceFile(kj::Path({name}), kj::WriteMode::CREATE)),
+        contexts(KJ_MAP(md, algorithms) {
+          kj::Own<EVP_MD_CTX> context = kj::disposeWith<EVP_MD_CTX_free>(EVP_MD_CTX_new());
+          KJ_ASSERT(EVP_DigestInit_ex(context.get(), md, nullptr) == 1);
+          return context;
+        }) {}
+
+  kj::Promise<void> write(kj::ArrayPtr<const kj::byte> buffer) override {
+    replacer->get().write(size, buffer);
+    size += buffer.size();
+    for (auto& context: contexts) {
+      KJ_ASSERT(EVP_DigestUpdate(context.get(), buffer.begin(), buffer.size()) == 1);
+    }
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> write(kj::ArrayPtr<const kj::ArrayPtr<const kj::byte>> pieces) override {
+    for (auto piece: pieces) {
+      write(piece);
+    }
+    return kj::READY_NOW;
+  }
+
+  kj::Promise<void> whenWriteDisconnected() override {
+    return kj::NEVER_DONE;
+  }
+
+  // Returns the digests of everything written, in the order of the algorithms passed to the
+  // constructor. Can only be called once.
+  kj::Array<kj::Array<kj::byte>> finishDigests() {
+    return KJ_MAP(context, contexts) {
+      kj::byte digest[EVP_MAX_MD_SIZE];
+      uint length = 0;
+      KJ_ASSERT(EVP_DigestFinal_ex(context.get(), digest, &length) == 1);
+      return kj::heapArray<kj::byte>(digest, length);
+    };
+  }
+
+  // Makes the blob visible under its name, and returns its size.
+  uint64_t commit() {
+    replacer->commit();
+    return size;
+  }
+
+ private:
+  kj::Own<kj::Directory::Replacer<kj::File>> replacer;
+  kj::Array<kj::Own<EVP_MD_CTX>> contexts;
+  uint64_t size = 0;
+};
+
+LocalR2::LocalR2(const kj::Clock& clock,
+    kj::EntropySource& entropySource,
+    kj::HttpHeaderTable::Builder& headerTableBuilder)
+    : clock(clock),
+      entropySource(entropySource),
+      headerTable(headerTableBuilder.getFutureTable()),
+      hRequest(headerTableBuilder.add("CF-R2-Request")),
+      hMetadataSize(headerTableBuilder.add("CF-R2-Metadata-Size")),
+      hError(headerTableBuilder.add("CF-R2-Error")) {}
+
+void LocalR2::open(const kj::Directory& dir) {
+  KJ_REQUIRE(database == kj::none, "LocalR2 opened twice");
+
+  auto& ownVfs = vfs.emplace(kj::heap<SqliteDatabase::Vfs>(dir));
+  auto db = kj::heap<SqliteDatabase>(*ownVfs, kj::Path({"index.sqlite"}),
+      kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT);
+
+  db->run("PRAGMA journal_mode=WAL;");
+
+  // Keys are TEXT and compared bytewise, so the primary key orders them the way list() returns
+  // them. `metadata` holds the object's `R2HeadResponse` as JSON, exactly as head() returns it.
+  db->run(R"(
+    CREATE TABLE IF NOT EXISTS objects (
+      key TEXT PRIMARY KEY,
+      version TEXT NOT NULL,
+      etag TEXT NOT NULL,
+      uploaded INTEGER NOT NULL,
+      metadata TEXT NOT NULL
+    ) WITHOUT ROWID;
+  )");
+
+  // The blobs each version of an object is made of, in order. A blob belongs to at most one
+  // object version or upload part at a time.
+  db->run(R"(
+    CREATE TABLE IF NOT EXISTS blobs (
+      version TEXT NOT NULL,
+      idx INTEGER NOT NULL,
+      name TEXT NOT NULL UNIQUE,
+      size INTEGER NOT NULL,
+      PRIMARY KEY (version, idx)
+    ) WITHOUT ROWID;
+  )");
+
+  // Multipart uploads in progress. `metadata` is the `R2HeadResponse` the object will get, minus
+  // the fields that aren't known until the upload completes.
+  db->run(R"(
+    CREATE TABLE IF NOT EXISTS uploads (
+      id TEXT PRIMARY KEY,
+      key TEXT NOT NULL,
+      metadata TEXT NOT NULL
+    ) WITHOUT ROWID;
+  )");
+
+  db->run(R"(
+    CREATE TABLE IF NOT EXISTS parts (
+      upload_id TEXT NOT NULL,
+      part INTEGER NOT NULL,
+      etag TEXT NOT NULL,
+      blob TEXT NOT NULL UNIQUE,
+      size INTEGER NOT NULL,
+      PRIMARY KEY (upload_id, part)
+    ) WITHOUT ROWID;
+  )");
+
+  blobDir = dir.openSubdir(kj::Path({"blobs"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+  database = kj::heap<Database>(kj::mv(db));
+
+  auto orphans = removeOrphanedBlobs();
+  if (orphans > 0) {
+    KJ_LOG(INFO, "removed R2 blobs left behind by unfinished writes", orphans);
+  }
+}
+
+LocalR2::Database& LocalR2::getDatabase() {
+  return *KJ_REQUIRE_NONNULL(database, "LocalR2 used before open()");
+}
+
+const kj::Directory& LocalR2::getBlobDir() {
+  return *KJ_REQUIRE_NONNULL(blobDir, "LocalR2 used before open()");
+}
+
+kj::String LocalR2::newId() {
+  kj::byte bytes[16];
+  entropySource.generate(kj::arrayPtr(bytes));
+  return kj::encodeHex(kj::arrayPtr(bytes));
+}
+
+int64_t LocalR2::nowMilliseconds() {
+  return (clock.now() - kj::UNIX_EPOCH) / kj::MILLISECONDS;
+}
+
+void LocalR2::inTransaction(kj::FunctionParam<void()> func) {
+  auto& db = *getDatabase().db;
+  db.run("BEGIN TRANSACTION");
+  KJ_ON_SCOPE_FAILURE(db.run("ROLLBACK"));
+  func();
+  db.run("COMMIT");
+}
+
+uint LocalR2::removeOrphanedBlobs() {
+  auto& db = getDatabase();
+  auto& dir = getBlobDir();
+  uint count = 0;
+  for (auto& name: dir.listNames()) {
+    if (db.stmtIsBlobUsed.run(name.asPtr()).isDone()) {
+      dir.remove(kj::Path({name}));
+      ++count;
+    }
+  }
+  return count;
+}
+
+kj::Maybe<LocalR2::StoredObject> LocalR2::getObject(kj::StringPtr key) {
+  auto& db = getDatabase();
+  StoredObject object;
+  {
+    auto query = db.stmtGetObject.run(key);
+    if (query.isDone()) return kj::none;
+    object.version = kj::str(query.getText(0));
+    object.etag = kj::str(query.getText(1));
+    object.uploaded = query.getInt64(2);
+    object.metadata = kj::str(query.getText(3));
+  }
+
+  kj::Vector<Blob> blobs;
+  for (auto query = db.stmtGetBlobs.run(object.version.asPtr()); !query.isDone();
+       query.nextRow()) {
+    blobs.add(Blob{kj::str(query.getText(0)), static_cast<uint64_t>(query.getInt64(1))});
+  }
+  object.blobs = blobs.releaseAsArray();
+  return kj::mv(object);
+}
+
+bool LocalR2::uploadExists(kj::StringPtr uploadId, kj::StringPtr key) {
+  return !getDatabase().stmtGetUpload.run(uploadId, key).isDone();
+}
+
+kj::Array<LocalR2::Blob> LocalR2::deleteObjectRows(kj::StringPtr key) {
+  auto& db = getDatabase();
+  KJ_IF_SOME(object, getObject(key)) {
+    db.stmtDeleteBlobs.run(object.version.asPtr());
+    db.stmtDeleteObject.run(key);
+    return kj::mv(object.blobs);
+  }
+  return nullptr;
+}
+
+void LocalR2::removeBlobs(kj::ArrayPtr<const Blob> blobs) {
+  auto& dir = getBlobDir();
+  for (auto& blob: blobs) {
+    KJ_IF_SOME(exception,
+        kj::runCatchingExceptions([&]() { dir.tryRemove(kj::Path({blob.name})); })) {
+      // removeOrphanedBlobs() will get it the next time the bucket is opened.
+      KJ_LOG(ERROR, "failed to remove R2 blob", blob.name, exception);
+    }
+  }
+}
+
+kj::Promise<void> LocalR2::request(kj::HttpMethod method,
+    kj::StringPtr url,
+    const kj::HttpHeaders& headers,
+    kj::AsyncInputStream& requestBody,
+    Response& response) {
+  capnp::MallocMessageBuilder message;
+  auto binding = message.initRoot<R2BindingRequest>();
+  auto decode = [&](kj::ArrayPtr<const char> text) {
+    return kj::runCatchingExceptions([&]() { decodeJson<R2BindingRequest>(text, binding); }) ==
+        kj::none;
+  };
+
+  if (method == kj::HttpMethod::GET) {
+    auto text = KJ_UNWRAP_OR(
+        headers.get(hRequest), { co_return co_await sendError(response, BAD_REQUEST); });
+    if (!decode(text)) {
+      co_return co_await sendError(response, BAD_REQUEST);
+    }
+
+    auto payload = binding.asReader().getPayload();
+    switch (payload.which()) {
+      case R2BindingRequest::Payload::HEAD:
+        co_return co_await head(payload.getHead(), response);
+      case R2BindingRequest::Payload::GET:
+        co_return co_await get(payload.getGet(), response);
+      case R2BindingRequest::Payload::LIST:
+        co_return co_await list(payload.getList(), response);
+      default:
+        break;
+    }
+  } else if (method == kj::HttpMethod::PUT) {
+    // The body starts with the request's JSON, followed by the content, if there is any.
+    auto sizeText = KJ_UNWRAP_OR(
+        headers.get(hMetadataSize), { co_return co_await sendError(response, BAD_REQUEST); });
+    auto size = KJ_UNWRAP_OR(
+        sizeText.tryParseAs<uint64_t>(), { co_return co_await sendError(response, BAD_REQUEST); });
+    if (size > MAX_METADATA_BYTES) {
+      co_return co_await sendError(response, BAD_REQUEST);
+    }
+    auto text = kj::heapArray<char>(size);
+    if (co_await requestBody.tryRead(text.begin(), size, size) < size || !decode(text)) {
+      co_return co_await sendError(response, BAD_REQUEST);
+    }
+
+    auto payload = binding.asReader().getPayload();
+    switch (payload.which()) {
+      case R2BindingRequest::Payload::PUT:
+        co_return co_await put(payload.getPut(), requestBody, response);
+      case R2BindingRequest::Payload::DELETE:
+        co_return co_await delete_(payload.getDelete(), response);
+      case R2BindingRequest::Payload::CREATE_MULTIPART_UPLOAD:
+        co_return co_await createMultipartUpload(payload.getCreateMultipartUpload(), response);
+      case R2BindingRequest::Payload::UPLOAD_PART:
+        co_return co_await uploadPart(payload.getUploadPart(), requestBody, response);
+      case R2BindingRequest::Payload::COMPLETE_MULTIPART_UPLOAD:
+        co_return co_await completeMultipartUpload(payload.getCompleteMultipartUpload(), response);
+      case R2BindingRequest::Payload::ABORT_MULTIPART_UPLOAD:
+        co_return co_await abortMultipartUpload(payload.getAbortMultipartUpload(), response);
+      default:
+        break;
+    }
+  } else {
+    co_return co_await response.sendError(405, "Method Not Allowed", headerTable);
+  }
+
+  // Bucket administration, which a bucket can't do to itself.
+  co_return co_await sendError(response, NOT_IMPLEMENTED);
+}
+
+kj::Promise<void> LocalR2::head(r2::R2HeadRequest::Reader request, Response& response) {
+  auto object = KJ_UNWRAP_OR(
+      getObject(request.getObject()), { co_return co_await sendError(response, NO_SUCH_KEY); });
+  co_return co_await sendMetadata(response, object.metadata);
+}
+
+kj::Promise<void> LocalR2::get(r2::R2GetRequest::Reader request, Response& response) {
+  if (request.hasSsec()) {
+    co_return co_await sendError(response, NOT_IMPLEMENTED);
+  }
+
+  // The blobs are opened before we wait on anything, so that the response comes from the version
+  // of the object that was current when the request arrived, even if it's replaced meanwhile.
+  auto object = KJ_UNWRAP_OR(
+      getObject(request.getObject()), { co_return co_await sendError(response, NO_SUCH_KEY); });
+  auto files = KJ_MAP(blob, object.blobs) { return getBlobDir().openFile(kj::Path({blob.name})); };
+
+  if (request.hasOnlyIf() &&
+      !conditionsHold(request.getOnlyIf(), object.etag.asPtr(), object.uploaded)) {
+    co_return co_await sendError(response, PRECONDITION_FAILED, object.metadata.asPtr());
+  }
+
+  uint64_t size = 0;
+  for (auto& blob: object.blobs) {
+    size += blob.size;
+  }
+  auto range = KJ_UNWRAP_OR(
+      resolveRange(request, size), { co_return co_await sendError(response, INVALID_RANGE); });
+
+  auto metadata = kj::mv(object.metadata);
+  if (request.hasRange() || request.hasRangeHeader()) {
+    // Echo the range being returned.
+    capnp::MallocMessageBuilder message;
+    auto root = message.initRoot<r2::R2HeadResponse>();
+    decodeJson<r2::R2HeadResponse>(metadata.asArray(), root);
+    auto echo = root.initRange();
+    echo.setOffset(range.offset);
+    echo.setLength(range.length);
+    metadata = encodeJson<r2::R2HeadResponse>(root.asReader());
+  }
+
+  kj::HttpHeaders headers(headerTable);
+  headers.set(hMetadataSize, kj::str(metadata.size()));
+  auto out = response.send(200, "OK", headers, metadata.size() + range.length);
+  co_await out->write(metadata.asBytes());
+
+  // Write the parts of the blobs that the range covers straight from their mappings.
+  uint64_t offset = range.offset;
+  uint64_t remaining = range.length;
+  for (auto i: kj::indices(files)) {
+    if (remaining == 0) break;
+    auto blobSize = object.blobs[i].size;
+    if (offset >= blobSize) {
+      offset -= blobSize;
+      continue;
+    }
+    auto length = kj::min(blobSize - offset, remaining);
+    auto mapping = files[i]->mmap(offset, length);
+    co_await out->write(mapping);
+    offset = 0;
+    remaining -= length;
+  }
+}
+
+kj::Promise<void> LocalR2::list(r2::R2ListRequest::Reader request, Response& response) {
+  uint limit = request.getLimit();
+  if (limit == 0 || limit > MAX_LIST_KEYS) {
+    limit = MAX_LIST_KEYS;
+  }
+
+  // Runtimes that predate `include` expect both kinds of metadata.
+  bool includeHttp = !request.getNewRuntime();
+  bool includeCustom = !request.getNewRuntime();
+  for (auto field: request.getInclude()) {
+    if (field == static_cast<uint16_t>(r2::R2ListRequest::IncludeField::HTTP)) {
+      includeHttp = true;
+    } else if (field == static_cast<uint16_t>(r2::R2ListRequest::IncludeField::CUSTOM)) {
+      includeCustom = true;
+    }
+  }
+
+  kj::StringPtr prefix = request.getPrefix();
+  kj::StringPtr delimiter = request.getDelimiter();
+  auto end = prefixEnd(prefix);
+
+  // `next` is the smallest key that may still be listed. The cursor is simply `next`, encoded.
+  auto next = kj::str(prefix);
+  if (request.hasStartAfter()) {
+    auto bound = keyAfter(request.getStartAfter());
+    if (next < bound) next = kj::mv(bound);
+  }
+  if (request.hasCursor()) {
+    auto decoded = kj::decodeBase64(request.getCursor());
+    if (decoded.hadErrors) {
+      co_return co_await sendError(response, BAD_REQUEST);
+    }
+    auto bound = kj::str(decoded.asChars());
+    if (next < bound) next = kj::mv(bound);
+  }
+
+  kj::Vector<kj::String> objects;
+  kj::Vector<kj::String> delimitedPrefixes;
+  bool truncated = false;
+  auto& db = getDatabase();
+  for (;;) {
+    // The query reads `from`, so `next` can't be reused for it.
+    auto from = kj::str(next);
+    bool skipped = false;
+    auto count = objects.size() + delimitedPrefixes.size();
+    // Ask for one more key than we need, to find out whether the listing is complete.
+    auto query =
+        db.stmtList.run(from.asPtr(), end.asPtr(), static_cast<int64_t>(limit - count + 1));
+    for (; !query.isDone(); query.nextRow()) {
+      if (objects.size() + delimitedPrefixes.size() == limit) {
+        truncated = true;
+        break;
+      }
+
+      auto key = query.getText(0);
+      if (delimiter.size() > 0) {
+        KJ_IF_SOME(i, findSubstring(key.slice(prefix.size()), delimiter)) {
+          // Keys under this prefix are all listed as the prefix, so skip to the end of them.
+          auto delimited = kj::str(key.first(prefix.size() + i + delimiter.size()));
+          next = prefixEnd(delimited);
+          delimitedPrefixes.add(kj::mv(delimited));
+          skipped = true;
+          break;
+        }
+      }
+
+      objects.add(kj::str(query.getText(1)));
+      next = keyAfter(key);
+    }
+    if (!skipped) break;
+  }
+
+  capnp::MallocMessageBuilder message;
+  auto root = message.initRoot<r2::R2ListResponse>();
+  auto objectsBuilder = root.initObjects(objects.size());
+  for (auto i: kj::indices(objects)) {
+    auto object = objectsBuilder[i];
+    decodeJson<r2::R2HeadResponse>(objects[i].asArray(), object);
+    if (!includeHttp) object.disownHttpFields();
+    if (!includeCustom) object.disownCustomFields();
+  }
+  root.setTruncated(truncated);
+  if (truncated) {
+    root.setCursor(kj::encodeBase64(next.asBytes()));
+  }
+  if (delimitedPrefixes.size() > 0) {
+    auto prefixes = root.initDelimitedPrefixes(delimitedPrefixes.size());
+    for (auto i: kj::indices(delimitedPrefixes)) {
+      prefixes.set(i, delimitedPrefixes[i]);
+    }
+  }
+
+  auto json = encodeJson<r2::R2ListResponse>(root.asReader());
+  co_return co_await sendMetadata(response, json);
+}
+
+kj::Promise<void> LocalR2::put(
+    r2::R2PutRequest::Reader request, kj::AsyncInputStream& requestBody, Response& response) {
+  kj::StringPtr key = request.getObject();
+  if (!isValidKey(key)) {
+    co_return co_await sendError(response, INVALID_OBJECT_NAME);
+  } else if (request.hasSsec()) {
+    co_return co_await sendError(response, NOT_IMPLEMENTED);
+  }
+
+  // The MD5 is always computed, as the etag is made from it. The other checksums are only
+  // computed to check the ones the request supplies.
+  struct Checksum {
+    const EVP_MD* md;
+    capnp::Data::Reader expected;
+    void (r2::R2Checksums::Builder::*set)(capnp::Data::Reader);
+  };
+  kj::Vector<Checksum> checksums;
+  checksums.add(Checksum{EVP_md5(), request.getMd5(), &r2::R2Checksums::Builder::setMd5});
+  if (request.hasSha1()) {
+    checksums.add(Checksum{EVP_sha1(), request.getSha1(), &r2::R2Checksums::Builder::setSha1});
+  }
+  if (request.hasSha256()) {
+    checksums.add(
+        Checksum{EVP_sha256(), request.getSha256(), &r2::R2Checksums::Builder::setSha256});
+  }
+  if (request.hasSha384()) {
+    checksums.add(
+        Checksum{EVP_sha384(), request.getSha384(), &r2::R2Checksums::Builder::setSha384});
+  }
+  if (request.hasSha512()) {
+    checksums.add(
+        Checksum{EVP_sha512(), request.getSha512(), &r2::R2Checksums::Builder::setSha512});
+  }
+
+  auto algorithms = KJ_MAP(checksum, checksums) { return checksum.md; };
+  Blob blob{newId(), 0};
+  BlobWriter writer(getBlobDir(), blob.name, algorithms);
+  co_await requestBody.pumpTo(writer);
+
+  auto digests = writer.finishDigests();
+  for (auto i: kj::indices(checksums)) {
+    auto expected = checksums[i].expected;
+    if (expected.size() > 0 && expected != digests[i].asPtr().asConst()) {
+      co_return co_await sendError(response, BAD_DIGEST);
+    }
+  }
+  blob.size = writer.commit();
+
+  auto version = newId();
+  auto etag = kj::encodeHex(digests[0]);
+  auto uploaded = nowMilliseconds();
+
+  capnp::MallocMessageBuilder message;
+  auto metadata = message.initRoot<r2::R2HeadResponse>();
+  metadata.setName(key);
+  metadata.setVersion(version);
+  metadata.setSize(blob.size);
+  metadata.setEtag(etag);
+  metadata.setUploadedMillisecondsSinceEpoch(uploaded);
+  if (request.hasHttpFields()) {
+    metadata.setHttpFields(request.getHttpFields());
+  }
+  if (request.hasCustomFields()) {
+    metadata.setCustomFields(request.getCustomFields());
+  }
+  auto checksumsBuilder = metadata.initChecksums();
+  for (auto i: kj::indices(checksums)) {
+    (checksumsBuilder.*checksums[i].set)(digests[i].asPtr().asConst());
+  }
+  metadata.setStorageClass(
+      request.hasStorageClass() ? kj::StringPtr(request.getStorageClass()) : "Standard"_kj);
+  auto json = encodeJson<r2::R2HeadResponse>(metadata.asReader());
+
+  // Now that the body is in, check the preconditions against whatever the key holds at this
+  // point, and replace it in the same step.
+  bool preconditionFailed = false;
+  kj::Array<Blob> replaced;
+  {
+    KJ_ON_SCOPE_FAILURE(removeBlobs(kj::arrayPtr(&blob, 1)));
+    auto& db = getDatabase();
+    inTransaction([&]() {
+      if (request.hasOnlyIf()) {
+        auto existing = getObject(key);
+        kj::Maybe<kj::StringPtr> existingEtag;
+        int64_t existingUploaded = 0;
+        KJ_IF_SOME(o, existing) {
+          existingEtag = o.etag.asPtr();
+          existingUploaded = o.uploaded;
+        }
+        if (!conditionsHold(request.getOnlyIf(), existingEtag, existingUploaded)) {
+          preconditionFailed = true;
+          return;
+        }
+      }
+      replaced = deleteObjectRows(key);
+      db.stmtPutObject.run(key, version.asPtr(), etag.asPtr(), uploaded, json.asPtr());
+      db.stmtAddBlob.run(version.asPtr(), 0, blob.name.asPtr(), static_cast<int64_t>(blob.size));
+    });
+  }
+
+  if (preconditionFailed) {
+    removeBlobs(kj::arrayPtr(&blob, 1));
+    co_return co_await sendError(response, PRECONDITION_FAILED);
+  }
+  removeBlobs(replaced);
+  co_return co_await sendJson(response, json);
+}
+
+kj::Promise<void> LocalR2::delete_(r2::R2DeleteRequest::Reader request, Response& response) {
+  kj::Vector<kj::StringPtr> keys;
+  switch (request.which()) {
+    case r2::R2DeleteRequest::OBJECT:
+      keys.add(request.getObject());
+      break;
+    case r2::R2DeleteRequest::OBJECTS:
+      for (auto key: request.getObjects()) {
+        keys.add(key);
+      }
+      break;
+  }
+  if (keys.size() > MAX_DELETE_KEYS) {
+    co_return co_await sendError(response, BAD_REQUEST);
+  }
+  for (auto key: keys) {
+    if (!isValidKey(key)) {
+      co_return co_await sendError(response, INVALID_OBJECT_NAME);
+    }
+  }
+
+  kj::Vector<Blob> removed;
+  inTransaction([&]() {
+    for (auto key: keys) {
+      for (auto& blob: deleteObjectRows(key)) {
+        removed.add(kj::mv(blob));
+      }
+    }
+  });
+  removeBlobs(removed);
+
+  // Deleting a key that doesn't exist succeeds, like it does in R2.
+  co_return co_await sendJson(response, ""_kj);
+}
+
+kj::Promise<void> LocalR2::createMultipartUpload(
+    r2::R2CreateMultipartUploadRequest::Reader request, Response& response) {
+  kj::StringPtr key = request.getObject();
+  if (!isValidKey(key)) {
+    co_return co_await sendError(response, INVALID_OBJECT_NAME);
+  } else if (request.hasSsec()) {
+    co_return co_await sendError(response, NOT_IMPLEMENTED);
+  }
+
+  capnp::MallocMessageBuilder message;
+  auto metadata = message.initRoot<r2::R2HeadResponse>();
+  if (request.hasHttpFields()) {
+    metadata.setHttpFields(request.getHttpFields());
+  }
+  if (request.hasCustomFields()) {
+    metadata.setCustomFields(request.getCustomFields());
+  }
+  metadata.setStorageClass(
+      request.hasStorageClass() ? kj::StringPtr(request.getStorageClass()) : "Standard"_kj);
+
+  auto uploadId = newId();
+  getDatabase().stmtCreateUpload.run(
+      uploadId.asPtr(), key, encodeJson<r2::R2HeadResponse>(metadata.asReader()).asPtr());
+
+  capnp::MallocMessageBuilder responseMessage;
+  auto root = responseMessage.initRoot<r2::R2CreateMultipartUploadResponse>();
+  root.setUploadId(uploadId);
+  auto json = encodeJson<r2::R2CreateMultipartUploadResponse>(root.asReader());
+  co_return co_await sendJson(response, json);
+}
+
+kj::Promise<void> LocalR2::uploadPart(r2::R2UploadPartRequest::Reader request,
+    kj::AsyncInputStream& requestBody,
+    Response& response) {
+  kj::StringPtr key = request.getObject();
+  kj::StringPtr uploadId = request.getUploadId();
+  auto partNumber = request.getPartNumber();
+  if (!isValidKey(key)) {
+    co_return co_await sendError(response, INVALID_OBJECT_NAME);
+  } else if (request.hasSsec()) {
+    co_return co_await sendError(response, NOT_IMPLEMENTED);
+  } else if (partNumber < 1 || partNumber > MAX_PART_NUMBER) {
+    co_return co_await sendError(response, BAD_REQUEST);
+  } else if (!uploadExists(uploadId, key)) {
+    co_return co_await sendError(response, NO_SUCH_UPLOAD);
+  }
+
+  const EVP_MD* md5 = EVP_md5();
+  Blob blob{newId(), 0};
+  BlobWriter writer(getBlobDir(), blob.name, kj::arrayPtr(&md5, 1));
+  co_await requestBody.pumpTo(writer);
+  auto etag = kj::encodeHex(writer.finishDigests()[0]);
+  blob.size = writer.commit();
+
+  bool uploadGone = false;
+  kj::Vector<Blob> replaced;
+  {
+    KJ_ON_SCOPE_FAILURE(removeBlobs(kj::arrayPtr(&blob, 1)));
+    auto& db = getDatabase();
+    inTransaction([&]() {
+      // The upload may have been completed or aborted while the part was arriving.
+      if (!uploadExists(uploadId, key)) {
+        uploadGone = true;
+        return;
+      }
+      {
+        auto query = db.stmtGetPart.run(uploadId, partNumber);
+        if (!query.isDone()) {
+          replaced.add(Blob{kj::str(query.getText(0)), 0});
+        }
+      }
+      db.stmtPutPart.run(
+          uploadId, partNumber, etag.asPtr(), blob.name.asPtr(), static_cast<int64_t>(blob.size));
+    });
+  }
+
+  if (uploadGone) {
+    removeBlobs(kj::arrayPtr(&blob, 1));
+    co_return co_await sendError(response, NO_SUCH_UPLOAD);
+  }
+  removeBlobs(replaced);
+
+  capnp::MallocMessageBuilder message;
+  auto root = message.initRoot<r2::R2UploadPartResponse>();
+  root.setEtag(etag);
+  auto json = encodeJson<r2::R2UploadPartResponse>(root.asReader());
+  co_return co_await sendJson(response, json);
+}
+
+kj::Promise<void> LocalR2::completeMultipartUpload(
+    r2::R2CompleteMultipartUploadRequest::Reader request, Response& response) {
+  kj::StringPtr key = request.getObject();
+  kj::StringPtr uploadId = request.getUploadId();
+  if (!isValidKey(key)) {
+    co_return co_await sendError(response, INVALID_OBJECT_NAME);
+  }
+
+  auto& db = getDatabase();
+  capnp::MallocMessageBuilder message;
+  auto metadata = message.initRoot<r2::R2HeadResponse>();
+  {
+    auto query = db.stmtGetUpload.run(uploadId, key);
+    if (query.isDone()) {
+      co_return co_await sendError(response, NO_SUCH_UPLOAD);
+    }
+    decodeJson<r2::R2HeadResponse>(query.getText(0), metadata);
+  }
+
+  // Match the requested parts, which must be in ascending order, against the uploaded ones. The
+  // object is made of the matched parts' blobs, and the rest are dropped.
+  auto parts = request.getParts();
+  kj::Vector<Blob> blobs;
+  kj::Vector<Blob> unused;
+  kj::Vector<kj::byte> partDigests;
+  bool valid = parts.size() > 0;
+  {
+    uint matched = 0;
+    for (auto query = db.stmtListParts.run(uploadId); !query.isDone(); query.nextRow()) {
+      Blob blob{kj::str(query.getText(2)), static_cast<uint64_t>(query.getInt64(3))};
+      if (matched < parts.size() && parts[matched].getPart() == query.getInt64(0)) {
+        auto etag = query.getText(1);
+        if (parts[matched].getEtag() != etag) {
+          valid = false;
+          break;
+        }
+        partDigests.addAll(kj::decodeHex(etag));
+        blobs.add(kj::mv(blob));
+        ++matched;
+      } else {
+        unused.add(kj::mv(blob));
+      }
+    }
+    valid = valid && matched == parts.size();
+  }
+  if (!valid) {
+    co_return co_await sendError(response, INVALID_PART);
+  }
+
+  // Like S3, a multipart object's etag is the MD5 of its parts' MD5s, followed by the number of
+  // parts.
+  kj::byte digest[MD5_DIGEST_LENGTH];
+  MD5(partDigests.begin(), partDigests.size(), digest);
+  auto etag = kj::str(kj::encodeHex(kj::arrayPtr(digest)), '-', parts.size());
+
+  auto version = newId();
+  auto uploaded = nowMilliseconds();
+  uint64_t size = 0;
+  for (auto& blob: blobs) {
+    size += blob.size;
+  }
+
+  metadata.setName(key);
+  metadata.setVersion(version);
+  metadata.setSize(size);
+  metadata.setEtag(etag);
+  metadata.setUploadedMillisecondsSinceEpoch(uploaded);
+  auto json = encodeJson<r2::R2HeadResponse>(metadata.asReader());
+
+  kj::Array<Blob> replaced;
+  inTransaction([&]() {
+    replaced = deleteObjectRows(key);
+    db.stmtPutObject.run(key, version.asPtr(), etag.asPtr(), uploaded, json.asPtr());
+    for (auto i: kj::indices(blobs)) {
+      db.stmtAddBlob.run(version.asPtr(), static_cast<int64_t>(i), blobs[i].name.asPtr(),
+          static_cast<int64_t>(blobs[i].size));
+    }
+    db.stmtDeleteParts.run(uploadId);
+    db.stmtDeleteUpload.run(uploadId);
+  });
+  removeBlobs(replaced);
+  removeBlobs(unused);
+
+  co_return co_await sendJson(response, json);
+}
+
+kj::Promise<void> LocalR2::abortMultipartUpload(
+    r2::R2AbortMultipartUploadRequest::Reader request, Response& response) {
+  kj::StringPtr uploadId = request.getUploadId();
+
+  kj::Vector<Blob> removed;
+  if (uploadExists(uploadId, request.getObject())) {
+    auto& db = getDatabase();
+    inTransaction([&]() {
+      for (auto query = db.stmtListParts.run(uploadId); !query.isDone(); query.nextRow()) {
+        removed.add(Blob{kj::str(query.getText(2)), static_cast<uint64_t>(query.getInt64(3))});
+      }
+      db.stmtDeleteParts.run(uploadId);
+      db.stmtDeleteUpload.run(uploadId);
+    });
+  }
+  removeBlobs(removed);
+
+  co_return co_await sendJson(response, ""_kj);
+}
+
+kj::Promise<void> LocalR2::sendMetadata(Response& response, kj::StringPtr metadata) {
+  kj::HttpHeaders headers(headerTable);
+  headers.set(hMetadataSize, kj::str(metadata.size()));
+  auto out = response.send(200, "OK", headers, metadata.size());
+  co_await out->write(metadata.asBytes());
+}
+
+kj::Promise<void> LocalR2::sendJson(Response& response, kj::StringPtr json) {
+  kj::HttpHeaders headers(headerTable);
+  if (json.size() > 0) {
+    headers.set(kj::HttpHeaderId::CONTENT_TYPE, MimeType::JSON.toString());
+  }
+  auto out = response.send(200, "OK", headers, json.size());
+  co_await out->write(json.asBytes());
+}
+
+kj::Promise<void> LocalR2::sendError(
+    Response& response, const ErrorCode& error, kj::Maybe<kj::StringPtr> metadata) {
+  capnp::MallocMessageBuilder message;
+  auto root = message.initRoot<r2::R2ErrorResponse>();
+  root.setV4code(error.v4code);
+  root.setMessage(error.message);
+
+  kj::HttpHeaders headers(headerTable);
+  headers.set(hError, encodeJson<r2::R2ErrorResponse>(root.asReader()));
+
+  // A get() whose preconditions fail still returns the object's metadata.
+  KJ_IF_SOME(m, metadata) {
+    headers.set(hMetadataSize, kj::str(m.size()));
+    auto out = response.send(error.statusCode, error.statusText, headers, m.size());
+    co_await out->write(m.asBytes());
+  } else {
+    response.send(error.statusCode, error.statusText, headers, uint64_t(0));
+  }
+}
+
+}  // namespace workerd::server
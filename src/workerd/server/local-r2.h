@@ -0,0 +1,215 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <workerd/api/r2-api.capnp.h>
+#include <workerd/util/sqlite.h>
+
+#include <kj/async.h>
+#include <kj/compat/http.h>
+#include <kj/filesystem.h>
+#include <kj/time.h>
+
+namespace workerd::server {
+
+// An in-process R2 bucket, speaking the same protocol that api/r2-rpc.c++ uses to talk to the
+// service bound as an `r2Bucket`. Each operation is a JSON-encoded `R2BindingRequest`:
+//
+// * head(), get() and list() are GET requests carrying the JSON in `CF-R2-Request`. The response
+//   body starts with `CF-R2-Metadata-Size` bytes of JSON, followed by the object's content.
+// * Everything else is a PUT request whose body starts with `CF-R2-Metadata-Size` bytes of JSON,
+//   followed by the object's (or part's) content. The response body is JSON.
+// * Errors carry a JSON `R2ErrorResponse` in `CF-R2-Error`.
+//
+// Object content lives in immutable "blob" files in the `blobs` subdirectory, with names that are
+// never reused, while keys and their metadata live in a SQLite database next to it:
+//
+// * A PUT body is written to a new blob as it arrives, and hashed on the way through, so that
+//   objects of any size are never held in memory. The object only replaces the key's previous
+//   version, whose blobs are then deleted, once the body has been received in full.
+// * A multipart upload writes each part to a blob of its own. Completing the upload makes the
+//   object out of the parts' blobs, in order, without copying them.
+// * A GET maps the blobs covering the requested range and writes them out directly. Because blobs
+//   never change once written, they are safe to map, and a GET that overlaps a PUT or DELETE of the
+//   same key keeps reading the version it started with.
+//
+// Blobs that the database doesn't know about, left behind if the server stopped in the middle of
+// a write, are deleted when the bucket is opened.
+//
+// Like the rest of the server, this is single-threaded.
+class LocalR2 final: public kj::HttpService {
+ public:
+  // Limits, as documented for R2.
+  static constexpr size_t MAX_KEY_BYTES = 1024;
+  static constexpr uint MAX_LIST_KEYS = 1000;
+  static constexpr uint MAX_DELETE_KEYS = 1000;
+  static constexpr uint MAX_PART_NUMBER = 10000;
+
+  // Upper bound on the JSON that precedes a request or response body.
+  static constexpr size_t MAX_METADATA_BYTES = 1 << 20;
+
+  LocalR2(const kj::Clock& clock,
+      kj::EntropySource& entropySource,
+      kj::HttpHeaderTable::Builder& headerTableBuilder);
+  KJ_DISALLOW_COPY_AND_MOVE(LocalR2);
+
+  // Opens the bucket kept in `dir`, creating it if necessary. Must be called before the first
+  // request. `dir` must outlive this object.
+  void open(const kj::Directory& dir);
+
+  // Deletes blobs that the database doesn't refer to, returning how many there were. Called by
+  // open().
+  uint removeOrphanedBlobs();
+
+  kj::Promise<void> request(kj::HttpMethod method,
+      kj::StringPtr url,
+      const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody,
+      Response& response) override;
+
+  // An error response, with the V4 API code that R2 reports it with.
+  struct ErrorCode {
+    uint statusCode;
+    kj::StringPtr statusText;
+    uint v4code;
+    kj::StringPtr message;
+  };
+
+ private:
+  using R2BindingRequest = api::public_beta::R2BindingRequest;
+
+  // The database and its prepared statements.
+  struct Database {
+    kj::Own<SqliteDatabase> db;
+
+    explicit Database(kj::Own<SqliteDatabase> db): db(kj::mv(db)) {}
+
+    SqliteDatabase::Statement stmtGetObject = db->prepare(R"(
+      SELECT version, etag, uploaded, metadata FROM objects WHERE key = ?
+    )");
+    SqliteDatabase::Statement stmtPutObject = db->prepare(R"(
+      INSERT INTO objects VALUES(?, ?, ?, ?, ?)
+        ON CONFLICT DO UPDATE SET
+          version = excluded.version, etag = excluded.etag, uploaded = excluded.uploaded,
+          metadata = excluded.metadata
+    )");
+    SqliteDatabase::Statement stmtDeleteObject = db->prepare(R"(
+      DELETE FROM objects WHERE key = ?
+    )");
+    // The first bound is inclusive and the second exclusive.
+    SqliteDatabase::Statement stmtList = db->prepare(R"(
+      SELECT key, metadata FROM objects WHERE key >= ? AND key < ? ORDER BY key LIMIT ?
+    )");
+
+    SqliteDatabase::Statement stmtGetBlobs = db->prepare(R"(
+      SELECT name, size FROM blobs WHERE version = ? ORDER BY idx
+    )");
+    SqliteDatabase::Statement stmtAddBlob = db->prepare(R"(
+      INSERT INTO blobs VALUES(?, ?, ?, ?)
+    )");
+    SqliteDatabase::Statement stmtDeleteBlobs = db->prepare(R"(
+      DELETE FROM blobs WHERE version = ?
+    )");
+    SqliteDatabase::Statement stmtIsBlobUsed = db->prepare(R"(
+      SELECT 1 FROM blobs WHERE name = ?1 UNION ALL SELECT 1 FROM parts WHERE blob = ?1
+    )");
+
+    SqliteDatabase::Statement stmtCreateUpload = db->prepare(R"(
+      INSERT INTO uploads VALUES(?, ?, ?)
+    )");
+    SqliteDatabase::Statement stmtGetUpload = db->prepare(R"(
+      SELECT metadata FROM uploads WHERE id = ? AND key = ?
+    )");
+    SqliteDatabase::Statement stmtDeleteUpload = db->prepare(R"(
+      DELETE FROM uploads WHERE id = ?
+    )");
+    SqliteDatabase::Statement stmtGetPart = db->prepare(R"(
+      SELECT blob FROM parts WHERE upload_id = ? AND part = ?
+    )");
+    SqliteDatabase::Statement stmtPutPart = db->prepare(R"(
+      INSERT INTO parts VALUES(?, ?, ?, ?, ?)
+        ON CONFLICT DO UPDATE SET etag = excluded.etag, blob = excluded.blob, size = excluded.size
+    )");
+    SqliteDatabase::Statement stmtListParts = db->prepare(R"(
+      SELECT part, etag, blob, size FROM parts WHERE upload_id = ? ORDER BY part
+    )");
+    SqliteDatabase::Statement stmtDeleteParts = db->prepare(R"(
+      DELETE FROM parts WHERE upload_id = ?
+    )");
+  };
+
+  // A blob that an object is made of.
+  struct Blob {
+    kj::String name;
+    uint64_t size;
+  };
+
+  // An object's row, and the blobs its content is made of.
+  struct StoredObject {
+    kj::String version;
+    kj::String etag;
+    int64_t uploaded;
+    // The `R2HeadResponse` that head() returns, as JSON.
+    kj::String metadata;
+    kj::Array<Blob> blobs;
+  };
+
+  class BlobWriter;
+
+  const kj::Clock& clock;
+  kj::EntropySource& entropySource;
+  kj::HttpHeaderTable& headerTable;
+  kj::HttpHeaderId hRequest;
+  kj::HttpHeaderId hMetadataSize;
+  kj::HttpHeaderId hError;
+
+  // The database must be closed before the VFS goes away, so this comes first.
+  kj::Maybe<kj::Own<SqliteDatabase::Vfs>> vfs;
+  kj::Maybe<kj::Own<Database>> database;
+  kj::Maybe<kj::Own<const kj::Directory>> blobDir;
+
+  Database& getDatabase();
+  const kj::Directory& getBlobDir();
+  kj::String newId();
+  int64_t nowMilliseconds();
+
+  // Runs `func` in a database transaction, rolling it back if `func` throws.
+  void inTransaction(kj::FunctionParam<void()> func);
+
+  kj::Maybe<StoredObject> getObject(kj::StringPtr key);
+  bool uploadExists(kj::StringPtr uploadId, kj::StringPtr key);
+  // Removes `key`'s rows, returning the blobs it was made of so that they can be removed once the
+  // transaction commits.
+  kj::Array<Blob> deleteObjectRows(kj::StringPtr key);
+  // Removes blob files once nothing refers to them any more.
+  void removeBlobs(kj::ArrayPtr<const Blob> blobs);
+
+  kj::Promise<void> head(api::public_beta::R2HeadRequest::Reader request, Response& response);
+  kj::Promise<void> get(api::public_beta::R2GetRequest::Reader request, Response& response);
+  kj::Promise<void> list(api::public_beta::R2ListRequest::Reader request, Response& response);
+  kj::Promise<void> put(api::public_beta::R2PutRequest::Reader request,
+      kj::AsyncInputStream& requestBody,
+      Response& response);
+  kj::Promise<void> delete_(api::public_beta::R2DeleteRequest::Reader request, Response& response);
+  kj::Promise<void> createMultipartUpload(
+      api::public_beta::R2CreateMultipartUploadRequest::Reader request, Response& response);
+  kj::Promise<void> uploadPart(api::public_beta::R2UploadPartRequest::Reader request,
+      kj::AsyncInputStream& requestBody,
+      Response& response);
+  kj::Promise<void> completeMultipartUpload(
+      api::public_beta::R2CompleteMultipartUploadRequest::Reader request, Response& response);
+  kj::Promise<void> abortMultipartUpload(
+      api::public_beta::R2AbortMultipartUploadRequest::Reader request, Response& response);
+
+  // Sends the response to a GET-style request that has no content after the metadata.
+  kj::Promise<void> sendMetadata(Response& response, kj::StringPtr metadata);
+  // Sends the response to a PUT-style request.
+  kj::Promise<void> sendJson(Response& response, kj::StringPtr json);
+  // Sends an error, along with the object's metadata if it's a failed precondition.
+  kj::Promise<void> sendError(
+      Response& response, const ErrorCode& error, kj::Maybe<kj::StringPtr> metadata = kj::none);
+};
+
+}  // namespace workerd::server
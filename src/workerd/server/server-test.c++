@@ -719,6 +719,37 @@ KJ_TEST("Server: serve modular Worker with imports") {
       "square.wasm says square(5) = 25");
 }
 
+KJ_TEST("Server: lazy module compilation") {
+  TestServer test(singleWorker(R"((
+    compatibilityDate = "2022-08-17",
+    lazyModules = true,
+    modules = [
+      ( name = "main.js",
+        esModule =
+          `export default {
+          `  async fetch(request) {
+          `    const { MESSAGE } = await import("foo.js");
+          `    return new Response(MESSAGE);
+          `  }
+          `}
+      ),
+      ( name = "foo.js",
+        esModule =
+          `export let MESSAGE = "Hello from foo.js"
+      ),
+      ( name = "unused.js",
+        esModule =
+          `this is not valid JavaScript, but nothing imports it
+      )
+    ]
+  ))"_kj));
+
+  test.server.allowExperimental();
+  test.start();
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/", "Hello from foo.js");
+}
+
 KJ_TEST("Server: compatibility dates") {
   // The easiest flag to test is the presence of the global `navigator`.
   auto selfNavigatorCheckerWorker = [](kj::StringPtr compatProperties) {
@@ -2995,6 +3026,44 @@ KJ_TEST("Server: external server") {
   conn.recvHttp200("OK");
 }
 
+KJ_TEST("Server: external server connection limit") {
+  TestServer test(R"((
+    services = [
+      (name = "hello", external = (address = "ext-addr", http = (),
+                                   connectionPool = (maxConnections = 1)))
+    ],
+    sockets = [
+      (name = "main", address = "test-addr", service = "hello")
+    ]
+  ))"_kj);
+
+  test.start();
+
+  auto conn1 = test.connect("test-addr");
+  auto conn2 = test.connect("test-addr");
+  conn1.sendHttpGet("/path");
+  conn2.sendHttpGet("/path");
+
+  // Both requests go over the one connection, the second waiting for the first to finish.
+  auto subreq = test.receiveSubrequest("ext-addr");
+  for (auto i KJ_UNUSED: kj::zeroTo(2)) {
+    subreq.recv(R"(
+      GET /path HTTP/1.1
+      Host: foo
+
+    )"_blockquote);
+    subreq.send(R"(
+      HTTP/1.1 200 OK
+      Content-Length: 2
+      Content-Type: text/plain;charset=UTF-8
+
+      OK)"_blockquote);
+  }
+
+  conn1.recvHttp200("OK");
+  conn2.recvHttp200("OK");
+}
+
 KJ_TEST("Server: external server proxy style") {
   TestServer test(R"((
     services = [
@@ -3213,6 +3282,7 @@ KJ_TEST("Server: disk service") {
     HTTP/1.1 200 OK
     Content-Length: 19
     Content-Type: application/octet-stream
+    ETag: "ae88e6257600-13"
     Last-Modified: Sat, 03 Jan 1970 05:18:23 GMT
 
     hello from foo.txt
@@ -3223,6 +3293,7 @@ KJ_TEST("Server: disk service") {
     HTTP/1.1 200 OK
     Content-Length: 19
     Content-Type: application/octet-stream
+    ETag: "7ad187fd8768c0-13"
     Last-Modified: Fri, 05 Feb 1971 02:52:09 GMT
 
     hello from bar.txt
@@ -3233,6 +3304,7 @@ KJ_TEST("Server: disk service") {
     HTTP/1.1 200 OK
     Content-Length: 19
     Content-Type: application/octet-stream
+    ETag: "0-13"
     Last-Modified: Thu, 01 Jan 1970 00:00:00 GMT
 
     hello from qux.txt
@@ -3253,6 +3325,7 @@ KJ_TEST("Server: disk service") {
     HTTP/1.1 200 OK
     Content-Length: 11
     Content-Type: application/octet-stream
+    ETag: "ae88e6257600-b"
     Last-Modified: Sat, 03 Jan 1970 05:18:23 GMT
 
   )"_blockquote);
@@ -3269,6 +3342,7 @@ KJ_TEST("Server: disk service") {
     Content-Length: 3
     Content-Type: application/octet-stream
     Content-Range: bytes 3-5/11
+    ETag: "ae88e6257600-b"
     Last-Modified: Sat, 03 Jan 1970 05:18:23 GMT
 
     345)"_blockquote);
@@ -3284,22 +3358,51 @@ KJ_TEST("Server: disk service") {
     HTTP/1.1 200 OK
     Content-Length: 11
     Content-Type: application/octet-stream
+    ETag: "ae88e6257600-b"
     Last-Modified: Sat, 03 Jan 1970 05:18:23 GMT
 
     0123456789
   )"_blockquote);
 
-  // GET with many ranges returns full content.
+  // GET with many ranges returns each of them, as multipart/byteranges.
   conn.send(R"(
     GET /numbers.txt HTTP/1.1
     Host: foo
     Range: bytes=1-3, 6-8
 
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 206 Partial Content
+    Content-Length: 262
+    Content-Type: multipart/byteranges; boundary=04040404040404040404040404040404
+    ETag: "ae88e6257600-b"
+    Last-Modified: Sat, 03 Jan 1970 05:18:23 GMT
+
+    --04040404040404040404040404040404
+    Content-Type: application/octet-stream
+    Content-Range: bytes 1-3/11
+
+    123
+    --04040404040404040404040404040404
+    Content-Type: application/octet-stream
+    Content-Range: bytes 6-8/11
+
+    678
+    --04040404040404040404040404040404--
+  )"_blockquote);
+
+  // GET with ranges adding up to more than the file returns full content.
+  conn.send(R"(
+    GET /numbers.txt HTTP/1.1
+    Host: foo
+    Range: bytes=0-7, 2-9
+
   )"_blockquote);
   conn.recv(R"(
     HTTP/1.1 200 OK
     Content-Length: 11
     Content-Type: application/octet-stream
+    ETag: "ae88e6257600-b"
     Last-Modified: Sat, 03 Jan 1970 05:18:23 GMT
 
     0123456789
@@ -3392,6 +3495,343 @@ KJ_TEST("Server: disk service") {
     Not Found)"_blockquote);
 }
 
+KJ_TEST("Server: disk service open file cache") {
+  TestServer test(R"((
+    services = [
+      (name = "hello", disk = (path = "../../frob/blah", openFileCacheSize = 2))
+    ],
+    sockets = [
+      (name = "main", address = "test-addr", service = "hello")
+    ]
+  ))"_kj);
+
+  auto mode = kj::WriteMode::CREATE | kj::WriteMode::CREATE_PARENT;
+  auto dir = test.root->openSubdir(kj::Path({"frob"_kj, "blah"_kj}), mode);
+  dir->openFile(kj::Path({"foo.txt"}), mode)->writeAll("hello from foo.txt\n");
+  dir->openFile(kj::Path({"bar.txt"}), mode)->writeAll("hello from bar.txt\n");
+  dir->openFile(kj::Path({"baz.txt"}), mode)->writeAll("hello from baz.txt\n");
+  dir->openFile(kj::Path({"empty.txt"}), mode)->writeAll("");
+  dir->openFile(kj::Path({"sub", "qux.txt"}), mode)->writeAll("hello from qux.txt\n");
+
+  test.start();
+
+  auto conn = test.connect("test-addr");
+
+  auto expectFile = [&](kj::StringPtr path, kj::StringPtr content, kj::StringPtr etag) {
+    conn.sendHttpGet(path);
+    conn.recv(kj::str("HTTP/1.1 200 OK\n"
+                      "Content-Length: ",
+        content.size(),
+        "\n"
+        "Content-Type: application/octet-stream\n"
+        "ETag: \"",
+        etag,
+        "\"\n"
+        "Last-Modified: Thu, 01 Jan 1970 00:00:00 GMT\n"
+        "\n",
+        content));
+  };
+
+  // Files are served the same way whether or not they were cached already, and the cache only
+  // keeps the two most recently served.
+  for (auto round KJ_UNUSED: kj::zeroTo(2)) {
+    expectFile("/foo.txt", "hello from foo.txt\n", "0-13");
+    expectFile("/bar.txt", "hello from bar.txt\n", "0-13");
+    expectFile("/baz.txt", "hello from baz.txt\n", "0-13");
+    expectFile("/sub/qux.txt", "hello from qux.txt\n", "0-13");
+    expectFile("/empty.txt", "", "0-0");
+  }
+
+  // Ranges are served from the cached file.
+  conn.send(R"(
+    GET /sub/qux.txt HTTP/1.1
+    Host: foo
+    Range: bytes=6-9, 11-13
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 206 Partial Content
+    Content-Length: 265
+    Content-Type: multipart/byteranges; boundary=04040404040404040404040404040404
+    ETag: "0-13"
+    Last-Modified: Thu, 01 Jan 1970 00:00:00 GMT
+
+    --04040404040404040404040404040404
+    Content-Type: application/octet-stream
+    Content-Range: bytes 6-9/19
+
+    from
+    --04040404040404040404040404040404
+    Content-Type: application/octet-stream
+    Content-Range: bytes 11-13/19
+
+    qux
+    --04040404040404040404040404040404--
+  )"_blockquote);
+
+  // Replacing a cached file is noticed.
+  expectFile("/foo.txt", "hello from foo.txt\n", "0-13");
+  {
+    auto replacer = dir->replaceFile(kj::Path({"foo.txt"}), kj::WriteMode::MODIFY);
+    replacer->get().writeAll("goodbye from foo.txt\n");
+    replacer->commit();
+  }
+  expectFile("/foo.txt", "goodbye from foo.txt\n", "0-15");
+
+  // So is deleting it.
+  dir->remove(kj::Path({"foo.txt"}));
+  conn.sendHttpGet("/foo.txt");
+  conn.recv(R"(
+    HTTP/1.1 404 Not Found
+    Content-Length: 9
+
+    Not Found)"_blockquote);
+
+  // HEAD works too.
+  conn.send(R"(
+    HEAD /bar.txt HTTP/1.1
+    Host: foo
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 19
+    Content-Type: application/octet-stream
+    ETag: "0-13"
+    Last-Modified: Thu, 01 Jan 1970 00:00:00 GMT
+
+  )"_blockquote);
+
+  // Truncating a cached file in place is noticed too.
+  expectFile("/bar.txt", "hello from bar.txt\n", "0-13");
+  dir->openFile(kj::Path({"bar.txt"}), kj::WriteMode::MODIFY)->truncate(6);
+  expectFile("/bar.txt", "hello ", "0-6");
+
+  // Files bigger than a chunk are written from their mapping one chunk at a time.
+  auto big = kj::heapString(150000);
+  for (auto i: kj::indices(big)) big[i] = 'a' + i % 26;
+  dir->openFile(kj::Path({"big.txt"}), mode)->writeAll(big);
+  expectFile("/big.txt", big, "0-249f0");
+  expectFile("/big.txt", big, "0-249f0");
+  conn.send(R"(
+    GET /big.txt HTTP/1.1
+    Host: foo
+    Range: bytes=65530-65541
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 206 Partial Content
+    Content-Length: 12
+    Content-Type: application/octet-stream
+    Content-Range: bytes 65530-65541/150000
+    ETag: "0-249f0"
+    Last-Modified: Thu, 01 Jan 1970 00:00:00 GMT
+
+    klmnopqrstuv)"_blockquote);
+}
+
+KJ_TEST("Server: disk service conditional requests and precompressed variants") {
+  TestServer test(R"((
+    services = [
+      (name = "hello", disk = (path = "../../frob/blah", servePrecompressed = true))
+    ],
+    sockets = [
+      (name = "main", address = "test-addr", service = "hello")
+    ]
+  ))"_kj);
+
+  auto mode = kj::WriteMode::CREATE | kj::WriteMode::CREATE_PARENT;
+  auto dir = test.root->openSubdir(kj::Path({"frob"_kj, "blah"_kj}), mode);
+  test.fakeDate = kj::UNIX_EPOCH + 1 * kj::DAYS;
+  dir->openFile(kj::Path({"plain.txt"}), mode)->writeAll("plain text\n");
+  dir->openFile(kj::Path({"app.js"}), mode)->writeAll("console.log('hi');\n");
+  dir->openFile(kj::Path({"app.js.br"}), mode)->writeAll("pretend brotli\n");
+  dir->openFile(kj::Path({"app.js.gz"}), mode)->writeAll("pretend gzip\n");
+
+  test.start();
+
+  auto conn = test.connect("test-addr");
+
+  // Brotli is preferred when both are acceptable.
+  conn.send(R"(
+    GET /app.js HTTP/1.1
+    Host: foo
+    Accept-Encoding: gzip, deflate, br
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 15
+    Content-Type: application/octet-stream
+    Content-Encoding: br
+    ETag: "4e94914f0000-f"
+    Last-Modified: Fri, 02 Jan 1970 00:00:00 GMT
+    Vary: Accept-Encoding
+
+    pretend brotli
+  )"_blockquote);
+
+  // A quality of zero rules an encoding out.
+  conn.send(R"(
+    GET /app.js HTTP/1.1
+    Host: foo
+    Accept-Encoding: br;q=0.0, *;q=0.5
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 13
+    Content-Type: application/octet-stream
+    Content-Encoding: gzip
+    ETag: "4e94914f0000-d"
+    Last-Modified: Fri, 02 Jan 1970 00:00:00 GMT
+    Vary: Accept-Encoding
+
+    pretend gzip
+  )"_blockquote);
+
+  // Without an acceptable encoding, the file itself is served.
+  conn.send(R"(
+    GET /app.js HTTP/1.1
+    Host: foo
+    Accept-Encoding: identity
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 19
+    Content-Type: application/octet-stream
+    ETag: "4e94914f0000-13"
+    Last-Modified: Fri, 02 Jan 1970 00:00:00 GMT
+    Vary: Accept-Encoding
+
+    console.log('hi');
+  )"_blockquote);
+
+  // So it is when there are no precompressed variants.
+  conn.send(R"(
+    GET /plain.txt HTTP/1.1
+    Host: foo
+    Accept-Encoding: br
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 11
+    Content-Type: application/octet-stream
+    ETag: "4e94914f0000-b"
+    Last-Modified: Fri, 02 Jan 1970 00:00:00 GMT
+    Vary: Accept-Encoding
+
+    plain text
+  )"_blockquote);
+
+  // A matching If-None-Match gets 304.
+  conn.send(R"(
+    GET /plain.txt HTTP/1.1
+    Host: foo
+    If-None-Match: "something-else", "4e94914f0000-b"
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 304 Not Modified
+    Content-Type: application/octet-stream
+    ETag: "4e94914f0000-b"
+    Last-Modified: Fri, 02 Jan 1970 00:00:00 GMT
+    Vary: Accept-Encoding
+
+    )"_blockquote);
+
+  // If-None-Match takes precedence over If-Modified-Since.
+  conn.send(R"(
+    HEAD /plain.txt HTTP/1.1
+    Host: foo
+    If-None-Match: "something-else"
+    If-Modified-Since: Fri, 02 Jan 1970 00:00:00 GMT
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 11
+    Content-Type: application/octet-stream
+    ETag: "4e94914f0000-b"
+    Last-Modified: Fri, 02 Jan 1970 00:00:00 GMT
+    Vary: Accept-Encoding
+
+  )"_blockquote);
+
+  // If-Modified-Since compares against Last-Modified.
+  conn.send(R"(
+    GET /plain.txt HTTP/1.1
+    Host: foo
+    If-Modified-Since: Fri, 02 Jan 1970 00:00:00 GMT
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 304 Not Modified
+    Content-Type: application/octet-stream
+    ETag: "4e94914f0000-b"
+    Last-Modified: Fri, 02 Jan 1970 00:00:00 GMT
+    Vary: Accept-Encoding
+
+    )"_blockquote);
+
+  conn.send(R"(
+    GET /plain.txt HTTP/1.1
+    Host: foo
+    If-Modified-Since: Thu, 01 Jan 1970 23:59:59 GMT
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 11
+    Content-Type: application/octet-stream
+    ETag: "4e94914f0000-b"
+    Last-Modified: Fri, 02 Jan 1970 00:00:00 GMT
+    Vary: Accept-Encoding
+
+    plain text
+  )"_blockquote);
+
+  // A Range with a stale If-Range gets the whole file...
+  conn.send(R"(
+    GET /plain.txt HTTP/1.1
+    Host: foo
+    Range: bytes=0-4
+    If-Range: "stale"
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 200 OK
+    Content-Length: 11
+    Content-Type: application/octet-stream
+    ETag: "4e94914f0000-b"
+    Last-Modified: Fri, 02 Jan 1970 00:00:00 GMT
+    Vary: Accept-Encoding
+
+    plain text
+  )"_blockquote);
+
+  // ...and one with a current If-Range gets the range.
+  conn.send(R"(
+    GET /plain.txt HTTP/1.1
+    Host: foo
+    Range: bytes=0-4
+    If-Range: "4e94914f0000-b"
+
+  )"_blockquote);
+  conn.recv(R"(
+    HTTP/1.1 206 Partial Content
+    Content-Length: 5
+    Content-Type: application/octet-stream
+    Content-Range: bytes 0-4/11
+    ETag: "4e94914f0000-b"
+    Last-Modified: Fri, 02 Jan 1970 00:00:00 GMT
+    Vary: Accept-Encoding
+
+    plain)"_blockquote);
+}
+
 KJ_TEST("Server: disk service writable") {
   TestServer test(R"((
     services = [
@@ -3614,6 +4054,7 @@ KJ_TEST("Server: disk service allow dotfiles") {
     HTTP/1.1 200 OK
     Content-Length: 6
     Content-Type: application/octet-stream
+    ETag: "0-6"
     Last-Modified: Thu, 01 Jan 1970 00:00:00 GMT
 
     waldo
@@ -4084,6 +4525,84 @@ KJ_TEST("Server: ctx.exports self-referential bindings") {
   conn.httpGet200("/", "foo: 123, bar: 321, baz: 234, corge: 555, grault: 456, false");
 }
 
+KJ_TEST("Server: threads serve requests") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [
+            ( name = "main.js",
+              esModule =
+                `export default {
+                `  async fetch(request) {
+                `    return new Response("Hello from a thread: " + new URL(request.url).pathname);
+                `  }
+                `}
+            )
+          ]
+        )
+      )
+    ],
+    sockets = [ ( name = "main", address = "test-addr", service = "hello" ) ],
+    threads = 2
+  ))"_kj);
+
+  test.server.allowExperimental();
+  test.start();
+
+  // In-memory connections have no file descriptor to hand to the other thread, so they're served
+  // by the thread that accepted them, while the replica starts up and serves the same socket.
+  auto conn = test.connect("test-addr");
+  conn.httpGet200("/", "Hello from a thread: /");
+  conn.httpGet200("/foo", "Hello from a thread: /foo");
+
+  auto conn2 = test.connect("test-addr");
+  conn2.httpGet200("/bar", "Hello from a thread: /bar");
+}
+
+KJ_TEST("Server: threads can't be used with local storage services") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          modules = [ ( name = "main.js", esModule = "export default {}" ) ],
+          bindings = [ ( name = "NS", kvNamespace = "kv" ) ]
+        )
+      ),
+      ( name = "kv", kv = () )
+    ],
+    sockets = [ ( name = "main", address = "test-addr", service = "hello" ) ],
+    threads = 2
+  ))"_kj);
+
+  test.server.allowExperimental();
+  test.expectErrors(
+      "Service \"kv\" is a local storage service, which can't be used with `threads`, since each "
+      "thread would keep its own separate copy of the data.\n");
+}
+
+KJ_TEST("Server: compileCachePath can't be used with the new module registry") {
+  TestServer test(R"((
+    services = [
+      ( name = "hello",
+        worker = (
+          compatibilityDate = "2022-08-17",
+          compatibilityFlags = ["new_module_registry"],
+          modules = [ ( name = "main.js", esModule = "export default {}" ) ]
+        )
+      )
+    ],
+    sockets = [ ( name = "main", address = "test-addr", service = "hello" ) ],
+    compileCachePath = "code-cache"
+  ))"_kj);
+
+  test.server.allowExperimental();
+  test.expectErrors("service hello: `compileCachePath` can't be used with the "
+                    "\"new_module_registry\" compatibility flag yet.\n");
+}
+
 // =======================================================================================
 
 // TODO(beta): Test TLS (send and receive)
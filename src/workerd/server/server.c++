@@ -4,6 +4,12 @@
 
 #include "server.h"
 
+#include "coalescing-http-service.h"
+#include "connection-dispatcher.h"
+#include "disk-code-cache.h"
+#include "local-cache.h"
+#include "local-kv.h"
+#include "local-r2.h"
 #include "workerd-api.h"
 
 #include <workerd/api/actor-state.h>
@@ -24,8 +30,10 @@
 #include <workerd/io/worker.h>
 #include <workerd/util/http-util.h>
 #include <workerd/util/mimetype.h>
+#include <workerd/util/sqlite-group-commit.h>
 #include <workerd/util/use-perfetto-categories.h>
 #include <workerd/util/uuid.h>
+#include <workerd/util/wait-list.h>
 
 #include <openssl/bio.h>
 #include <openssl/pem.h>
@@ -39,7 +47,9 @@
 #include <kj/debug.h>
 #include <kj/encoding.h>
 #include <kj/glob-filter.h>
+#include <kj/list.h>
 #include <kj/map.h>
+#include <kj/thread.h>
 
 #include <cstdlib>
 #include <ctime>
@@ -218,6 +228,12 @@ class Server::Service {
   virtual Service* service() {
     return this;
   }
+
+  // Returns the KV namespace this service implements in-process, if it's a KV service, so that
+  // bindings to it can skip HTTP.
+  virtual kj::Maybe<KvClient&> getKvClient() {
+    return kj::none;
+  }
 };
 
 Server::~Server() noexcept {
@@ -597,25 +613,58 @@ class Server::ExternalTcpService final: public Service, private WorkerInterface
 // Service used when the service is configured as external HTTP service.
 class Server::ExternalHttpService final: public Service, private kj::TaskSet::ErrorHandler {
  public:
+  // Settings from the ExternalServer config that HTTP and HTTPS services share.
+  struct Settings {
+    kj::Duration idleTimeout = 5 * kj::SECONDS;
+    // 0 means no limit.
+    uint maxConnections = 0;
+
+    struct Coalescing {
+      kj::Array<kj::HttpHeaderId> keyHeaders;
+      CoalescingHttpService::BypassHeaders bypassHeaders;
+    };
+    kj::Maybe<Coalescing> coalescing;
+  };
+
   ExternalHttpService(kj::Own<kj::NetworkAddress> addrParam,
       kj::Own<HttpRewriter> rewriter,
       kj::HttpHeaderTable& headerTable,
       kj::Timer& timer,
       kj::EntropySource& entropySource,
       capnp::ByteStreamFactory& byteStreamFactory,
-      capnp::HttpOverCapnpFactory& httpOverCapnpFactory)
-      : addr(kj::mv(addrParam)),
+      capnp::HttpOverCapnpFactory& httpOverCapnpFactory,
+      Settings settings)
+      : addr(kj::heap<CountingNetworkAddress>(kj::mv(addrParam), connectionCount)),
         inner(kj::newHttpClient(timer,
             headerTable,
             *addr,
-            {.entropySource = entropySource,
+            {.idleTimeout = settings.idleTimeout,
+              .entropySource = entropySource,
               .webSocketCompressionMode = kj::HttpClientSettings::MANUAL_COMPRESSION})),
-        serviceAdapter(kj::newHttpService(*inner)),
         rewriter(kj::mv(rewriter)),
         headerTable(headerTable),
+        timer(timer),
+        idleTimeout(settings.idleTimeout),
         byteStreamFactory(byteStreamFactory),
         httpOverCapnpFactory(httpOverCapnpFactory),
-        waitUntilTasks(*this) {}
+        waitUntilTasks(*this) {
+    kj::HttpClient* client = inner.get();
+    if (settings.maxConnections > 0) {
+      // Each request in progress holds a connection of its own, so limiting requests limits the
+      // connections the pool ever needs to open.
+      client = limitedClient
+                   .emplace(kj::newConcurrencyLimitingHttpClient(*inner, settings.maxConnections,
+                       [this](uint runningCount, uint pendingCount) {
+        queuedRequestCount = pendingCount;
+      })).get();
+    }
+    serviceAdapter = kj::newHttpService(*client);
+
+    KJ_IF_SOME(coalescing, settings.coalescing) {
+      serviceAdapter = kj::heap<CoalescingHttpService>(kj::mv(serviceAdapter),
+          kj::mv(coalescing.keyHeaders), kj::mv(coalescing.bypassHeaders));
+    }
+  }
 
   kj::Own<WorkerInterface> startRequest(IoChannelFactory::SubrequestMetadata metadata) override {
     return kj::heap<WorkerInterfaceImpl>(*this, kj::mv(metadata));
@@ -626,14 +675,54 @@ class Server::ExternalHttpService final: public Service, private kj::TaskSet::Er
   }
 
  private:
+  // Counts the connections that are opened to the server, so that traces can show how often
+  // requests get to reuse one instead.
+  class CountingNetworkAddress final: public kj::NetworkAddress {
+   public:
+    CountingNetworkAddress(kj::Own<kj::NetworkAddress> inner, uint64_t& count)
+        : inner(kj::mv(inner)),
+          count(count) {}
+
+    kj::Promise<kj::Own<kj::AsyncIoStream>> connect() override {
+      ++count;
+      return inner->connect();
+    }
+    kj::Promise<kj::AuthenticatedStream> connectAuthenticated() override {
+      ++count;
+      return inner->connectAuthenticated();
+    }
+
+    kj::Own<kj::ConnectionReceiver> listen() override {
+      return inner->listen();
+    }
+    kj::Own<kj::NetworkAddress> clone() override {
+      return inner->clone();
+    }
+    kj::String toString() override {
+      return inner->toString();
+    }
+
+   private:
+    kj::Own<kj::NetworkAddress> inner;
+    uint64_t& count;
+  };
+
+  uint64_t requestCount = 0;
+  uint64_t connectionCount = 0;
+  uint queuedRequestCount = 0;
+
   kj::Own<kj::NetworkAddress> addr;
 
   kj::Own<kj::HttpClient> inner;
+  // Wraps `inner` when the number of connections is limited.
+  kj::Maybe<kj::Own<kj::HttpClient>> limitedClient;
   kj::Own<kj::HttpService> serviceAdapter;
 
   kj::Own<HttpRewriter> rewriter;
 
   kj::HttpHeaderTable& headerTable;
+  kj::Timer& timer;
+  kj::Duration idleTimeout;
   capnp::ByteStreamFactory& byteStreamFactory;
   capnp::HttpOverCapnpFactory& httpOverCapnpFactory;
   kj::TaskSet waitUntilTasks;
@@ -657,6 +746,11 @@ class Server::ExternalHttpService final: public Service, private kj::TaskSet::Er
   // This task nulls out `capnpClient` when the connection is lost.
   kj::Promise<void> clearCapnpClientTask = nullptr;
 
+  // Custom events in progress over `capnpClient`, and the task that closes it once there have
+  // been none for `idleTimeout`.
+  uint capnpEventCount = 0;
+  kj::Promise<void> idleCapnpClientTask = nullptr;
+
   // Get an WorkerdBootstrap representing the service on the other end of an HTTP connection. May
   // reuse an existing connection, or form a new one over `client`.
   rpc::WorkerdBootstrap::Client getOutgoingCapnp(kj::HttpClient& client) {
@@ -672,9 +766,8 @@ class Server::ExternalHttpService final: public Service, private kj::TaskSet::Er
     auto& c = capnpClient.emplace(kj::mv(req.connection));
 
     // Arrange that when the connection is lost, we'll null out `capnpClient`. This ensures that
-    // on the next event, we'll attempt to reconnect.
-    //
-    // TODO(perf): Time out idle connections?
+    // on the next event, we'll attempt to reconnect. Canceling this task does the same, which is
+    // how idle connections are closed.
     clearCapnpClientTask =
         c.rpcSystem.onDisconnect().attach(kj::defer([this]() {
       capnpClient = kj::none;
@@ -683,6 +776,19 @@ class Server::ExternalHttpService final: public Service, private kj::TaskSet::Er
     return c.rpcSystem.bootstrap().castAs<rpc::WorkerdBootstrap>();
   }
 
+  void capnpEventStarted() {
+    ++capnpEventCount;
+    idleCapnpClientTask = nullptr;
+  }
+
+  void capnpEventFinished() {
+    if (--capnpEventCount == 0 && capnpClient != kj::none) {
+      idleCapnpClientTask = timer.afterDelay(idleTimeout).then([this]() {
+        clearCapnpClientTask = nullptr;
+      }).eagerlyEvaluate(nullptr);
+    }
+  }
+
   class WorkerInterfaceImpl final: public WorkerInterface, private kj::HttpService::Response {
    public:
     WorkerInterfaceImpl(ExternalHttpService& parent, IoChannelFactory::SubrequestMetadata metadata)
@@ -694,7 +800,10 @@ class Server::ExternalHttpService final: public Service, private kj::TaskSet::Er
         const kj::HttpHeaders& headers,
         kj::AsyncInputStream& requestBody,
         kj::HttpService::Response& response) override {
-      TRACE_EVENT("workerd", "ExternalHttpServer::request()");
+      ++parent.requestCount;
+      TRACE_EVENT("workerd", "ExternalHttpServer::request()", "requests", parent.requestCount,
+          "connectionsOpened", parent.connectionCount, "queuedRequests",
+          parent.queuedRequestCount);
       KJ_REQUIRE(wrappedResponse == kj::none, "object should only receive one request");
       wrappedResponse = response;
       if (parent.rewriter->needsRewriteRequest()) {
@@ -730,9 +839,10 @@ class Server::ExternalHttpService final: public Service, private kj::TaskSet::Er
       auto bootstrap = parent.getOutgoingCapnp(*parent.inner);
       auto dispatcher =
           bootstrap.startEventRequest(capnp::MessageSize{4, 0}).send().getDispatcher();
+      parent.capnpEventStarted();
       return event
           ->sendRpc(parent.httpOverCapnpFactory, parent.byteStreamFactory, kj::mv(dispatcher))
-          .attach(kj::mv(event));
+          .attach(kj::mv(event), kj::defer([&parent = parent]() { parent.capnpEventFinished(); }));
     }
 
    private:
@@ -792,6 +902,26 @@ kj::Own<Server::Service> Server::makeExternalService(kj::StringPtr name,
     return makeInvalidConfigService();
   }
 
+  ExternalHttpService::Settings httpSettings;
+  if (conf.isTcp() && (conf.hasConnectionPool() || conf.hasRequestCoalescing())) {
+    reportConfigError(kj::str("External service \"", name,
+        "\" sets connectionPool or requestCoalescing, which only apply to HTTP and HTTPS "
+        "services."));
+  }
+  auto pool = conf.getConnectionPool();
+  httpSettings.idleTimeout = pool.getIdleTimeoutMillis() * kj::MILLISECONDS;
+  httpSettings.maxConnections = pool.getMaxConnections();
+  if (conf.hasRequestCoalescing()) {
+    // Like the rewriter's, the IDs of the headers that coalesced requests must agree on, or that
+    // keep them from being coalesced, have to be registered upfront.
+    httpSettings.coalescing = ExternalHttpService::Settings::Coalescing{
+      .keyHeaders = KJ_MAP(headerName, conf.getRequestCoalescing().getKeyHeaders()) {
+        return headerTableBuilder.add(headerName);
+      },
+      .bypassHeaders = CoalescingHttpService::BypassHeaders(headerTableBuilder),
+    };
+  }
+
   switch (conf.which()) {
     case config::ExternalServer::HTTP: {
       // We have to construct the rewriter upfront before waiting on any promises, since the
@@ -800,7 +930,8 @@ kj::Own<Server::Service> Server::makeExternalService(kj::StringPtr name,
       auto addr = kj::heap<PromisedNetworkAddress>(network.parseAddress(addrStr, 80));
       return kj::heap<ExternalHttpService>(kj::mv(addr), kj::mv(rewriter),
           headerTableBuilder.getFutureTable(), timer, entropySource,
-          globalContext->byteStreamFactory, globalContext->httpOverCapnpFactory);
+          globalContext->byteStreamFactory, globalContext->httpOverCapnpFactory,
+          kj::mv(httpSettings));
     }
     case config::ExternalServer::HTTPS: {
       auto httpsConf = conf.getHttps();
@@ -813,7 +944,8 @@ kj::Own<Server::Service> Server::makeExternalService(kj::StringPtr name,
           makeTlsNetworkAddress(httpsConf.getTlsOptions(), addrStr, certificateHost, 443));
       return kj::heap<ExternalHttpService>(kj::mv(addr), kj::mv(rewriter),
           headerTableBuilder.getFutureTable(), timer, entropySource,
-          globalContext->byteStreamFactory, globalContext->httpOverCapnpFactory);
+          globalContext->byteStreamFactory, globalContext->httpOverCapnpFactory,
+          kj::mv(httpSettings));
     }
     case config::ExternalServer::TCP: {
       auto tcpConf = conf.getTcp();
@@ -932,19 +1064,38 @@ class Server::DiskDirectoryService final: public Service, private WorkerInterfac
  public:
   DiskDirectoryService(config::DiskDirectory::Reader conf,
       kj::Own<const kj::Directory> dir,
-      kj::HttpHeaderTable::Builder& headerTableBuilder)
+      kj::HttpHeaderTable::Builder& headerTableBuilder,
+      kj::EntropySource& entropySource,
+      kj::Timer& timer)
       : writable(*dir),
         readable(kj::mv(dir)),
         headerTable(headerTableBuilder.getFutureTable()),
-        hLastModified(headerTableBuilder.add("Last-Modified")),
-        allowDotfiles(conf.getAllowDotfiles()) {}
+        headerIds(headerTableBuilder),
+        entropySource(entropySource),
+        allowDotfiles(conf.getAllowDotfiles()),
+        servePrecompressed(conf.getServePrecompressed()),
+        openFileCacheSize(conf.getOpenFileCacheSize()) {
+    if (conf.getDurableObjectGroupCommitMillis() > 0) {
+      groupCommit = kj::heap<SqliteGroupCommit>(timer,
+          conf.getDurableObjectGroupCommitMillis() * kj::MILLISECONDS,
+          KJ_ASSERT_NONNULL(writable).getFd());
+    }
+  }
   DiskDirectoryService(config::DiskDirectory::Reader conf,
       kj::Own<const kj::ReadableDirectory> dir,
-      kj::HttpHeaderTable::Builder& headerTableBuilder)
+      kj::HttpHeaderTable::Builder& headerTableBuilder,
+      kj::EntropySource& entropySource)
       : readable(kj::mv(dir)),
         headerTable(headerTableBuilder.getFutureTable()),
-        hLastModified(headerTableBuilder.add("Last-Modified")),
-        allowDotfiles(conf.getAllowDotfiles()) {}
+        headerIds(headerTableBuilder),
+        entropySource(entropySource),
+        allowDotfiles(conf.getAllowDotfiles()),
+        servePrecompressed(conf.getServePrecompressed()),
+        openFileCacheSize(conf.getOpenFileCacheSize()) {}
+
+  ~DiskDirectoryService() noexcept(false) {
+    while (!openFileLru.empty()) openFileLru.remove(openFileLru.front());
+  }
 
   kj::Own<WorkerInterface> startRequest(IoChannelFactory::SubrequestMetadata metadata) override {
     return {this, kj::NullDisposer::instance};
@@ -954,16 +1105,416 @@ class Server::DiskDirectoryService final: public Service, private WorkerInterfac
     return writable;
   }
 
+  // Shared by all Durable Objects stored in this directory, if group commit is enabled.
+  kj::Maybe<SqliteGroupCommit&> getGroupCommit() {
+    return groupCommit;
+  }
+
   bool hasHandler(kj::StringPtr handlerName) override {
     return handlerName == "fetch"_kj;
   }
 
  private:
+  // A multi-range request is answered with the whole file instead if it asks for more ranges than
+  // this, or for more bytes in total than the file has.
+  static constexpr size_t MAX_RANGES = 16;
+
+  // Precompressed siblings looked for when `servePrecompressed` is set, most preferred first.
+  struct PrecompressedVariant {
+    kj::StringPtr coding;
+    kj::StringPtr extension;
+  };
+  static constexpr PrecompressedVariant PRECOMPRESSED_VARIANTS[] = {
+    {"br"_kj, ".br"_kj},
+    {"gzip"_kj, ".gz"_kj},
+  };
+
+  struct HeaderIds {
+    kj::HttpHeaderId lastModified;
+    kj::HttpHeaderId etag;
+    kj::HttpHeaderId vary;
+    kj::HttpHeaderId acceptEncoding;
+    kj::HttpHeaderId contentEncoding;
+    kj::HttpHeaderId ifModifiedSince;
+    kj::HttpHeaderId ifNoneMatch;
+    kj::HttpHeaderId ifRange;
+
+    explicit HeaderIds(kj::HttpHeaderTable::Builder& builder)
+        : lastModified(builder.add("Last-Modified")),
+          etag(builder.add("ETag")),
+          vary(builder.add("Vary")),
+          acceptEncoding(builder.add("Accept-Encoding")),
+          contentEncoding(builder.add("Content-Encoding")),
+          ifModifiedSince(builder.add("If-Modified-Since")),
+          ifNoneMatch(builder.add("If-None-Match")),
+          ifRange(builder.add("If-Range")) {}
+  };
+
+  // A file kept open and memory-mapped by the open-file cache, along with the metadata it had when
+  // it was opened. Responses hold their own reference while writing it out, so the file can be
+  // evicted or replaced in the meantime.
+  struct CachedFile: public kj::Refcounted {
+    kj::String path;
+    kj::FsNode::Metadata metadata;
+    kj::Own<const kj::ReadableFile> file;
+
+    // `metadata.size` bytes of `file`. Only read while `file` still matches `metadata`, see
+    // writeFileRange().
+    kj::Array<const kj::byte> mapping;
+
+    // Link in `openFileLru`, while the file is in `openFiles`.
+    kj::ListLink<CachedFile> link;
+  };
+
+  // A regular file that a HEAD request only needed to stat(), without opening it.
+  struct StatOnly {};
+
+  // The bytes of a file being served: either a file from the open-file cache, or a file opened
+  // just for this request.
+  using FileContent = kj::OneOf<kj::Own<CachedFile>, kj::Own<const kj::ReadableFile>, StatOnly>;
+
   kj::Maybe<const kj::Directory&> writable;
   kj::Own<const kj::ReadableDirectory> readable;
   kj::HttpHeaderTable& headerTable;
-  kj::HttpHeaderId hLastModified;
+  HeaderIds headerIds;
+  kj::EntropySource& entropySource;
   bool allowDotfiles;
+  bool servePrecompressed;
+  kj::Maybe<kj::Own<SqliteGroupCommit>> groupCommit;
+
+  // The open-file cache, if `openFileCacheSize` is non-zero. Keys point into the files themselves.
+  uint openFileCacheSize;
+  kj::HashMap<kj::StringPtr, kj::Own<CachedFile>> openFiles;
+
+  // Least recently served files first.
+  kj::List<CachedFile, &CachedFile::link> openFileLru;
+
+  // Whether `a` and `b` describe the same version of the same file, as far as we can tell.
+  static bool isSameFile(const kj::FsNode::Metadata& a, const kj::FsNode::Metadata& b) {
+    return a.size == b.size && a.lastModified == b.lastModified && a.hashCode == b.hashCode;
+  }
+
+  // Returns the regular file at `path` from the open-file cache, opening it and adding it to the
+  // cache if it isn't there or has changed since it was opened. Returns none for anything that
+  // isn't a regular file, leaving it to the uncached path to deal with. Symlinks aren't cached,
+  // since we can't tell when their target changes without opening them.
+  kj::Maybe<kj::Own<CachedFile>> openCachedFile(const kj::Path& path) {
+    auto key = path.toString();
+    auto meta = KJ_UNWRAP_OR(readable->tryLstat(path), {
+      evictCachedFile(key);
+      return kj::none;
+    });
+    if (meta.type != kj::FsNode::Type::FILE) {
+      evictCachedFile(key);
+      return kj::none;
+    }
+
+    KJ_IF_SOME(cached, openFiles.find(key)) {
+      if (isSameFile(cached->metadata, meta)) {
+        openFileLru.remove(*cached);
+        openFileLru.add(*cached);
+        return kj::addRef(*cached);
+      }
+      evictCachedFile(key);
+    }
+
+    auto file = KJ_UNWRAP_OR(readable->tryOpenFile(path), return kj::none);
+    // The file may have been replaced since we looked, so remember what we actually opened.
+    meta = file->stat();
+    if (meta.type != kj::FsNode::Type::FILE) return kj::none;
+
+    auto cached = kj::refcounted<CachedFile>();
+    cached->path = kj::mv(key);
+    cached->metadata = meta;
+    if (meta.size > 0) cached->mapping = file->mmap(0, meta.size);
+    cached->file = kj::mv(file);
+
+    if (openFiles.size() >= openFileCacheSize) {
+      auto& oldest = openFileLru.front();
+      evictCachedFile(oldest.path);
+    }
+    openFileLru.add(*cached);
+    auto result = kj::addRef(*cached);
+    openFiles.insert(result->path, kj::mv(cached));
+    return kj::mv(result);
+  }
+
+  void evictCachedFile(kj::StringPtr path) {
+    KJ_IF_SOME(cached, openFiles.find(path)) {
+      openFileLru.remove(*cached);
+      // Erasing destroys the key that `path` may point into, so copy it first.
+      auto key = kj::str(path);
+      openFiles.erase(key);
+    }
+  }
+
+  // Opens the regular file at `path` for serving, from the open-file cache if it's enabled and
+  // the file is going to be read. Returns none if there's no regular file there.
+  kj::Maybe<FileContent> tryOpenRegularFile(
+      kj::HttpMethod method, const kj::Path& path, kj::FsNode::Metadata& meta) {
+    if (method == kj::HttpMethod::HEAD) {
+      KJ_IF_SOME(m, tryStatRegularFile(path)) {
+        meta = m;
+        return FileContent(StatOnly());
+      }
+    } else if (openFileCacheSize > 0) {
+      KJ_IF_SOME(cached, openCachedFile(path)) {
+        meta = cached->metadata;
+        return FileContent(kj::mv(cached));
+      }
+    }
+
+    auto file = KJ_UNWRAP_OR(readable->tryOpenFile(path), return kj::none);
+    meta = file->stat();
+    if (meta.type != kj::FsNode::Type::FILE) return kj::none;
+    return FileContent(kj::mv(file));
+  }
+
+  // Returns the metadata of the regular file at `path`, without opening it. Returns none for
+  // anything else, including symlinks, which can't be followed without opening them.
+  kj::Maybe<kj::FsNode::Metadata> tryStatRegularFile(const kj::Path& path) {
+    KJ_IF_SOME(meta, readable->tryLstat(path)) {
+      if (meta.type == kj::FsNode::Type::FILE) return meta;
+    }
+    return kj::none;
+  }
+
+  static const kj::ReadableFile& getFile(FileContent& content) {
+    KJ_SWITCH_ONEOF(content) {
+      KJ_CASE_ONEOF(cached, kj::Own<CachedFile>) {
+        return *cached->file;
+      }
+      KJ_CASE_ONEOF(file, kj::Own<const kj::ReadableFile>) {
+        return *file;
+      }
+      KJ_CASE_ONEOF(_, StatOnly) {
+        KJ_FAIL_REQUIRE("file was not opened");
+      }
+    }
+    KJ_UNREACHABLE;
+  }
+
+  // Returns the ETag of a file with the given metadata. It's derived from the modification time and
+  // size, like nginx does, rather than from the contents, so that neither the first request for a
+  // file nor a HEAD request has to read it. The inode is left out so that copies of a directory
+  // deployed to several machines agree on their ETags.
+  static kj::String computeETag(const kj::FsNode::Metadata& meta) {
+    uint64_t modified = (meta.lastModified - kj::UNIX_EPOCH) / kj::NANOSECONDS;
+    return kj::str('"', kj::hex(modified), '-', kj::hex(meta.size), '"');
+  }
+
+  // Returns whether `acceptEncoding`, the value of an `Accept-Encoding` header, allows the given
+  // content coding, i.e. lists it, or lists `*` without listing it, with a non-zero quality.
+  static bool acceptsEncoding(kj::StringPtr acceptEncoding, kj::StringPtr coding) {
+    kj::Maybe<bool> listed;
+    kj::Maybe<bool> wildcard;
+    forEachListElement(acceptEncoding, [&](kj::ArrayPtr<const char> element) {
+      size_t nameEnd = 0;
+      while (nameEnd < element.size() && element[nameEnd] != ';') ++nameEnd;
+      auto name = toLower(trimLeadingAndTrailingWhitespace(element.first(nameEnd)));
+
+      bool allowed = true;
+      auto params = element.slice(nameEnd);
+      while (params.size() > 0) {
+        params = params.slice(1);  // skip the ';'
+        size_t end = 0;
+        while (end < params.size() && params[end] != ';') ++end;
+        auto param = trimLeadingAndTrailingWhitespace(params.first(end));
+        if (param.size() >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+          // A quality of zero, however it's spelled, means "not acceptable".
+          allowed = false;
+          for (char c: param.slice(2)) {
+            if (c != '0' && c != '.') allowed = true;
+          }
+        }
+        params = params.slice(end);
+      }
+
+      if (name == coding) {
+        listed = allowed;
+      } else if (name == "*") {
+        wildcard = allowed;
+      }
+    });
+    return listed.orDefault(wildcard.orDefault(false));
+  }
+
+  // Whether a GET or HEAD with these headers can be answered with 304 Not Modified.
+  bool isNotModified(
+      const kj::HttpHeaders& requestHeaders, kj::StringPtr etag, kj::Date lastModified) {
+    // If-None-Match takes precedence over If-Modified-Since when both are present.
+    KJ_IF_SOME(ifNoneMatch, requestHeaders.get(headerIds.ifNoneMatch)) {
+      bool matched = false;
+      forEachListElement(ifNoneMatch, [&](kj::ArrayPtr<const char> tag) {
+        if (tag == "*"_kj.asArray() || etagMatches(tag, etag.asArray())) matched = true;
+      });
+      return matched;
+    }
+
+    KJ_IF_SOME(ifModifiedSince, requestHeaders.get(headerIds.ifModifiedSince)) {
+      KJ_IF_SOME(since, parseHttpDate(ifModifiedSince)) {
+        // Last-Modified only has a resolution of seconds.
+        return lastModified - since < 1 * kj::SECONDS;
+      }
+    }
+
+    return false;
+  }
+
+  // Whether a Range request should be honored given its If-Range header, if any, which must match
+  // the current ETag exactly, or the current Last-Modified date.
+  bool isRangeCurrent(
+      const kj::HttpHeaders& requestHeaders, kj::StringPtr etag, kj::StringPtr lastModified) {
+    auto ifRange = KJ_UNWRAP_OR(requestHeaders.get(headerIds.ifRange), return true);
+    if (ifRange.startsWith("\"") || ifRange.startsWith("W/")) {
+      // Weak ETags never match here.
+      return ifRange == etag;
+    }
+    return ifRange == lastModified;
+  }
+
+  // Cached files are written from their mapping in chunks of this size.
+  static constexpr size_t MAPPED_CHUNK_SIZE = 64 * 1024;
+
+  // Writes `size` bytes of `content`, starting at `start`, to `out`.
+  //
+  // Cached files are written straight from their mapping, without copying them into a buffer of
+  // our own first. Reading a mapping past the end of its file raises SIGBUS, though, so before each
+  // chunk the open file is stat()ed again, and as soon as its size or modification time differs
+  // from when it was mapped, the rest is read with positional reads instead. A file truncated in
+  // place then only cuts the response short.
+  static kj::Promise<void> writeFileRange(
+      kj::AsyncOutputStream& out, FileContent& content, uint64_t start, uint64_t size) {
+    KJ_IF_SOME(cached, content.tryGet<kj::Own<CachedFile>>()) {
+      uint64_t end = start + size;
+      while (start < end) {
+        auto meta = cached->file->stat();
+        if (!isSameFile(meta, cached->metadata)) break;
+        uint64_t chunkEnd = kj::min(end, start + MAPPED_CHUNK_SIZE);
+        co_await out.write(cached->mapping.slice(start, chunkEnd));
+        start = chunkEnd;
+      }
+      size = end - start;
+      if (size == 0) co_return;
+    }
+
+    kj::FileInputStream in(getFile(content), start);
+    co_await in.pumpTo(out, size);
+  }
+
+  // Sends a file with the given metadata and content. `encoding` is its content coding, if it's a
+  // precompressed variant.
+  kj::Promise<void> sendFile(kj::HttpMethod method,
+      const kj::HttpHeaders& requestHeaders,
+      kj::HttpService::Response& response,
+      kj::FsNode::Metadata meta,
+      FileContent content,
+      kj::Maybe<kj::StringPtr> encoding = kj::none) {
+    auto etag = computeETag(meta);
+    auto lastModified = httpTime(meta.lastModified);
+
+    kj::HttpHeaders headers(headerTable);
+    headers.set(kj::HttpHeaderId::CONTENT_TYPE, MimeType::OCTET_STREAM.toString());
+    headers.set(headerIds.lastModified, lastModified);
+    headers.set(headerIds.etag, etag);
+    if (servePrecompressed) {
+      headers.set(headerIds.vary, "Accept-Encoding");
+    }
+    KJ_IF_SOME(e, encoding) {
+      headers.set(headerIds.contentEncoding, e);
+    }
+
+    if (isNotModified(requestHeaders, etag, meta.lastModified)) {
+      response.send(304, "Not Modified", headers, uint64_t(0));
+      co_return;
+    }
+
+    // If this is a GET request with a Range header, return partial content if the ranges are
+    // satisfiable.
+    kj::Array<kj::HttpByteRange> ranges;
+    if (method == kj::HttpMethod::GET && isRangeCurrent(requestHeaders, etag, lastModified)) {
+      KJ_IF_SOME(header, requestHeaders.get(kj::HttpHeaderId::RANGE)) {
+        KJ_SWITCH_ONEOF(kj::tryParseHttpRangeHeader(header.asArray(), meta.size)) {
+          KJ_CASE_ONEOF(parsed, kj::Array<kj::HttpByteRange>) {
+            KJ_ASSERT(parsed.size() > 0);
+            uint64_t total = 0;
+            for (auto& r: parsed) {
+              KJ_ASSERT(r.start <= r.end);
+              total += r.end - r.start + 1;
+            }
+            // Lots of ranges, or ranges that overlap enough to add up to more than the file, cost
+            // more to send than the file itself. Sending the whole file instead is allowed.
+            if (parsed.size() == 1 || (parsed.size() <= MAX_RANGES && total <= meta.size)) {
+              ranges = kj::mv(parsed);
+            }
+          }
+          KJ_CASE_ONEOF(_, kj::HttpEverythingRange) {}
+          KJ_CASE_ONEOF(_, kj::HttpUnsatisfiableRange) {
+            kj::HttpHeaders errorHeaders(headerTable);
+            errorHeaders.set(kj::HttpHeaderId::CONTENT_RANGE, kj::str("bytes */", meta.size));
+            co_return co_await response.sendError(416, "Range Not Satisfiable", errorHeaders);
+          }
+        }
+      }
+    }
+
+    // We explicitly set the Content-Length header because if we don't, and we were called
+    // by a local Worker (without an actual HTTP connection in between), then the Worker
+    // will not see a Content-Length header, but being able to query the content length
+    // (especially with HEAD requests) is quite useful.
+    // TODO(cleanup): Arguably the implementation of `fetch()` should be adjusted so that
+    //   if no `Content-Length` header is returned, but the body size is known via the KJ
+    //   HTTP API, then the header should be filled in automatically. Unclear if this is safe
+    //   to change without a compat flag.
+
+    if (method == kj::HttpMethod::HEAD) {
+      headers.set(kj::HttpHeaderId::CONTENT_LENGTH, kj::str(meta.size));
+      response.send(200, "OK", headers, meta.size);
+      co_return;
+    } else if (ranges.size() == 1) {
+      auto& r = ranges[0];
+      auto rangeSize = r.end - r.start + 1;
+      headers.set(kj::HttpHeaderId::CONTENT_LENGTH, kj::str(rangeSize));
+      headers.set(kj::HttpHeaderId::CONTENT_RANGE,
+          kj::str("bytes ", r.start, "-", r.end, "/", meta.size));
+      auto out = response.send(206, "Partial Content", headers, rangeSize);
+
+      co_return co_await writeFileRange(*out, content, r.start, rangeSize);
+    } else if (ranges.size() > 1) {
+      kj::byte random[16];
+      entropySource.generate(random);
+      auto boundary = kj::encodeHex(random);
+
+      auto partHeaders = KJ_MAP(r, ranges) {
+        return kj::str("--", boundary, "\r\nContent-Type: ", MimeType::OCTET_STREAM.toString(),
+            "\r\nContent-Range: bytes ", r.start, "-", r.end, "/", meta.size, "\r\n\r\n");
+      };
+      auto trailer = kj::str("--", boundary, "--\r\n");
+
+      uint64_t length = trailer.size();
+      for (auto i: kj::indices(ranges)) {
+        length += partHeaders[i].size() + (ranges[i].end - ranges[i].start + 1) + 2;
+      }
+
+      headers.set(
+          kj::HttpHeaderId::CONTENT_TYPE, kj::str("multipart/byteranges; boundary=", boundary));
+      headers.set(kj::HttpHeaderId::CONTENT_LENGTH, kj::str(length));
+      auto out = response.send(206, "Partial Content", headers, length);
+
+      for (auto i: kj::indices(ranges)) {
+        auto& r = ranges[i];
+        co_await out->write(partHeaders[i].asBytes());
+        co_await writeFileRange(*out, content, r.start, r.end - r.start + 1);
+        co_await out->write("\r\n"_kjb);
+      }
+      co_return co_await out->write(trailer.asBytes());
+    } else {
+      headers.set(kj::HttpHeaderId::CONTENT_LENGTH, kj::str(meta.size));
+      auto out = response.send(200, "OK", headers, meta.size);
+
+      co_return co_await writeFileRange(*out, content, 0, meta.size);
+    }
+  }
 
   kj::Promise<void> request(kj::HttpMethod method,
       kj::StringPtr urlStr,
@@ -996,6 +1547,33 @@ class Server::DiskDirectoryService final: public Service, private WorkerInterfac
         co_return co_await response.sendError(404, "Not Found", headerTable);
       }
 
+      if (servePrecompressed && path.size() > 0) {
+        KJ_IF_SOME(acceptEncoding, requestHeaders.get(headerIds.acceptEncoding)) {
+          for (auto& variant: PRECOMPRESSED_VARIANTS) {
+            if (!acceptsEncoding(acceptEncoding, variant.coding)) continue;
+            auto variantPath = path.parent().append(kj::str(path.basename()[0], variant.extension));
+            kj::FsNode::Metadata meta;
+            KJ_IF_SOME(content, tryOpenRegularFile(method, variantPath, meta)) {
+              co_return co_await sendFile(method, requestHeaders, response, meta,
+                  kj::mv(content), variant.coding);
+            }
+          }
+        }
+      }
+
+      // HEAD requests for regular files only need to stat() them. Anything else, including a
+      // symlink, is opened below.
+      if (method == kj::HttpMethod::HEAD) {
+        KJ_IF_SOME(meta, tryStatRegularFile(path)) {
+          co_return co_await sendFile(method, requestHeaders, response, meta, StatOnly());
+        }
+      } else if (openFileCacheSize > 0) {
+        KJ_IF_SOME(cached, openCachedFile(path)) {
+          auto meta = cached->metadata;
+          co_return co_await sendFile(method, requestHeaders, response, meta, kj::mv(cached));
+        }
+      }
+
       auto file = KJ_UNWRAP_OR(readable->tryOpenFile(path),
           { co_return co_await response.sendError(404, "Not Found", headerTable); });
 
@@ -1003,61 +1581,7 @@ class Server::DiskDirectoryService final: public Service, private WorkerInterfac
 
       switch (meta.type) {
         case kj::FsNode::Type::FILE: {
-          // If this is a GET request with a Range header, return partial content if a single
-          // satisfiable range is specified.
-          // TODO(someday): consider supporting multiple ranges with multipart/byteranges
-          kj::Maybe<kj::HttpByteRange> range;
-          if (method == kj::HttpMethod::GET) {
-            KJ_IF_SOME(header, requestHeaders.get(kj::HttpHeaderId::RANGE)) {
-              KJ_SWITCH_ONEOF(kj::tryParseHttpRangeHeader(header.asArray(), meta.size)) {
-                KJ_CASE_ONEOF(ranges, kj::Array<kj::HttpByteRange>) {
-                  KJ_ASSERT(ranges.size() > 0);
-                  if (ranges.size() == 1) range = ranges[0];
-                }
-                KJ_CASE_ONEOF(_, kj::HttpEverythingRange) {}
-                KJ_CASE_ONEOF(_, kj::HttpUnsatisfiableRange) {
-                  kj::HttpHeaders headers(headerTable);
-                  headers.set(kj::HttpHeaderId::CONTENT_RANGE, kj::str("bytes */", meta.size));
-                  co_return co_await response.sendError(416, "Range Not Satisfiable", headers);
-                }
-              }
-            }
-          }
-
-          kj::HttpHeaders headers(headerTable);
-          headers.set(kj::HttpHeaderId::CONTENT_TYPE, MimeType::OCTET_STREAM.toString());
-          headers.set(hLastModified, httpTime(meta.lastModified));
-
-          // We explicitly set the Content-Length header because if we don't, and we were called
-          // by a local Worker (without an actual HTTP connection in between), then the Worker
-          // will not see a Content-Length header, but being able to query the content length
-          // (especially with HEAD requests) is quite useful.
-          // TODO(cleanup): Arguably the implementation of `fetch()` should be adjusted so that
-          //   if no `Content-Length` header is returned, but the body size is known via the KJ
-          //   HTTP API, then the header should be filled in automatically. Unclear if this is safe
-          //   to change without a compat flag.
-
-          if (method == kj::HttpMethod::HEAD) {
-            headers.set(kj::HttpHeaderId::CONTENT_LENGTH, kj::str(meta.size));
-            response.send(200, "OK", headers, meta.size);
-            co_return;
-          } else KJ_IF_SOME(r, range) {
-            KJ_ASSERT(r.start <= r.end);
-            auto rangeSize = r.end - r.start + 1;
-            headers.set(kj::HttpHeaderId::CONTENT_LENGTH, kj::str(rangeSize));
-            headers.set(kj::HttpHeaderId::CONTENT_RANGE,
-                kj::str("bytes ", r.start, "-", r.end, "/", meta.size));
-            auto out = response.send(206, "Partial Content", headers, rangeSize);
-
-            auto in = kj::heap<kj::FileInputStream>(*file, r.start);
-            co_return co_await in->pumpTo(*out, rangeSize).ignoreResult();
-          } else {
-            headers.set(kj::HttpHeaderId::CONTENT_LENGTH, kj::str(meta.size));
-            auto out = response.send(200, "OK", headers, meta.size);
-
-            auto in = kj::heap<kj::FileInputStream>(*file);
-            co_return co_await in->pumpTo(*out, meta.size).ignoreResult();
-          }
+          co_return co_await sendFile(method, requestHeaders, response, meta, kj::mv(file));
         }
         case kj::FsNode::Type::DIRECTORY: {
           // Whoooops, we opened a directory. Back up and start over.
@@ -1066,7 +1590,7 @@ class Server::DiskDirectoryService final: public Service, private WorkerInterfac
 
           kj::HttpHeaders headers(headerTable);
           headers.set(kj::HttpHeaderId::CONTENT_TYPE, MimeType::JSON.toString());
-          headers.set(hLastModified, httpTime(meta.lastModified));
+          headers.set(headerIds.lastModified, httpTime(meta.lastModified));
 
           // We intentionally don't provide the expected size here in order to reserve the right
           // to switch to streaming directory listing in the future.
@@ -1214,15 +1738,357 @@ kj::Own<Server::Service> Server::makeDiskDirectoryService(kj::StringPtr name,
       return makeInvalidConfigService();
     });
 
-    return kj::heap<DiskDirectoryService>(conf, kj::mv(openDir), headerTableBuilder);
+    return kj::heap<DiskDirectoryService>(
+        conf, kj::mv(openDir), headerTableBuilder, entropySource, timer);
   } else {
     auto openDir = KJ_UNWRAP_OR(fs.getRoot().tryOpenSubdir(kj::mv(path)), {
       reportConfigError(kj::str("Directory named \"", name, "\" not found: ", pathStr));
       return makeInvalidConfigService();
     });
 
-    return kj::heap<DiskDirectoryService>(conf, kj::mv(openDir), headerTableBuilder);
+    return kj::heap<DiskDirectoryService>(conf, kj::mv(openDir), headerTableBuilder, entropySource);
+  }
+}
+
+// Service used when the service is configured as an in-process cache.
+class Server::CacheStorageService final: public Service, private WorkerInterface {
+ public:
+  // Returns the directory to spill to. Called from link(), once all services exist.
+  using LinkCallback = kj::Function<kj::Maybe<const kj::Directory&>()>;
+
+  CacheStorageService(kj::HttpHeaderTable::Builder& headerTableBuilder,
+      LocalCache::Options options,
+      kj::Maybe<LinkCallback> linkCallback)
+      : cache(kj::systemPreciseCalendarClock(), headerTableBuilder, options),
+        linkCallback(kj::mv(linkCallback)) {}
+
+  void link() override {
+    KJ_IF_SOME(callback, linkCallback) {
+      KJ_IF_SOME(dir, callback()) {
+        cache.enableDiskTier(dir);
+      }
+      linkCallback = kj::none;
+    }
+  }
+
+  kj::Own<WorkerInterface> startRequest(IoChannelFactory::SubrequestMetadata metadata) override {
+    return {this, kj::NullDisposer::instance};
+  }
+
+  bool hasHandler(kj::StringPtr handlerName) override {
+    return handlerName == "fetch"_kj;
+  }
+
+ private:
+  LocalCache cache;
+  kj::Maybe<LinkCallback> linkCallback;
+
+  kj::Promise<void> request(kj::HttpMethod method,
+      kj::StringPtr url,
+      const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody,
+      kj::HttpService::Response& response) override {
+    TRACE_EVENT("workerd", "CacheStorageService::request()", "url", url.cStr());
+    return cache.request(method, url, headers, requestBody, response);
+  }
+
+  kj::Promise<void> connect(kj::StringPtr host,
+      const kj::HttpHeaders& headers,
+      kj::AsyncIoStream& connection,
+      kj::HttpService::ConnectResponse& response,
+      kj::HttpConnectSettings settings) override {
+    throwUnsupported();
+  }
+  kj::Promise<void> prewarm(kj::StringPtr url) override {
+    return kj::READY_NOW;
+  }
+  kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime, kj::StringPtr cron) override {
+    throwUnsupported();
+  }
+  kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime, uint32_t retryCount) override {
+    throwUnsupported();
+  }
+  kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+    return event->notSupported();
+  }
+
+  [[noreturn]] void throwUnsupported() {
+    JSG_FAIL_REQUIRE(Error, "Cache services don't support this event type.");
+  }
+};
+
+kj::Own<Server::Service> Server::makeCacheStorageService(kj::StringPtr name,
+    config::CacheStorage::Reader conf,
+    kj::HttpHeaderTable::Builder& headerTableBuilder) {
+  TRACE_EVENT("workerd", "Server::makeCacheStorageService()");
+  if (!experimental) {
+    reportConfigError(kj::str("Cache service \"", name,
+        "\" uses an experimental feature which may change or go away in the future. You must run "
+        "workerd with `--experimental` to use this feature."));
+  }
+
+  LocalCache::Options options{
+    .memoryLimitBytes = conf.getMemoryLimitBytes(),
+    .diskLimitBytes = conf.getDiskLimitBytes(),
+    .maxObjectBytes = conf.getMaxObjectBytes(),
+  };
+
+  kj::Maybe<CacheStorageService::LinkCallback> linkCallback;
+  if (conf.hasDisk()) {
+    linkCallback = [this, name = kj::str(name), diskName = kj::str(conf.getDisk())]() {
+      return lookupWritableDisk(name, "cache", diskName);
+    };
+  }
+
+  return kj::heap<CacheStorageService>(headerTableBuilder, options, kj::mv(linkCallback));
+}
+
+// Service used when the service is configured as an in-process KV namespace.
+class Server::KvStorageService final: public Service, private WorkerInterface {
+ public:
+  // Returns the directory to keep the database in, or none to keep it in memory. Called from
+  // link(), once all services exist.
+  using LinkCallback = kj::Function<kj::Maybe<const kj::Directory&>()>;
+
+  KvStorageService(kj::Timer& timer,
+      kj::HttpHeaderTable::Builder& headerTableBuilder,
+      kj::Path path,
+      kj::Maybe<LinkCallback> linkCallback)
+      : path(kj::mv(path)),
+        linkCallback(kj::mv(linkCallback)),
+        kv(kj::systemPreciseCalendarClock(), timer, headerTableBuilder) {}
+
+  void link() override {
+    const kj::Directory* dir = nullptr;
+    KJ_IF_SOME(callback, linkCallback) {
+      KJ_IF_SOME(d, callback()) {
+        dir = &d;
+      }
+      linkCallback = kj::none;
+    }
+    if (dir == nullptr) {
+      dir = ownDir.emplace(kj::newInMemoryDirectory(kj::systemPreciseCalendarClock())).get();
+    }
+
+    auto& ownVfs = vfs.emplace(kj::heap<SqliteDatabase::Vfs>(*dir));
+    kv.open(*ownVfs, kj::mv(path));
+  }
+
+  kj::Own<WorkerInterface> startRequest(IoChannelFactory::SubrequestMetadata metadata) override {
+    return {this, kj::NullDisposer::instance};
+  }
+
+  bool hasHandler(kj::StringPtr handlerName) override {
+    return handlerName == "fetch"_kj;
+  }
+
+  kj::Maybe<KvClient&> getKvClient() override {
+    return kv;
+  }
+
+ private:
+  kj::Path path;
+  kj::Maybe<LinkCallback> linkCallback;
+
+  // The database must be closed before its directory and VFS go away, so these come first.
+  kj::Maybe<kj::Own<const kj::Directory>> ownDir;
+  kj::Maybe<kj::Own<SqliteDatabase::Vfs>> vfs;
+  LocalKv kv;
+
+  kj::Promise<void> request(kj::HttpMethod method,
+      kj::StringPtr url,
+      const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody,
+      kj::HttpService::Response& response) override {
+    TRACE_EVENT("workerd", "KvStorageService::request()", "url", url.cStr());
+    return kv.request(method, url, headers, requestBody, response);
+  }
+
+  kj::Promise<void> connect(kj::StringPtr host,
+      const kj::HttpHeaders& headers,
+      kj::AsyncIoStream& connection,
+      kj::HttpService::ConnectResponse& response,
+      kj::HttpConnectSettings settings) override {
+    throwUnsupported();
+  }
+  kj::Promise<void> prewarm(kj::StringPtr url) override {
+    return kj::READY_NOW;
+  }
+  kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime, kj::StringPtr cron) override {
+    throwUnsupported();
+  }
+  kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime, uint32_t retryCount) override {
+    throwUnsupported();
+  }
+  kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+    return event->notSupported();
+  }
+
+  [[noreturn]] void throwUnsupported() {
+    JSG_FAIL_REQUIRE(Error, "KV services don't support this event type.");
+  }
+};
+
+kj::Own<Server::Service> Server::makeKvStorageService(kj::StringPtr name,
+    config::KvStorage::Reader conf,
+    kj::HttpHeaderTable::Builder& headerTableBuilder) {
+  TRACE_EVENT("workerd", "Server::makeKvStorageService()");
+  if (!experimental) {
+    reportConfigError(kj::str("KV service \"", name,
+        "\" uses an experimental feature which may change or go away in the future. You must run "
+        "workerd with `--experimental` to use this feature."));
+  }
+
+  auto fileName = conf.hasFile() ? kj::str(conf.getFile()) : kj::str(name, ".sqlite");
+  kj::Path path = nullptr;
+  KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() { path = kj::Path::parse(fileName); })) {
+    reportConfigError(kj::str("service ", name, ": invalid KV database file name \"", fileName,
+        "\": ", exception.getDescription()));
+    return makeInvalidConfigService();
+  }
+
+  kj::Maybe<KvStorageService::LinkCallback> linkCallback;
+  if (conf.hasDisk()) {
+    linkCallback = [this, name = kj::str(name), diskName = kj::str(conf.getDisk())]() {
+      return lookupWritableDisk(name, "KV", diskName);
+    };
+  }
+
+  return kj::heap<KvStorageService>(timer, headerTableBuilder, kj::mv(path), kj::mv(linkCallback));
+}
+
+// Service used when the service is configured as an in-process R2 bucket.
+class Server::R2StorageService final: public Service, private WorkerInterface {
+ public:
+  // Returns the directory to keep the bucket's directory in, or none to keep it in memory. Called
+  // from link(), once all services exist.
+  using LinkCallback = kj::Function<kj::Maybe<const kj::Directory&>()>;
+
+  R2StorageService(kj::EntropySource& entropySource,
+      kj::HttpHeaderTable::Builder& headerTableBuilder,
+      kj::Path path,
+      kj::Maybe<LinkCallback> linkCallback)
+      : path(kj::mv(path)),
+        linkCallback(kj::mv(linkCallback)),
+        r2(kj::systemPreciseCalendarClock(), entropySource, headerTableBuilder) {}
+
+  void link() override {
+    const kj::Directory* dir = nullptr;
+    KJ_IF_SOME(callback, linkCallback) {
+      KJ_IF_SOME(d, callback()) {
+        dir = &d;
+      }
+      linkCallback = kj::none;
+    }
+    if (dir == nullptr) {
+      dir = ownDir.emplace(kj::newInMemoryDirectory(kj::systemPreciseCalendarClock())).get();
+    }
+
+    auto& ownBucketDir = bucketDir.emplace(dir->openSubdir(
+        path, kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT));
+    r2.open(*ownBucketDir);
+  }
+
+  kj::Own<WorkerInterface> startRequest(IoChannelFactory::SubrequestMetadata metadata) override {
+    return {this, kj::NullDisposer::instance};
+  }
+
+  bool hasHandler(kj::StringPtr handlerName) override {
+    return handlerName == "fetch"_kj;
+  }
+
+ private:
+  kj::Path path;
+  kj::Maybe<LinkCallback> linkCallback;
+
+  // The bucket must be closed before its directory goes away, so these come first.
+  kj::Maybe<kj::Own<const kj::Directory>> ownDir;
+  kj::Maybe<kj::Own<const kj::Directory>> bucketDir;
+  LocalR2 r2;
+
+  kj::Promise<void> request(kj::HttpMethod method,
+      kj::StringPtr url,
+      const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody,
+      kj::HttpService::Response& response) override {
+    TRACE_EVENT("workerd", "R2StorageService::request()", "url", url.cStr());
+    return r2.request(method, url, headers, requestBody, response);
+  }
+
+  kj::Promise<void> connect(kj::StringPtr host,
+      const kj::HttpHeaders& headers,
+      kj::AsyncIoStream& connection,
+      kj::HttpService::ConnectResponse& response,
+      kj::HttpConnectSettings settings) override {
+    throwUnsupported();
   }
+  kj::Promise<void> prewarm(kj::StringPtr url) override {
+    return kj::READY_NOW;
+  }
+  kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime, kj::StringPtr cron) override {
+    throwUnsupported();
+  }
+  kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime, uint32_t retryCount) override {
+    throwUnsupported();
+  }
+  kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+    return event->notSupported();
+  }
+
+  [[noreturn]] void throwUnsupported() {
+    JSG_FAIL_REQUIRE(Error, "R2 services don't support this event type.");
+  }
+};
+
+kj::Own<Server::Service> Server::makeR2StorageService(kj::StringPtr name,
+    config::R2Storage::Reader conf,
+    kj::HttpHeaderTable::Builder& headerTableBuilder) {
+  TRACE_EVENT("workerd", "Server::makeR2StorageService()");
+  if (!experimental) {
+    reportConfigError(kj::str("R2 service \"", name,
+        "\" uses an experimental feature which may change or go away in the future. You must run "
+        "workerd with `--experimental` to use this feature."));
+  }
+
+  auto pathName = conf.hasPath() ? kj::str(conf.getPath()) : kj::str(name);
+  kj::Path path = nullptr;
+  KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() { path = kj::Path::parse(pathName); })) {
+    reportConfigError(kj::str("service ", name, ": invalid R2 bucket directory \"", pathName,
+        "\": ", exception.getDescription()));
+    return makeInvalidConfigService();
+  }
+
+  kj::Maybe<R2StorageService::LinkCallback> linkCallback;
+  if (conf.hasDisk()) {
+    linkCallback = [this, name = kj::str(name), diskName = kj::str(conf.getDisk())]() {
+      return lookupWritableDisk(name, "R2", diskName);
+    };
+  }
+
+  return kj::heap<R2StorageService>(
+      entropySource, headerTableBuilder, kj::mv(path), kj::mv(linkCallback));
+}
+
+kj::Maybe<const kj::Directory&> Server::lookupWritableDisk(
+    kj::StringPtr serviceName, kj::StringPtr kind, kj::StringPtr diskName) {
+  KJ_IF_SOME(svc, services.find(diskName)) {
+    auto diskSvc = dynamic_cast<DiskDirectoryService*>(svc.get());
+    if (diskSvc == nullptr) {
+      reportConfigError(kj::str("service ", serviceName, ": ", kind,
+          " disk config refers to the service \"", diskName,
+          "\", but that service is not a local disk service."));
+    } else KJ_IF_SOME(dir, diskSvc->getWritable()) {
+      return dir;
+    } else {
+      reportConfigError(kj::str("service ", serviceName, ": ", kind,
+          " disk config refers to the disk service \"", diskName,
+          "\", but that service is defined read-only."));
+    }
+  } else {
+    reportConfigError(kj::str("service ", serviceName, ": ", kind,
+        " disk config refers to a service \"", diskName, "\", but no such service is defined."));
+  }
+  return kj::none;
 }
 
 // =======================================================================================
@@ -1794,6 +2660,8 @@ class Server::WorkerService final: public Service,
     kj::Array<kj::Maybe<ActorNamespace&>> actor;  // null = configuration error
     kj::Maybe<kj::Own<Service>> cache;
     kj::Maybe<kj::Own<SqliteDatabase::Vfs>> actorStorage;
+    SqliteDatabase::CacheLimits actorStorageCacheLimits;
+    kj::Maybe<SqliteGroupCommit&> actorStorageGroupCommit;
     AlarmScheduler& alarmScheduler;
     kj::Array<kj::Own<Service>> tails;
   };
@@ -2342,7 +3210,7 @@ class Server::WorkerService final: public Service,
         } else {
           alarmScheduler.deleteAlarm(actor);
         }
-        return kj::READY_NOW;
+        return alarmScheduler.onBatchCommitted();
       }
 
      private:
@@ -2397,16 +3265,32 @@ class Server::WorkerService final: public Service,
 
                 auto db = kj::heap<SqliteDatabase>(*as,
                     kj::Path({d.uniqueKey, kj::str(idPtr, ".sqlite")}),
-                    kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT);
+                    kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT,
+                    sqliteObserver);
+                db->setCacheLimits(channels.actorStorageCacheLimits);
 
                 // Before we do anything, make sure the database is in WAL mode. We also need to
                 // do this after reset() is used, so register a callback for that.
-                auto setWalMode = [](SqliteDatabase& db) { db.run("PRAGMA journal_mode=WAL;"); };
+                auto groupCommit = channels.actorStorageGroupCommit;
+                auto setWalMode = [groupCommit](SqliteDatabase& db) {
+                  db.run("PRAGMA journal_mode=WAL;");
+                  if (groupCommit != kj::none) {
+                    SqliteGroupCommit::configure(db);
+                  }
+                };
                 setWalMode(*db);
                 db->afterReset(kj::mv(setWalMode));
 
-                return kj::heap<ActorSqlite>(kj::mv(db), outputGate,
-                    []() -> kj::Promise<void> { return kj::READY_NOW; }, *sqliteHooks)
+                // With group commit, COMMIT no longer syncs the log, so the commit callback is
+                // where the transaction becomes durable. The output gate stays locked until then.
+                kj::Function<kj::Promise<void>()> commitCallback =
+                    []() -> kj::Promise<void> { return kj::READY_NOW; };
+                KJ_IF_SOME(gc, groupCommit) {
+                  commitCallback = [&gc, &dbRef = *db]() { return gc.sync(dbRef); };
+                }
+
+                return kj::heap<ActorSqlite>(
+                    kj::mv(db), outputGate, kj::mv(commitCallback), *sqliteHooks)
                     .attach(kj::mv(sqliteHooks));
               } else {
                 // Create an ActorCache backed by a fake, empty storage. Elsewhere, we configure
@@ -2645,6 +3529,14 @@ class Server::WorkerService final: public Service,
     return kj::heap<CacheClientImpl>(cache, threadContext.getHeaderIds().cfCacheNamespace);
   }
 
+  kj::Maybe<KvClient&> getKvClient(uint channel) override {
+    auto& channels =
+        KJ_REQUIRE_NONNULL(ioChannels.tryGet<LinkedIoChannels>(), "link() has not been called");
+
+    KJ_REQUIRE(channel < channels.subrequest.size(), "invalid subrequest channel number");
+    return channels.subrequest[channel]->getKvClient();
+  }
+
   TimerChannel& getTimer() override {
     return *this;
   }
@@ -3094,6 +3986,7 @@ static kj::Maybe<WorkerdApi::Global> createBinding(kj::StringPtr workerName,
       cacheCopy.maxKeys = limits.getMaxKeys();
       cacheCopy.maxValueSize = limits.getMaxValueSize();
       cacheCopy.maxTotalValueSize = limits.getMaxTotalValueSize();
+      cacheCopy.evictionPolicy = limits.getEvictionPolicy();
       return makeGlobal(kj::mv(cacheCopy));
     }
   }
@@ -3230,6 +4123,12 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name,
     }
   };
 
+  if (conf.getLazyModules()) {
+    KJ_REQUIRE(experimental,
+        "Lazy module compilation is an experimental feature. "
+        "You must run workerd with `--experimental` to use this feature.");
+  }
+
   auto jsgobserver = kj::atomicRefcounted<JsgIsolateObserver>();
   auto observer = kj::atomicRefcounted<IsolateObserver>();
   auto limitEnforcer = kj::refcounted<NullIsolateLimitEnforcer>();
@@ -3241,11 +4140,17 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name,
         "You must run workerd with `--experimental` to use this feature.");
     newModuleRegistry = WorkerdApi::initializeBundleModuleRegistry(
         *jsgobserver, conf, featureFlags.asReader(), pythonConfig);
+    if (codeCache != kj::none) {
+      errorReporter.addError(kj::str("`compileCachePath` can't be used with the "
+                                     "\"new_module_registry\" compatibility flag yet."));
+    }
   }
 
   auto api = kj::heap<WorkerdApi>(globalContext->v8System, featureFlags.asReader(),
       limitEnforcer->getCreateParams(), kj::mv(jsgobserver), *memoryCacheProvider, pythonConfig,
-      kj::mv(newModuleRegistry));
+      kj::mv(newModuleRegistry), codeCache.map([](auto& c) -> const jsg::CodeCacheStore& {
+    return *c;
+  }));
   auto inspectorPolicy = Worker::Isolate::InspectorPolicy::DISALLOW;
   if (inspectorOverride != kj::none) {
     // For workerd, if the inspector is enabled, it is always fully trusted.
@@ -3602,7 +4507,14 @@ kj::Own<Server::Service> Server::makeWorker(kj::StringPtr name,
               "to the service \"",
               diskName, "\", but that service is not a local disk service."));
         } else KJ_IF_SOME(dir, diskSvc->getWritable()) {
-          result.actorStorage = kj::heap<SqliteDatabase::Vfs>(dir);
+          result.actorStorage = kj::heap<SqliteDatabase::Vfs>(
+              dir, SqliteDatabase::Vfs::Options{.mmapBytes = conf.getLocalDiskMmapBytes()});
+          result.actorStorageCacheLimits = sqliteCacheLimits;
+          if (conf.getLocalDiskMmapBytes() > 0) {
+            // Let the VFS default apply instead of the process-wide setting.
+            result.actorStorageCacheLimits.mmapBytes = kj::none;
+          }
+          result.actorStorageGroupCommit = diskSvc->getGroupCommit();
         } else {
           reportConfigError(kj::str("service ", name,
               ": durableObjectStorage config refers "
@@ -3666,6 +4578,15 @@ kj::Own<Server::Service> Server::makeService(config::Service::Reader conf,
 
     case config::Service::DISK:
       return makeDiskDirectoryService(name, conf.getDisk(), headerTableBuilder);
+
+    case config::Service::CACHE:
+      return makeCacheStorageService(name, conf.getCache(), headerTableBuilder);
+
+    case config::Service::KV:
+      return makeKvStorageService(name, conf.getKv(), headerTableBuilder);
+
+    case config::Service::R2:
+      return makeR2StorageService(name, conf.getR2(), headerTableBuilder);
   }
 
   reportConfigError(kj::str("Service named \"", name,
@@ -4064,6 +4985,171 @@ kj::Promise<void> Server::handleDrain(kj::Promise<void> drainWhen) {
   }
 }
 
+// A copy of the server on a thread of its own, for `Config.threads`. It builds its services from
+// the same config as the primary, shares the primary's memory caches, and serves the connections
+// that it accepts on its own SO_REUSEPORT sockets or that the primary's `connectionDispatcher`
+// hands it.
+class Server::Replica {
+ public:
+  Replica(Server& primary, jsg::V8System& v8System, config::Config::Reader config)
+      : experimental(primary.experimental),
+        consoleMode(primary.consoleMode),
+        entropySource(primary.entropySource),
+        memoryCacheProvider(*primary.memoryCacheProvider),
+        dispatcher(*KJ_ASSERT_NONNULL(primary.connectionDispatcher)),
+        packageDiskCacheRoot(primary.pythonConfig.packageDiskCacheRoot.map(
+            [](auto& dir) { return dir->clone(); })),
+        pyodideDiskCacheRoot(primary.pythonConfig.pyodideDiskCacheRoot.map(
+            [](auto& dir) { return dir->clone(); })),
+        thread([this, &v8System, config]() { run(v8System, config); }) {
+    // The primary consumes its overrides as it starts its own services, so take copies first.
+    for (auto& entry: primary.directoryOverrides) {
+      directoryOverrides.insert(kj::str(entry.key), kj::str(entry.value));
+    }
+    for (auto& entry: primary.externalOverrides) {
+      externalOverrides.insert(kj::str(entry.key), kj::str(entry.value));
+    }
+    for (auto& entry: primary.reusePortAddresses) {
+      reusePortAddresses.insert(kj::str(entry.key), kj::str(entry.value));
+    }
+    ready.fulfill();
+  }
+
+  ~Replica() noexcept(false) {
+    stopped.fulfill();
+    // `thread` is joined as it's destroyed.
+  }
+
+  // Drains the replica's connections, like the primary's on `drainWhen`.
+  void drain() {
+    drained.fulfill();
+  }
+
+  // Resolves once the replica's server has finished, after draining, or rejects if it failed.
+  kj::Promise<void> whenDone() {
+    return done.addWaiter();
+  }
+
+ private:
+  bool experimental;
+  Worker::ConsoleMode consoleMode;
+  kj::EntropySource& entropySource;
+  api::MemoryCacheProvider& memoryCacheProvider;
+  const ConnectionDispatcher& dispatcher;
+  kj::Maybe<kj::Own<const kj::Directory>> packageDiskCacheRoot;
+  kj::Maybe<kj::Own<const kj::Directory>> pyodideDiskCacheRoot;
+  kj::HashMap<kj::String, kj::String> directoryOverrides;
+  kj::HashMap<kj::String, kj::String> externalOverrides;
+  kj::HashMap<kj::String, kj::String> reusePortAddresses;
+
+  CrossThreadWaitList ready;
+  CrossThreadWaitList drained;
+  CrossThreadWaitList stopped;
+  CrossThreadWaitList done;
+
+  // Last, so that it's joined before anything it uses goes away.
+  kj::Thread thread;
+
+  void run(jsg::V8System& v8System, config::Config::Reader config) {
+    auto io = kj::setupAsyncIo();
+    auto fs = kj::newDiskFilesystem();
+
+    KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() {
+      ready.addWaiter().wait(io.waitScope);
+
+      // The primary reports any errors in the config, which is the same for every replica.
+      Server server(*fs, io.provider->getTimer(), io.provider->getNetwork(), entropySource,
+          consoleMode, [](kj::String) {});
+      server.isReplica = true;
+      server.experimental = experimental;
+      server.memoryCacheProvider = fakeOwn(memoryCacheProvider);
+      server.directoryOverrides = kj::mv(directoryOverrides);
+      server.externalOverrides = kj::mv(externalOverrides);
+      server.pythonConfig.packageDiskCacheRoot = kj::mv(packageDiskCacheRoot);
+      server.pythonConfig.pyodideDiskCacheRoot = kj::mv(pyodideDiskCacheRoot);
+      server.lowLevelProvider = *io.lowLevelProvider;
+      for (auto sock: config.getSockets()) {
+        KJ_IF_SOME(addr, reusePortAddresses.find(sock.getName())) {
+          server.overrideSocket(kj::str(sock.getName()), kj::str(addr));
+        } else {
+          server.overrideSocket(kj::str(sock.getName()),
+              dispatcher.addReceiver(sock.getName(), *io.lowLevelProvider));
+        }
+      }
+      server.reusePortAddresses = kj::mv(reusePortAddresses);
+
+      server.run(v8System, config, drained.addWaiter())
+          .exclusiveJoin(stopped.addWaiter())
+          .wait(io.waitScope);
+    })) {
+      done.reject(kj::mv(exception));
+      return;
+    }
+    done.fulfill();
+  }
+};
+
+void Server::startReplicas(jsg::V8System& v8System, config::Config::Reader config) {
+  auto threads = config.getThreads();
+  if (threads <= 1 || isReplica) return;
+
+#if _WIN32
+  reportConfigError(kj::str("`threads` is not supported on Windows."));
+  return;
+#endif
+
+  if (!experimental) {
+    reportConfigError(kj::str("`threads` is an experimental feature which may change or go away "
+                              "in the future. You must run workerd with `--experimental` to use "
+                              "this feature."));
+    return;
+  }
+
+  for (auto service: config.getServices()) {
+    if (service.isWorker() && service.getWorker().getDurableObjectNamespaces().size() > 0) {
+      reportConfigError(kj::str("Service \"", service.getName(),
+          "\" defines Durable Objects, which can't be used with `threads`, since each object must "
+          "live on exactly one thread."));
+      return;
+    }
+    if (service.isCache() || service.isKv() || service.isR2()) {
+      reportConfigError(kj::str("Service \"", service.getName(),
+          "\" is a local storage service, which can't be used with `threads`, since each thread "
+          "would keep its own separate copy of the data."));
+      return;
+    }
+  }
+
+  // The caches are now shared between threads, so they can't read the time from this thread's
+  // event loop.
+  memoryCacheProvider = kj::heap<api::MemoryCacheProvider>(kj::systemPreciseMonotonicClock());
+  connectionDispatcher = kj::heap<ConnectionDispatcher>();
+
+  if (lowLevelProvider != kj::none) {
+    for (auto sock: config.getSockets()) {
+      kj::StringPtr addr;
+      KJ_IF_SOME(override, socketOverrides.find(sock.getName())) {
+        // A socket passed in with `--socket-fd` is already listening, so must be dispatched.
+        if (!override.is<kj::String>()) continue;
+        addr = override.get<kj::String>();
+      } else if (sock.hasAddress()) {
+        addr = sock.getAddress();
+      } else {
+        continue;
+      }
+      uint defaultPort = sock.isHttps() ? 443 : 80;
+      if (canListenWithReusePort(addr, defaultPort)) {
+        reusePortAddresses.insert(kj::str(sock.getName()), kj::str(addr));
+      }
+    }
+  }
+
+  for (auto i KJ_UNUSED: kj::zeroTo(threads - 1)) {
+    auto& replica = *replicas.add(kj::heap<Replica>(*this, v8System, config));
+    tasks.add(replica.whenDone());
+  }
+}
+
 kj::Promise<void> Server::run(
     jsg::V8System& v8System, config::Config::Reader config, kj::Promise<void> drainWhen) {
   TRACE_EVENT("workerd", "Server.run");
@@ -4076,6 +5162,15 @@ kj::Promise<void> Server::run(
 
   auto forkedDrainWhen = handleDrain(kj::mv(drainWhen)).fork();
 
+  startReplicas(v8System, config);
+  if (!replicas.empty()) {
+    tasks.add(forkedDrainWhen.addBranch().then([this]() {
+      for (auto& replica: replicas) {
+        replica->drain();
+      }
+    }));
+  }
+
   startServices(v8System, config, headerTableBuilder, forkedDrainWhen);
 
   auto listenPromise = listenOnSockets(config, headerTableBuilder, forkedDrainWhen);
@@ -4165,6 +5260,38 @@ void Server::startServices(jsg::V8System& v8System,
   // ---------------------------------------------------------------------------
   // Configure services
   TRACE_EVENT("workerd", "startServices");
+
+  if (config.hasSqliteMemory()) {
+    auto sqliteConf = config.getSqliteMemory();
+    SqliteDatabase::setHeapLimits(
+        sqliteConf.getSoftHeapLimitBytes(), sqliteConf.getHardHeapLimitBytes());
+    if (sqliteConf.getPageCacheBytesPerDatabase() > 0) {
+      sqliteCacheLimits.pageCacheBytes = sqliteConf.getPageCacheBytesPerDatabase();
+    }
+    if (sqliteConf.getMmapBytesPerDatabase() > 0) {
+      sqliteCacheLimits.mmapBytes = sqliteConf.getMmapBytesPerDatabase();
+    }
+  }
+
+  if (config.hasCompileCachePath()) {
+    if (!experimental) {
+      reportConfigError(kj::str("`compileCachePath` is an experimental feature which may change or "
+                                "go away in the future. You must run workerd with `--experimental` "
+                                "to use this feature."));
+    } else {
+      auto pathStr = config.getCompileCachePath();
+      KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() {
+        auto dir = fs.getRoot().openSubdir(fs.getCurrentPath().evalNative(pathStr),
+            kj::WriteMode::CREATE | kj::WriteMode::MODIFY | kj::WriteMode::CREATE_PARENT);
+        codeCache =
+            kj::heap<DiskCodeCache>(kj::mv(dir), v8::ScriptCompiler::CachedDataVersionTag());
+      })) {
+        reportConfigError(kj::str("Couldn't open compile cache directory \"", pathStr,
+            "\": ", exception.getDescription()));
+      }
+    }
+  }
+
   // First pass: Extract actor namespace configs.
   for (auto serviceConf: config.getServices()) {
     kj::StringPtr name = serviceConf.getName();
@@ -4342,8 +5469,15 @@ kj::Promise<void> Server::listenOnSockets(config::Config::Reader config,
   validSocket:
     using PromisedReceived = kj::Promise<kj::Own<kj::ConnectionReceiver>>;
     PromisedReceived listener = nullptr;
+    bool dispatched = connectionDispatcher != kj::none;
     KJ_IF_SOME(l, listenerOverride) {
       listener = kj::mv(l);
+    } else KJ_IF_SOME(reusePortAddr, reusePortAddresses.find(name)) {
+      // Every thread listens for itself, and the kernel spreads the connections between them.
+      listener = kj::evalNow([&]() {
+        return listenWithReusePort(KJ_ASSERT_NONNULL(lowLevelProvider), reusePortAddr, defaultPort);
+      });
+      dispatched = false;
     } else {
       listener = ([](kj::Promise<kj::Own<kj::NetworkAddress>> promise) -> PromisedReceived {
         auto parsed = co_await promise;
@@ -4351,6 +5485,19 @@ kj::Promise<void> Server::listenOnSockets(config::Config::Reader config,
       })(network.parseAddress(addrStr, defaultPort));
     }
 
+    if (dispatched) {
+      auto& d = KJ_ASSERT_NONNULL(connectionDispatcher);
+      // Accept on this thread, and serve this thread's share of the connections like the replicas
+      // serve theirs. The port is known once dispatching starts.
+      listener = listener.then([this, &dispatcher = *d, name = kj::str(name),
+                                   local = d->addReceiver(name, kj::none),
+                                   drained = forkedDrainWhen.addBranch()](
+                                   kj::Own<kj::ConnectionReceiver> port) mutable {
+        tasks.add(dispatcher.dispatch(kj::mv(name), kj::mv(port)).exclusiveJoin(kj::mv(drained)));
+        return kj::mv(local);
+      });
+    }
+
     KJ_IF_SOME(t, tls) {
       listener = ([](kj::Promise<kj::Own<kj::ConnectionReceiver>> promise,
                       kj::Own<kj::TlsContext> tls) -> PromisedReceived {
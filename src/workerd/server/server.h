@@ -29,6 +29,9 @@ namespace workerd::server {
 
 using api::pyodide::PythonConfig;
 
+class ConnectionDispatcher;
+class DiskCodeCache;
+
 // Implements the single-tenant Workers Runtime server / CLI.
 //
 // The purpose of this class is to implement the core logic independently of the CLI itself,
@@ -49,6 +52,12 @@ class Server final: private kj::TaskSet::ErrorHandler {
     experimental = true;
   }
 
+  // Lets `Config.threads` open a listening socket per thread itself, where possible, rather than
+  // accepting on one thread and handing connections out.
+  void setLowLevelProvider(kj::LowLevelAsyncIoProvider& provider) {
+    lowLevelProvider = provider;
+  }
+
   void overrideSocket(kj::String name, kj::Own<kj::ConnectionReceiver> port) {
     socketOverrides.upsert(kj::mv(name), kj::mv(port));
   }
@@ -130,6 +139,21 @@ class Server final: private kj::TaskSet::ErrorHandler {
 
   kj::Own<api::MemoryCacheProvider> memoryCacheProvider;
 
+  kj::Maybe<kj::LowLevelAsyncIoProvider&> lowLevelProvider;
+
+  // When `Config.threads` is more than one, the primary server (this one, as created by the CLI)
+  // starts `replicas`, copies of the server that run on threads of their own. They share
+  // `memoryCacheProvider`, so must be destroyed before it. Sockets named in `reusePortAddresses`
+  // are listened on by every thread with SO_REUSEPORT, at the given address; the primary accepts
+  // every connection on the others and hands them out through `connectionDispatcher`.
+  kj::Maybe<kj::Own<ConnectionDispatcher>> connectionDispatcher;
+  kj::HashMap<kj::String, kj::String> reusePortAddresses;
+  class Replica;
+  kj::Vector<kj::Own<Replica>> replicas;
+
+  // True if this is one of another server's `replicas`.
+  bool isReplica = false;
+
   kj::HashMap<kj::String, kj::OneOf<kj::String, kj::Own<kj::ConnectionReceiver>>> socketOverrides;
   kj::HashMap<kj::String, kj::String> directoryOverrides;
 
@@ -155,6 +179,10 @@ class Server final: private kj::TaskSet::ErrorHandler {
   // correctly construct dependent services.
   kj::HashMap<kj::String, kj::HashMap<kj::String, ActorConfig>> actorConfigs;
 
+  // Code caches for the workers' modules, if `Config.compileCachePath` is set. Initialized in
+  // startServices(), before any worker is created, and must outlive `services`.
+  kj::Maybe<kj::Own<DiskCodeCache>> codeCache;
+
   kj::HashMap<kj::String, kj::Own<Service>> services;
 
   kj::Own<kj::PromiseFulfiller<void>> fatalFulfiller;
@@ -162,6 +190,10 @@ class Server final: private kj::TaskSet::ErrorHandler {
   // Initialized in startAlarmScheduler().
   kj::Own<AlarmScheduler> alarmScheduler;
 
+  // Applied to every Durable Object database opened on `localDisk`. Initialized from the config in
+  // startServices().
+  SqliteDatabase::CacheLimits sqliteCacheLimits;
+
   // An HttpServer object maintained in a linked list.
   struct ListedHttpServer {
     Server& owner;
@@ -193,6 +225,9 @@ class Server final: private kj::TaskSet::ErrorHandler {
   // request in flight.
   kj::Promise<void> handleDrain(kj::Promise<void> drainWhen);
 
+  // Starts `replicas` for `Config.threads`, if it asks for more than one thread and can have them.
+  void startReplicas(jsg::V8System& v8System, config::Config::Reader config);
+
   kj::Own<kj::TlsContext> makeTlsContext(config::TlsOptions::Reader conf);
   kj::Promise<kj::Own<kj::NetworkAddress>> makeTlsNetworkAddress(config::TlsOptions::Reader conf,
       kj::StringPtr addrStr,
@@ -209,6 +244,21 @@ class Server final: private kj::TaskSet::ErrorHandler {
   kj::Own<Service> makeDiskDirectoryService(kj::StringPtr name,
       config::DiskDirectory::Reader conf,
       kj::HttpHeaderTable::Builder& headerTableBuilder);
+  kj::Own<Service> makeCacheStorageService(kj::StringPtr name,
+      config::CacheStorage::Reader conf,
+      kj::HttpHeaderTable::Builder& headerTableBuilder);
+  kj::Own<Service> makeKvStorageService(kj::StringPtr name,
+      config::KvStorage::Reader conf,
+      kj::HttpHeaderTable::Builder& headerTableBuilder);
+  kj::Own<Service> makeR2StorageService(kj::StringPtr name,
+      config::R2Storage::Reader conf,
+      kj::HttpHeaderTable::Builder& headerTableBuilder);
+
+  // Can only be called in the link stage. Returns the writable directory of the disk service
+  // named `diskName`, which the `kind` service `serviceName` is configured to store data in, or
+  // reports a config error.
+  kj::Maybe<const kj::Directory&> lookupWritableDisk(
+      kj::StringPtr serviceName, kj::StringPtr kind, kj::StringPtr diskName);
   kj::Own<Service> makeWorker(kj::StringPtr name,
       config::Worker::Reader conf,
       capnp::List<config::Extension>::Reader extensions);
@@ -235,6 +285,9 @@ class Server final: private kj::TaskSet::ErrorHandler {
   class ExternalTcpService;
   class NetworkService;
   class DiskDirectoryService;
+  class CacheStorageService;
+  class KvStorageService;
+  class R2StorageService;
   class WorkerService;
   class WorkerEntrypointService;
   class HttpListener;
@@ -230,6 +230,7 @@ struct WorkerdApi::Impl final {
   JsgWorkerdIsolate jsgIsolate;
   api::MemoryCacheProvider& memoryCacheProvider;
   const PythonConfig& pythonConfig;
+  kj::Maybe<const jsg::CodeCacheStore&> codeCacheStore;
   kj::Maybe<api::pyodide::EmscriptenRuntime> maybeEmscriptenRuntime;
 
   class Configuration {
@@ -258,13 +259,15 @@ struct WorkerdApi::Impl final {
       kj::Own<JsgIsolateObserver> observerParam,
       api::MemoryCacheProvider& memoryCacheProvider,
       const PythonConfig& pythonConfig = defaultConfig,
-      kj::Maybe<kj::Own<jsg::modules::ModuleRegistry>> newModuleRegistry = kj::none)
+      kj::Maybe<kj::Own<jsg::modules::ModuleRegistry>> newModuleRegistry = kj::none,
+      kj::Maybe<const jsg::CodeCacheStore&> codeCacheStore = kj::none)
       : features(capnp::clone(featuresParam)),
         maybeOwnedModuleRegistry(kj::mv(newModuleRegistry)),
         observer(kj::atomicAddRef(*observerParam)),
         jsgIsolate(v8System, Configuration(*this), kj::mv(observerParam), kj::mv(createParams)),
         memoryCacheProvider(memoryCacheProvider),
-        pythonConfig(pythonConfig) {
+        pythonConfig(pythonConfig),
+        codeCacheStore(codeCacheStore) {
     jsgIsolate.runInLockScope([&](JsgWorkerdIsolate::Lock& lock) {
       if (features->getPythonWorkers()) {
         auto pythonRelease = KJ_ASSERT_NONNULL(getPythonSnapshotRelease(*features));
@@ -324,14 +327,16 @@ WorkerdApi::WorkerdApi(jsg::V8System& v8System,
     kj::Own<JsgIsolateObserver> observer,
     api::MemoryCacheProvider& memoryCacheProvider,
     const PythonConfig& pythonConfig,
-    kj::Maybe<kj::Own<jsg::modules::ModuleRegistry>> newModuleRegistry)
+    kj::Maybe<kj::Own<jsg::modules::ModuleRegistry>> newModuleRegistry,
+    kj::Maybe<const jsg::CodeCacheStore&> codeCacheStore)
     : impl(kj::heap<Impl>(v8System,
           features,
           kj::mv(createParams),
           kj::mv(observer),
           memoryCacheProvider,
           pythonConfig,
-          kj::mv(newModuleRegistry))) {}
+          kj::mv(newModuleRegistry),
+          codeCacheStore)) {}
 WorkerdApi::~WorkerdApi() noexcept(false) {}
 
 kj::Own<jsg::Lock> WorkerdApi::lock(jsg::V8StackScope& stackScope) const {
@@ -465,7 +470,8 @@ kj::Array<kj::StringPtr> compileNamedExports(capnp::List<capnp::Text>::Reader na
 kj::Maybe<jsg::ModuleRegistry::ModuleInfo> WorkerdApi::tryCompileModule(jsg::Lock& js,
     config::Worker::Module::Reader module,
     jsg::CompilationObserver& observer,
-    CompatibilityFlags::Reader featureFlags) {
+    CompatibilityFlags::Reader featureFlags,
+    kj::Maybe<const jsg::CodeCacheStore&> codeCacheStore) {
   TRACE_EVENT("workerd", "WorkerdApi::tryCompileModule()", "name", module.getName());
   auto& lock = kj::downcast<JsgWorkerdIsolate::Lock>(js);
   switch (module.which()) {
@@ -492,7 +498,8 @@ kj::Maybe<jsg::ModuleRegistry::ModuleInfo> WorkerdApi::tryCompileModule(jsg::Loc
     case config::Worker::Module::ES_MODULE: {
       // TODO(soon): Make sure passing nullptr to compile cache is desired.
       return jsg::ModuleRegistry::ModuleInfo(lock, module.getName(), module.getEsModule(),
-          nullptr /* compile cache */, jsg::ModuleInfoCompileOption::BUNDLE, observer);
+          nullptr /* compile cache */, jsg::ModuleInfoCompileOption::BUNDLE, observer,
+          codeCacheStore);
     }
     case config::Worker::Module::COMMON_JS_MODULE: {
       kj::Maybe<kj::Array<kj::StringPtr>> named = kj::none;
@@ -502,7 +509,7 @@ kj::Maybe<jsg::ModuleRegistry::ModuleInfo> WorkerdApi::tryCompileModule(jsg::Loc
       return jsg::ModuleRegistry::ModuleInfo(lock, module.getName(),
           named.map([](kj::Array<kj::StringPtr>& named) { return named.asPtr(); }),
           jsg::ModuleRegistry::CommonJsModuleInfo(
-              lock, module.getName(), module.getCommonJsModule()));
+              lock, module.getName(), module.getCommonJsModule(), codeCacheStore));
     }
     case config::Worker::Module::NODE_JS_COMPAT_MODULE: {
       KJ_REQUIRE(featureFlags.getNodeJsCompat(),
@@ -601,7 +608,20 @@ void WorkerdApi::compileModules(jsg::Lock& lockParam,
 
     for (auto module: confModules) {
       auto path = kj::Path::parse(module.getName());
-      auto maybeInfo = tryCompileModule(lockParam, module, modules->getObserver(), featureFlags);
+      if (conf.getLazyModules() && module.which() != config::Worker::Module::PYTHON_MODULE &&
+          module.which() != config::Worker::Module::PYTHON_REQUIREMENT) {
+        // Compile the module when it is first imported or required instead. `module` points into
+        // the config, which outlives the worker.
+        modules->add(path,
+            [module, featureFlags, &observer = modules->getObserver(),
+                codeCacheStore = impl->codeCacheStore](jsg::Lock& js,
+                jsg::ModuleRegistry::ResolveMethod, kj::Maybe<const kj::Path&>&) {
+          return tryCompileModule(js, module, observer, featureFlags, codeCacheStore);
+        });
+        continue;
+      }
+      auto maybeInfo = tryCompileModule(
+          lockParam, module, modules->getObserver(), featureFlags, impl->codeCacheStore);
       KJ_IF_SOME(info, maybeInfo) {
         modules->add(path, kj::mv(info));
       }
@@ -609,8 +629,10 @@ void WorkerdApi::compileModules(jsg::Lock& lockParam,
 
     api::registerModules(*modules, featureFlags);
 
-    // TODO(perf): we'd like to find a way to precompile these on server startup and use isolate
-    // cloning for faster worker creation.
+    // Only the first isolate to import an extension module compiles it from scratch; the rest
+    // consume its code cache (see compileEsmModule()).
+    // TODO(perf): we'd also like to use isolate cloning or startup snapshots so that new isolates
+    // skip evaluating these, too.
     for (auto extension: extensions) {
       for (auto module: extension.getModules()) {
         modules->addBuiltinModule(module.getName(), module.getEsModule().asArray(),
@@ -699,6 +721,10 @@ static v8::Local<v8::Value> createBindingValue(JsgWorkerdIsolate::Lock& lock,
                     .maxKeys = cache.maxKeys,
                     .maxValueSize = cache.maxValueSize,
                     .maxTotalValueSize = cache.maxTotalValueSize,
+                    .evictionPolicy = cache.evictionPolicy ==
+                            config::Worker::Binding::MemoryCacheLimits::EvictionPolicy::TINY_LFU
+                        ? api::SharedMemoryCache::EvictionPolicy::TINY_LFU
+                        : api::SharedMemoryCache::EvictionPolicy::LRU,
                   })));
     }
 
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <workerd/io/worker.h>
+#include <workerd/jsg/compile-cache.h>
 #include <workerd/jsg/modules-new.h>
 #include <workerd/server/workerd.capnp.h>
 
@@ -38,7 +39,8 @@ class WorkerdApi final: public Worker::Api {
       kj::Own<JsgIsolateObserver> observer,
       api::MemoryCacheProvider& memoryCacheProvider,
       const PythonConfig& pythonConfig,
-      kj::Maybe<kj::Own<jsg::modules::ModuleRegistry>> newModuleRegistry);
+      kj::Maybe<kj::Own<jsg::modules::ModuleRegistry>> newModuleRegistry,
+      kj::Maybe<const jsg::CodeCacheStore&> codeCacheStore = kj::none);
   ~WorkerdApi() noexcept(false);
 
   static const WorkerdApi& from(const Worker::Api&);
@@ -144,6 +146,8 @@ class WorkerdApi final: public Worker::Api {
       uint32_t maxKeys;
       uint32_t maxValueSize;
       uint64_t maxTotalValueSize;
+      config::Worker::Binding::MemoryCacheLimits::EvictionPolicy evictionPolicy =
+          config::Worker::Binding::MemoryCacheLimits::EvictionPolicy::LRU;
 
       MemoryCache clone() const {
         return MemoryCache{
@@ -151,6 +155,7 @@ class WorkerdApi final: public Worker::Api {
           .maxKeys = maxKeys,
           .maxValueSize = maxValueSize,
           .maxTotalValueSize = maxTotalValueSize,
+          .evictionPolicy = evictionPolicy,
         };
       }
     };
@@ -236,10 +241,12 @@ class WorkerdApi final: public Worker::Api {
       v8::Local<v8::Object> target,
       uint32_t ownerId) const;
 
+  // ES and CommonJS modules are compiled with the code caches in `codeCacheStore`, if given.
   static kj::Maybe<jsg::ModuleRegistry::ModuleInfo> tryCompileModule(jsg::Lock& js,
       config::Worker::Module::Reader conf,
       jsg::CompilationObserver& observer,
-      CompatibilityFlags::Reader featureFlags);
+      CompatibilityFlags::Reader featureFlags,
+      kj::Maybe<const jsg::CodeCacheStore&> codeCacheStore = kj::none);
 
   using ModuleFallbackCallback = Worker::Api::ModuleFallbackCallback;
   void setModuleFallbackCallback(kj::Function<ModuleFallbackCallback>&& callback) const override;
@@ -691,6 +691,8 @@ class CliMain final: public SchemaFileImpl::ErrorReporter {
     // We don't want to force people to specify top-level file IDs in `workerd` config files, as
     // those IDs would be totally irrelevant.
     schemaParser.setFileIdsRequired(false);
+
+    server->setLowLevelProvider(*io.lowLevelProvider);
   }
 
   kj::MainFunc getMain() {
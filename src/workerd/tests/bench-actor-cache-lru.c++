@@ -0,0 +1,70 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// Measures how cached reads from many ActorCaches on different threads scale when they share one
+// ActorCache::SharedLru, with the clean list in a single shard versus split across several.
+
+#include <workerd/io/actor-cache.h>
+#include <workerd/io/io-gate.h>
+#include <workerd/tests/bench-tools.h>
+
+namespace workerd {
+namespace {
+
+constexpr uint KEY_COUNT = 100;
+
+// Accepts puts so that entries can be flushed and become clean. Everything else is unimplemented,
+// which is fine since the benchmark only reads keys that are already in cache.
+class PutOnlyStorage final: public rpc::ActorStorage::Stage::Server {
+ protected:
+  kj::Promise<void> put(PutContext context) override {
+    return kj::READY_NOW;
+  }
+};
+
+ActorCacheSharedLruOptions lruOptions(size_t shards) {
+  return {
+    .softLimit = 64 * (1ull << 20),
+    .hardLimit = 128 * (1ull << 20),
+    .staleTimeout = 30 * kj::SECONDS,
+    .dirtyListByteLimit = 8 * (1ull << 20),
+    .maxKeysPerRpc = 128,
+    .cleanListShards = shards,
+  };
+}
+
+// Each benchmark thread plays the part of one isolate's thread, with its own event loop and its
+// own ActorCache, all sharing the same SharedLru.
+template <size_t shards>
+static void ActorCache_CachedGet(benchmark::State& state) {
+  static const ActorCache::SharedLru lru(lruOptions(shards));
+
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+  OutputGate gate;
+  ActorCache cache(kj::heap<PutOnlyStorage>(), lru, gate);
+
+  auto keys = kj::heapArrayBuilder<kj::String>(KEY_COUNT);
+  for (auto i: kj::zeroTo(KEY_COUNT)) {
+    keys.add(kj::str("key", i));
+  }
+  for (auto& key: keys) {
+    (void)cache.put(kj::str(key), kj::heapArray<const byte>("value"_kj.asBytes()), {});
+  }
+  gate.wait().wait(ws);
+
+  for (auto _: state) {
+    for (auto& key: keys) {
+      auto result = cache.get(kj::str(key), {});
+      benchmark::DoNotOptimize(result);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * KEY_COUNT);
+}
+
+BENCHMARK_TEMPLATE(ActorCache_CachedGet, 1)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(ActorCache_CachedGet, 16)->ThreadRange(1, 16)->UseRealTime();
+
+}  // namespace
+}  // namespace workerd
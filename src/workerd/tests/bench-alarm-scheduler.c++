@@ -0,0 +1,118 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// Measures AlarmScheduler with a large number of alarms: scheduling them (which mostly measures
+// the batched writes, since most alarms are beyond the in-memory horizon), and then running them
+// all as simulated time passes.
+
+#include <workerd/server/alarm-scheduler.h>
+#include <workerd/tests/bench-tools.h>
+
+namespace workerd::server {
+namespace {
+
+class FakeClock final: public kj::Clock {
+ public:
+  kj::Date now() const override {
+    return time;
+  }
+
+  kj::Date time = kj::UNIX_EPOCH + 1'700'000'000 * kj::SECONDS;
+};
+
+// Counts alarm invocations and reports success for all of them.
+class CountingWorker final: public WorkerInterface {
+ public:
+  uint64_t alarmCount = 0;
+
+  kj::Promise<void> request(kj::HttpMethod method,
+      kj::StringPtr url,
+      const kj::HttpHeaders& headers,
+      kj::AsyncInputStream& requestBody,
+      kj::HttpService::Response& response) override {
+    KJ_UNIMPLEMENTED("not used");
+  }
+  kj::Promise<void> connect(kj::StringPtr host,
+      const kj::HttpHeaders& headers,
+      kj::AsyncIoStream& connection,
+      ConnectResponse& response,
+      kj::HttpConnectSettings settings) override {
+    KJ_UNIMPLEMENTED("not used");
+  }
+  kj::Promise<void> prewarm(kj::StringPtr url) override {
+    return kj::READY_NOW;
+  }
+  kj::Promise<ScheduledResult> runScheduled(kj::Date scheduledTime, kj::StringPtr cron) override {
+    KJ_UNIMPLEMENTED("not used");
+  }
+  kj::Promise<AlarmResult> runAlarm(kj::Date scheduledTime, uint32_t retryCount) override {
+    ++alarmCount;
+    return AlarmResult{.retry = false, .outcome = EventOutcome::OK};
+  }
+  kj::Promise<CustomEvent::Result> customEvent(kj::Own<CustomEvent> event) override {
+    KJ_UNIMPLEMENTED("not used");
+  }
+};
+
+struct SchedulerFixture {
+  kj::EventLoop loop;
+  kj::WaitScope ws{loop};
+  FakeClock clock;
+  kj::TimerImpl timer{kj::origin<kj::TimePoint>()};
+  kj::Own<const kj::Directory> dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs{*dir};
+  AlarmScheduler scheduler{clock, timer, vfs, kj::Path({"alarms.sqlite"})};
+  CountingWorker worker;
+
+  SchedulerFixture() {
+    scheduler.registerNamespace("ns"_kj, [this](kj::String) -> kj::Own<WorkerInterface> {
+      return {&worker, kj::NullDisposer::instance};
+    });
+    ws.poll();
+  }
+
+  // Schedules `count` alarms spread evenly over `span`, in batches of `batchSize` per turn of the
+  // event loop, the way many objects writing at once would.
+  void schedule(uint count, kj::Duration span, uint batchSize = 1000) {
+    auto start = clock.now();
+    for (uint i = 0; i < count; i += batchSize) {
+      for (auto j: kj::range(i, kj::min(i + batchSize, count))) {
+        auto id = kj::str(j);
+        scheduler.setAlarm({.uniqueKey = "ns"_kj, .actorId = id}, start + span / count * j);
+      }
+      scheduler.onBatchCommitted().wait(ws);
+    }
+  }
+
+  void advance(kj::Duration delta) {
+    clock.time = clock.time + delta;
+    timer.advanceTo(timer.now() + delta);
+    ws.poll();
+  }
+};
+
+static void AlarmScheduler_Schedule(benchmark::State& state) {
+  for (auto _: state) {
+    SchedulerFixture f;
+    f.schedule(state.range(0), 30 * kj::DAYS);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void AlarmScheduler_ScheduleAndRun(benchmark::State& state) {
+  for (auto _: state) {
+    SchedulerFixture f;
+    f.schedule(state.range(0), 1 * kj::HOURS);
+    while (f.worker.alarmCount < uint64_t(state.range(0))) {
+      f.advance(1 * kj::SECONDS);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(AlarmScheduler_Schedule)->Arg(1'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(AlarmScheduler_ScheduleAndRun)->Arg(1'000'000)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace workerd::server
@@ -0,0 +1,50 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include <workerd/tests/bench-tools.h>
+#include <workerd/tests/test-fixture.h>
+
+#include <kj/thread.h>
+#include <kj/vector.h>
+
+// Benchmarks for threads contending for an isolate's async lock: each of `state.range(0)` threads
+// repeatedly takes the lock with Worker::Isolate::takeAsyncLock() and then releases it.
+
+namespace workerd {
+namespace {
+
+constexpr uint TURNS_PER_THREAD = 1000;
+
+static void Bench_takeAsyncLock(benchmark::State& state) {
+  TestFixture fixture({.mainModuleSource = R"(
+    export default {
+      async fetch(request) {
+        return new Response("OK");
+      },
+    };
+  )"_kj});
+  auto& isolate = fixture.getIsolate();
+
+  for (auto _: state) {
+    kj::Vector<kj::Own<kj::Thread>> threads;
+    for (auto i KJ_UNUSED: kj::zeroTo(state.range(0))) {
+      threads.add(kj::heap<kj::Thread>([&]() {
+        kj::EventLoop loop;
+        kj::WaitScope ws(loop);
+        auto request = kj::refcounted<RequestObserver>();
+        for (auto j KJ_UNUSED: kj::zeroTo(TURNS_PER_THREAD)) {
+          // Dropping the lock passes it to the next thread in line.
+          isolate.takeAsyncLock(*request).wait(ws);
+        }
+      }));
+    }
+    // The threads are joined as they're destroyed.
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0) * TURNS_PER_THREAD);
+}
+
+WD_BENCHMARK(Bench_takeAsyncLock)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16)->UseRealTime();
+
+}  // namespace
+}  // namespace workerd
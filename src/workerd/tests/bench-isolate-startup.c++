@@ -0,0 +1,89 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include <workerd/tests/bench-tools.h>
+#include <workerd/tests/test-fixture.h>
+
+// Benchmarks for how long a new isolate takes to serve its first request: creating the isolate
+// and its global scope, compiling and evaluating the worker's modules, including the built-in
+// ones it imports, and running the request.
+
+namespace workerd {
+namespace {
+
+static void Bench_timeToFirstRequest(benchmark::State& state) {
+  capnp::MallocMessageBuilder message;
+  auto flags = message.initRoot<CompatibilityFlags>();
+  flags.setNodeJsCompat(true);
+
+  for (auto _: state) {
+    TestFixture fixture({
+      .featureFlags = flags.asReader(),
+      .mainModuleSource = R"(
+        import { Buffer } from "node:buffer";
+        import { EventEmitter } from "node:events";
+        export default {
+          async fetch(request) {
+            new EventEmitter().emit("request");
+            return new Response(Buffer.from("OK"));
+          },
+        };
+      )"_kj,
+    });
+    auto result = fixture.runRequest(kj::HttpMethod::GET, "http://www.example.com"_kj, ""_kj);
+    KJ_EXPECT(result.statusCode == 200);
+  }
+}
+
+WD_BENCHMARK(Bench_timeToFirstRequest);
+
+// Like the above, but for a bundle of many modules of which the worker only imports a few, with
+// `lazyModules` off (0) and on (1). Also reports the isolate's heap usage after the request.
+static void Bench_largeBundleTimeToFirstRequest(benchmark::State& state) {
+  constexpr uint MODULE_COUNT = 500;
+  constexpr uint IMPORTED_COUNT = 10;
+
+  capnp::MallocMessageBuilder message;
+  auto conf = message.initRoot<server::config::Worker>();
+  conf.setLazyModules(state.range(0) != 0);
+  auto modules = conf.initModules(MODULE_COUNT + 1);
+
+  kj::Vector<kj::String> imports;
+  for (auto i: kj::zeroTo(MODULE_COUNT)) {
+    auto name = kj::str("module", i, ".js");
+    modules[i + 1].setName(name);
+    modules[i + 1].setEsModule(kj::str("export function add", i, "(a, b) { return a + b + ", i,
+        "; }\n"
+        "export class Counter", i, " { count = 0; increment() { return ++this.count; } }\n"
+        "export const TABLE = Array.from({ length: 64 }, (_, j) => add", i, "(j, j));\n"));
+    if (i < IMPORTED_COUNT) {
+      imports.add(kj::str("import { add", i, " } from \"", name, "\";\n"));
+    }
+  }
+  modules[0].setName("main");
+  modules[0].setEsModule(kj::str(kj::strArray(imports, ""),
+      "export default {\n"
+      "  async fetch(request) {\n"
+      "    return new Response(String(add0(1, 2)));\n"
+      "  },\n"
+      "};\n"));
+
+  size_t heapBytes = 0;
+  for (auto _: state) {
+    TestFixture fixture({.workerConfig = conf.asReader()});
+    auto result = fixture.runRequest(kj::HttpMethod::GET, "http://www.example.com"_kj, ""_kj);
+    KJ_EXPECT(result.statusCode == 200);
+    fixture.runInIoContext([&](const TestFixture::Environment& env) {
+      v8::HeapStatistics stats;
+      env.isolate->GetHeapStatistics(&stats);
+      heapBytes = stats.used_heap_size();
+    });
+  }
+  state.counters["heapBytes"] = heapBytes;
+}
+
+WD_BENCHMARK(Bench_largeBundleTimeToFirstRequest)->Arg(0)->Arg(1);
+
+}  // namespace
+}  // namespace workerd
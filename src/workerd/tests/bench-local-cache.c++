@@ -0,0 +1,83 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// Compares the latency of a Cache API hit served by the in-process `cache` service with the same
+// hit served over an HTTP/1.1 connection, the way `cacheApiOutbound` pointing at a caching proxy
+// running as a sidecar works. The sidecar variant uses a socketpair rather than TCP and the same
+// cache implementation on the other end, so it only measures the cost of the extra hop itself.
+
+#include <workerd/server/local-cache.h>
+#include <workerd/tests/bench-tools.h>
+
+#include <kj/async-io.h>
+
+namespace workerd::server {
+namespace {
+
+constexpr kj::StringPtr URL = "https://example.com/asset"_kj;
+
+struct CacheFixture {
+  kj::AsyncIoContext io = kj::setupAsyncIo();
+  kj::HttpHeaderTable::Builder builder;
+  LocalCache cache{kj::systemPreciseCalendarClock(), builder, {}};
+  kj::Own<kj::HttpHeaderTable> table = builder.build();
+  kj::Own<kj::HttpClient> inProcess = kj::newHttpClient(cache);
+
+  kj::TwoWayPipe pipe = io.provider->newTwoWayPipe();
+  kj::HttpServer server{io.provider->getTimer(), *table, cache};
+  kj::Promise<void> serverLoop = server.listenHttp(kj::mv(pipe.ends[0])).eagerlyEvaluate(nullptr);
+  kj::Own<kj::HttpClient> sidecar = kj::newHttpClient(*table, *pipe.ends[1]);
+
+  explicit CacheFixture(size_t bodySize) {
+    auto body = kj::heapString(bodySize);
+    for (auto& c: body) c = 'x';
+    auto payload = kj::str("HTTP/1.1 200 OK\r\nCache-Control: max-age=3600\r\nContent-Length: ",
+        bodySize, "\r\n\r\n", body);
+
+    auto request = inProcess->request(
+        kj::HttpMethod::PUT, URL, kj::HttpHeaders(*table), uint64_t(payload.size()));
+    request.body->write(payload.asBytes()).wait(io.waitScope);
+    request.body = nullptr;
+    KJ_ASSERT(request.response.wait(io.waitScope).statusCode == 204);
+  }
+
+  void match(kj::HttpClient& client) {
+    kj::HttpHeaders headers(*table);
+    auto response = client.request(kj::HttpMethod::GET, URL, headers).response.wait(io.waitScope);
+    KJ_ASSERT(response.statusCode == 200);
+    benchmark::DoNotOptimize(response.body->readAllBytes().wait(io.waitScope).size());
+  }
+};
+
+static void LocalCache_HitInProcess(benchmark::State& state) {
+  CacheFixture f(state.range(0));
+  for (auto _: state) {
+    f.match(*f.inProcess);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+static void LocalCache_HitViaSidecar(benchmark::State& state) {
+  CacheFixture f(state.range(0));
+  for (auto _: state) {
+    f.match(*f.sidecar);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(LocalCache_HitInProcess)
+    ->ArgName("bodyBytes")
+    ->Arg(1 << 10)
+    ->Arg(64 << 10)
+    ->Arg(1 << 20)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(LocalCache_HitViaSidecar)
+    ->ArgName("bodyBytes")
+    ->Arg(1 << 10)
+    ->Arg(64 << 10)
+    ->Arg(1 << 20)
+    ->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+}  // namespace workerd::server
@@ -0,0 +1,73 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// Measures how the throughput of memory cache hits scales when many threads read from the same
+// SharedMemoryCache at once, the way isolates on different threads sharing one cache id do.
+
+#include <workerd/api/memory-cache.h>
+#include <workerd/io/trace.h>
+#include <workerd/tests/bench-tools.h>
+
+namespace workerd::api {
+namespace {
+
+using Use = SharedMemoryCache::Use;
+
+constexpr uint KEY_COUNT = 1000;
+constexpr uint VALUE_SIZE = 256;
+
+constexpr SharedMemoryCache::Limits LIMITS = {
+  .maxKeys = KEY_COUNT,
+  .maxValueSize = VALUE_SIZE,
+  .maxTotalValueSize = KEY_COUNT * VALUE_SIZE,
+};
+
+// The cache shared by all benchmark threads, filled with KEY_COUNT entries. It holds on to a Use
+// of its own so that the entries stay around while threads come and go.
+struct CacheFixture {
+  kj::Own<const SharedMemoryCache> cache =
+      SharedMemoryCache::create(kj::none, "bench"_kj, kj::none, kj::systemPreciseMonotonicClock());
+  Use use{kj::atomicAddRef(*cache), LIMITS};
+  kj::Vector<kj::String> keys;
+
+  CacheFixture() {
+    kj::EventLoop loop;
+    kj::WaitScope ws(loop);
+    SpanBuilder span(nullptr);
+
+    for (auto i: kj::zeroTo(KEY_COUNT)) {
+      auto& key = keys.add(kj::str("key", i));
+      // A miss with no other fallback in progress always asks us to run the fallback.
+      auto result = use.getWithFallback(key, span);
+      auto outcome = result.get<kj::Promise<Use::GetWithFallbackOutcome>>().wait(ws);
+      auto& callback = outcome.get<Use::FallbackDoneCallback>();
+      callback(Use::FallbackResult{
+        .value = kj::atomicRefcounted<CacheValue>(kj::heapArray<kj::byte>(VALUE_SIZE)),
+        .expiration = kj::none,
+      });
+    }
+  }
+};
+
+static void MemoryCache_Hit(benchmark::State& state) {
+  static const CacheFixture fixture;
+
+  // Each thread reads through a Use of its own, like each isolate's binding does.
+  Use use(kj::atomicAddRef(*fixture.cache), LIMITS);
+  SpanBuilder span(nullptr);
+
+  for (auto _: state) {
+    for (auto& key: fixture.keys) {
+      auto value = use.getWithoutFallback(key, span);
+      KJ_ASSERT(value != kj::none);
+      benchmark::DoNotOptimize(value);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * KEY_COUNT);
+}
+
+BENCHMARK(MemoryCache_Hit)->ThreadRange(1, 16)->UseRealTime();
+
+}  // namespace
+}  // namespace workerd::api
@@ -0,0 +1,121 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// Compares SqliteKv's batched multi-key operations against looping over the single-key ones,
+// which is what ActorSqlite used to do for `storage.get([...])` and friends.
+
+#include <workerd/tests/bench-tools.h>
+#include <workerd/util/sqlite-kv.h>
+
+namespace workerd {
+namespace {
+
+// Matches ActorCacheSharedLruOptions::maxKeysPerRpc, the most keys a single storage operation
+// usually carries.
+constexpr uint KEY_COUNT = 128;
+
+struct KvFixture {
+  kj::Own<const kj::Directory> dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs{*dir};
+  SqliteDatabase db{vfs, kj::Path({"foo"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY};
+  SqliteKv kv{db};
+
+  kj::Vector<kj::String> keys;
+  kj::Vector<SqliteKv::KeyPtr> keyPtrs;
+  kj::Array<kj::byte> value = kj::heapArray<kj::byte>(100);
+  kj::Vector<SqliteKv::KeyValuePtrPair> pairs;
+
+  KvFixture() {
+    memset(value.begin(), 0x42, value.size());
+    for (auto i: kj::zeroTo(KEY_COUNT)) {
+      keys.add(kj::str("key", i));
+    }
+    for (auto& key: keys) {
+      keyPtrs.add(key);
+      pairs.add(SqliteKv::KeyValuePtrPair{.key = key, .value = value});
+    }
+    kv.put(pairs.asPtr());
+  }
+};
+
+static void SqliteKv_GetLoop(benchmark::State& state) {
+  KvFixture f;
+  for (auto _: state) {
+    uint count = 0;
+    for (auto key: f.keyPtrs) {
+      f.kv.get(key, [&](SqliteKv::ValuePtr value) { count += value.size() > 0; });
+    }
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * KEY_COUNT);
+}
+
+static void SqliteKv_GetBatched(benchmark::State& state) {
+  KvFixture f;
+  for (auto _: state) {
+    uint count = 0;
+    f.kv.get(f.keyPtrs.asPtr(),
+        [&](SqliteKv::KeyPtr, SqliteKv::ValuePtr value) { count += value.size() > 0; });
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * KEY_COUNT);
+}
+
+static void SqliteKv_PutLoop(benchmark::State& state) {
+  KvFixture f;
+  for (auto _: state) {
+    f.db.run("BEGIN TRANSACTION");
+    for (auto& pair: f.pairs) {
+      f.kv.put(pair.key, pair.value);
+    }
+    f.db.run("COMMIT TRANSACTION");
+  }
+  state.SetItemsProcessed(state.iterations() * KEY_COUNT);
+}
+
+static void SqliteKv_PutBatched(benchmark::State& state) {
+  KvFixture f;
+  for (auto _: state) {
+    f.db.run("BEGIN TRANSACTION");
+    f.kv.put(f.pairs.asPtr());
+    f.db.run("COMMIT TRANSACTION");
+  }
+  state.SetItemsProcessed(state.iterations() * KEY_COUNT);
+}
+
+// Deletes are measured inside a transaction that's rolled back, so every iteration starts from
+// a full table.
+static void SqliteKv_DeleteLoop(benchmark::State& state) {
+  KvFixture f;
+  for (auto _: state) {
+    f.db.run("BEGIN TRANSACTION");
+    uint count = 0;
+    for (auto key: f.keyPtrs) {
+      count += f.kv.delete_(key);
+    }
+    benchmark::DoNotOptimize(count);
+    f.db.run("ROLLBACK TRANSACTION");
+  }
+  state.SetItemsProcessed(state.iterations() * KEY_COUNT);
+}
+
+static void SqliteKv_DeleteBatched(benchmark::State& state) {
+  KvFixture f;
+  for (auto _: state) {
+    f.db.run("BEGIN TRANSACTION");
+    benchmark::DoNotOptimize(f.kv.delete_(f.keyPtrs.asPtr()));
+    f.db.run("ROLLBACK TRANSACTION");
+  }
+  state.SetItemsProcessed(state.iterations() * KEY_COUNT);
+}
+
+WD_BENCHMARK(SqliteKv_GetLoop);
+WD_BENCHMARK(SqliteKv_GetBatched);
+WD_BENCHMARK(SqliteKv_PutLoop);
+WD_BENCHMARK(SqliteKv_PutBatched);
+WD_BENCHMARK(SqliteKv_DeleteLoop);
+WD_BENCHMARK(SqliteKv_DeleteBatched);
+
+}  // namespace
+}  // namespace workerd
@@ -0,0 +1,89 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+// Compares point-lookup latency on an on-disk database with and without memory-mapped I/O, i.e.
+// `durableObjectStorage = (localDisk = ...)` with and without `localDiskMmapBytes`.
+//
+// The page cache is kept small so that most lookups actually have to fetch pages from the file;
+// otherwise both variants would just be measuring SQLite's page cache.
+
+#include <workerd/tests/bench-tools.h>
+#include <workerd/util/sqlite.h>
+
+#include <kj/filesystem.h>
+
+#include <errno.h>
+#include <stdlib.h>
+
+namespace workerd {
+namespace {
+
+constexpr uint ROW_COUNT = 20000;
+constexpr uint VALUE_SIZE = 1024;
+
+class MmapFixture {
+ public:
+  explicit MmapFixture(uint64_t mmapBytes)
+      : vfs(*dir, {.mmapBytes = mmapBytes}),
+        db(vfs, kj::Path({"bench.sqlite"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY) {
+    db.setCacheLimits({.pageCacheBytes = 64 * 1024});
+    db.run("CREATE TABLE kv (id INTEGER PRIMARY KEY, value BLOB)");
+    db.run("BEGIN TRANSACTION");
+    auto value = kj::heapArray<kj::byte>(VALUE_SIZE);
+    memset(value.begin(), 0x42, value.size());
+    auto insert = db.prepare("INSERT INTO kv VALUES (?, ?)");
+    for (auto i: kj::zeroTo(ROW_COUNT)) {
+      insert.run(i, value.asPtr().asConst());
+    }
+    db.run("COMMIT TRANSACTION");
+  }
+
+  ~MmapFixture() noexcept(false) {
+    disk->getRoot().remove(path);
+  }
+
+  SqliteDatabase& getDb() {
+    return db;
+  }
+
+ private:
+  kj::Own<kj::Filesystem> disk = kj::newDiskFilesystem();
+  kj::Path path = makeTmpPath();
+  kj::Own<const kj::Directory> dir = disk->getRoot().openSubdir(path, kj::WriteMode::MODIFY);
+  SqliteDatabase::Vfs vfs;
+  SqliteDatabase db;
+
+  kj::Path makeTmpPath() {
+    const char* tmpDir = getenv("TEST_TMPDIR");
+    auto pathStr = kj::str(tmpDir != nullptr ? tmpDir : "/var/tmp", "/workerd-bench-mmap.XXXXXX");
+    if (mkdtemp(pathStr.begin()) == nullptr) {
+      KJ_FAIL_SYSCALL("mkdtemp", errno, pathStr);
+    }
+    return disk->getCurrentPath().evalNative(pathStr);
+  }
+};
+
+static void Sqlite_PointLookup(benchmark::State& state) {
+  MmapFixture f(state.range(0));
+  auto& db = f.getDb();
+  auto select = db.prepare("SELECT value FROM kv WHERE id = ?");
+
+  // A fixed-seed LCG so both variants visit the same sequence of rows.
+  uint32_t seed = 12345;
+  for (auto _: state) {
+    seed = seed * 1103515245 + 12345;
+    auto query = select.run(static_cast<int64_t>(seed % ROW_COUNT));
+    benchmark::DoNotOptimize(query.getBlob(0).size());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(Sqlite_PointLookup)
+    ->ArgName("mmapBytes")
+    ->Arg(0)
+    ->Arg(256 << 20)
+    ->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+}  // namespace workerd
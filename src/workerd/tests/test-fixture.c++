@@ -228,11 +228,6 @@ struct MockErrorReporter final: public Worker::ValidationErrorReporter {
 
 inline server::config::Worker::Reader buildConfig(
     TestFixture::SetupParams& params, capnp::MallocMessageBuilder& arena) {
-  auto config = arena.initRoot<server::config::Worker>();
-  auto modules = config.initModules(1);
-  modules[0].setName(mainModuleName);
-  modules[0].setEsModule(params.mainModuleSource.orDefault(mainModuleSource));
-
   // Initialize autogates with an empty config. TODO(later): allow TestFixture to accept autogate
   // states and pass them in here.
   //
@@ -240,6 +235,14 @@ inline server::config::Worker::Reader buildConfig(
   // `TestFixture`.
   util::Autogate::initAutogate({});
 
+  KJ_IF_SOME(config, params.workerConfig) {
+    return config;
+  }
+
+  auto config = arena.initRoot<server::config::Worker>();
+  auto modules = config.initModules(1);
+  modules[0].setName(mainModuleName);
+  modules[0].setEsModule(params.mainModuleSource.orDefault(mainModuleSource));
   return config;
 }
 
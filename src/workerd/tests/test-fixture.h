@@ -24,6 +24,8 @@ struct TestFixture {
     kj::Maybe<kj::WaitScope&> waitScope;
     kj::Maybe<CompatibilityFlags::Reader> featureFlags;
     kj::Maybe<kj::StringPtr> mainModuleSource;
+    // If set, used instead of a worker made of just the main module. Must outlive the fixture.
+    kj::Maybe<server::config::Worker::Reader> workerConfig;
     // If set, make a stub of an Actor with the given id.
     kj::Maybe<Worker::Actor::Id> actorId;
   };
@@ -88,6 +90,11 @@ struct TestFixture {
   // Performs HTTP request on the default module handler, and waits for full response.
   Response runRequest(kj::HttpMethod method, kj::StringPtr url, kj::StringPtr body);
 
+  // The worker's isolate, e.g. for taking its async lock directly.
+  const Worker::Isolate& getIsolate() const {
+    return *workerIsolate;
+  }
+
  private:
   kj::Maybe<kj::WaitScope&> waitScope;
   capnp::MallocMessageBuilder configArena;
@@ -0,0 +1,47 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "http-util.h"
+
+#include <stdio.h>
+
+namespace workerd {
+
+kj::Maybe<kj::Date> parseHttpDate(kj::StringPtr text) {
+  static constexpr kj::StringPtr MONTHS[] = {"Jan"_kj, "Feb"_kj, "Mar"_kj, "Apr"_kj, "May"_kj,
+    "Jun"_kj, "Jul"_kj, "Aug"_kj, "Sep"_kj, "Oct"_kj, "Nov"_kj, "Dec"_kj};
+
+  char monthName[4]{};
+  int day, year, hour, minute, second;
+  if (sscanf(text.cStr(), "%*3s, %2d %3s %4d %2d:%2d:%2d GMT", &day, monthName, &year, &hour,
+          &minute, &second) != 6) {
+    return kj::none;
+  }
+
+  int month = 0;
+  while (month < 12 && MONTHS[month] != monthName) ++month;
+  if (month == 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+    return kj::none;
+  }
+
+  // Days since the epoch for a proleptic Gregorian date, per Howard Hinnant's days_from_civil().
+  int y = year - (month < 2);
+  int era = (y >= 0 ? y : y - 399) / 400;
+  int yearOfEra = y - era * 400;
+  int dayOfYear = (153 * (month + (month < 2 ? 10 : -2)) + 2) / 5 + day - 1;
+  int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  int64_t days = int64_t(era) * 146097 + dayOfEra - 719468;
+
+  return kj::UNIX_EPOCH + days * kj::DAYS + hour * kj::HOURS + minute * kj::MINUTES +
+      second * kj::SECONDS;
+}
+
+bool etagMatches(kj::ArrayPtr<const char> a, kj::ArrayPtr<const char> b) {
+  auto strip = [](kj::ArrayPtr<const char> tag) {
+    return tag.size() >= 2 && tag[0] == 'W' && tag[1] == '/' ? tag.slice(2) : tag;
+  };
+  return strip(a) == strip(b);
+}
+
+}  // namespace workerd
@@ -4,10 +4,35 @@
 
 #pragma once
 
+#include <workerd/util/strings.h>
+
 #include <kj/compat/http.h>
+#include <kj/time.h>
 
 namespace workerd {
 
+// Calls `func` with each comma-separated element of a header value, trimmed of whitespace.
+// Empty elements are skipped.
+template <typename Func>
+void forEachListElement(kj::StringPtr value, Func&& func) {
+  auto rest = value.asArray();
+  while (rest.size() > 0) {
+    size_t end = 0;
+    while (end < rest.size() && rest[end] != ',') ++end;
+    auto element = trimLeadingAndTrailingWhitespace(rest.first(end));
+    if (element.size() > 0) func(element);
+    rest = end < rest.size() ? rest.slice(end + 1) : rest.slice(rest.size());
+  }
+}
+
+// Parses an HTTP date in the preferred IMF-fixdate format, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+// The obsolete formats, which HTTP says caches should also accept, are treated as invalid, which
+// for `Expires` means already expired.
+kj::Maybe<kj::Date> parseHttpDate(kj::StringPtr text);
+
+// Compares entity tags the way If-None-Match does, i.e. ignoring the weak indicator.
+bool etagMatches(kj::ArrayPtr<const char> a, kj::ArrayPtr<const char> b);
+
 // Attaches the given object to a `Request` so that it lives as long as the request's properties.
 // The given object must support `kj::addRef()` (e.g. `kj::Refcount`).
 template <typename T>
@@ -0,0 +1,130 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "sqlite-group-commit.h"
+
+#include <kj/test.h>
+
+#if __linux__
+#include <stdlib.h>
+#endif
+
+namespace workerd {
+namespace {
+
+void setupDb(SqliteDatabase& db) {
+  db.run("PRAGMA journal_mode=WAL;");
+  SqliteGroupCommit::configure(db);
+  db.run("CREATE TABLE things (value INTEGER)");
+}
+
+KJ_TEST("SqliteGroupCommit batches syncs across databases") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+  kj::TimerImpl timer(kj::origin<kj::TimePoint>());
+
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs(*dir);
+  SqliteDatabase db1(vfs, kj::Path({"foo"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+  SqliteDatabase db2(vfs, kj::Path({"bar"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+  setupDb(db1);
+  setupDb(db2);
+  KJ_EXPECT(db1.run("PRAGMA synchronous").getInt(0) == 1);  // NORMAL
+
+  SqliteGroupCommit groupCommit(timer, 10 * kj::MILLISECONDS);
+
+  db1.run("INSERT INTO things VALUES (1)");
+  auto promise1 = groupCommit.sync(db1);
+  db1.run("INSERT INTO things VALUES (2)");
+  auto promise2 = groupCommit.sync(db1);
+  db2.run("INSERT INTO things VALUES (3)");
+  auto promise3 = groupCommit.sync(db2);
+
+  // Nothing is synced until the window closes.
+  KJ_EXPECT(!promise1.poll(ws));
+  KJ_EXPECT(!promise3.poll(ws));
+  KJ_EXPECT(groupCommit.getSyncCount() == 0);
+
+  timer.advanceTo(timer.now() + 10 * kj::MILLISECONDS);
+  promise1.wait(ws);
+  promise2.wait(ws);
+  promise3.wait(ws);
+
+  // Each database was synced once, even though db1 committed twice.
+  KJ_EXPECT(groupCommit.getSyncCount() == 2);
+
+  // A sync whose promise is dropped doesn't touch the database.
+  {
+    db2.run("INSERT INTO things VALUES (4)");
+    auto dropped = groupCommit.sync(db2);
+  }
+  timer.advanceTo(timer.now() + 10 * kj::MILLISECONDS);
+  ws.poll();
+  KJ_EXPECT(groupCommit.getSyncCount() == 2);
+
+  // A new window starts with the next sync.
+  db2.run("INSERT INTO things VALUES (5)");
+  auto promise4 = groupCommit.sync(db2);
+  KJ_EXPECT(!promise4.poll(ws));
+  timer.advanceTo(timer.now() + 10 * kj::MILLISECONDS);
+  promise4.wait(ws);
+  KJ_EXPECT(groupCommit.getSyncCount() == 3);
+}
+
+#if __linux__
+KJ_TEST("SqliteGroupCommit uses one syncfs() for a batch on real disk") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+  kj::TimerImpl timer(kj::origin<kj::TimePoint>());
+
+  auto disk = kj::newDiskFilesystem();
+  const char* tmpDir = getenv("TEST_TMPDIR");
+  auto pathStr =
+      kj::str(tmpDir != nullptr ? tmpDir : "/var/tmp", "/workerd-sqlite-group-commit-test.XXXXXX");
+  if (mkdtemp(pathStr.begin()) == nullptr) {
+    KJ_FAIL_SYSCALL("mkdtemp", errno, pathStr);
+  }
+  auto path = disk->getCurrentPath().evalNative(pathStr);
+  KJ_DEFER(disk->getRoot().remove(path));
+
+  {
+    auto dir = disk->getRoot().openSubdir(path, kj::WriteMode::MODIFY);
+    SqliteDatabase::Vfs vfs(*dir);
+    SqliteDatabase db1(vfs, kj::Path({"foo"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+    SqliteDatabase db2(vfs, kj::Path({"bar"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+    setupDb(db1);
+    setupDb(db2);
+
+    SqliteGroupCommit groupCommit(timer, 10 * kj::MILLISECONDS, dir->getFd());
+
+    // A batch covering a single database syncs just that database's log.
+    db1.run("INSERT INTO things VALUES (1)");
+    auto promise1 = groupCommit.sync(db1);
+    timer.advanceTo(timer.now() + 10 * kj::MILLISECONDS);
+    promise1.wait(ws);
+    KJ_EXPECT(groupCommit.getSyncCount() == 1);
+
+    // A batch covering both databases is made durable by one syncfs() rather than two syncs.
+    db1.run("INSERT INTO things VALUES (2)");
+    auto promise2 = groupCommit.sync(db1);
+    db2.run("INSERT INTO things VALUES (3)");
+    auto promise3 = groupCommit.sync(db2);
+    timer.advanceTo(timer.now() + 10 * kj::MILLISECONDS);
+    promise2.wait(ws);
+    promise3.wait(ws);
+    KJ_EXPECT(groupCommit.getSyncCount() == 2);
+  }
+
+  // The committed rows are visible to a fresh connection.
+  auto dir = disk->getRoot().openSubdir(path, kj::WriteMode::MODIFY);
+  SqliteDatabase::Vfs vfs(*dir);
+  SqliteDatabase db1(vfs, kj::Path({"foo"}), kj::WriteMode::MODIFY);
+  SqliteDatabase db2(vfs, kj::Path({"bar"}), kj::WriteMode::MODIFY);
+  KJ_EXPECT(db1.run("SELECT COUNT(*) FROM things").getInt(0) == 2);
+  KJ_EXPECT(db2.run("SELECT COUNT(*) FROM things").getInt(0) == 1);
+}
+#endif
+
+}  // namespace
+}  // namespace workerd
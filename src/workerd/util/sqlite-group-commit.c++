@@ -0,0 +1,96 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "sqlite-group-commit.h"
+
+#include <kj/debug.h>
+#include <kj/map.h>
+
+#if __linux__
+#include <unistd.h>
+#endif
+
+namespace workerd {
+
+SqliteGroupCommit::SqliteGroupCommit(kj::Timer& timer, kj::Duration window, kj::Maybe<int> dirFd)
+    : timer(timer),
+      window(window),
+      dirFd(dirFd),
+      tasks(*this) {}
+
+void SqliteGroupCommit::configure(SqliteDatabase& db) {
+  // In WAL mode, NORMAL still syncs the log before checkpointing, so the database can't be
+  // corrupted by a crash; it only stops COMMIT from waiting for the log to reach disk. That
+  // barrier is what sync() provides instead.
+  db.run(SqliteDatabase::TRUSTED, "PRAGMA synchronous = NORMAL;");
+}
+
+kj::Promise<void> SqliteGroupCommit::sync(SqliteDatabase& db) {
+  auto paf = kj::newPromiseAndFulfiller<void>();
+  waiters.add(Waiter{.db = &db, .fulfiller = kj::mv(paf.fulfiller)});
+
+  if (!flushScheduled) {
+    flushScheduled = true;
+    tasks.add(timer.afterDelay(window).then([this]() { flush(); }));
+  }
+
+  return kj::mv(paf.promise);
+}
+
+void SqliteGroupCommit::flush() {
+  flushScheduled = false;
+
+  // Commits whose caller has gone away, e.g. because the Durable Object was destroyed, may refer
+  // to databases that no longer exist, so drop them before doing anything else.
+  auto batch = kj::heapArrayBuilder<Waiter>(waiters.size());
+  for (auto& waiter: waiters) {
+    if (waiter.fulfiller->isWaiting()) {
+      batch.add(kj::mv(waiter));
+    }
+  }
+  waiters.clear();
+
+  KJ_IF_SOME(exception, kj::runCatchingExceptions([&]() { syncBatch(batch.asPtr()); })) {
+    for (auto& waiter: batch) {
+      waiter.fulfiller->reject(kj::cp(exception));
+    }
+  } else {
+    for (auto& waiter: batch) {
+      waiter.fulfiller->fulfill();
+    }
+  }
+}
+
+void SqliteGroupCommit::syncBatch(kj::ArrayPtr<Waiter> batch) {
+  kj::HashSet<SqliteDatabase*> databases;
+  for (auto& waiter: batch) {
+    if (databases.find(waiter.db) == kj::none) {
+      databases.insert(waiter.db);
+    }
+  }
+
+#if __linux__
+  KJ_IF_SOME(fd, dirFd) {
+    if (databases.size() > 1) {
+      // syncfs() also flushes unrelated dirty data on the same filesystem, so it only pays off
+      // once it replaces more than one fsync().
+      KJ_SYSCALL(syncfs(fd));
+      ++syncCount;
+      return;
+    }
+  }
+#endif
+
+  for (auto db: databases) {
+    db->syncJournal();
+    ++syncCount;
+  }
+}
+
+void SqliteGroupCommit::taskFailed(kj::Exception&& exception) {
+  // flush() reports errors to the waiters, so only the timer itself could fail here.
+  KJ_LOG(ERROR, "SQLite group commit failed", exception);
+}
+
+}  // namespace workerd
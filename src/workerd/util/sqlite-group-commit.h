@@ -0,0 +1,71 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include "sqlite.h"
+
+#include <kj/async.h>
+#include <kj/timer.h>
+#include <kj/vector.h>
+
+namespace workerd {
+
+// Batches the durability barriers of many SQLite databases stored in the same directory, so that
+// a burst of small commits across many databases costs a few syncs rather than one sync each.
+//
+// Databases taking part must be in WAL mode and have been passed to `configure()`, which turns
+// off SQLite's own sync on commit. After each commit, the caller must wait for `sync()` before
+// treating the transaction as durable -- for ActorSqlite, this means calling it from the
+// `commitCallback`, so that the output gate stays locked until the shared sync completes.
+//
+// Each sync() call is held for up to `window`, then the whole batch is made durable together:
+// each distinct database's log is synced once, or, on Linux, when the batch covers more than one
+// database and the directory's file descriptor is known, the whole filesystem is synced with a
+// single syncfs().
+//
+// Like SqliteDatabase, this class is not thread-safe; all databases must be used from the
+// thread that owns it.
+class SqliteGroupCommit: private kj::TaskSet::ErrorHandler {
+ public:
+  // `dirFd` is the file descriptor of the directory containing the databases, if they are on a
+  // real disk. It must remain open for the lifetime of this object.
+  SqliteGroupCommit(kj::Timer& timer, kj::Duration window, kj::Maybe<int> dirFd = kj::none);
+
+  // Prepares `db` for group commit, by setting `PRAGMA synchronous = NORMAL`. This must be
+  // called again after the database is reset, e.g. from an `afterReset()` callback.
+  static void configure(SqliteDatabase& db);
+
+  // Returns a promise that resolves once everything committed to `db` so far is durable. If the
+  // promise is dropped before then, `db` is not touched again, so it's safe to destroy it.
+  kj::Promise<void> sync(SqliteDatabase& db);
+
+  // Number of sync operations performed so far, for tests and metrics.
+  uint64_t getSyncCount() const {
+    return syncCount;
+  }
+
+ private:
+  kj::Timer& timer;
+  kj::Duration window;
+  kj::Maybe<int> dirFd;
+
+  struct Waiter {
+    SqliteDatabase* db;
+    kj::Own<kj::PromiseFulfiller<void>> fulfiller;
+  };
+  kj::Vector<Waiter> waiters;
+
+  bool flushScheduled = false;
+  uint64_t syncCount = 0;
+
+  kj::TaskSet tasks;
+
+  void flush();
+  void syncBatch(kj::ArrayPtr<Waiter> batch);
+
+  void taskFailed(kj::Exception&& exception) override;
+};
+
+}  // namespace workerd
@@ -4,6 +4,7 @@
 
 #include "sqlite-kv.h"
 
+#include <kj/map.h>
 #include <kj/test.h>
 
 namespace workerd {
@@ -128,5 +129,111 @@ KJ_TEST("large key") {
       "string or blob too big: SQLITE_TOOBIG", kv.put(tooBigString, "hello"_kj.asBytes()));
 }
 
+KJ_TEST("multi-key operations") {
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs(*dir);
+  SqliteDatabase db(vfs, kj::Path({"foo"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+  SqliteKv kv(db);
+
+  // Use enough keys to exercise every batch width plus some leftover single-key operations, and
+  // include keys containing NUL bytes, which must not be confused with their prefixes.
+  kj::Vector<kj::String> keys;
+  kj::Vector<kj::String> values;
+  for (auto i: kj::zeroTo(97)) {
+    keys.add(kj::str("key", i));
+    values.add(kj::str("value", i));
+  }
+  keys.add(kj::heapString("nul\0a", 5));
+  values.add(kj::str("first"));
+  keys.add(kj::heapString("nul\0b", 5));
+  values.add(kj::str("second"));
+  keys.add(kj::str("nul"));
+  values.add(kj::str("third"));
+
+  auto keyPtrs = KJ_MAP(k, keys) -> SqliteKv::KeyPtr { return k; };
+  kj::Vector<SqliteKv::KeyValuePtrPair> pairs;
+  for (auto i: kj::indices(keys)) {
+    pairs.add(SqliteKv::KeyValuePtrPair{keys[i], values[i].asBytes()});
+  }
+  // A duplicate key takes the last value, even across batches.
+  pairs.add(SqliteKv::KeyValuePtrPair{keys[0], "overwritten"_kj.asBytes()});
+  kv.put(pairs.asPtr());
+
+  kj::HashMap<kj::String, kj::String> seen;
+  auto record = [&](kj::StringPtr key, kj::ArrayPtr<const byte> value) {
+    seen.insert(kj::str(key), kj::str(value.asChars()));
+  };
+
+  auto missing = kj::str("missing");
+  auto lookup = kj::heapArray<SqliteKv::KeyPtr>(keyPtrs.size() + 1);
+  for (auto i: kj::indices(keyPtrs)) {
+    lookup[i] = keyPtrs[i];
+  }
+  lookup.back() = missing;
+  KJ_EXPECT(kv.get(lookup.asPtr(), record) == keys.size());
+  KJ_EXPECT(seen.size() == keys.size());
+  KJ_EXPECT(KJ_ASSERT_NONNULL(seen.find(keys[0])) == "overwritten");
+  for (auto i: kj::range<size_t>(1, keys.size())) {
+    KJ_EXPECT(KJ_ASSERT_NONNULL(seen.find(keys[i])) == values[i], keys[i]);
+  }
+  KJ_EXPECT(seen.find(missing) == kj::none);
+
+  // The keys handed to the callback are the caller's, so they outlive the rows they came from.
+  kj::Vector<SqliteKv::KeyPtr> keptKeys;
+  kv.get(lookup.asPtr(), [&](SqliteKv::KeyPtr key, auto) { keptKeys.add(key); });
+  KJ_EXPECT(keptKeys.size() == keys.size());
+  for (auto key: keptKeys) {
+    KJ_EXPECT(std::find_if(keyPtrs.begin(), keyPtrs.end(), [&](SqliteKv::KeyPtr k) {
+      return k.begin() == key.begin();
+    }) != keyPtrs.end(), key);
+  }
+
+  // Deleting reports only the keys that existed.
+  KJ_EXPECT(kv.delete_(lookup.slice(50, lookup.size())) == keys.size() - 50);
+  KJ_EXPECT(kv.delete_(lookup.slice(40, lookup.size())) == 10);
+
+  seen.clear();
+  KJ_EXPECT(kv.get(lookup.asPtr(), record) == 40);
+  KJ_EXPECT(seen.find(keys[39]) != kj::none);
+  KJ_EXPECT(seen.find(keys[40]) == kj::none);
+
+  // Empty inputs are no-ops.
+  kv.put(nullptr);
+  KJ_EXPECT(kv.delete_(kj::ArrayPtr<const SqliteKv::KeyPtr>()) == 0);
+}
+
+KJ_TEST("range operations") {
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs(*dir);
+  SqliteDatabase db(vfs, kj::Path({"foo"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+  SqliteKv kv(db);
+
+  // Before the table exists, ranges are empty.
+  KJ_EXPECT(kv.countRange(""_kj, kj::none).count == 0);
+  KJ_EXPECT(kv.deleteRange(""_kj, kj::none) == 0);
+
+  for (auto prefix: {"a"_kj, "b"_kj, "c"_kj}) {
+    for (auto i: kj::zeroTo(10)) {
+      kv.put(kj::str(prefix, ":", i), "value"_kj.asBytes());
+    }
+  }
+
+  KJ_EXPECT(kv.countRange(""_kj, kj::none).count == 30);
+  KJ_EXPECT(kv.countRange("b:"_kj, "b;"_kj).count == 10);
+  KJ_EXPECT(kv.countRange("b:"_kj, "b;"_kj).keyBytes == 30);
+  KJ_EXPECT(kv.countRange("b:3"_kj, "b:7"_kj).count == 4);
+  KJ_EXPECT(kv.countRange("b:5"_kj, kj::none).count == 15);
+  KJ_EXPECT(kv.countRange("d"_kj, kj::none).count == 0);
+
+  KJ_EXPECT(kv.deleteRange("b:"_kj, "b;"_kj) == 10);
+  KJ_EXPECT(kv.countRange("b:"_kj, "b;"_kj).count == 0);
+  KJ_EXPECT(kv.countRange(""_kj, kj::none).count == 20);
+
+  KJ_EXPECT(kv.deleteRange("c:5"_kj, kj::none) == 5);
+  KJ_EXPECT(kv.countRange(""_kj, kj::none).count == 15);
+  KJ_EXPECT(kv.get("c:4"_kj, [](auto) {}));
+  KJ_EXPECT(!kv.get("c:5"_kj, [](auto) {}));
+}
+
 }  // namespace
 }  // namespace workerd
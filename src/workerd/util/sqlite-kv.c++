@@ -76,6 +76,78 @@ bool SqliteKv::delete_(KeyPtr key) {
   return query.changeCount() > 0;
 }
 
+SqliteDatabase::Statement& SqliteKv::getBatchStatement(
+    Initialized& stmts, BatchOp op, uint widthIndex) {
+  auto& slot = stmts.batchStmts[op][widthIndex];
+  KJ_IF_SOME(stmt, slot) {
+    return stmt;
+  }
+
+  kj::StringPtr prefix;
+  kj::StringPtr group;
+  kj::StringPtr suffix;
+  switch (op) {
+    case BATCH_GET:
+      prefix = "SELECT key, value FROM _cf_KV WHERE key IN ("_kj;
+      group = "?"_kj;
+      suffix = ") ORDER BY key"_kj;
+      break;
+    case BATCH_PUT:
+      // SQLite applies the rows of a multi-row upsert in order, so a key that appears more than
+      // once ends up with its last value, same as a series of single-key puts.
+      prefix = "INSERT INTO _cf_KV VALUES "_kj;
+      group = "(?, ?)"_kj;
+      suffix = " ON CONFLICT DO UPDATE SET value = excluded.value"_kj;
+      break;
+    case BATCH_DELETE:
+      prefix = "DELETE FROM _cf_KV WHERE key IN ("_kj;
+      group = "?"_kj;
+      suffix = ")"_kj;
+      break;
+    case BATCH_OP_COUNT:
+      KJ_UNREACHABLE;
+  }
+
+  auto groups = kj::heapArray<kj::StringPtr>(BATCH_WIDTHS[widthIndex]);
+  for (auto& g: groups) {
+    g = group;
+  }
+  return slot.emplace(
+      stmts.db.prepare(stmts.regulator, kj::str(prefix, kj::strArray(groups, ", "), suffix)));
+}
+
+void SqliteKv::put(kj::ArrayPtr<const KeyValuePtrPair> pairs) {
+  if (pairs.size() == 0) return;
+  auto& stmts = ensureInitialized();
+
+  forEachBatch(pairs, [&](kj::ArrayPtr<const KeyValuePtrPair> batch, uint widthIndex) {
+    SqliteDatabase::Query::ValuePtr bindings[BATCH_WIDTHS[0] * 2];
+    for (auto i: kj::indices(batch)) {
+      bindings[i * 2] = batch[i].key;
+      bindings[i * 2 + 1] = batch[i].value;
+    }
+    getBatchStatement(stmts, BATCH_PUT, widthIndex)
+        .run(kj::ArrayPtr<const SqliteDatabase::Query::ValuePtr>(bindings, batch.size() * 2));
+  }, [&](const KeyValuePtrPair& pair) { stmts.stmtPut.run(pair.key, pair.value); });
+}
+
+uint SqliteKv::delete_(kj::ArrayPtr<const KeyPtr> keys) {
+  if (keys.size() == 0) return 0;
+  auto& stmts = ensureInitialized();
+
+  uint count = 0;
+  forEachBatch(keys, [&](kj::ArrayPtr<const KeyPtr> batch, uint widthIndex) {
+    SqliteDatabase::Query::ValuePtr bindings[BATCH_WIDTHS[0]];
+    for (auto i: kj::indices(batch)) {
+      bindings[i] = batch[i];
+    }
+    count += getBatchStatement(stmts, BATCH_DELETE, widthIndex)
+                 .run(kj::ArrayPtr<const SqliteDatabase::Query::ValuePtr>(bindings, batch.size()))
+                 .changeCount();
+  }, [&](KeyPtr key) { count += stmts.stmtDelete.run(key).changeCount(); });
+  return count;
+}
+
 uint SqliteKv::deleteAll() {
   // TODO(perf): Consider introducing a compatibility flag that causes deleteAll() to always return
   //   1. Apps almost certainly don't care about the return value but historically we returned the
@@ -85,6 +157,36 @@ uint SqliteKv::deleteAll() {
   return count;
 }
 
+uint SqliteKv::deleteRange(KeyPtr begin, kj::Maybe<KeyPtr> end) {
+  if (!tableCreated) return 0;
+  auto& stmts = ensureInitialized();
+
+  KJ_IF_SOME(e, end) {
+    return stmts.stmtDeleteRangeEnd.run(begin, e).changeCount();
+  } else {
+    return stmts.stmtDeleteRange.run(begin).changeCount();
+  }
+}
+
+SqliteKv::RangeCount SqliteKv::countRange(KeyPtr begin, kj::Maybe<KeyPtr> end) {
+  RangeCount empty{.count = 0, .keyBytes = 0};
+  if (!tableCreated) return empty;
+  auto& stmts = KJ_UNWRAP_OR(state.tryGet<Initialized>(), return empty);
+
+  auto toRangeCount = [](SqliteDatabase::Query&& query) {
+    return RangeCount{
+      .count = static_cast<uint>(query.getInt64(0)),
+      .keyBytes = static_cast<uint64_t>(query.getInt64(1)),
+    };
+  };
+
+  KJ_IF_SOME(e, end) {
+    return toRangeCount(stmts.stmtCountRangeEnd.run(begin, e));
+  } else {
+    return toRangeCount(stmts.stmtCountRange.run(begin));
+  }
+}
+
 void SqliteKv::beforeSqliteReset() {
   // We'll need to recreate the table on the next operation.
   tableCreated = false;
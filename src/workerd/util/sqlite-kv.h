@@ -8,6 +8,8 @@
 
 #include <workerd/jsg/exception.h>
 
+#include <algorithm>
+
 namespace workerd {
 
 // Small class which is used to customize certain aspects of the underlying sql operations
@@ -54,12 +56,56 @@ class SqliteKv: private SqliteDatabase::ResetListener {
 
   uint deleteAll();
 
-  // TODO(perf): Should we provide multi-get, multi-put, and multi-delete? It's a bit tricky to
-  //   implement them as single SQL queries, while still using prepared statements. The c-array
-  //   extension might help here, though it can only support arrays of NUL-terminated strings, not
-  //   byte blobs or strings containing NUL bytes.
+  struct RangeCount {
+    uint count;
+
+    // Total size of the keys counted, in bytes.
+    uint64_t keyBytes;
+  };
+
+  // Delete or count all keys in the range [begin, end), each as a single statement that never
+  // reads values. `end` can be null to include everything through the last key. deleteRange()
+  // returns the number of keys deleted.
+  uint deleteRange(KeyPtr begin, kj::Maybe<KeyPtr> end);
+  RangeCount countRange(KeyPtr begin, kj::Maybe<KeyPtr> end);
+
+  struct KeyValuePtrPair {
+    KeyPtr key;
+    ValuePtr value;
+  };
+
+  // Multi-key variants of get(), put(), and delete_(). Keys are split into batches which are each
+  // executed as a single prepared statement with one placeholder per key (e.g. `key IN (?, ?, ...)`
+  // or a multi-row upsert), so a 128-key operation takes four trips into SQLite rather than 128.
+  // Since keys are bound as ordinary parameters, they may contain arbitrary bytes, including NULs.
+  // (The c-array extension would avoid the fixed-width statements, but can only bind arrays of
+  // NUL-terminated strings.)
+  //
+  // The multi-key get() calls the callback (with KeyPtr and ValuePtr parameters) for each key that
+  // is found and returns the number of calls. The KeyPtr is the one from `keys`, so it remains
+  // valid after the call, unlike the ValuePtr. Results are not delivered in any particular order,
+  // and a key which appears in `keys` more than once may be reported more than once.
+  //
+  // The multi-key put() behaves as if each pair were put in order, so if a key appears more than
+  // once, the last value wins. The multi-key delete_() returns the number of keys deleted.
+  template <typename Func>
+  uint get(kj::ArrayPtr<const KeyPtr> keys, Func&& callback);
+  void put(kj::ArrayPtr<const KeyValuePtrPair> pairs);
+  uint delete_(kj::ArrayPtr<const KeyPtr> keys);
 
  private:
+  // Widths of the batched statements used by the multi-key operations, widest first. Whatever
+  // remains after filling as many batches as possible (fewer than the narrowest width) is handled
+  // with the single-key statements. Using a few fixed widths rather than padding a single wide
+  // statement means small operations don't pay for the wide ones.
+  //
+  // A batched put binds two parameters per key, so the widest batch must stay within half of the
+  // SQLITE_LIMIT_VARIABLE_NUMBER that SqliteDatabase sets (100).
+  static constexpr uint BATCH_WIDTHS[] = {32, 8, 2};
+  static constexpr uint BATCH_WIDTH_COUNT = kj::size(BATCH_WIDTHS);
+
+  enum BatchOp { BATCH_GET, BATCH_PUT, BATCH_DELETE, BATCH_OP_COUNT };
+
   struct Uninitialized {};
 
   struct Initialized {
@@ -123,12 +169,28 @@ class SqliteKv: private SqliteDatabase::ResetListener {
       ORDER BY key DESC
       LIMIT ?
     )");
+    SqliteDatabase::Statement stmtDeleteRange = db.prepare(regulator, R"(
+      DELETE FROM _cf_KV WHERE key >= ?
+    )");
+    SqliteDatabase::Statement stmtDeleteRangeEnd = db.prepare(regulator, R"(
+      DELETE FROM _cf_KV WHERE key >= ? AND key < ?
+    )");
+    SqliteDatabase::Statement stmtCountRange = db.prepare(regulator, R"(
+      SELECT count(*), coalesce(sum(octet_length(key)), 0) FROM _cf_KV WHERE key >= ?
+    )");
+    SqliteDatabase::Statement stmtCountRangeEnd = db.prepare(regulator, R"(
+      SELECT count(*), coalesce(sum(octet_length(key)), 0) FROM _cf_KV WHERE key >= ? AND key < ?
+    )");
     // We don't pass in the regulator here because this query doesn't take user input, so
     // it failing is always our fault.
     SqliteDatabase::Statement stmtCountKeys = db.prepare(R"(
       SELECT count(*) FROM _cf_KV
     )");
 
+    // Batched statements for the multi-key operations, indexed by BatchOp and then by position in
+    // BATCH_WIDTHS. These are prepared on first use, since most objects never need most of them.
+    kj::Maybe<SqliteDatabase::Statement> batchStmts[BATCH_OP_COUNT][BATCH_WIDTH_COUNT];
+
     Initialized(SqliteDatabase& db): db(db) {}
   };
 
@@ -143,6 +205,15 @@ class SqliteKv: private SqliteDatabase::ResetListener {
   // first write.
 
   void beforeSqliteReset() override;
+
+  // Returns the batched statement for the given operation and width, preparing it if necessary.
+  SqliteDatabase::Statement& getBatchStatement(Initialized& stmts, BatchOp op, uint widthIndex);
+
+  // Splits `items` into batches as described at BATCH_WIDTHS, calling `batchFunc(batch,
+  // widthIndex)` for each full batch and `singleFunc(item)` for each leftover item.
+  template <typename T, typename BatchFunc, typename SingleFunc>
+  static void forEachBatch(
+      kj::ArrayPtr<const T> items, BatchFunc&& batchFunc, SingleFunc&& singleFunc);
 };
 
 // =======================================================================================
@@ -167,6 +238,54 @@ bool SqliteKv::get(KeyPtr key, Func&& callback) {
   }
 }
 
+template <typename T, typename BatchFunc, typename SingleFunc>
+void SqliteKv::forEachBatch(
+    kj::ArrayPtr<const T> items, BatchFunc&& batchFunc, SingleFunc&& singleFunc) {
+  for (uint i: kj::zeroTo(BATCH_WIDTH_COUNT)) {
+    while (items.size() >= BATCH_WIDTHS[i]) {
+      batchFunc(items.first(BATCH_WIDTHS[i]), i);
+      items = items.slice(BATCH_WIDTHS[i], items.size());
+    }
+  }
+  for (auto& item: items) {
+    singleFunc(item);
+  }
+}
+
+template <typename Func>
+uint SqliteKv::get(kj::ArrayPtr<const KeyPtr> keys, Func&& callback) {
+  if (!tableCreated) return 0;
+  auto& stmts = KJ_UNWRAP_OR(state.tryGet<Initialized>(), return 0);
+
+  uint count = 0;
+  forEachBatch(keys, [&](kj::ArrayPtr<const KeyPtr> batch, uint widthIndex) {
+    SqliteDatabase::Query::ValuePtr bindings[BATCH_WIDTHS[0]];
+    for (auto i: kj::indices(batch)) {
+      bindings[i] = batch[i];
+    }
+
+    auto query = getBatchStatement(stmts, BATCH_GET, widthIndex)
+                     .run(kj::ArrayPtr<const SqliteDatabase::Query::ValuePtr>(
+                         bindings, batch.size()));
+    while (!query.isDone()) {
+      // The row's copy of the key goes away with the row, so hand over the caller's.
+      auto rowKey = query.getText(0);
+      auto match = std::find(batch.begin(), batch.end(), rowKey);
+      KJ_ASSERT(match != batch.end(), "batch get returned a key that wasn't asked for");
+      callback(*match, query.getBlob(1));
+      query.nextRow();
+      ++count;
+    }
+  }, [&](KeyPtr key) {
+    auto query = stmts.stmtGet.run(key);
+    if (!query.isDone()) {
+      callback(key, query.getBlob(0));
+      ++count;
+    }
+  });
+  return count;
+}
+
 template <typename Func>
 uint SqliteKv::list(
     KeyPtr begin, kj::Maybe<KeyPtr> end, kj::Maybe<uint> limit, Order order, Func&& callback) {
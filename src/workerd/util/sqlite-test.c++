@@ -822,6 +822,59 @@ KJ_TEST("reset database") {
   }
 }
 
+KJ_TEST("SQLite read-only connection reads committed snapshots") {
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs(*dir);
+  SqliteDatabase db(vfs, kj::Path({"foo"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+
+  KJ_EXPECT_THROW_MESSAGE("read-only connections require WAL mode", db.getReadOnlyConnection());
+
+  auto setWalMode = [](SqliteDatabase& db) { db.run("PRAGMA journal_mode=WAL;"); };
+  setWalMode(db);
+  db.afterReset(setWalMode);
+
+  db.run("CREATE TABLE things (id INTEGER PRIMARY KEY)");
+  db.run("INSERT INTO things VALUES (1)");
+  db.run("INSERT INTO things VALUES (2)");
+
+  auto& reader = db.getReadOnlyConnection();
+  KJ_EXPECT(&db.getReadOnlyConnection() == &reader);
+
+  // Uncommitted writes are invisible to the reader.
+  db.run("BEGIN TRANSACTION");
+  db.run("INSERT INTO things VALUES (3)");
+  KJ_EXPECT(reader.run("SELECT count(*) FROM things").getInt(0) == 2);
+
+  {
+    // An open read neither blocks the commit nor sees its results.
+    auto scan = reader.run("SELECT id FROM things");
+    db.run("COMMIT");
+    db.run("INSERT INTO things VALUES (4)");
+
+    uint count = 0;
+    for (; !scan.isDone(); scan.nextRow()) {
+      ++count;
+    }
+    KJ_EXPECT(count == 2);
+  }
+
+  // A new read sees everything committed so far.
+  KJ_EXPECT(reader.run("SELECT count(*) FROM things").getInt(0) == 4);
+
+  KJ_EXPECT_THROW_MESSAGE(
+      "attempt to write a readonly database", reader.run("INSERT INTO things VALUES (5)"));
+
+  // reset() cancels the reader's queries too, then reopens it on the new database.
+  auto scan = reader.run("SELECT id FROM things");
+  db.reset();
+  KJ_EXPECT_THROW_MESSAGE("query canceled because reset()", scan.nextRow());
+
+  db.run("CREATE TABLE others (id INTEGER PRIMARY KEY)");
+  db.run("INSERT INTO others VALUES (1)");
+  KJ_EXPECT(reader.run("SELECT count(*) FROM others").getInt(0) == 1);
+  KJ_EXPECT_THROW_MESSAGE("no such table: things", reader.run("SELECT * FROM things"));
+}
+
 KJ_TEST("SQLite observer addQueryStats") {
   class TestSqliteObserver: public SqliteObserver {
    public:
@@ -892,6 +945,81 @@ KJ_TEST("SQLite observer addQueryStats") {
   KJ_EXPECT(sqliteObserver.rowsWritten - rowsWrittenBefore == 1);
 }
 
+KJ_TEST("SQLite cache limits and page cache stats") {
+  class TestSqliteObserver: public SqliteObserver {
+   public:
+    void addPageCacheStats(uint64_t hits, uint64_t misses) override {
+      this->hits += hits;
+      this->misses += misses;
+    }
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+
+  auto dir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs vfs(*dir);
+  TestSqliteObserver sqliteObserver;
+  SqliteDatabase db(
+      vfs, kj::Path({"foo"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY, sqliteObserver);
+
+  db.setCacheLimits({.pageCacheBytes = 1u << 20});
+  KJ_EXPECT(db.run("PRAGMA cache_size").getInt(0) == -1024);
+
+  db.run("CREATE TABLE things (id INTEGER PRIMARY KEY)");
+  db.run("INSERT INTO things VALUES (123)");
+  KJ_EXPECT(db.run("SELECT id FROM things").getInt(0) == 123);
+
+  // Nothing is reported until asked for.
+  KJ_EXPECT(sqliteObserver.hits == 0);
+  db.reportPageCacheStats();
+  KJ_EXPECT(sqliteObserver.hits > 0);
+
+  auto stats = db.getPageCacheStats();
+  KJ_EXPECT(stats.hits > 0);
+  KJ_EXPECT(stats.usedBytes > 0);
+  KJ_EXPECT(sqliteObserver.hits == stats.hits);
+  KJ_EXPECT(sqliteObserver.misses == stats.misses);
+
+  // Counters accumulate across calls rather than being reset by each read.
+  db.run("SELECT id FROM things");
+  auto stats2 = db.getPageCacheStats();
+  KJ_EXPECT(stats2.hits > stats.hits);
+  KJ_EXPECT(stats2.misses >= stats.misses);
+
+  // The limits are re-applied to the new connection after reset(), and the counters carry over.
+  db.reset();
+  KJ_EXPECT(db.run("PRAGMA cache_size").getInt(0) == -1024);
+  auto stats3 = db.getPageCacheStats();
+  KJ_EXPECT(stats3.hits >= stats2.hits);
+  KJ_EXPECT(sqliteObserver.hits == stats3.hits);
+  KJ_EXPECT(sqliteObserver.misses == stats3.misses);
+}
+
+#if !_WIN32
+KJ_TEST("SQLite memory-mapped I/O on real disk") {
+  TempDirOnDisk dir;
+  SqliteDatabase::Vfs vfs(*dir, {.mmapBytes = 1u << 20});
+  KJ_EXPECT(vfs.getMmapBytes() == 1u << 20);
+
+  SqliteDatabase db(vfs, kj::Path({"foo"}), kj::WriteMode::CREATE | kj::WriteMode::MODIFY);
+  KJ_EXPECT(db.run("PRAGMA mmap_size").getInt(0) == 1u << 20);
+
+  setupSql(db);
+  checkSql(db);
+
+  // The database's own limit wins over the VFS default.
+  db.setCacheLimits({.mmapBytes = 0});
+  KJ_EXPECT(db.run("PRAGMA mmap_size").getInt(0) == 0);
+  checkSql(db);
+
+  // The KJ VFS never maps files, so it ignores the option.
+  auto memDir = kj::newInMemoryDirectory(kj::nullClock());
+  SqliteDatabase::Vfs memVfs(*memDir, {.mmapBytes = 1u << 20});
+  KJ_EXPECT(memVfs.getMmapBytes() == 0);
+}
+#endif
+
 KJ_TEST("SQLite failed statement reset") {
   auto dir = kj::newInMemoryDirectory(kj::nullClock());
   SqliteDatabase::Vfs vfs(*dir);
@@ -450,6 +450,18 @@ static constexpr PragmaInfo ALLOWED_PRAGMAS[] = {{"data_version"_kj, PragmaSigna
 
 SqliteObserver SqliteObserver::DEFAULT = SqliteObserver{};
 
+namespace {
+// Set once setHeapLimits() has been called, so that setupSecurity() doesn't override it with the
+// defaults.
+std::atomic<bool> heapLimitsConfigured = false;
+}  // namespace
+
+void SqliteDatabase::setHeapLimits(uint64_t softLimit, uint64_t hardLimit) {
+  heapLimitsConfigured.store(true, std::memory_order_relaxed);
+  sqlite3_soft_heap_limit64(softLimit);
+  sqlite3_hard_heap_limit64(hardLimit);
+}
+
 constexpr SqliteDatabase::Regulator SqliteDatabase::TRUSTED;
 
 SqliteDatabase::SqliteDatabase(const Vfs& vfs,
@@ -505,9 +517,84 @@ void SqliteDatabase::init(kj::Maybe<kj::WriteMode> maybeMode) {
   setupSecurity(db);
 
   maybeDb = *db;
+
+  applyCacheLimits();
+}
+
+void SqliteDatabase::setCacheLimits(CacheLimits limits) {
+  cacheLimits = kj::mv(limits);
+  applyCacheLimits();
+}
+
+void SqliteDatabase::applyCacheLimits() {
+  KJ_IF_SOME(bytes, cacheLimits.pageCacheBytes) {
+    // A negative cache_size is interpreted as a number of KiB rather than pages.
+    run(TRUSTED, kj::str("PRAGMA cache_size = -", kj::max(bytes / 1024, uint64_t(1))));
+  }
+  KJ_IF_SOME(bytes, cacheLimits.mmapBytes) {
+    run(TRUSTED, kj::str("PRAGMA mmap_size = ", bytes));
+  } else if (uint64_t bytes = vfs.getMmapBytes(); bytes > 0) {
+    run(TRUSTED, kj::str("PRAGMA mmap_size = ", bytes));
+  }
+}
+
+void SqliteDatabase::reportPageCacheStats() {
+  sqlite3* db = &KJ_UNWRAP_OR(maybeDb, return);
+
+  // This runs from close(), possibly while unwinding, so don't throw. These calls can only fail if
+  // passed an invalid op, in which case the counters are simply left at zero.
+  int hits = 0;
+  int misses = 0;
+  int unused = 0;
+  sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_HIT, &hits, &unused, true);
+  sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_MISS, &misses, &unused, true);
+
+  if (hits != 0 || misses != 0) {
+    pageCacheHits += hits;
+    pageCacheMisses += misses;
+    sqliteObserver.addPageCacheStats(hits, misses);
+  }
+}
+
+SqliteDatabase::PageCacheStats SqliteDatabase::getPageCacheStats() {
+  reportPageCacheStats();
+
+  int used = 0;
+  KJ_IF_SOME(db, maybeDb) {
+    int unused = 0;
+    SQLITE_CALL_NODB(sqlite3_db_status(&db, SQLITE_DBSTATUS_CACHE_USED, &used, &unused, false));
+  }
+
+  return {
+    .hits = pageCacheHits,
+    .misses = pageCacheMisses,
+    .usedBytes = static_cast<uint64_t>(used),
+  };
+}
+
+void SqliteDatabase::syncJournal() {
+  sqlite3* db = &KJ_ASSERT_NONNULL(maybeDb);
+
+  sqlite3_file* file = nullptr;
+  SQLITE_CALL(sqlite3_file_control(db, "main", SQLITE_FCNTL_JOURNAL_POINTER, &file));
+  if (file == nullptr || file->pMethods == nullptr) {
+    // No log has been opened, so there's nothing to sync.
+    return;
+  }
+
+  SQLITE_CALL_SCOPE {
+    int err = file->pMethods->xSync(file, SQLITE_SYNC_NORMAL);
+    if (err != SQLITE_OK) {
+      SQLITE_CALL_FAILED("xSync()", err);
+    }
+  }
 }
 
 SqliteDatabase::~SqliteDatabase() noexcept(false) {
+  // Close the read-only connection first, so that this connection is the last one and can clean
+  // up the WAL.
+  readOnlyConnection = kj::none;
+
   sqlite3* db = &KJ_UNWRAP_OR(maybeDb, return);
 
   auto err = sqlite3_close(db);
@@ -807,16 +894,14 @@ void SqliteDatabase::reset() {
   auto writeCb = kj::mv(onWriteCallback);
   KJ_DEFER(onWriteCallback = kj::mv(writeCb));
 
-  KJ_IF_SOME(db, maybeDb) {
-    for (auto& listener: resetListeners) {
-      listener.beforeSqliteReset();
-    }
-
-    auto err = sqlite3_close(&db);
-    KJ_REQUIRE(err == SQLITE_OK, "can't reset() database because dependent objects still exist",
-        sqlite3_errstr(err));
+  // The read-only connection must let go of the files before they are deleted, otherwise its
+  // WAL could be left behind and replayed into the new database.
+  KJ_IF_SOME(reader, readOnlyConnection) {
+    reader->close();
+  }
 
-    maybeDb = kj::none;
+  if (maybeDb != kj::none) {
+    close();
     vfs.directory.remove(path);
   }
 
@@ -826,6 +911,43 @@ void SqliteDatabase::reset() {
   KJ_IF_SOME(resetCb, afterResetCallback) {
     resetCb(*this);
   }
+
+  // Reopen only once the after-reset callback has put the new database in WAL mode.
+  KJ_IF_SOME(reader, readOnlyConnection) {
+    reader->init(kj::none);
+  }
+}
+
+void SqliteDatabase::close() {
+  sqlite3& db = KJ_ASSERT_NONNULL(maybeDb);
+
+  for (auto& listener: resetListeners) {
+    listener.beforeSqliteReset();
+  }
+
+  // Don't lose the counters of the connection we're about to close.
+  reportPageCacheStats();
+
+  auto err = sqlite3_close(&db);
+  KJ_REQUIRE(err == SQLITE_OK, "can't reset() database because dependent objects still exist",
+      sqlite3_errstr(err));
+
+  maybeDb = kj::none;
+}
+
+SqliteDatabase& SqliteDatabase::getReadOnlyConnection() {
+  KJ_IF_SOME(reader, readOnlyConnection) {
+    return *reader;
+  }
+
+  KJ_REQUIRE(!readOnly, "database is already read-only");
+  // (Use the table-valued form, since SQLite considers the plain PRAGMA a write.)
+  KJ_REQUIRE(run(TRUSTED, "SELECT * FROM pragma_journal_mode;").getText(0) == "wal",
+      "read-only connections require WAL mode, otherwise readers would block commits");
+
+  auto reader = kj::heap<SqliteDatabase>(vfs, path.clone(), kj::none, sqliteObserver);
+  reader->setCacheLimits(cacheLimits);
+  return *readOnlyConnection.emplace(kj::mv(reader));
 }
 
 bool SqliteDatabase::isAuthorized(int actionCode,
@@ -1207,15 +1329,15 @@ void SqliteDatabase::setupSecurity(sqlite3* db) {
   // This happens inside LimitEnforcer.
 
   // 5. Limit heap size.
-  // Annoyingly, this sets a process-wide limit. We'll set 128MB "soft" limit (to try to control
-  // how much page caching SQLite does) and 512MB "hard" limit (to block DoS attacks from taking
-  // down the whole system).
-  // TODO(perf): Revisit as popularity grows. Maybe make configurable? Maybe patch SQLite to allow
-  //   these to be controlled per-database? Is page caching even all that important when the kernel
-  //   does its own page caching?
+  // Annoyingly, this sets a process-wide limit. Unless the embedder has chosen its own limits with
+  // setHeapLimits(), we'll set 128MB "soft" limit (to try to control how much page caching SQLite
+  // does) and 512MB "hard" limit (to block DoS attacks from taking down the whole system).
+  // Individual databases can additionally bound their own page cache with setCacheLimits().
   static bool doOnce KJ_UNUSED = []() {
-    sqlite3_soft_heap_limit64(128u << 20);
-    sqlite3_hard_heap_limit64(512u << 20);
+    if (!heapLimitsConfigured.load(std::memory_order_relaxed)) {
+      sqlite3_soft_heap_limit64(128u << 20);
+      sqlite3_hard_heap_limit64(512u << 20);
+    }
     return false;
   }();
 
@@ -29,6 +29,9 @@ class SqliteObserver {
   virtual void addQueryStats(uint64_t rowsRead, uint64_t rowsWritten) {}
   // The method is not used by the SqliteDatabase, it is added here for convenience
   virtual void setSqliteStoredBytes(uint64_t sqliteStoredBytes) {}
+  // Reports page cache hits and misses since the previous report, for tracking hit rates. Called
+  // by reportPageCacheStats(), getPageCacheStats() and reset(), not for every query.
+  virtual void addPageCacheStats(uint64_t hits, uint64_t misses) {}
 
   static SqliteObserver DEFAULT;
 };
@@ -202,6 +205,17 @@ class SqliteDatabase {
   // may throw if they depend on tables that haven't been recreated yet).
   void reset();
 
+  // Returns a second, read-only connection to the same database file, opening it on first use.
+  //
+  // The database must be in WAL mode. Each read on the returned connection then sees a consistent
+  // snapshot of the last committed state, as of when the read began, and holds that snapshot
+  // until the query completes. Readers never wait for, nor delay, transactions on this
+  // connection, so long scans can run on the read-only connection while writes continue here.
+  //
+  // The read-only connection is closed before, and reopened after, each reset() of this
+  // database, so its queries are canceled in the same way as this connection's.
+  SqliteDatabase& getReadOnlyConnection();
+
   // Objects that need to be notified when reset() is called may inherit `ResetListener`.
   class ResetListener {
    public:
@@ -258,6 +272,50 @@ class SqliteDatabase {
     }
   }
 
+  // Per-database memory settings. SQLite keeps these per connection, so they are re-applied
+  // whenever the database is reopened by reset().
+  struct CacheLimits {
+    // Upper bound on this database's page cache (`PRAGMA cache_size`). If null, SQLite's default
+    // of about 2MiB is used.
+    kj::Maybe<uint64_t> pageCacheBytes;
+
+    // How much of the database file may be accessed through memory-mapped I/O
+    // (`PRAGMA mmap_size`). If null, the VFS's default (`VfsOptions::mmapBytes`) is used. Only
+    // takes effect if the VFS supports it.
+    kj::Maybe<uint64_t> mmapBytes;
+  };
+
+  // Applies `limits` immediately and remembers them for after reset().
+  void setCacheLimits(CacheLimits limits);
+
+  struct PageCacheStats {
+    // Page cache lookups that did and did not find the page in cache, since the database was
+    // constructed.
+    uint64_t hits;
+    uint64_t misses;
+
+    // Bytes of heap currently used by this database's page cache.
+    uint64_t usedBytes;
+  };
+
+  PageCacheStats getPageCacheStats();
+
+  // Reports the page cache hits and misses since the previous report to the SqliteObserver. This
+  // costs two sqlite3_db_status() calls, so is meant to be called about once per transaction.
+  void reportPageCacheStats();
+
+  // Syncs this database's write-ahead log (or rollback journal) to disk. With
+  // `PRAGMA synchronous = NORMAL` in WAL mode, committing a transaction writes the log but does not
+  // sync it; calling this afterwards makes every transaction committed so far durable. Used by
+  // SqliteGroupCommit. Does nothing if the log hasn't been opened yet.
+  void syncJournal();
+
+  // Sets SQLite's process-wide soft and hard heap limits, which apply to all databases together.
+  // The soft limit is the point at which SQLite starts freeing page cache memory before allocating
+  // more; allocations past the hard limit fail. If this is not called before the first database
+  // is opened, the defaults are 128MiB and 512MiB respectively.
+  static void setHeapLimits(uint64_t softLimit, uint64_t hardLimit);
+
  private:
   const Vfs& vfs;
   kj::Path path;
@@ -300,8 +358,22 @@ class SqliteDatabase {
   // True if in a BEGIN TRANSACTION transaction.
   bool inTransaction = false;
 
+  CacheLimits cacheLimits;
+
+  kj::Maybe<kj::Own<SqliteDatabase>> readOnlyConnection;
+
+  // Page cache counters collected so far. SQLite's own counters are reset each time we collect
+  // them, and are lost when the connection is closed.
+  uint64_t pageCacheHits = 0;
+  uint64_t pageCacheMisses = 0;
+
   void init(kj::Maybe<kj::WriteMode> maybeMode);
 
+  // Notifies reset listeners and closes the connection, leaving `maybeDb` null.
+  void close();
+
+  void applyCacheLimits();
+
   // Describes various kinds of interesting state changes which a statement might apply, which we
   // need to track to implement the SqliteDatabse interface. In particular, we must track
   // transactions to implement the onRollback() method.
@@ -621,6 +693,16 @@ struct SqliteDatabase::VfsOptions {
   // will fall back to the native VFS implementation. In that case, the options you set here will
   // be ORed with the ones set by the underlying VFS.
   int deviceCharacteristics = 0x00001000;  // = SQLITE_FCNTL_POWERSAFE_OVERWRITE
+
+  // Default for how many bytes of each database file opened through this VFS may be accessed via
+  // memory-mapped I/O, i.e. SQLite's xFetch()/xUnfetch() methods, rather than read() into the page
+  // cache. For read-heavy workloads this saves a syscall and a copy per page read. 0 disables
+  // memory mapping. A database's own `CacheLimits::mmapBytes`, if set, takes precedence.
+  //
+  // This only has an effect when the VFS delegates to the native implementation, i.e. when the
+  // directory is a real disk directory. The KJ-based implementation never maps files, because
+  // mapping an in-memory kj::File would prevent it from growing.
+  uint64_t mmapBytes = 0;
 };
 
 // Implements a SQLite VFS based on a KJ directory.
@@ -675,6 +757,12 @@ class SqliteDatabase::Vfs {
     return name;
   }
 
+  // Returns `Options::mmapBytes` if files opened through this VFS can be memory-mapped, or 0 if
+  // they can't.
+  uint64_t getMmapBytes() const {
+    return rootFd == -1 ? 0 : options.mmapBytes;
+  }
+
   KJ_DISALLOW_COPY_AND_MOVE(Vfs);
 
  private:
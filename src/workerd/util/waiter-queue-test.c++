@@ -0,0 +1,99 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "waiter-queue.h"
+
+#include <kj/test.h>
+#include <kj/thread.h>
+#include <kj/vector.h>
+
+namespace workerd {
+namespace {
+
+KJ_TEST("WaiterQueue takes turns in the order tickets joined") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+  WaiterQueue queue;
+
+  auto first = queue.join();
+  auto second = queue.join();
+  auto third = queue.join();
+  KJ_EXPECT(first.ready.poll(ws));
+  KJ_EXPECT(!second.ready.poll(ws));
+  KJ_EXPECT(!third.ready.poll(ws));
+
+  first.ticket = nullptr;
+  KJ_EXPECT(second.ready.poll(ws));
+  KJ_EXPECT(!third.ready.poll(ws));
+
+  second.ticket = nullptr;
+  KJ_EXPECT(third.ready.poll(ws));
+
+  third.ticket = nullptr;
+  KJ_EXPECT(queue.isEmpty());
+
+  // The queue is reusable once empty.
+  auto fourth = queue.join();
+  KJ_EXPECT(fourth.ready.poll(ws));
+}
+
+KJ_TEST("WaiterQueue skips tickets dropped before their turn") {
+  kj::EventLoop loop;
+  kj::WaitScope ws(loop);
+  WaiterQueue queue;
+
+  auto first = queue.join();
+  auto second = queue.join();
+  auto third = queue.join();
+  auto fourth = queue.join();
+
+  second.ticket = nullptr;
+  third.ticket = nullptr;
+  KJ_EXPECT(!fourth.ready.poll(ws));
+
+  first.ticket = nullptr;
+  KJ_EXPECT(fourth.ready.poll(ws));
+
+  // Dropping the last tickets while waiting leaves the queue empty once the turn passes them.
+  auto fifth = queue.join();
+  fifth.ticket = nullptr;
+  fourth.ticket = nullptr;
+  KJ_EXPECT(queue.isEmpty());
+}
+
+KJ_TEST("WaiterQueue gives one thread a turn at a time") {
+  constexpr uint THREADS = 8;
+  constexpr uint TURNS = 1000;
+
+  WaiterQueue queue;
+  uint insideCount = 0;
+  uint turnCount = 0;
+
+  {
+    kj::Vector<kj::Own<kj::Thread>> threads;
+    for (auto i KJ_UNUSED: kj::zeroTo(THREADS)) {
+      threads.add(kj::heap<kj::Thread>([&]() {
+        kj::EventLoop loop;
+        kj::WaitScope ws(loop);
+        for (auto j: kj::zeroTo(TURNS)) {
+          auto joined = queue.join();
+          if (j % 10 == 9) {
+            // Occasionally give up before our turn comes.
+            continue;
+          }
+          joined.ready.wait(ws);
+          KJ_ASSERT(__atomic_add_fetch(&insideCount, 1, __ATOMIC_RELAXED) == 1);
+          ++turnCount;
+          __atomic_sub_fetch(&insideCount, 1, __ATOMIC_RELAXED);
+        }
+      }));
+    }
+  }
+
+  KJ_EXPECT(turnCount == THREADS * (TURNS - TURNS / 10));
+  KJ_EXPECT(queue.isEmpty());
+}
+
+}  // namespace
+}  // namespace workerd
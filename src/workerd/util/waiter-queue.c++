@@ -0,0 +1,125 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#include "waiter-queue.h"
+
+#include <kj/debug.h>
+
+#include <thread>
+
+namespace workerd {
+
+struct WaiterQueue::Node: public kj::AtomicRefcounted {
+  enum State: uint8_t {
+    // Waiting for the turn to be handed over.
+    WAITING,
+    // It is this node's turn. Its ticket will pass the turn on when dropped.
+    TURN,
+    // The ticket was dropped while waiting. Whoever hands over the turn skips this node.
+    ABANDONED,
+  };
+
+  // One of `State`. Accessed atomically.
+  mutable uint8_t state = WAITING;
+
+  // The node that joined right behind this one, or null if none has linked itself yet. Set once,
+  // atomically, by the successor, after it sets `nextRef`.
+  mutable const Node* next = nullptr;
+
+  // Keeps `next` alive until the turn passes it, even if its ticket is dropped first. Only read
+  // after observing `next` as non-null.
+  mutable kj::Own<const Node> nextRef;
+
+  // Fulfilled when the turn is handed to this node. Never fulfilled for a node that joined an
+  // empty queue.
+  mutable kj::Own<kj::CrossThreadPromiseFulfiller<void>> fulfiller;
+};
+
+class WaiterQueue::Ticket {
+ public:
+  Ticket(const WaiterQueue& queue, kj::Own<const Node> node): queue(queue), node(kj::mv(node)) {}
+  KJ_DISALLOW_COPY_AND_MOVE(Ticket);
+
+  ~Ticket() noexcept {
+    uint8_t expected = Node::WAITING;
+    if (__atomic_compare_exchange_n(&node->state, &expected, Node::ABANDONED, false,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      // Our turn hasn't come yet. Our predecessor will skip us when it passes on its turn.
+      return;
+    }
+    KJ_ASSERT(expected == Node::TURN);
+    queue.passTurn(kj::mv(node));
+  }
+
+ private:
+  const WaiterQueue& queue;
+  kj::Own<const Node> node;
+};
+
+WaiterQueue::~WaiterQueue() noexcept {
+  // Every ticket refers to the queue, so it must be empty by now, or we'd leave dangling pointers.
+  KJ_ASSERT(isEmpty(), "destroying non-empty waiter queue?");
+}
+
+WaiterQueue::Joined WaiterQueue::join() const {
+  // Allocate everything up front: once we're in `tail`, a predecessor whose turn ends spins until
+  // we link ourselves, so nothing slow may happen between the exchange and the link. If the queue
+  // turns out to be empty, the promise and extra reference go unused.
+  auto node = kj::atomicRefcounted<Node>();
+  auto paf = kj::newPromiseAndCrossThreadFulfiller<void>();
+  node->fulfiller = kj::mv(paf.fulfiller);
+  auto nextRef = kj::atomicAddRef(*node);
+
+  const Node* prev = __atomic_exchange_n(&tail, node.get(), __ATOMIC_ACQ_REL);
+
+  kj::Promise<void> ready = nullptr;
+  if (prev == nullptr) {
+    // The queue was empty, so it's our turn already. No one else touches our state until we link
+    // a successor behind us, which happens-after this store.
+    __atomic_store_n(&node->state, Node::TURN, __ATOMIC_RELEASE);
+    ready = kj::READY_NOW;
+  } else {
+    // `prev` stays alive until we link ourselves: even once its turn is over, it waits for us.
+    prev->nextRef = kj::mv(nextRef);
+    __atomic_store_n(&prev->next, node.get(), __ATOMIC_RELEASE);
+    ready = kj::mv(paf.promise);
+  }
+
+  return {kj::heap<Ticket>(*this, kj::mv(node)), kj::mv(ready)};
+}
+
+void WaiterQueue::passTurn(kj::Own<const Node> node) const {
+  for (;;) {
+    const Node* next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+    if (next == nullptr) {
+      const Node* expected = node.get();
+      if (__atomic_compare_exchange_n(
+              &tail, &expected, nullptr, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        // No one is waiting behind us.
+        return;
+      }
+      // Someone has joined behind us but hasn't linked itself yet. It will momentarily.
+      while ((next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) == nullptr) {
+        std::this_thread::yield();
+      }
+    }
+
+    auto successor = kj::mv(node->nextRef);
+    KJ_DASSERT(successor.get() == next);
+    uint8_t expected = Node::WAITING;
+    if (__atomic_compare_exchange_n(&successor->state, &expected, Node::TURN, false,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      // `successor` may pass its turn on at any point now, but our reference keeps its fulfiller
+      // alive for this call.
+      successor->fulfiller->fulfill();
+      return;
+    }
+
+    // The successor's ticket is gone, so pass the turn on for it.
+    KJ_ASSERT(expected == Node::ABANDONED);
+    node = kj::mv(successor);
+  }
+}
+
+}  // namespace workerd
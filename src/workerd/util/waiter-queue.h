@@ -0,0 +1,57 @@
+// Copyright (c) 2024 Cloudflare, Inc.
+// Licensed under the Apache 2.0 license found in the LICENSE file or at:
+//     https://opensource.org/licenses/Apache-2.0
+
+#pragma once
+
+#include <kj/async.h>
+
+namespace workerd {
+
+// A lock-free FIFO queue of threads taking turns at something, such as an isolate's async lock.
+// A thread joins the back of the queue and is notified when it reaches the front. It holds its
+// turn until it drops its `Ticket`, which passes the turn to the next ticket in line. A ticket
+// that is dropped before its turn comes leaves the queue and is skipped.
+//
+// This is an MCS queue lock (Mellor-Crummey & Scott) whose waiters await a promise instead of
+// spinning. Joining and leaving take no mutex: each ticket swaps itself into `tail` and links
+// itself behind its predecessor, and a leaving ticket hands its turn directly to its successor.
+// The one wait is when a successor has swapped itself into `tail` but not yet linked itself,
+// which is a window of a few instructions.
+class WaiterQueue {
+ public:
+  WaiterQueue() = default;
+  ~WaiterQueue() noexcept;
+  KJ_DISALLOW_COPY_AND_MOVE(WaiterQueue);
+
+  class Ticket;
+
+  struct Joined {
+    // Dropping the ticket leaves the queue, passing on the turn if it was this ticket's.
+    kj::Own<Ticket> ticket;
+
+    // Resolves when it is the ticket's turn. Already resolved if the queue was empty.
+    kj::Promise<void> ready;
+  };
+
+  // Joins the back of the queue. Thread-safe.
+  Joined join() const;
+
+  // Returns true if no ticket is in the queue. Of course, another thread may join concurrently.
+  bool isEmpty() const {
+    return __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == nullptr;
+  }
+
+ private:
+  struct Node;
+
+  // The most recently joined node, or null if the queue is empty. Accessed atomically.
+  mutable const Node* tail = nullptr;
+
+  // Ends the turn of `node`, handing it to the next node that is still waiting.
+  void passTurn(kj::Own<const Node> node) const;
+};
+
+KJ_DECLARE_NON_POLYMORPHIC(WaiterQueue::Ticket);
+
+}  // namespace workerd